@@ -1,14 +1,38 @@
 #include "shader_m.h"
+#include "shader_variants.h"
 #include "camera.h"
 #include "geometry.h"
 #include "skybox.h"
 #include "texture_utils.h"
 #include "input_utils.h"
 #include "celestial.h"
+#include "body_transforms.h"
+#include "headless.h"
+#include "benchmark.h"
+#include "golden.h"
+#include "async_texture_loader.h"
+#include "texture_compiler.h"
+#include "virtual_texture.h"
+#include "asteroid_belt.h"
+#include "asteroid_field.h"
+#include "asteroid_generator.h"
+#include "asset_pack.h"
+#include "simulation.h"
+#include "job_system.h"
+#include "task_scheduler.h"
+#include "frame_arena.h"
+#include "alloc_trace.h"
+#include "real_scale.h"
+#include "system_description.h"
+#include "bvh.h"
+#include <cfloat>
 #include <cstdlib>
+#include <chrono>
+#include <map>
+#include <set>
 
-const unsigned int SCR_WIDTH = 1600;
-const unsigned int SCR_HEIGHT = 900;
+unsigned int SCR_WIDTH = 1600;
+unsigned int SCR_HEIGHT = 900;
 
 // Camera settings
 Camera camera(glm::vec3(0.0f, 0.0f, 35.0f));
@@ -26,13 +50,40 @@ bool OrbitOn = true;
 bool bloom = true;
 bool skyBoxOn = true;
 int sphereRes = 2;
-float gamma = 2.2f;
+float gammaVal = 2.2f;
 float exposureVal = 1.5f;
 int NUM_ASTEROIDS = 1050;
-
-int main()
+AsteroidFieldOptions asteroidFieldOptions; // --asteroid-field: stream the belt instead
+AllocTraceOptions allocTraceOptions;       // --trace-allocs, --alloc-test
+RealScaleOptions realScaleOptions;         // --real-scale
+SystemOptions systemOptions;               // --system, --compile-system
+// Rocks per piece of the orbits the spatial index is refit with
+const size_t SPATIAL_ROCK_GRAIN = 8192;
+
+// What a system description's bodies are drawn with besides their sphere
+struct CloudLayer
+{
+    int body;
+    GLuint texture;
+    VirtualTexture* virtualTexture;
+    int feedback;           // Virtual texture feedback id, 0 when another layer asks for the tiles
+    CloudElements elements;
+};
+
+struct BodyRing
+{
+    int body;
+    GLuint VAO;
+    GLuint texture;
+    bool flipped;
+};
+
+// Sets up the window and scene, then runs the render loop until the window closes
+// or the headless/benchmark frame count is reached
+static int runApp(const HeadlessOptions& headless, BenchmarkRun* bench)
 {
     // ------------- INITIALIZE DISPLAYS ------------
+    applyHeadlessInitHints(headless);
     if (!glfwInit())
     {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -43,6 +94,7 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_SAMPLES, 8);
+    applyHeadlessWindowHints(headless);
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Solar System", nullptr, nullptr);
     if (!window)
     {
@@ -57,22 +109,50 @@ int main()
         std::cerr << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    // Before any depth buffer is made, they are made to suit
+    if (realScaleOptions.enabled && !enableReversedDepth())
+    {
+        glfwTerminate();
+        return -1;
+    }
   
-    // Set callbacks for mouse and scroll
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // Hide cursor
-    printControls();
-    // ------------------------- Bloom effect ----------------------------
+    if (bench)
+    {
+        glfwSwapInterval(0); // Measure rendering, not vsync
+        bench->result.renderer = (const char*)glGetString(GL_RENDERER);
+        std::cout << "Benchmark " << bench->config.scene << ": " << bench->config.asteroids << " asteroids, sphereRes "
+            << bench->config.sphereRes << ", " << bench->config.width << "x" << bench->config.height << std::endl;
+    }
+    else if (headless.enabled)
+    {
+        glfwSwapInterval(0); // Never wait for a display that is not there
+        std::cout << "Headless run: " << headless.frames << " frames, renderer " << glGetString(GL_RENDERER) << std::endl;
+    }
+    if (!headless.enabled)
+    {
+        // Set callbacks for mouse and scroll
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // Hide cursor
+        printControls();
+    }
+    // ---------------------------- Shaders ------------------------------
+    // Every program is kicked off here; the driver builds them while the scene is set up
+    // and finishShaders collects them before the first frame
+    initShaderCache();
     Shader framebufferProgram("framebuffer.vert", "framebuffer.frag");
     Shader blurProgram("framebuffer.vert", "blur.frag");
+    Shader skyboxShader("skyBox.vs", "skyBox.fs");
+    // Lit surfaces are compiled per feature set on first use; see ShaderVariants
+    ShaderVariants celestialShaders("celestial.vs", "celestial.fs", PLANET_SHADER_FEATURES);
+    Shader orbitShader("orbit_vertex_shader.vs", "orbit_fragment_shader.fs");
+    ShaderVariants cloudShaders("cloud.vs", "cloud.fs", CLOUD_SHADER_FEATURES);
+    ShaderVariants ringShaders("ring.vs", "ring.fs");
+    Shader feedbackShader("celestial.vs", "vt_feedback.fs");
+    ShaderVariants asteroidShaders("asteroid.vs", "asteroid.fs");
+    ShaderVariants impostorShaders("asteroid_impostor.vs", "asteroid_impostor.fs");
 
-    framebufferProgram.use();
-    glUniform1i(glGetUniformLocation(framebufferProgram.ID, "screenTexture"), 0);	
-    glUniform1i(glGetUniformLocation(framebufferProgram.ID, "bloomTexture"), 1);
-    blurProgram.use();
-    glUniform1i(glGetUniformLocation(blurProgram.ID, "screenTexture"), 0);
-
+    // ------------------------- Bloom effect ----------------------------
 	// Prepare framebuffer rectangle VBO and VAO
 	unsigned int rectVAO, rectVBO;
 	glGenVertexArrays(1, &rectVAO);
@@ -118,7 +198,7 @@ int main()
 	unsigned int RBO;
 	glGenRenderbuffers(1, &RBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+	glRenderbufferStorage(GL_RENDERBUFFER, reversedDepth ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
 
 	// Error checking framebuffer
@@ -146,12 +226,6 @@ int main()
             std::cout << "Ping-Pong Framebuffer error: " << fboStatus << std::endl;
     }
     // ----------------------- Celestial bodies --------------------------
-    Shader skyboxShader("skyBox.vs", "skyBox.fs");    
-    Shader celestialShader("celestial.vs", "celestial.fs");
-    Shader orbitShader("orbit_vertex_shader.vs", "orbit_fragment_shader.fs");
-    Shader cloudShader("cloud.vs", "cloud.fs");
-    Shader ringShader("ring.vs", "ring.fs");
-
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
@@ -161,108 +235,330 @@ int main()
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
  
-    GLuint cubemapTexture = loadCubemap(skyboxFaces);
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
+    // Images decode on worker threads while the rest of the scene is set up
+    AsyncTextureLoader textureLoader;
+    textureLoader.start();
+    GLuint cubemapTexture = textureLoader.requestCubemap(skyboxFaces);
 
-    GLuint sphereVAO = createSphereVAO();
+    SphereModel sphere = createSphereVAO();
+    bool sphereRebuilding = false;  // A detail change is being tessellated or uploaded
     
    glm::vec3 lightPos(0.0f, 0.0f, 0.0f);
    glm::vec4 lightColor = glm::vec4(1.0, 1.0, 1.0, 1.0);
 
-   GLuint sunTexture = loadTexture("../textures/planets/sun.jpg");
-   GLuint mercuryTexture = loadTexture("../textures/planets/mercury.jpg");
-   GLuint venusTexture = loadTexture("../textures/planets/venus.jpg");
-   // EARTH
-   GLuint earthTexture = loadTexture("../textures/planets/earth_daymap.jpg");
-   GLuint earthSpecularMap = specularTextureLoad("../textures/planets/earth_specular_map.jpg");
-   GLuint cloudTexture = loadTexture("../textures/planets/earth_clouds.jpg");
-   GLuint earthNightMap = loadTexture("../textures/planets/earth_nightmap.jpg");
-
-   GLuint moonTexture = loadTexture("../textures/planets/moon.jpg");
-   GLuint marsTexture = loadTexture("../textures/planets/mars.jpg");
-   GLuint jupiterTexture = loadTexture("../textures/planets/jupiter.jpg");
-   // SATURN
-   GLuint saturnTexture = loadTexture("../textures/planets/saturn.jpg");
-   GLuint saturnRingTexture = loadRingTexture("../textures/planets/saturn_ring_alpha.png");
-
-   GLuint uranusTexture = loadTexture("../textures/planets/uranus.jpg");
-   GLuint uranusRingTexture = loadRingTexture("../textures/planets/uranus_ring_alpha.png");
-
-
-   GLuint neptuneTexture = loadTexture("../textures/planets/neptune.jpg");
-   GLuint plutoTexture = loadTexture("../textures/planets/pluto.jpg");
-   // planets
-   PlanetParams sun(0.0f, 0.0f, 2.0f, 0.0f, 0.0f, 0.0, 8.0f, sunTexture, 1.2f, 0.0f, 0.0f, glm::vec3(9.0,2.0,0.0), 20.0f, glm::vec3(0.0), 0.0f, glm::vec3(50.5), -50.0f);               //rim                        //term                                          // edge
-   PlanetParams mercury(14.0f, 47.87f, 360.0f / 1406.4f, 0.034f, 0.206f, 7.0f, 0.5f, mercuryTexture, 0.0002f, 0.03f, 10.0f, glm::vec3(0.5f, 0.4f, 0.2f), 3.5f, glm::vec3(0.025f, 0.0015f, 0.0f) + 0.02f, 2.9f);
-   PlanetParams venus(19.0f, 35.02f, 360.0f / (-243.0f * 24.0f), 177.4f, 0.007f, 3.4f, 0.8f, venusTexture, 0.001f, 0.04f, 10.0f, glm::vec3(0.8f, 0.4f, 0.3f), 4.45f, glm::vec3(0.02f, 0.0095f, 0.0f) + 0.02f, 2.9f);
-   PlanetParams earth(24.0f, 29.78f, 360.0f, 23.5f, 0.017f, 0.0f, 1.0f, earthTexture, 0.00088f, 0.74f, 9.5f, glm::vec3(0.10, 0.26, 0.84), 10.32f, glm::vec3(0.0003, 0.005, 0.016), 2.6f, glm::vec3(-0.02f, -0.05f, 0.0f), 5.0f, earthSpecularMap, true, earthNightMap, true);
-   PlanetParams mars(30.0f, 24.13f, 360.0f / 24.6f, 25.2f, 0.093f, 1.9f, 0.7f, marsTexture, 0.0008f, 0.1f, 8.0f, glm::vec3(0.5f, 0.45f, 0.45f), 2.02f, glm::vec3(0.075f, 0.035f, 0.02f), 5.9f);
-   PlanetParams jupiter(55.0f, 13.07, 360.0f / 9.9f, 3.1f, 0.049f, 1.3f, 3.5f, jupiterTexture, 0.0007f, 0.06f, 5.0f, glm::vec3(0.55f, 0.54f, 0.5f), 1.03f, glm::vec3(0.04f, 0.0276f, 0.024f), 5.9f, glm::vec3(-0.07f, -0.01f, -0.00f), 4.6f);
-   PlanetParams saturn(65.0f, 9.69f, 360.0f / 10.7f, 26.7f, 0.056f, 2.5f, 2.0f, saturnTexture, 0.0006f, 0.05f, 5.0f, glm::vec3(0.54f, 0.57f, 0.5f), 1.03f, glm::vec3(0.035f, 0.0276f, 0.026f), 5.9f, glm::vec3(-0.12f, -0.057f, -0.002f), 3.5f);
-   PlanetParams uranus(75.0f, 6.81f, 360.0f / 17.2f, 97.8f, 0.046f, 0.8f, 1.5f, uranusTexture, 0.0005f, 0.04f, 5.0f, glm::vec3(0.7f, 0.7f, 0.8f), 0.73f, glm::vec3(0.041f, 0.045f, 0.046f), 5.5f, glm::vec3(-0.008f, -0.04f, -0.0f), 3.5f);
-   PlanetParams neptune(85.0f, 5.43f, 360.0f / 16.1f, 28.3f, 0.046f, 0.8f, 1.5f, neptuneTexture, 0.0004f, 0.04f, 8.0f, glm::vec3(0.5f, 0.5f, 0.9f), 0.22f, glm::vec3(0.021f, 0.021f, 0.037f), 5.9f, glm::vec3(-0.0f, -0.027f, -0.0f), 3.5f);
-   PlanetParams pluto(110.0f, 4.67f, 360.0f / 153.3f, 122.5f, 0.248f, 17.2f, 0.4f, plutoTexture, 0.0003f, 0.02f, 5.0f, glm::vec3(0.5f, 0.5f, 0.5f), 0.92f, glm::vec3(0.03f, 0.03f, 0.03f), 5.9f);
-   PlanetParams moon(2.5f, 1.022f * 50, 360.0f / 27.3f, 6.68f, 0.0549f, 5.145f, 0.27f, moonTexture, 0.00087f, 0.1f, 32.0f, glm::vec3(0.4f, 0.4f, 0.4f), 2.95f, glm::vec3(0.04f, 0.0215f, 0.025f), 2.9f);
-   std::vector<std::reference_wrapper<PlanetParams>> planets = { sun, mercury, venus, earth, moon, mars, jupiter, saturn, uranus, neptune, pluto };
-
-   Orbit mercuryOrbit = generateOrbitPath(mercury.semiMajorAxis, mercury.eccentricity, mercury.inclination);
-   Orbit venusOrbit = generateOrbitPath(venus.semiMajorAxis, venus.eccentricity, venus.inclination);
-   Orbit earthOrbit = generateOrbitPath(earth.semiMajorAxis, earth.eccentricity, earth.inclination);
-   Orbit marsOrbit = generateOrbitPath(mars.semiMajorAxis, mars.eccentricity, mars.inclination);
-   Orbit jupiterOrbit = generateOrbitPath(jupiter.semiMajorAxis, jupiter.eccentricity, jupiter.inclination);
-   Orbit saturnOrbit = generateOrbitPath(saturn.semiMajorAxis, saturn.eccentricity, saturn.inclination);
-   Orbit uranusOrbit = generateOrbitPath(uranus.semiMajorAxis, uranus.eccentricity, uranus.inclination);
-   Orbit neptuneOrbit = generateOrbitPath(neptune.semiMajorAxis, neptune.eccentricity, neptune.inclination);
-   Orbit plutoOrbit = generateOrbitPath(pluto.semiMajorAxis, pluto.eccentricity, pluto.inclination);
-   Orbit moonOrbit = generateOrbitPath(moon.semiMajorAxis, moon.eccentricity, moon.inclination);
-   std::vector<std::reference_wrapper<Orbit>> orbits = { mercuryOrbit, venusOrbit, earthOrbit, moonOrbit, marsOrbit, jupiterOrbit, saturnOrbit, uranusOrbit, neptuneOrbit, plutoOrbit };
-    GLuint saturnsRing = createRingVAO(saturn.scale + 0.5f, 1.4f);
-    GLuint uranusRing = createRingVAO(uranus.scale, uranus.scale + 0.57f);
-    std::vector<glm::vec3> moonOrbitPath;
+   // The bodies and everything drawn with them come from the system description (system_description.h)
+   SystemDescription system;
+   if (!loadSystem(systemOptions.path, system))
+   {
+       glfwTerminate();
+       return -1;
+   }
+   // A map shared by several bodies or layers is requested once
+   std::map<std::pair<std::string, TextureKind>, GLuint> requestedMaps;
+   auto requestMap = [&](const std::string& path, TextureKind kind) -> GLuint
+   {
+       if (path.empty())
+           return 0;
+       auto found = requestedMaps.find({ path, kind });
+       if (found != requestedMaps.end())
+           return found->second;
+       GLuint texture = textureLoader.requestTexture(path.c_str(), kind);
+       requestedMaps[{ path, kind }] = texture;
+       return texture;
+   };
+
+   // Maps with a compiled .vtex stream tiles on demand into a fixed-size cache
+   VirtualTextureSystem virtualTextures;
+   virtualTextures.init(SCR_WIDTH, SCR_HEIGHT);
+   std::map<std::string, VirtualTexture*> virtualMaps;
+   auto loadVirtual = [&](const std::string& path) -> VirtualTexture*
+   {
+       if (path.empty())
+           return nullptr;
+       auto found = virtualMaps.find(path);
+       if (found != virtualMaps.end())
+           return found->second;
+       return virtualMaps[path] = virtualTextures.load(path);
+   };
+
+   BodyStore bodies;
+   bodies.reserve(system.bodies.size());
+   std::vector<int> bodyFeedback;
+   std::vector<CloudLayer> cloudLayers;
+   std::vector<BodyRing> rings;
+   std::set<VirtualTexture*> cloudsWithFeedback;
+   for (const BodyDescription& description : system.bodies)
+   {
+       // A streamed map is never loaded whole; its pinned coarsest tile stands in until finer ones arrive
+       RenderableComponent maps;
+       maps.virtualColor = loadVirtual(description.texture);
+       maps.virtualSpecular = loadVirtual(description.specularMap);
+       maps.virtualNight = loadVirtual(description.nightMap);
+       maps.texture = maps.virtualColor ? 0 : requestMap(description.texture, TEXTURE_COLOR);
+       maps.specularMap = maps.virtualSpecular ? 0 : requestMap(description.specularMap, TEXTURE_SPECULAR);
+       maps.nightMap = maps.virtualNight ? 0 : requestMap(description.nightMap, TEXTURE_COLOR);
+       int index = addBody(bodies, description, maps);
+       bodyFeedback.push_back(virtualTextures.feedbackId({ maps.virtualColor, maps.virtualSpecular, maps.virtualNight }));
+       // Ring radii are in units of the body's scale, so they keep their compressed shape
+       if (!description.ringTexture.empty())
+           rings.push_back({ index, createRingVAO(description.ring.innerRadius, description.ring.outerRadius),
+               requestMap(description.ringTexture, TEXTURE_RING), description.ring.flipped != 0 });
+       for (const CloudLayerDescription& layer : description.clouds)
+       {
+           VirtualTexture* virtualClouds = loadVirtual(layer.texture);
+           GLuint clouds = virtualClouds ? 0 : requestMap(layer.texture, TEXTURE_COLOR);
+           cloudLayers.push_back({ index, clouds, virtualClouds, 0, layer.elements });
+       }
+   }
+   // Layers sharing a streamed map ask for its tiles once, through the outermost
+   for (auto layer = cloudLayers.rbegin(); layer != cloudLayers.rend(); ++layer)
+       if (layer->virtualTexture && cloudsWithFeedback.insert(layer->virtualTexture).second)
+           layer->feedback = virtualTextures.feedbackId({ layer->virtualTexture });
+
+    int orbitSegments = 360;
+    if (realScaleOptions.enabled)
+    {
+        for (size_t i = 0; i < bodies.size(); i++)
+            applyRealScale(bodies, (int)i);
+        orbitSegments = REAL_SCALE_ORBIT_SEGMENTS;
+    }
+
+   // Each path is about its parent's centre and drawn wherever the parent is, so a moon's path
+   // follows its planet without being rebuilt
+   std::vector<Orbit> orbits;
+   std::vector<int> orbitBodies;
+   for (size_t i = 0; i < bodies.size(); i++)
+   {
+       if (!system.bodies[i].showOrbit)
+           continue;
+       const OrbitComponent& orbit = bodies.orbits[i];
+       orbits.emplace_back(generateOrbitPath(orbit.semiMajorAxis, orbit.eccentricity, orbit.inclination, orbitSegments));
+       orbitBodies.push_back((int)i);
+   }
+   for (Orbit& orbit : orbits)
+       uploadOrbitPath(orbit);
 //------------------------------------------ ASTEROIDS ----------------------------------------------
-    Shader asteroidShader("asteroid.vs", "asteroid.fs");
-    GLuint asteroidTexture = loadTexture("../textures/planets/asteroid.jpg");
-    int asteroidHeight = 5; int asteroidWidth = 4;
-    GLuint asteroid = createSphereVAO(0.7, asteroidHeight, asteroidWidth);
-    std::vector<glm::mat4> asteroidTransforms = asteroids(38.5,6.5,0.2f, 0.9f,1.08f,1.1,-1.1);
-    
-    // Create a buffer for instance matrices
-    unsigned int instanceVBO;
-    glGenBuffers(1, &instanceVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, NUM_ASTEROIDS * sizeof(glm::mat4), &asteroidTransforms[0], GL_STATIC_DRAW);
-
-    // Link the buffer to a vertex array object (VAO)
-    glBindVertexArray(asteroid); 
-
-    // Set instance attributes
-    std::size_t vec4Size = sizeof(glm::vec4);
-    for (unsigned int i = 0; i < 4; i++) {
-        glEnableVertexAttribArray(3 + i); // Use attribute locations 3, 4, 5, 6
-        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * vec4Size));
-        glVertexAttribDivisor(3 + i, 1); // One per instance
+    GLuint asteroidTexture = requestMap(system.beltTexture, TEXTURE_COLOR);
+    const AsteroidBeltShape& beltShape = system.belt;
+    AsteroidBelt asteroidBelt;
+    AsteroidField asteroidField;
+    // The fixed belt's rocks, kept for the spatial index
+    std::vector<AsteroidInstance> generatedRocks;
+    const AsteroidInstance* beltRocks = nullptr;
+    size_t beltRockCount = 0;
+    // The belt's shape and orbits are compressed units through and through; real scale goes without
+    bool drawBelt = system.hasBelt && !realScaleOptions.enabled;
+    bool streamedBelt = drawBelt && asteroidFieldOptions.count > 0;
+    if (streamedBelt)
+    {
+        // Chunks are generated from the seed alone, so every run streams the same belt
+        asteroidField.start(asteroidFieldOptions, beltShape, bench ? bench->seed : 1u, asteroidBelt, asteroidTexture);
     }
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    else if (drawBelt && system.minorPlanetCount > 0)
+    {
+        // A catalog takes the place of the generated rocks, uploaded straight from the description
+        asteroidBelt.init(system.minorPlanets, system.minorPlanetCount, asteroidTexture);
+        beltRocks = system.minorPlanets;
+        beltRockCount = system.minorPlanetCount;
+    }
+    else if (drawBelt)
+    {
+        // Same belt for every run of the sweep, however many threads generate it
+        generatedRocks = asteroids(bench ? bench->seed : 1u, beltShape);
+        asteroidBelt.init(generatedRocks, asteroidTexture);
+        beltRocks = generatedRocks.data();
+        beltRockCount = generatedRocks.size();
+    }
+//------------------------------------------ SPATIAL INDEX ------------------------------------------
+    // The bodies, then the belt's rocks, as spheres where this frame draws them: what a pick is
+    // tested against. The streamed field's rocks come and go with its chunks and are left out.
+    std::vector<BvhSphere> spatialItems(bodies.size() + beltRockCount);
+    std::vector<glm::vec3> rockPositions(beltRockCount);
+    float rockBoundingRadius = asteroidBelt.rockBoundingRadius();
+    Bvh spatialIndex;
+    int focused = -1;   // Item of spatialItems left-drag orbits, from the last pick; -1 for none
     //--------------------------------------------------------------------------------------------------------
     float time = 0.0f;
-    float asteroidRotationAngle = 0.0f;
+    double asteroidOrbitTime = 0.0;  // Sim seconds from the simulation; each rock's orbit is evaluated at it on the GPU
     glCullFace(GL_FRONT);
+    int frameIndex = 0;
+    FrameStats frameStats;
+    int exitCode = 0;
+
+    // Benchmarks and headless runs advance by a fixed step so every run renders the same frames
+    bool fixedStep = headless.enabled || bench;
+    int frameLimit = headless.frames;
+    int followed = -1;
+    GpuTimer gpuTimer;
+    int gpuSamples = 0;
+    if (bench)
+    {
+        float endTime = bench->endTime >= 0.0f ? bench->endTime : bench->scene->duration;
+        frameLimit = bench->warmupFrames + (int)floor(endTime / headless.fixedStep + 0.5f) + 1;
+        followed = bodies.find(bench->scene->follow);
+        gpuTimer.init();
+    }
+    if (fixedStep)
+        textureLoader.finish(); // Fixed-step runs must render the same images every time
+    // Everything a run records per frame is sized up front
+    frameStats.reserve(frameLimit);
+    if (bench)
+    {
+        bench->result.frame.reserve(frameLimit);
+        bench->result.cpu.reserve(frameLimit);
+        bench->result.gpu.reserve(frameLimit);
+        bench->result.drawCalls.reserve(frameLimit);
+    }
+
+    // Orbits tick on their own thread; fixed-step runs step them once a frame instead
+    Simulation simulation;
+    simulation.init(bodies, speedFactor);
+    float sentSpeed = speedFactor;
+    if (!fixedStep)
+    {
+        simulation.step(0.0); // Places the bodies, so the first frame has a snapshot to draw
+        simulation.start();
+    }
+    // Real scale starts a few earth radii out (or the first body's, in a system without one), on
+    // the side the camera looks from
+    RealScaleView realView;
+    if (realScaleOptions.enabled)
+    {
+        realView.anchor = std::max(bodies.find("earth"), 0);
+        realView.offset = glm::dvec3(0.0, 0.0, 4.0 * bodies.transforms[realView.anchor].scale);
+        cameraPos = glm::vec3(0.0f);
+    }
+
+    // Start the variants the first frame will ask for so they build alongside the other programs
+    unsigned startFeatures = (flashlightOn ? SHADER_FLASHLIGHT : 0) | (bloom ? SHADER_BLOOM : 0);
+    for (const RenderableComponent& maps : bodies.renderables)
+        celestialShaders.prepare(startFeatures | planetShaderFeatures(maps));
+    for (const CloudLayer& layer : cloudLayers)
+        cloudShaders.prepare(startFeatures | (layer.virtualTexture ? CLOUD_VIRTUAL : 0));
+    ringShaders.prepare(startFeatures);
+    asteroidShaders.prepare(startFeatures);
+    impostorShaders.prepare(startFeatures);
+    FrameUniformBuffer frameUniforms;
+    frameUniforms.init();
+
+    finishShaders();
+    bindFrameUniforms(feedbackShader.ID);
+    framebufferProgram.use();
+    glUniform1i(glGetUniformLocation(framebufferProgram.ID, "screenTexture"), 0);
+    glUniform1i(glGetUniformLocation(framebufferProgram.ID, "bloomTexture"), 1);
+    blurProgram.use();
+    glUniform1i(glGetUniformLocation(blurProgram.ID, "screenTexture"), 0);
+    skyboxShader.use();
+    skyboxShader.setInt("skybox", 0);
+    skyboxShader.setFloat("farDepth", farDepth());
 
+    frameArena.init();
+    if (allocTraceOptions.enabled)
+        startAllocTrace(allocTraceOptions);
     while (!glfwWindowShouldClose(window))
     {   
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        frameArena.reset(); // Last frame's scratch is dead: its jobs were all waited on
+        drawCallCount = 0;
+        if (bench)
+        {
+            double gpuMs;
+            while (gpuTimer.poll(gpuMs, gpuTimer.full()))
+                if (gpuSamples++ >= bench->warmupFrames)
+                    bench->result.gpu.add(gpuMs);
+            gpuTimer.begin();
+        }
         glEnable(GL_DEPTH_TEST);
         glFrontFace(GL_CW);
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        if (fixedStep)
+        {
+            deltaTime = headless.fixedStep;
+        }
+        else
+        {
+            float currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+        }
         time += deltaTime; // Increment time
+        if (bench)
+        {
+            float sceneTime = std::max(0, frameIndex - bench->warmupFrames) * headless.fixedStep;
+            glm::vec3 followPosition = followed >= 0 ? bodies.transforms[followed].position : glm::vec3(0.0f);
+            sampleScene(*bench->scene, sceneTime, followPosition, cameraPos, cameraFront, speedFactor);
+        }
         
-        asteroidRotationAngle -= deltaTime * 0.1f * speedFactor; // Adjust speed of rotation as needed
-        if (asteroidRotationAngle <= 360.0f)
-            asteroidRotationAngle += 360.0f; // Keep angle within 0-360 degrees
-        processInput(window);
+        if (headless.enabled && !bench)
+        {
+            scriptedCamera(frameIndex, headless.frames, cameraPos, cameraFront);
+            if (realScaleOptions.enabled)
+            {
+                // The same path around the sun, with the earth's 24 units made an AU
+                realView.anchor = -1;
+                realView.offset = glm::dvec3(0.0);
+                cameraPos *= (float)(KM_PER_AU / COMPRESSED_UNITS_PER_AU);
+            }
+        }
+        else if (!headless.enabled)
+            processInput(window);
+        if (realScaleOptions.enabled)
+        {
+            // The camera moved from the origin; the origin catches up once the bodies are in
+            realView.offset += glm::dvec3(cameraPos);
+            cameraPos = glm::vec3(0.0f);
+        }
+        // Retried next frame if the queue is full
+        if (speedFactor != sentSpeed && simulation.send({ SIM_SET_SPEED, speedFactor }))
+            sentSpeed = speedFactor;
+        if (fixedStep)
+            simulation.step(deltaTime);
+        if (frameIndex == (bench ? bench->warmupFrames : 0))
+            jobSystem.resetStats(); // Utilization of the measured frames only
+        // The CPU side of the frame as a graph: the snapshot, then every body's transform, on the
+        // workers while this thread does the GL work that can't leave it
+        JobHandle snapshotJob = jobSystem.submit([&] { simulation.apply(bodies, asteroidOrbitTime); });
+        // Real scale moves the render origin to the camera before anything is made relative to it
+        JobHandle originJob = snapshotJob;
+        if (realScaleOptions.enabled)
+            originJob = jobSystem.submit([&] { updateRealScaleView(realView, bodies); }, { snapshotJob });
+        // Split in whole SIMD batches so no piece runs half-empty lanes
+        size_t transformBatches = (bodies.size() + TRANSFORM_LANES - 1) / TRANSFORM_LANES;
+        JobHandle transformJob = jobSystem.parallelFor(transformBatches, 2, [&](size_t first, size_t count)
+        {
+            size_t begin = first * TRANSFORM_LANES;
+            size_t end = std::min(bodies.size(), (first + count) * TRANSFORM_LANES);
+            updateBodyTransforms(bodies, begin, end - begin, realView.origin);
+        }, { originJob });
+        // The spatial index follows: the rocks' orbits in pieces, then one refit once the bodies
+        // are placed too. Built on the first frame, and again when the orbits have sheared the
+        // belt enough that the refit tree costs more than a new one.
+        JobHandle rockJob = jobSystem.parallelFor(beltRockCount, SPATIAL_ROCK_GRAIN, [&](size_t first, size_t count)
+        {
+            asteroidPositions(beltRocks + first, count, asteroidOrbitTime, rockPositions.data() + first);
+        }, { snapshotJob });
+        JobHandle spatialJob = jobSystem.submit([&]
+        {
+            size_t bodyCount = bodies.size();
+            for (size_t i = 0; i < bodyCount; i++)
+                spatialItems[i] = { bodies.transforms[i].position, bodies.transforms[i].scale };
+            for (size_t i = 0; i < beltRockCount; i++)
+                spatialItems[bodyCount + i] = { rockPositions[i], beltRocks[i].phase.w * rockBoundingRadius };
+            if (spatialIndex.nodeCount() == 0 || spatialIndex.needsRebuild())
+                spatialIndex.build(spatialItems.data(), spatialItems.size());
+            else
+                spatialIndex.refit(spatialItems.data());
+        }, { transformJob, rockJob });
+        textureLoader.pump(2.0); // Frame budget for texture uploads in ms
+        if (drawBelt && !asteroidBelt.impostorsBaked() && textureLoader.resident(asteroidTexture))
+            asteroidBelt.bakeImpostors(); // From the streamed surface, once its real image is in
+        virtualTextures.update(1.0);
+        if (requestedSphereRes && !sphereRebuilding)
+        {
+            if (requestedSphereRes != sphereRes)
+                rebuildSphere(requestedSphereRes, sphere, sphereRebuilding);
+            requestedSphereRes = 0;
+        }
+        taskScheduler.pump(2.0); // Frame budget for coroutine work in ms
         // Bind the custom framebuffer
         if (bloom) {
             glBindFramebuffer(GL_FRAMEBUFFER, postProcessingFBO);
@@ -276,121 +572,126 @@ int main()
         //----------------------------------- MAIN DRAWINGS ----------------------------------------
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
         glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+        float distanceScale = 1.0f;
+        if (realScaleOptions.enabled)
+        {
+            projection = infiniteReversedPerspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT,
+                realScaleOptions.nearPlane);
+            distanceScale = REAL_SCALE_DISTANCE_SCALE;
+            jobSystem.wait(originJob);
+            // The sun sits at the world origin, drawn where the render origin puts it
+            lightPos = glm::vec3(-realView.origin);
+            cameraSpeedScale = (float)realView.altitude * REAL_SCALE_CAMERA_SPEED;
+            orbitCenter = glm::vec3(-realView.offset);
+        }
+        glm::vec3 orbitOffset = glm::vec3(-realView.origin);
         // SET UP SHADERS
-            cloudShader.use();
-            cloudShader.setMat4("view", view);
-            cloudShader.setMat4("projection", projection);
-            cloudShader.setVec3("lightPos", lightPos);
-            cloudShader.setVec4("lightColor", lightColor);
-            cloudShader.setVec3("viewPos", cameraPos);
-            cloudShader.setBool("flashlightOn", flashlightOn);
-            cloudShader.setVec3("flashlightDir", cameraFront);
-            cloudShader.setFloat("ambientStrength", 0.001f);
-            cloudShader.setBool("haveBloom", bloom);
-            cloudShader.setFloat("exposure",exposureVal);
-            celestialShader.use();
-            celestialShader.setMat4("view", view);
-            celestialShader.setMat4("projection", projection);
-            celestialShader.setVec3("lightPos", lightPos);
-            celestialShader.setVec4("lightColor", lightColor);
-            celestialShader.setVec3("viewPos", cameraPos);
-            celestialShader.setVec3("flashlightDir", cameraFront);
-            celestialShader.setInt("flashlightOn", flashlightOn);
-            celestialShader.setFloat("gamma", gamma);
-            celestialShader.setBool("haveBloom", bloom);
-            celestialShader.setFloat("exposure", exposureVal);
+        // Shared by every lit program through the FrameData block
+        FrameUniforms frame;
+        frame.view = view;
+        frame.projection = projection;
+        frame.lightPos = lightPos;
+        frame.gamma = gammaVal;
+        frame.lightColor = lightColor;
+        frame.viewPos = cameraPos;
+        frame.exposure = exposureVal;
+        frame.flashlightDir = cameraFront;
+        frame.distanceScale = distanceScale;
+        frameUniforms.update(frame);
+        // Toggles become variants instead of uniform branches
+        unsigned frameFeatures = (flashlightOn ? SHADER_FLASHLIGHT : 0) | (bloom ? SHADER_BLOOM : 0);
             orbitShader.use();
             orbitShader.setMat4("view", view);
             orbitShader.setMat4("projection", projection);
             orbitShader.setVec3("cameraPos", cameraPos);
             orbitShader.setBool("haveBloom", bloom);
-            orbitShader.setFloat("gamma", gamma);    
-            ringShader.use();
-            ringShader.setMat4("view", view);
-            ringShader.setMat4("projection", projection);
-            ringShader.setVec3("lightPos", lightPos);
-            ringShader.setVec4("lightColor", lightColor);
-            ringShader.setVec3("viewPos", cameraPos);
-            ringShader.setBool("flashlightOn", flashlightOn);
-            ringShader.setVec3("flashlightDir", cameraFront);
-            ringShader.setBool("haveBloom", bloom);
-            ringShader.setFloat("exposure", exposureVal);
-            glm::mat4 skyView = glm::mat4(glm::mat3(camera.GetViewMatrix())); // Remove translation
+            orbitShader.setFloat("gamma", gammaVal);    
+            orbitShader.setFloat("distanceScale", distanceScale);
+            // Remove translation; scripted cameras never update the Camera object so use the main view
+            glm::mat4 skyView = glm::mat4(glm::mat3(fixedStep ? view : camera.GetViewMatrix()));
             glm::mat4 skyProjection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
             skyboxShader.use();
             skyboxShader.setMat4("view", skyView);
             skyboxShader.setMat4("projection", skyProjection);
             skyboxShader.setBool("haveBloom", bloom);
             skyboxShader.setFloat("exposure", exposureVal);
-            asteroidShader.use();
-            asteroidShader.setMat4("view", view);
-            asteroidShader.setMat4("projection", projection);
-            asteroidShader.setVec3("lightPos", lightPos);
-            asteroidShader.setVec4("lightColor", lightColor);
-            asteroidShader.setVec3("viewPos", cameraPos);
-            asteroidShader.setVec3("flashlightDir", cameraFront);
-            asteroidShader.setInt("flashlightOn", flashlightOn);
-            asteroidShader.setBool("haveBloom", bloom);
-            asteroidShader.setFloat("exposure", exposureVal);
-
-        celestialShader.use();
-        for (auto& planet_wrapper : planets)
-        {
-            auto& planet = planet_wrapper.get();
-            if (&planet == &moon)
-            {
-                continue;
-            }
-            updateCelestialPosition(planet, deltaTime * speedFactor); // Update only planets
-            renderPlanet(celestialShader.ID, sphereVAO, planet);
-            if (&planet == &earth)
-            {
-                updateCelestialPosition(moon, deltaTime * speedFactor, planet.position);
-                renderPlanet(celestialShader.ID, sphereVAO, moon);
-            }
-        }
-        asteroidShader.use();
+
+        jobSystem.wait(transformJob); // Bodies and the asteroid orbit time are read from here on
+        for (size_t i = 0; i < bodies.size(); i++)
+            renderPlanet(celestialShaders.use(frameFeatures | planetShaderFeatures(bodies.renderables[i])).ID, sphere, bodies, (int)i);
+        const Shader& asteroidShader = asteroidShaders.use(frameFeatures);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, asteroidTexture);
         glUniform1i(glGetUniformLocation(asteroidShader.ID, "texture1"), 0);
-        renderAsteroidBelt(asteroidShader.ID, asteroid, asteroidHeight * asteroidWidth * 6,
-            0.00,0.01f, glm::vec3(0.001),0.02,asteroidRotationAngle);
+        // Fixed-step runs wait for the chunks in range so every run draws the same rocks
+        if (streamedBelt)
+            asteroidField.update(cameraPos, asteroidOrbitTime, fixedStep);
+        const Shader& impostorShader = impostorShaders.use(frameFeatures);
+        if (drawBelt)
+            renderAsteroidBelt(asteroidShader.ID, impostorShader.ID, asteroidBelt, projection, view,
+                0.00,0.01f, glm::vec3(0.001),0.02,(float)asteroidOrbitTime);
 
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         orbitShader.use();
         if(OrbitOn){
-            for (auto& orbits_wrapper : orbits)
+            for (size_t i = 0; i < orbits.size(); i++)
             {
-                auto& orbit = orbits_wrapper.get();
-                if (&orbit != &moonOrbit)
-                    renderOrbitPath(orbitShader.ID, orbit.points);
-            }
-            moonOrbitPath = computeMoonOrbitPath(earth.position, moon.semiMajorAxis, moon.eccentricity, moon.inclination);
-            renderOrbitPath(orbitShader.ID, moonOrbitPath);}
+                // Around the parent where it is now; bodies without one circle the world origin
+                int parent = bodies.parents[orbitBodies[i]];
+                renderOrbitPath(orbitShader.ID, orbits[i], parent >= 0 ? bodies.transforms[parent].position : orbitOffset);
+            }}
         if (skyBoxOn) {
             // skybox cube
             skyboxShader.use();
-            glDepthFunc(GL_LEQUAL); // Change depth function so skybox is drawn behind everything
+            glDepthFunc(nearerOrEqualDepthFunc()); // Change depth function so skybox is drawn behind everything
             glBindVertexArray(skyboxVAO);
             glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
             glDrawArrays(GL_TRIANGLES, 0, 36);
+            drawCallCount++;
             glBindVertexArray(0);
-            glDepthFunc(GL_LESS); // Reset to default depth function// set depth function back to default   
+            glDepthFunc(nearerDepthFunc()); // Reset to default depth function// set depth function back to default   
+        }
+        for (const CloudLayer& layer : cloudLayers)
+        {
+            const CloudElements& cloud = layer.elements;
+            const Shader& cloudShader = cloudShaders.use(frameFeatures | (layer.virtualTexture ? CLOUD_VIRTUAL : 0));
+            cloudShader.setFloat("ambientStrength", cloud.ambientStrength);
+            renderCloudLayer(cloudShader.ID, sphere, bodies, layer.body, layer.texture, cloud.color, cloud.scale,
+                (float)(time + cloud.timeOffset), cloud.alpha, cloud.rimColor, cloud.rimIntensity, cloud.terminatorColor,
+                cloud.terminatorBlendFactor, layer.virtualTexture);
         }
-        // Activate cloud shader
-        cloudShader.use();
-        renderCloudLayer(
-            cloudShader.ID, sphereVAO, earth, cloudTexture, glm::vec3(0.02, 0.04, 0.12), 1.004f, time, 0.91f, glm::vec3(0.02, 0.11, 0.85), 4.5);
-        renderCloudLayer(
-            cloudShader.ID, sphereVAO, earth, cloudTexture, glm::vec3(0.92, 0.92, 0.96), 1.01f, time+0.1, 1.0f, glm::vec3(0.37, 0.48, 0.87),2.5);
         glDisable(GL_CULL_FACE);
-        ringShader.use();
-        renderRing(ringShader.ID, saturnsRing, saturn, saturnRingTexture);
-        renderRing(ringShader.ID, uranusRing, uranus, uranusRingTexture, true);
+        const Shader& ringShader = ringShaders.use(frameFeatures);
+        for (const BodyRing& ring : rings)
+            renderRing(ringShader.ID, ring.VAO, bodies, ring.body, ring.texture, ring.flipped);
         glEnable(GL_CULL_FACE);
         glDisable(GL_BLEND);
+        if (virtualTextures.active())
+        {
+            // Tell the streamer which tiles these surfaces need; read back a few frames later
+            feedbackShader.use();
+            feedbackShader.setFloat("lodBias", virtualTextures.lodBias());
+            virtualTextures.beginFeedback();
+            for (size_t i = 0; i < bodies.size(); i++)
+            {
+                if (!bodyFeedback[i])
+                    continue;
+                feedbackShader.setInt("feedbackId", bodyFeedback[i]);
+                renderPlanet(feedbackShader.ID, sphere, bodies, (int)i);
+            }
+            virtualTextures.beginTranslucentFeedback();
+            for (const CloudLayer& layer : cloudLayers)
+            {
+                if (!layer.feedback)
+                    continue;
+                feedbackShader.setInt("feedbackId", layer.feedback);
+                renderCloudLayer(feedbackShader.ID, sphere, bodies, layer.body, layer.texture, glm::vec3(0.0f),
+                    layer.elements.scale, (float)(time + layer.elements.timeOffset));
+            }
+            virtualTextures.endFeedback(bloom ? postProcessingFBO : 0);
+        }
         //-------------------------------------------------------------------------------------
         if (bloom) {
             // Bounce the image data around to blur multiple times
@@ -420,6 +721,7 @@ int main()
 			    glBindVertexArray(rectVAO);
 			    glDisable(GL_DEPTH_TEST);
 			    glDrawArrays(GL_TRIANGLES, 0, 6);
+			    drawCallCount++;
 
 			    // Switch between vertical and horizontal blurring
 			    horizontal = !horizontal;
@@ -447,27 +749,213 @@ int main()
 
             // Draw the fullscreen quad
             glDrawArrays(GL_TRIANGLES, 0, 6);
+            drawCallCount++;
         }
         
+        if (fixedStep)
+        {
+            if (bench)
+                gpuTimer.end();
+            auto submitEnd = std::chrono::high_resolution_clock::now();
+            // Include the GPU work in the frame time, there is no swap to throttle on
+            glFinish();
+            auto frameEnd = std::chrono::high_resolution_clock::now();
+            double frameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+            frameStats.add(frameMs);
+            if (bench && frameIndex >= bench->warmupFrames)
+            {
+                bench->result.frame.add(frameMs);
+                bench->result.cpu.add(std::chrono::duration<double, std::milli>(submitEnd - frameStart).count());
+                bench->result.drawCalls.push_back(drawCallCount);
+            }
+
+            bool lastFrameOfRun = frameIndex == frameLimit - 1;
+            if (lastFrameOfRun && bench && bench->captureLastFrame)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                bench->image = readFramebuffer(SCR_WIDTH, SCR_HEIGHT);
+            }
+            bool capture = lastFrameOfRun || (headless.captureEvery > 0 && frameIndex % headless.captureEvery == 0);
+            if (capture && !headless.outputDir.empty())
+            {
+                std::string path = headless.outputDir + "/frame_" + std::to_string(frameIndex) + (headless.rawOutput ? ".raw" : ".ppm");
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                saveFramebuffer(path, SCR_WIDTH, SCR_HEIGHT, headless.rawOutput);
+            }
+            if (lastFrameOfRun)
+                glfwSetWindowShouldClose(window, true);
+        }
+        // Right click: whatever is at the centre of the screen becomes what left-drag orbits
+        jobSystem.wait(spatialJob);
+        if (pickRequested)
+        {
+            pickRequested = false;
+            BvhRayHit hit;
+            focused = spatialIndex.raycast(cameraPos, cameraFront, FLT_MAX, hit) ? (int)hit.item : -1;
+            if (focused < 0)
+            {
+                std::cout << "Nothing at the centre of the screen" << std::endl;
+                if (!realScaleOptions.enabled)
+                    orbitCenter = glm::vec3(0.0f);
+            }
+            else if (focused < (int)bodies.size())
+                std::cout << "Orbiting " << bodies.names[focused] << std::endl;
+            else
+                std::cout << "Orbiting asteroid " << focused - bodies.size() << std::endl;
+        }
+        if (focused >= 0)
+            orbitCenter = spatialItems[focused].center;
+        endAllocFrame(frameIndex);
+        frameIndex++;
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    if (bench)
+    {
+        double gpuMs;
+        while (gpuTimer.poll(gpuMs, true))
+            if (gpuSamples++ >= bench->warmupFrames)
+                bench->result.gpu.add(gpuMs);
+        gpuTimer.destroy();
+        bench->result.frame.printSummary(std::cout);
+        bench->result.workers = jobSystem.stats();
+        jobSystem.printUtilization(std::cout);
+    }
+    else if (headless.enabled)
+    {
+        frameStats.printSummary(std::cout);
+        jobSystem.printUtilization(std::cout);
+    }
+    if (allocTraceOptions.enabled)
+    {
+        stopAllocTrace();
+        if (!printAllocReport(std::cout))
+            exitCode = 1;
+        std::cout << "Frame arena: " << (frameArena.highWater() >> 10) << " of " << (frameArena.capacity() >> 10)
+            << " KB used at most" << std::endl;
+    }
 
-    glDeleteVertexArrays(1, &sphereVAO);
+    simulation.stop();
+    taskScheduler.finish(); // Coroutines may still hold references to the locals here
+    textureLoader.stop();
+    virtualTextures.shutdown();
+    glDeleteProgram(feedbackShader.ID);
+    deleteSphereVAO(sphere.VAO);
+    for (Orbit& orbit : orbits)
+        deleteOrbitPath(orbit);
     glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteVertexArrays(1, &saturnsRing);
-    glDeleteVertexArrays(1, &asteroid);
-    glDeleteVertexArrays(1, &uranusRing);
-    glDeleteProgram(celestialShader.ID);
+    for (BodyRing& ring : rings)
+        glDeleteVertexArrays(1, &ring.VAO);
+    asteroidField.stop();
+    asteroidBelt.release();
+    celestialShaders.release();
     glDeleteProgram(orbitShader.ID);
-    glDeleteProgram(cloudShader.ID);
-    glDeleteProgram(asteroidShader.ID);
-    glDeleteProgram(ringShader.ID);
+    cloudShaders.release();
+    asteroidShaders.release();
+    impostorShaders.release();
+    ringShaders.release();
+    frameUniforms.release();
     glDeleteBuffers(1, &skyboxVBO);
 
     glDeleteFramebuffers(1, &postProcessingFBO);
     glfwDestroyWindow(window);
 
+    frameArena.release();
+
     glfwTerminate();
-    return 0;
+    return exitCode;
+}
+
+int main(int argc, char** argv)
+{
+    HeadlessOptions headless;
+    BenchmarkOptions benchOptions;
+    GoldenOptions goldenOptions;
+    TextureCompilerOptions compilerOptions;
+    AssetPackOptions packOptions;
+    AsteroidGenBenchOptions genBenchOptions;
+    BvhBenchOptions bvhBenchOptions;
+    if (!parseHeadlessArgs(argc, argv, headless) || !parseBenchmarkArgs(argc, argv, benchOptions) ||
+        !parseGoldenArgs(argc, argv, goldenOptions) || !parseTextureCompilerArgs(argc, argv, compilerOptions) ||
+        !parseAssetPackArgs(argc, argv, packOptions) || !parseAsteroidFieldArgs(argc, argv, asteroidFieldOptions) ||
+        !parseAsteroidGenBenchArgs(argc, argv, genBenchOptions) || !parseAllocTraceArgs(argc, argv, allocTraceOptions) ||
+        !parseRealScaleArgs(argc, argv, realScaleOptions) || !parseSystemArgs(argc, argv, systemOptions) ||
+        !parseBvhBenchArgs(argc, argv, bvhBenchOptions))
+        return -1;
+    if (realScaleOptions.enabled && (benchOptions.enabled || goldenOptions.enabled))
+    {
+        std::cerr << "--real-scale can't be combined with --bench or --golden: their scenes are in compressed units" << std::endl;
+        return -1;
+    }
+    if (allocTraceOptions.test)
+        headless.enabled = true; // Fixed steps, so every run of the test renders the same frames
+
+    // Build steps only, no window needed
+    if (compilerOptions.enabled)
+        return compileTextureManifest(compilerOptions);
+    if (packOptions.build)
+        return buildAssetPack(packOptions);
+    if (genBenchOptions.enabled)
+        return runAsteroidGenBenchmark(genBenchOptions, benchOptions.seed);
+    if (bvhBenchOptions.enabled)
+        return runBvhBenchmark(bvhBenchOptions, benchOptions.seed);
+    if (systemOptions.compile)
+        return compileSystem(systemOptions);
+    jobSystem.start();
+
+    // Loose files are used for anything the pack doesn't have, or when there is no pack
+    if (packOptions.mount)
+        assetPack.mount(packOptions.pack);
+
+    if (goldenOptions.enabled)
+    {
+        float defaultSpeed = speedFactor;
+        return runGoldenSuite(goldenOptions, [&](const GoldenCase& golden, GoldenCapture& capture)
+        {
+            SCR_WIDTH = goldenOptions.width;
+            SCR_HEIGHT = goldenOptions.height;
+            speedFactor = defaultSpeed;
+            BenchmarkConfig config = { golden.scene, NUM_ASTEROIDS, sphereRes, goldenOptions.width, goldenOptions.height };
+            BenchmarkRun run = {};
+            run.scene = findBenchmarkScene(golden.scene);
+            run.config = config;
+            run.seed = benchOptions.seed;
+            run.endTime = golden.simTime;
+            run.captureLastFrame = true;
+            if (runApp(headless, &run) != 0 || run.image.empty())
+                return false;
+            capture.pixels = run.image;
+            capture.renderMs = 0.0;
+            for (double ms : run.result.frame.frameMs)
+                capture.renderMs += ms;
+            return true;
+        });
+    }
+    if (!benchOptions.enabled)
+        return runApp(headless, nullptr);
+
+    // Every point of the sweep gets a fresh context and scene
+    std::vector<BenchmarkResult> results;
+    std::vector<BenchmarkConfig> sweep = expandSweep(benchOptions, NUM_ASTEROIDS, sphereRes, SCR_WIDTH, SCR_HEIGHT);
+    float defaultSpeed = speedFactor;
+    for (const BenchmarkConfig& config : sweep)
+    {
+        NUM_ASTEROIDS = config.asteroids;
+        sphereRes = config.sphereRes;
+        SCR_WIDTH = config.width;
+        SCR_HEIGHT = config.height;
+        speedFactor = defaultSpeed;
+
+        BenchmarkRun run = {};
+        run.scene = findBenchmarkScene(config.scene);
+        run.config = config;
+        run.warmupFrames = benchOptions.warmupFrames;
+        run.seed = benchOptions.seed;
+        run.result.config = config;
+        if (runApp(headless, &run) != 0)
+            return -1;
+        results.push_back(run.result);
+    }
+    return writeBenchmarkJson(benchOptions.jsonPath, results) ? 0 : -1;
 }
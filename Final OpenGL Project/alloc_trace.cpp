@@ -0,0 +1,328 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#define ALLOC_TRACE_NOINLINE __declspec(noinline)
+#else
+#include <execinfo.h>
+#define ALLOC_TRACE_NOINLINE __attribute__((noinline))
+#endif
+#include "alloc_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <vector>
+
+// Frames kept per sampled stack, after dropping the hook's own
+static const int STACK_DEPTH = 12;
+// captureSample, recordAllocation and allocate
+static const int STACK_SKIP = 3;
+// The newest samples are kept; older ones are overwritten
+static const uint32_t MAX_SAMPLES = 4096;
+// Call stacks printed by the report
+static const size_t REPORT_STACKS = 8;
+
+struct StackSample
+{
+    size_t bytes;
+    int depth;
+    void* frames[STACK_DEPTH];
+};
+
+struct Counter
+{
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
+
+// Written from any thread that allocates
+static std::atomic<bool> tracing{ false };
+static std::atomic<bool> sampling{ false };     // Only after the warmup, so the report shows steady frames
+static std::atomic<int> sampleEvery{ 0 };
+static std::atomic<uint64_t> sampleClock{ 0 };
+static std::atomic<uint32_t> sampleCount{ 0 };
+static StackSample samples[MAX_SAMPLES];
+static Counter frameCounts;
+static Counter backgroundCounts;
+static thread_local bool frameThread = false;
+static thread_local bool inHook = false;        // Whatever the hook itself allocates isn't counted
+
+// GL thread only
+static AllocTraceOptions traceOptions;
+static int loggedFrames = 0;
+static int allocatingFrames = 0;
+static int worstFrame = -1;
+static AllocCounts loggedTotal;
+static AllocCounts worstCounts;
+
+bool parseAllocTraceArgs(int argc, char** argv, AllocTraceOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool trace = strcmp(argv[i], "--trace-allocs") == 0;
+        bool test = strcmp(argv[i], "--alloc-test") == 0;
+        if (!trace && !test)
+            continue;
+        options.enabled = true;
+        options.test = options.test || test;
+        // The value is optional
+        if (i + 1 >= argc || strncmp(argv[i + 1], "--", 2) == 0)
+            continue;
+        char* end = nullptr;
+        long value = strtol(argv[i + 1], &end, 10);
+        if (end == argv[i + 1] || *end != '\0' || value < 0)
+        {
+            std::cerr << "Bad value for " << argv[i] << ": " << argv[i + 1] << std::endl;
+            return false;
+        }
+        i++;
+        if (trace)
+            options.sampleEvery = (int)value;
+        else
+            options.warmupFrames = (int)value;
+    }
+    return true;
+}
+
+static ALLOC_TRACE_NOINLINE void captureSample(size_t size)
+{
+    StackSample& sample = samples[sampleCount.fetch_add(1, std::memory_order_relaxed) % MAX_SAMPLES];
+#ifdef _WIN32
+    sample.depth = CaptureStackBackTrace(STACK_SKIP, STACK_DEPTH, sample.frames, nullptr);
+#else
+    void* frames[STACK_SKIP + STACK_DEPTH];
+    int depth = backtrace(frames, STACK_SKIP + STACK_DEPTH);
+    sample.depth = std::max(0, depth - STACK_SKIP);
+    memcpy(sample.frames, frames + STACK_SKIP, sample.depth * sizeof(void*));
+#endif
+    sample.bytes = size;
+}
+
+static ALLOC_TRACE_NOINLINE void recordAllocation(size_t size)
+{
+    if (!tracing.load(std::memory_order_relaxed) || inHook)
+        return;
+    inHook = true;
+    Counter& counter = frameThread ? frameCounts : backgroundCounts;
+    counter.allocations.fetch_add(1, std::memory_order_relaxed);
+    counter.bytes.fetch_add(size, std::memory_order_relaxed);
+    int every = sampleEvery.load(std::memory_order_relaxed);
+    if (frameThread && every > 0 && sampling.load(std::memory_order_relaxed) &&
+        sampleClock.fetch_add(1, std::memory_order_relaxed) % every == 0)
+        captureSample(size);
+    inHook = false;
+}
+
+void startAllocTrace(const AllocTraceOptions& options)
+{
+    traceOptions = options;
+    loggedFrames = allocatingFrames = 0;
+    worstFrame = -1;
+    loggedTotal = worstCounts = AllocCounts();
+    frameCounts.allocations = frameCounts.bytes = 0;
+    backgroundCounts.allocations = backgroundCounts.bytes = 0;
+    sampleClock = 0;
+    sampleCount = 0;
+#ifndef _WIN32
+    // The first backtrace loads the unwinder; better here than inside the first sample
+    void* frame;
+    backtrace(&frame, 1);
+#endif
+    markFrameThread();
+    sampleEvery = options.sampleEvery;
+    sampling = options.warmupFrames == 0;
+    tracing = true;
+}
+
+void stopAllocTrace()
+{
+    tracing = false;
+    sampling = false;
+}
+
+void markFrameThread()
+{
+    frameThread = true;
+}
+
+void endAllocFrame(int frameIndex)
+{
+    if (!tracing)
+        return;
+    AllocCounts counts;
+    counts.allocations = frameCounts.allocations.exchange(0, std::memory_order_relaxed);
+    counts.bytes = frameCounts.bytes.exchange(0, std::memory_order_relaxed);
+    if (frameIndex + 1 >= traceOptions.warmupFrames)
+        sampling = true;
+    if (frameIndex < traceOptions.warmupFrames)
+        return;
+    loggedFrames++;
+    loggedTotal.allocations += counts.allocations;
+    loggedTotal.bytes += counts.bytes;
+    if (counts.allocations == 0)
+        return;
+    allocatingFrames++;
+    if (counts.allocations > worstCounts.allocations)
+    {
+        worstCounts = counts;
+        worstFrame = frameIndex;
+    }
+}
+
+static void printFrames(std::ostream& out, void* const* frames, int depth)
+{
+#ifdef _WIN32
+    HANDLE process = GetCurrentProcess();
+    static bool symbols = SymInitialize(process, nullptr, TRUE) != FALSE;
+    alignas(SYMBOL_INFO) char buffer[sizeof(SYMBOL_INFO) + 256];
+    SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(buffer);
+    for (int i = 0; i < depth; i++)
+    {
+        DWORD64 address = (DWORD64)frames[i];
+        symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+        symbol->MaxNameLen = 255;
+        DWORD64 displacement = 0;
+        out << "      " << (symbols && SymFromAddr(process, address, &displacement, symbol) ? symbol->Name : "?");
+        IMAGEHLP_LINE64 line = {};
+        line.SizeOfStruct = sizeof(line);
+        DWORD lineDisplacement = 0;
+        if (symbols && SymGetLineFromAddr64(process, address, &lineDisplacement, &line))
+            out << " (" << line.FileName << ":" << line.LineNumber << ")";
+        out << std::endl;
+    }
+#else
+    char** names = backtrace_symbols(frames, depth);
+    for (int i = 0; i < depth; i++)
+        out << "      " << (names ? names[i] : "?") << std::endl;
+    free(names);
+#endif
+}
+
+bool printAllocReport(std::ostream& out)
+{
+    out << "Allocations: " << loggedFrames << " frames after " << traceOptions.warmupFrames << " warmup, "
+        << allocatingFrames << " of them allocated, " << loggedTotal.allocations << " times (" << loggedTotal.bytes << " bytes)";
+    if (worstFrame >= 0)
+        out << "; most in frame " << worstFrame << ": " << worstCounts.allocations << " (" << worstCounts.bytes << " bytes)";
+    out << std::endl;
+    out << "  Streaming threads: " << backgroundCounts.allocations << " allocations (" << backgroundCounts.bytes
+        << " bytes) over the whole run" << std::endl;
+
+    // The same stack sampled again and again is the call site worth fixing first
+    struct Site
+    {
+        uint64_t samples = 0;
+        uint64_t bytes = 0;
+    };
+    std::map<std::vector<void*>, Site> sites;
+    uint32_t taken = std::min(sampleCount.load(), MAX_SAMPLES);
+    for (uint32_t i = 0; i < taken; i++)
+    {
+        Site& site = sites[std::vector<void*>(samples[i].frames, samples[i].frames + samples[i].depth)];
+        site.samples++;
+        site.bytes += samples[i].bytes;
+    }
+    std::vector<std::pair<Site, const std::vector<void*>*>> ranked;
+    for (const auto& entry : sites)
+        ranked.push_back({ entry.second, &entry.first });
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first.samples > b.first.samples; });
+    if (!ranked.empty())
+        out << "  Call stacks, one in " << traceOptions.sampleEvery << " frame allocations (" << taken << " sampled):" << std::endl;
+    for (size_t i = 0; i < ranked.size() && i < REPORT_STACKS; i++)
+    {
+        out << "    " << ranked[i].first.samples << " samples, " << ranked[i].first.bytes << " bytes" << std::endl;
+        printFrames(out, ranked[i].second->data(), (int)ranked[i].second->size());
+    }
+
+    if (!traceOptions.test)
+        return true;
+    bool passed = allocatingFrames == 0 && loggedFrames > 0;
+    out << "Allocation test " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+// ----- Global operator new and delete -----
+
+static void* alignedMalloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    // aligned_alloc wants a whole number of alignments
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+static void alignedFree(void* pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+// alignment 0: plain malloc, freed by the unaligned deletes. nullptr once the new handler gives up.
+static ALLOC_TRACE_NOINLINE void* allocate(size_t size, size_t alignment)
+{
+    recordAllocation(size);
+    if (size == 0)
+        size = 1;
+    while (true)
+    {
+        void* pointer = alignment ? alignedMalloc(size, alignment) : malloc(size);
+        if (pointer)
+            return pointer;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            return nullptr;
+        handler();
+    }
+}
+
+static void* allocateOrThrow(size_t size, size_t alignment)
+{
+    void* pointer = allocate(size, alignment);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+static void* allocateNoThrow(size_t size, size_t alignment) noexcept
+{
+    try
+    {
+        return allocate(size, alignment);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size) { return allocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return allocateOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocateNoThrow(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocateNoThrow(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateOrThrow(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateOrThrow(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateNoThrow(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateNoThrow(size, (size_t)alignment); }
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { alignedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { alignedFree(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { alignedFree(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { alignedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(pointer); }
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef ALLOC_TRACE_H
+#define ALLOC_TRACE_H
+
+#include <cstdint>
+#include <iostream>
+
+// Replaces the global operator new and delete with ones that can count. Until a run asks for it the
+// hook is one relaxed load per allocation. Allocations on the threads that make up a frame (the GL
+// thread and the job system's workers) are counted per frame, and every Nth of them keeps its call
+// stack; the streaming threads are counted apart, since they allocate by design. Only C++
+// allocations are seen, not what the driver or GLFW get from malloc.
+struct AllocTraceOptions
+{
+    bool enabled = false;
+    int sampleEvery = 16;   // Every Nth frame allocation keeps its call stack (0 = none)
+    bool test = false;      // Fail the run if a frame after the warmup allocates
+    int warmupFrames = 30;  // Frames that may still be filling pools and caches
+};
+
+// Parses --trace-allocs [N], --alloc-test [WARMUP]; --alloc-test implies --headless
+// Returns false on a malformed argument
+bool parseAllocTraceArgs(int argc, char** argv, AllocTraceOptions& options);
+
+struct AllocCounts
+{
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+// Starts counting; the calling thread is the GL thread and counts as a frame thread
+void startAllocTrace(const AllocTraceOptions& options);
+void stopAllocTrace();
+// The calling thread's allocations count as the frame's
+void markFrameThread();
+// GL thread, once a frame: files what the frame threads allocated since the last call
+void endAllocFrame(int frameIndex);
+// Per-frame totals and the call stacks sampled most often. False when testing and a frame after
+// the warmup allocated.
+bool printAllocReport(std::ostream& out);
+
+#endif // ALLOC_TRACE_H
@@ -0,0 +1,284 @@
+#include "asset_pack.h"
+#include "compressed_texture.h"
+#include "system_description.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <unordered_set>
+
+AssetPack assetPack;
+
+bool parseAssetPackArgs(int argc, char** argv, AssetPackOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--pack-assets") == 0)
+        {
+            options.build = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+                options.list = argv[++i];
+        }
+        else if (strcmp(argv[i], "--asset-pack") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "--asset-pack needs a file name" << std::endl;
+                return false;
+            }
+            options.pack = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-asset-pack") == 0)
+            options.mount = false;
+    }
+    return true;
+}
+
+std::string normalizeAssetPath(const std::string& path)
+{
+    std::string normalized = path;
+    for (char& c : normalized)
+        if (c == '\\')
+            c = '/';
+    // Everything is opened relative to the project folder, so the leading "../" carries no information
+    size_t start = 0;
+    while (true)
+    {
+        if (normalized.compare(start, 3, "../") == 0)
+            start += 3;
+        else if (normalized.compare(start, 2, "./") == 0)
+            start += 2;
+        else
+            break;
+    }
+    return normalized.substr(start);
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t hashAssetPath(const std::string& normalizedPath)
+{
+    uint64_t hash = hashBytes(normalizedPath.data(), normalizedPath.size());
+    return hash ? hash : 1;   // Zero marks an empty slot
+}
+
+// ----- Runtime -----
+
+AssetPack::~AssetPack()
+{
+    unmount();
+}
+
+bool AssetPack::mount(const std::string& path)
+{
+    unmount();
+    // The whole pack is read at startup anyway, so ask for it up front
+    if (!file.open(path, true))
+        return false;
+    const unsigned char* base = file.data();
+    size_t size = file.size();
+
+    // Validate everything find() relies on once, so lookups can trust the table
+    header = reinterpret_cast<const AssetPackHeader*>(base);
+    bool valid = size >= sizeof(AssetPackHeader) && memcmp(header->magic, "APAK", 4) == 0 &&
+        header->version == PACK_VERSION && header->slotCount != 0 &&
+        (header->slotCount & (header->slotCount - 1)) == 0 &&
+        header->indexOffset % alignof(AssetPackEntry) == 0 &&
+        header->indexOffset + (uint64_t)header->slotCount * sizeof(AssetPackEntry) <= size &&
+        header->namesOffset <= size;
+    if (valid)
+    {
+        entries = reinterpret_cast<const AssetPackEntry*>(base + header->indexOffset);
+        for (uint32_t i = 0; i < header->slotCount && valid; i++)
+        {
+            const AssetPackEntry& entry = entries[i];
+            valid = entry.offset + entry.size <= size &&
+                header->namesOffset + entry.nameOffset + entry.nameLength <= size;
+        }
+    }
+    if (!valid)
+    {
+        std::cerr << "Not a valid asset pack: " << path << std::endl;
+        unmount();
+        return false;
+    }
+    std::cout << "Mounted asset pack " << path << ": " << header->entryCount << " files, "
+        << size / (1024 * 1024) << " MB" << std::endl;
+    return true;
+}
+
+void AssetPack::unmount()
+{
+    file.close();
+    header = nullptr;
+    entries = nullptr;
+}
+
+bool AssetPack::find(const std::string& path, AssetSpan& span) const
+{
+    if (!file.isOpen())
+        return false;
+    const unsigned char* base = file.data();
+    std::string name = normalizeAssetPath(path);
+    uint64_t hash = hashAssetPath(name);
+    uint32_t mask = header->slotCount - 1;
+    const char* names = reinterpret_cast<const char*>(base + header->namesOffset);
+    for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask)
+    {
+        const AssetPackEntry& entry = entries[i];
+        if (entry.hash == 0)
+            return false;
+        if (entry.hash == hash && entry.nameLength == name.size() &&
+            memcmp(names + entry.nameOffset, name.data(), name.size()) == 0)
+        {
+            span.data = base + entry.offset;
+            span.size = (size_t)entry.size;
+            return true;
+        }
+    }
+}
+
+bool loadAsset(const std::string& path, AssetSpan& span, std::vector<unsigned char>& storage)
+{
+    if (assetPack.find(path, span))
+        return true;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    storage.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(storage.data()), storage.size());
+    if (!file)
+        return false;
+    span.data = storage.data();
+    span.size = storage.size();
+    return true;
+}
+
+// ----- Packer -----
+
+static bool fileExists(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return (bool)file;
+}
+
+int buildAssetPack(const AssetPackOptions& options)
+{
+    std::ifstream list(options.list);
+    if (!list)
+    {
+        std::cerr << "Failed to open asset list: " << options.list << std::endl;
+        return -1;
+    }
+
+    // Keep the list order: it is the order the program loads things in
+    std::vector<std::string> paths;
+    std::unordered_set<std::string> seen;
+    std::string line;
+    while (std::getline(list, line))
+    {
+        std::istringstream fields(line);
+        std::string path;
+        if (!(fields >> path) || path[0] == '#')
+            continue;
+        // The loaders never open a source image that has a compiled container, so leave it out; the
+        // same goes for a system description (system_description.h)
+        std::vector<std::string> candidates;
+        std::string compiled = compressedTexturePath(path);
+        if (fileExists(compiledSystemPath(path)))
+            compiled = compiledSystemPath(path);
+        candidates.push_back(fileExists(compiled) ? compiled : path);
+        if (fileExists(path + ".vtex"))
+            candidates.push_back(path + ".vtex");
+        for (const std::string& candidate : candidates)
+        {
+            if (seen.insert(normalizeAssetPath(candidate)).second)
+                paths.push_back(candidate);
+        }
+    }
+
+    std::ofstream out(options.pack, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << options.pack << " for writing" << std::endl;
+        return -1;
+    }
+    AssetPackHeader header;
+    memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<AssetPackEntry> packed;
+    std::string names;
+    uint64_t offset = sizeof(header);
+    int failed = 0;
+    for (const std::string& path : paths)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "Missing asset: " << path << std::endl;
+            failed++;
+            continue;
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        uint64_t padding = (PACK_ALIGNMENT - offset % PACK_ALIGNMENT) % PACK_ALIGNMENT;
+        out.write(std::string((size_t)padding, '\0').data(), padding);
+        offset += padding;
+
+        std::string name = normalizeAssetPath(path);
+        AssetPackEntry entry = { hashAssetPath(name), offset, data.size(), (uint32_t)names.size(), (uint32_t)name.size() };
+        packed.push_back(entry);
+        names += name;
+        out.write(data.data(), data.size());
+        offset += data.size();
+    }
+
+    // At most half full keeps probe chains short
+    uint32_t slotCount = 1;
+    while (slotCount < packed.size() * 2)
+        slotCount <<= 1;
+    std::vector<AssetPackEntry> table(slotCount);
+    memset(table.data(), 0, table.size() * sizeof(AssetPackEntry));
+    for (const AssetPackEntry& entry : packed)
+    {
+        uint32_t i = (uint32_t)entry.hash & (slotCount - 1);
+        while (table[i].hash != 0)
+            i = (i + 1) & (slotCount - 1);
+        table[i] = entry;
+    }
+
+    uint64_t padding = (PACK_ALIGNMENT - offset % PACK_ALIGNMENT) % PACK_ALIGNMENT;
+    out.write(std::string((size_t)padding, '\0').data(), padding);
+    offset += padding;
+    memcpy(header.magic, "APAK", 4);
+    header.version = PACK_VERSION;
+    header.entryCount = (uint32_t)packed.size();
+    header.slotCount = slotCount;
+    header.indexOffset = offset;
+    header.namesOffset = offset + table.size() * sizeof(AssetPackEntry);
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(AssetPackEntry));
+    out.write(names.data(), names.size());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!out)
+    {
+        std::cerr << "Failed to write " << options.pack << std::endl;
+        return -1;
+    }
+
+    std::cout << "Packed " << packed.size() << " files (" << header.namesOffset / 1024 << " KB) into " << options.pack;
+    if (failed)
+        std::cout << ", " << failed << " missing";
+    std::cout << std::endl;
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "utils.h"
+#include "mapped_file.h"
+#include <cstdint>
+
+// Single-file archive of the textures, compiled containers and shaders. The runtime maps it into
+// memory once and the loaders read straight out of the mapping, so a cold start is one sequential
+// read instead of an open/stat/read per loose file.
+const uint32_t PACK_VERSION = 1;
+const uint32_t PACK_ALIGNMENT = 16;     // Entry data offsets, so block data can be used in place
+
+struct AssetPackHeader
+{
+    char magic[4];          // "APAK"
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t slotCount;     // Hash table size, a power of two
+    uint64_t indexOffset;   // AssetPackEntry[slotCount]
+    uint64_t namesOffset;   // Normalized paths the entries point into
+};
+
+// Slot of an open-addressed table keyed by the FNV-1a hash of the normalized path.
+// Empty slots are all zero; data is stored in list order so a cold read walks the file once.
+struct AssetPackEntry
+{
+    uint64_t hash;
+    uint64_t offset;        // From the start of the file
+    uint64_t size;
+    uint32_t nameOffset;    // From namesOffset
+    uint32_t nameLength;
+};
+
+// Bytes of one asset: inside the mapped pack, or in storage the caller owns for loose files
+struct AssetSpan
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+struct AssetPackOptions
+{
+    bool build = false;
+    bool mount = true;
+    std::string list = "../assets.txt";
+    std::string pack = "../assets.pak";
+};
+
+// Parses --pack-assets [LIST], --asset-pack FILE and --no-asset-pack
+bool parseAssetPackArgs(int argc, char** argv, AssetPackOptions& options);
+
+// Packs every file in the list (one path per line, as the program opens it; '#' starts a comment).
+// A compiled ".ctex" replaces its source image and a ".vtex" goes in next to it. Returns the process exit code.
+int buildAssetPack(const AssetPackOptions& options);
+
+class AssetPack
+{
+public:
+    ~AssetPack();
+
+    // Quietly returns false when there is no pack, so loose files keep working
+    bool mount(const std::string& path);
+    void unmount();
+    bool mounted() const { return file.isOpen(); }
+
+    // Safe from any thread: the mapping is read-only while mounted
+    bool find(const std::string& path, AssetSpan& span) const;
+
+private:
+    MappedFile file;
+    const AssetPackHeader* header = nullptr;
+    const AssetPackEntry* entries = nullptr;
+};
+
+extern AssetPack assetPack;
+
+// "../textures/a.jpg", "..\\textures\\a.jpg" and "textures/a.jpg" all name the same entry
+std::string normalizeAssetPath(const std::string& path);
+uint64_t hashAssetPath(const std::string& normalizedPath);
+// FNV-1a; pass a previous result as hash to continue over several buffers
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// The mounted pack first, then the loose file read into storage. False if neither has it.
+bool loadAsset(const std::string& path, AssetSpan& span, std::vector<unsigned char>& storage);
+
+#endif // ASSET_PACK_H
@@ -3,39 +3,32 @@
 layout(location = 0) in vec3 aPos;            // Vertex position
 layout(location = 1) in vec3 aNormal;         // Vertex normal
 layout(location = 2) in vec2 aTexCoords;      // Texture coordinates
-layout(location = 3) in mat4 instanceMatrix;  // Instance-specific model matrix
+layout(location = 3) in vec4 instanceOrbit;    // a, e, inclination, node
+layout(location = 4) in vec4 instancePhase;    // Periapsis, mean anomaly, mean motion, w uniform scale
+layout(location = 5) in vec4 instanceRotation; // Quaternion xyz at time 0, w = spin
 
 out vec2 TexCoords;                           // Pass to fragment shader
 out vec3 FragPos;                             // Pass to fragment shader
 out vec3 Normal;                              // Pass to fragment shader
+flat out float Fade;                          // Below 1 while cross-fading into the impostor
 
-uniform mat4 view;                            // View matrix
-uniform mat4 projection;                      // Projection matrix
-uniform float asteroidRotationAngle;          // Rotation angle for the belt
+#include "asteroid_instance.glsl"             // View and projection matrices, orbits
 
 void main() {
-    // Compute rotation matrix around the Y-axis
-    mat4 rotation = mat4(
-        cos(asteroidRotationAngle), 0.0, sin(asteroidRotationAngle), 0.0,
-        0.0,                        1.0, 0.0,                        0.0,
-       -sin(asteroidRotationAngle), 0.0, cos(asteroidRotationAngle), 0.0,
-        0.0,                        0.0, 0.0,                        1.0
-    );
-
-    // Combine rotation with instance matrix
-    mat4 model = rotation * instanceMatrix;
-
     // Compute world position
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    vec3 center = orbitPosition(instanceOrbit, instancePhase);
+    vec4 rotation = spinRotation(instanceRotation);
+    vec4 worldPos = vec4(rotate(rotation, aPos) * instancePhase.w + center, 1.0);
     FragPos = vec3(worldPos);
 
-    // Compute transformed normal
-    mat3 normalMatrix = mat3(transpose(inverse(model)));
-    Normal = normalize(normalMatrix * aNormal);
+    // Rotations and a uniform scale only, so the normal just rotates with the model
+    Normal = rotate(rotation, aNormal);
 
     // Pass texture coordinates
     TexCoords = aTexCoords;
 
+    Fade = meshFade(projectedSize(center, instancePhase.w));
+
     // Compute final vertex position
     gl_Position = projection * view * worldPos;
 }
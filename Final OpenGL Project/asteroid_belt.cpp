@@ -0,0 +1,645 @@
+#include "asteroid_belt.h"
+#include "benchmark.h"
+#include "bvh.h"
+#include "frame_arena.h"
+#include "shader_m.h"
+#include "shader_variants.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <unordered_map>
+
+// Not part of the GL 3.3 core headers
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_QUERY_BUFFER
+#define GL_QUERY_BUFFER 0x9192
+#endif
+
+typedef void (APIENTRY* MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+// GL 4.3, or the ARB extensions; baseInstance has to be honoured for the instance attributes
+static MultiDrawElementsIndirectProc loadMultiDrawIndirect()
+{
+    bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3) ||
+        (glfwExtensionSupported("GL_ARB_multi_draw_indirect") && glfwExtensionSupported("GL_ARB_base_instance"));
+    if (!supported)
+        return nullptr;
+    return (MultiDrawElementsIndirectProc)glfwGetProcAddress("glMultiDrawElementsIndirect");
+}
+
+static MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+
+// ----- Rock generator -----
+
+static float latticeValue(int x, int y, int z, unsigned seed)
+{
+    unsigned h = (unsigned)x * 73856093u ^ (unsigned)y * 19349663u ^ (unsigned)z * 83492791u ^ seed * 2654435761u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return (float)(h & 0xFFFFFF) / (float)0xFFFFFF * 2.0f - 1.0f;
+}
+
+static float valueNoise(const glm::vec3& p, unsigned seed)
+{
+    glm::vec3 cell = glm::floor(p);
+    glm::vec3 f = p - cell;
+    glm::vec3 w = f * f * (3.0f - 2.0f * f);
+    int x = (int)cell.x, y = (int)cell.y, z = (int)cell.z;
+    float result = 0.0f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+        float weight = (dx ? w.x : 1.0f - w.x) * (dy ? w.y : 1.0f - w.y) * (dz ? w.z : 1.0f - w.z);
+        result += weight * latticeValue(x + dx, y + dy, z + dz, seed);
+    }
+    return result;
+}
+
+// Radius multiplier of a shape in one direction: lumpy fBm on top of a squashed ellipsoid
+static float rockSurface(const glm::vec3& direction, const glm::vec3& stretch, unsigned seed)
+{
+    float noise = 0.0f, amplitude = 0.5f;
+    glm::vec3 p = direction * 1.7f;
+    for (int octave = 0; octave < 4; octave++)
+    {
+        noise += amplitude * valueNoise(p, seed + octave);
+        p *= 2.1f;
+        amplitude *= 0.5f;
+    }
+    return glm::length(direction * stretch) * (1.0f + 0.35f * noise);
+}
+
+static void buildIcosphere(int subdivisions, std::vector<glm::vec3>& points, std::vector<GLuint>& triangles)
+{
+    const float t = (1.0f + sqrt(5.0f)) / 2.0f;
+    points = { { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 }, { 0, -1, t }, { 0, 1, t },
+        { 0, -1, -t }, { 0, 1, -t }, { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 } };
+    for (glm::vec3& point : points)
+        point = glm::normalize(point);
+    // Counter-clockwise seen from outside, like the sphere
+    triangles = { 0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1 };
+
+    for (int level = 0; level < subdivisions; level++)
+    {
+        std::unordered_map<uint64_t, GLuint> midpoints;
+        auto midpoint = [&](GLuint a, GLuint b) {
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            auto found = midpoints.find(key);
+            if (found != midpoints.end())
+                return found->second;
+            points.push_back(glm::normalize(points[a] + points[b]));
+            GLuint index = (GLuint)points.size() - 1;
+            midpoints[key] = index;
+            return index;
+        };
+        std::vector<GLuint> finer;
+        finer.reserve(triangles.size() * 4);
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            GLuint a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+            GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            finer.insert(finer.end(), { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca });
+        }
+        triangles.swap(finer);
+    }
+}
+
+void generateRockMeshes(int shapeCount, float radius, unsigned seed,
+    std::vector<RockVertex>& vertices, std::vector<GLuint>& indices, std::vector<RockMesh>& meshes)
+{
+    vertices.clear();
+    indices.clear();
+    meshes.clear();
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> stretchRange(0.75f, 1.25f);
+    for (int shape = 0; shape < shapeCount; shape++)
+    {
+        glm::vec3 stretch(stretchRange(random), stretchRange(random), stretchRange(random));
+        unsigned shapeSeed = random();
+        for (int lod = 0; lod < ROCK_LODS; lod++)
+        {
+            std::vector<glm::vec3> directions;
+            std::vector<GLuint> triangles;
+            buildIcosphere(ROCK_LODS - 1 - lod, directions, triangles);
+
+            std::vector<RockVertex> mesh(directions.size());
+            for (size_t i = 0; i < directions.size(); i++)
+            {
+                glm::vec3 d = directions[i];
+                mesh[i].position = d * radius * rockSurface(d, stretch, shapeSeed);
+                mesh[i].normal = glm::vec3(0.0f);
+                mesh[i].texCoords = glm::vec2(atan2(d.z, d.x) / (2.0f * (float)M_PI) + 0.5f, acos(glm::clamp(d.y, -1.0f, 1.0f)) / (float)M_PI);
+            }
+            // Area-weighted face normals, so the lumps shade as lumps
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                RockVertex& a = mesh[triangles[i]];
+                RockVertex& b = mesh[triangles[i + 1]];
+                RockVertex& c = mesh[triangles[i + 2]];
+                glm::vec3 normal = glm::cross(b.position - a.position, c.position - a.position);
+                a.normal += normal;
+                b.normal += normal;
+                c.normal += normal;
+            }
+            for (RockVertex& vertex : mesh)
+                vertex.normal = glm::normalize(vertex.normal);
+            // Triangles that straddle the texture seam get copies of their low-u vertices at u + 1
+            std::unordered_map<GLuint, GLuint> wrapped;
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                float minU = 1.0f, maxU = 0.0f;
+                for (int k = 0; k < 3; k++)
+                {
+                    minU = std::min(minU, mesh[triangles[i + k]].texCoords.x);
+                    maxU = std::max(maxU, mesh[triangles[i + k]].texCoords.x);
+                }
+                if (maxU - minU <= 0.5f)
+                    continue;
+                for (int k = 0; k < 3; k++)
+                {
+                    GLuint index = triangles[i + k];
+                    if (mesh[index].texCoords.x >= 0.5f)
+                        continue;
+                    auto found = wrapped.find(index);
+                    if (found == wrapped.end())
+                    {
+                        RockVertex copy = mesh[index];
+                        copy.texCoords.x += 1.0f;
+                        mesh.push_back(copy);
+                        found = wrapped.emplace(index, (GLuint)mesh.size() - 1).first;
+                    }
+                    triangles[i + k] = found->second;
+                }
+            }
+
+            RockMesh range = { (GLuint)indices.size(), (GLuint)triangles.size(), (GLint)vertices.size() };
+            meshes.push_back(range);
+            vertices.insert(vertices.end(), mesh.begin(), mesh.end());
+            indices.insert(indices.end(), triangles.begin(), triangles.end());
+        }
+    }
+}
+
+// ----- Belt -----
+
+// Direction of the view at uv in [-1, 1]^2 of the octahedral map (octahedralDecode in asteroid_impostor.vs)
+static glm::vec3 impostorDirection(glm::vec2 uv)
+{
+    glm::vec3 n(uv, 1.0f - fabs(uv.x) - fabs(uv.y));
+    if (n.z < 0.0f)
+    {
+        glm::vec2 folded = glm::vec2(1.0f - fabs(n.y), 1.0f - fabs(n.x));
+        n.x = n.x >= 0.0f ? folded.x : -folded.x;
+        n.y = n.y >= 0.0f ? folded.y : -folded.y;
+    }
+    return glm::normalize(n);
+}
+
+void AsteroidBelt::init(const AsteroidInstance* instances, size_t count, GLuint surfaceTexture, float radius)
+{
+    // Fastest a rock moves: n * a, a little more at periapsis
+    maxOrbitSpeed = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        maxOrbitSpeed = std::max(maxOrbitSpeed, instances[i].phase.z * instances[i].orbit.x * (1.0f + 2.0f * instances[i].orbit.y));
+
+    // Spread the shapes by a hash of the index (rand() belongs to the belt layout) and group the
+    // source by shape, so each shape is one contiguous range for the cull pass
+    std::vector<std::vector<AsteroidInstance>> byShape(ROCK_SHAPES);
+    for (size_t i = 0; i < count; i++)
+        byShape[((uint32_t)i * 2654435761u >> 16) % ROCK_SHAPES].push_back(instances[i]);
+    std::vector<AsteroidInstance> source;
+    shapeStart.clear();
+    for (const std::vector<AsteroidInstance>& shape : byShape)
+    {
+        shapeStart.push_back((GLuint)source.size());
+        source.insert(source.end(), shape.begin(), shape.end());
+    }
+    shapeStart.push_back((GLuint)source.size());
+    slotCapacity = 0;
+    create(source, surfaceTexture, radius);
+}
+
+void AsteroidBelt::initStreaming(int slotCount, int capacity, float orbitSpeed, GLuint surfaceTexture, float radius)
+{
+    maxOrbitSpeed = orbitSpeed;
+    // Slot k of shape s holds capacity / ROCK_SHAPES instances at (s * slotCount + k) * that; the
+    // unused ones have zero scale, which the cull drops like any rock under a pixel
+    slotCapacity = (capacity + ROCK_SHAPES - 1) / ROCK_SHAPES;
+    this->slotCount = slotCount;
+    shapeStart.clear();
+    for (int shape = 0; shape <= ROCK_SHAPES; shape++)
+        shapeStart.push_back((GLuint)(shape * slotCount * slotCapacity));
+    std::vector<AsteroidInstance> source(shapeStart.back());
+    memset(source.data(), 0, source.size() * sizeof(AsteroidInstance));
+    create(source, surfaceTexture, radius);
+}
+
+void AsteroidBelt::uploadChunk(int slot, const std::vector<AsteroidInstance>& instances)
+{
+    // Dealt round-robin over the shapes, so every shape's share fits its part of the slot
+    FrameVector<AsteroidInstance> part(slotCapacity);
+    glBindBuffer(GL_ARRAY_BUFFER, sourceBuffer);
+    for (int shape = 0; shape < ROCK_SHAPES; shape++)
+    {
+        memset(part.data(), 0, part.size() * sizeof(AsteroidInstance));
+        size_t used = 0;
+        for (size_t i = shape; i < instances.size() && used < part.size(); i += ROCK_SHAPES)
+            part[used++] = instances[i];
+        size_t offset = shapeStart[shape] + (size_t)slot * slotCapacity;
+        glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(AsteroidInstance), part.size() * sizeof(AsteroidInstance), part.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void AsteroidBelt::create(const std::vector<AsteroidInstance>& source, GLuint surfaceTexture, float radius)
+{
+    multiDrawElementsIndirect = loadMultiDrawIndirect();
+    gpuCounts = multiDrawElementsIndirect && (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) ||
+        glfwExtensionSupported("GL_ARB_query_buffer_object"));
+    // The counts are ready on the GPU in the same frame, so one set is enough
+    setCount = gpuCounts ? 1 : CULL_SETS;
+    frame = 0;
+    rockRadius = radius;
+    // A fixed seed: the rocks are part of the scene and goldens must not change between runs
+    std::vector<RockVertex> vertices;
+    std::vector<GLuint> indices;
+    generateRockMeshes(ROCK_SHAPES, radius, 1234u, vertices, indices, meshes);
+    boundingRadius = 0.0f;
+    for (const RockVertex& vertex : vertices)
+        boundingRadius = std::max(boundingRadius, glm::length(vertex.position));
+
+    // The impostor quad shares the buffers; its corners are scaled and oriented in the shader
+    impostorQuad = { (GLuint)indices.size(), 6, (GLint)vertices.size() };
+    const glm::vec2 corners[4] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+    for (const glm::vec2& corner : corners)
+        vertices.push_back({ glm::vec3(corner, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), corner * 0.5f + 0.5f });
+    for (GLuint index : { 0, 1, 2, 0, 2, 3 })
+        indices.push_back(index);
+
+    glGenVertexArrays(1, &vao);
+    glGenVertexArrays(1, &cullVao);
+    glGenBuffers(1, &vertexBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glGenBuffers(1, &sourceBuffer);
+    glGenBuffers(setCount, outputBuffers);
+
+    glBindVertexArray(cullVao);
+    glBindBuffer(GL_ARRAY_BUFFER, sourceBuffer);
+    // Streamed slots are rewritten as chunks come and go
+    glBufferData(GL_ARRAY_BUFFER, source.size() * sizeof(AsteroidInstance), source.data(), slotCapacity ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    for (unsigned int i = 0; i < ASTEROID_INSTANCE_VEC4S; i++)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)(i * sizeof(glm::vec4)));
+    }
+    for (int set = 0; set < setCount; set++)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, outputBuffers[set]);
+        glBufferData(GL_ARRAY_BUFFER, ROCK_BUCKETS * source.size() * sizeof(AsteroidInstance), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(RockVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(RockVertex), (void*)offsetof(RockVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(RockVertex), (void*)offsetof(RockVertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(RockVertex), (void*)offsetof(RockVertex, texCoords));
+    glEnableVertexAttribArray(2);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    // Instance attributes: orbit at location 3, phase and scale at 4, rotation and spin at 5
+    glBindBuffer(GL_ARRAY_BUFFER, outputBuffers[0]);
+    for (unsigned int i = 0; i < ASTEROID_INSTANCE_VEC4S; i++)
+    {
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(3 + i, 1); // One per instance
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // One command per bucket and shape; the range each reads never moves, only the count changes
+    commands.clear();
+    for (int bucket = 0; bucket < ROCK_BUCKETS; bucket++)
+    {
+        for (int shape = 0; shape < ROCK_SHAPES; shape++)
+        {
+            const RockMesh& mesh = bucket < ROCK_LODS ? meshes[shape * ROCK_LODS + bucket] : impostorQuad;
+            GLuint baseInstance = (GLuint)(bucket * source.size()) + shapeStart[shape];
+            commands.push_back({ mesh.indexCount, 0, mesh.firstIndex, mesh.baseVertex, baseInstance });
+        }
+    }
+    for (int set = 0; set < setCount; set++)
+    {
+        queries[set].resize(commands.size());
+        glGenQueries((GLsizei)commands.size(), queries[set].data());
+    }
+    if (gpuCounts)
+    {
+        glGenBuffers(1, &indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // Both go through the binary cache and the parallel compile; the bake program is kept until
+    // release, since the bake may run before finishShaders has collected it
+    cullProgram = Shader("asteroid_cull.vs", "asteroid_cull.gs", GL_GEOMETRY_SHADER, { "ROCK_LODS " + std::to_string(ROCK_LODS) },
+        { "outOrbit", "outPhase", "outRotation" }).ID; // Interleaved like AsteroidInstance
+    bakeProgram = Shader("asteroid_impostor_bake.vs", "asteroid_impostor_bake.fs").ID;
+    bindFrameUniforms(cullProgram);
+
+    // The atlases are filled by bakeImpostors once the surface texture has streamed in
+    surface = surfaceTexture;
+    baked = false;
+    const int size = IMPOSTOR_GRID * IMPOSTOR_CELL;
+    GLuint* atlases[] = { &impostorAlbedo, &impostorNormalDepth };
+    for (GLuint* atlas : atlases)
+    {
+        glGenTextures(1, atlas);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, *atlas);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size, ROCK_SHAPES, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // Views stop at 8 pixels, before the mips blend neighbouring views together
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 2);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    std::cout << "Asteroid belt: " << ROCK_SHAPES << " rock shapes x " << ROCK_LODS << " LODs + impostors, GPU culled, "
+        << (gpuCounts ? "multi-draw indirect" : "instanced draw per group, one frame behind") << std::endl;
+}
+
+// Renders every shape from IMPOSTOR_GRID^2 directions into one layer per shape: albedo with
+// coverage in alpha, and the object-space normal with the depth from the eye. Orthographic, with
+// the bounding sphere filling each view, so the impostor shader can place every texel in 3D.
+void AsteroidBelt::bakeImpostors()
+{
+    const int size = IMPOSTOR_GRID * IMPOSTOR_CELL;
+
+    GLint previousFramebuffer, previousViewport[4];
+    GLfloat previousClear[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClear);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE), depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+    GLuint framebuffer, depth;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &depth);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    GLuint program = bakeProgram;
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "texture1"), 0);
+    GLint viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, surface);
+    glBindVertexArray(vao);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);    // Closed meshes; the depth test is enough
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    float r = boundingRadius;
+    glm::mat4 projection = glm::ortho(-r, r, -r, r, 0.0f, 2.0f * r);
+    for (int shape = 0; shape < ROCK_SHAPES; shape++)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, impostorAlbedo, 0, shape);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, impostorNormalDepth, 0, shape);
+        if (shape == 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Impostor bake framebuffer is not complete!" << std::endl;
+        glViewport(0, 0, size, size);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        const RockMesh& mesh = meshes[shape * ROCK_LODS]; // Finest LOD
+        for (int y = 0; y < IMPOSTOR_GRID; y++)
+        {
+            for (int x = 0; x < IMPOSTOR_GRID; x++)
+            {
+                glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / (float)IMPOSTOR_GRID * 2.0f - 1.0f;
+                glm::vec3 axis = impostorDirection(uv);
+                // The up hint never lines up with a view: no cell center sits on the octahedron's y corners
+                glm::mat4 view = glm::lookAt(axis * r, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                glm::mat4 viewProjection = projection * view;
+                glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+                glViewport(x * IMPOSTOR_CELL, y * IMPOSTOR_CELL, IMPOSTOR_CELL, IMPOSTOR_CELL);
+                glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+                    (void*)(mesh.firstIndex * sizeof(GLuint)), mesh.baseVertex);
+            }
+        }
+    }
+    for (GLuint atlas : { impostorAlbedo, impostorNormalDepth })
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glBindVertexArray(0);
+    glDeleteRenderbuffers(1, &depth);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glClearColor(previousClear[0], previousClear[1], previousClear[2], previousClear[3]);
+    if (cullFace)
+        glEnable(GL_CULL_FACE);
+    if (!depthTest)
+        glDisable(GL_DEPTH_TEST);
+    baked = true;
+}
+
+void AsteroidBelt::cull(const glm::mat4& projection, const glm::mat4& view, float time)
+{
+    // Planes of the view frustum in world space, normalized so the shader can compare distances
+    // against radii
+    glm::vec4 planes[6];
+    frustumPlanes(projection * view, planes);
+
+    // When the counts come back a frame late, the kept set has to cover where things will be next
+    // frame: grow every bound by last frame's camera movement and the farthest any rock moved along
+    // its orbit and, per unit of distance, by the camera's turn. Half again on top for uneven frame
+    // times.
+    glm::mat4 cameraToWorld = glm::inverse(view);
+    glm::vec3 cameraPos = glm::vec3(cameraToWorld[3]);
+    glm::vec3 forward = -glm::vec3(cameraToWorld[2]);
+    glm::vec2 margin(0.0f);
+    if (!gpuCounts && frame > 0)
+    {
+        float turn = acos(glm::clamp(glm::dot(forward, lastForward), -1.0f, 1.0f));
+        float orbitMove = fabs(time - orbitTime) * maxOrbitSpeed;
+        margin = 1.5f * glm::vec2(glm::length(cameraPos - lastCameraPos) + orbitMove, turn);
+    }
+    lastCameraPos = cameraPos;
+    lastForward = forward;
+    orbitTime = time;
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glUseProgram(cullProgram);
+    setInstanceUniforms(cullProgram);
+    glUniform4fv(glGetUniformLocation(cullProgram, "frustumPlanes"), 6, glm::value_ptr(planes[0]));
+    glUniform2fv(glGetUniformLocation(cullProgram, "cullMargin"), 1, glm::value_ptr(margin));
+    glUniform1f(glGetUniformLocation(cullProgram, "boundingRadius"), boundingRadius);
+    glUniform1f(glGetUniformLocation(cullProgram, "pixelScale"), projection[1][1] * viewport[3] * 0.5f);
+    glUniform1f(glGetUniformLocation(cullProgram, "minPixels"), 0.5f);
+    glUniform1fv(glGetUniformLocation(cullProgram, "lodSizes"), ROCK_LODS - 1, ROCK_LOD_SIZES);
+    GLint lodLocation = glGetUniformLocation(cullProgram, "lod");
+
+    int set = frame % setCount;
+    GLuint output = outputBuffers[set];
+    size_t sourceCount = shapeStart.back();
+    glBindVertexArray(cullVao);
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (int bucket = 0; bucket < ROCK_BUCKETS; bucket++)
+    {
+        glUniform1i(lodLocation, bucket);
+        for (int shape = 0; shape < ROCK_SHAPES; shape++)
+        {
+            GLuint first = shapeStart[shape], count = shapeStart[shape + 1] - first;
+            GLuint query = queries[set][bucket * ROCK_SHAPES + shape];
+            // Every shape and bucket has room for all of its instances, so nothing is ever dropped
+            if (count)
+                glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, output,
+                    (bucket * sourceCount + first) * sizeof(AsteroidInstance), count * sizeof(AsteroidInstance));
+            glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+            if (count)
+            {
+                glBeginTransformFeedback(GL_POINTS);
+                glDrawArrays(GL_POINTS, first, count);
+                glEndTransformFeedback();
+                drawCallCount++;
+            }
+            glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        }
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+
+    if (gpuCounts)
+    {
+        // Each result lands in its command's instanceCount without a round trip to the CPU
+        glBindBuffer(GL_QUERY_BUFFER, indirectBuffer);
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            size_t offset = i * sizeof(DrawElementsIndirectCommand) + offsetof(DrawElementsIndirectCommand, instanceCount);
+            glGetQueryObjectuiv(queries[set][i], GL_QUERY_RESULT, (GLuint*)offset);
+        }
+        glBindBuffer(GL_QUERY_BUFFER, 0);
+    }
+    frame++;
+}
+
+void AsteroidBelt::setInstanceUniforms(GLuint program)
+{
+    glUniform1f(glGetUniformLocation(program, "rockRadius"), rockRadius);
+    glUniform2fv(glGetUniformLocation(program, "impostorSizes"), 1, IMPOSTOR_SIZES);
+    glUniform1f(glGetUniformLocation(program, "orbitTime"), orbitTime);
+}
+
+void AsteroidBelt::drawCommands(size_t first, size_t count)
+{
+    glBindVertexArray(vao);
+    if (gpuCounts)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        drawCallCount++;
+    }
+    else
+    {
+        // Last frame's set, whose counts are finished by now; the very first frame waits for its own.
+        // Always the same set for the same frame, so fixed-step runs render identically.
+        int set = (frame >= 2 ? frame - 2 : 0) % setCount;
+        glBindBuffer(GL_ARRAY_BUFFER, outputBuffers[set]);
+        for (size_t i = first; i < first + count; i++)
+        {
+            GLuint visible = 0;
+            glGetQueryObjectuiv(queries[set][i], GL_QUERY_RESULT, &visible);
+            if (!visible)
+                continue;
+            const DrawElementsIndirectCommand& command = commands[i];
+            // GL 3.3 has no base instance, so the instance attributes are pointed at each range instead
+            size_t offset = command.baseInstance * sizeof(AsteroidInstance);
+            for (unsigned int attribute = 0; attribute < ASTEROID_INSTANCE_VEC4S; attribute++)
+                glVertexAttribPointer(3 + attribute, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance),
+                    (void*)(offset + attribute * sizeof(glm::vec4)));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                (void*)(command.firstIndex * sizeof(GLuint)), visible, command.baseVertex);
+            drawCallCount++;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glBindVertexArray(0);
+}
+
+void AsteroidBelt::draw(GLuint program)
+{
+    if (frame == 0)
+        return;
+    setInstanceUniforms(program);
+    drawCommands(0, ROCK_LODS * ROCK_SHAPES);
+}
+
+void AsteroidBelt::drawImpostors(GLuint program)
+{
+    if (frame == 0 || !baked)
+        return;
+    setInstanceUniforms(program);
+    glUniform1f(glGetUniformLocation(program, "boundingRadius"), boundingRadius);
+    glUniform1i(glGetUniformLocation(program, "impostorGrid"), IMPOSTOR_GRID);
+    glUniform1i(glGetUniformLocation(program, "impostorAlbedo"), 1);
+    glUniform1i(glGetUniformLocation(program, "impostorNormalDepth"), 2);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, impostorAlbedo);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, impostorNormalDepth);
+    glActiveTexture(GL_TEXTURE0);
+    // The layer is picked per shape; eight small draws instead of needing gl_DrawID
+    GLint layerLocation = glGetUniformLocation(program, "impostorLayer");
+    for (int shape = 0; shape < ROCK_SHAPES; shape++)
+    {
+        glUniform1f(layerLocation, (float)shape);
+        drawCommands(ROCK_LODS * ROCK_SHAPES + shape, 1);
+    }
+}
+
+void AsteroidBelt::release()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteVertexArrays(1, &cullVao);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &sourceBuffer);
+    glDeleteBuffers(setCount, outputBuffers);
+    for (int set = 0; set < setCount; set++)
+    {
+        glDeleteQueries((GLsizei)queries[set].size(), queries[set].data());
+        queries[set].clear();
+    }
+    if (indirectBuffer)
+        glDeleteBuffers(1, &indirectBuffer);
+    if (cullProgram)
+        glDeleteProgram(cullProgram);
+    if (bakeProgram)
+        glDeleteProgram(bakeProgram);
+    glDeleteTextures(1, &impostorAlbedo);
+    glDeleteTextures(1, &impostorNormalDepth);
+    vao = cullVao = vertexBuffer = indexBuffer = sourceBuffer = indirectBuffer = cullProgram = bakeProgram = 0;
+    impostorAlbedo = impostorNormalDepth = surface = 0;
+    baked = false;
+}
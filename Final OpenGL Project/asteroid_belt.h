@@ -0,0 +1,123 @@
+#pragma once
+#ifndef ASTEROID_BELT_H
+#define ASTEROID_BELT_H
+
+#include "utils.h"
+#include "celestial.h"
+
+// Procedural rocks for the asteroid belt: a few noise-displaced icospheres, each at several
+// levels of detail, packed into one vertex and one index buffer. Every frame a transform feedback
+// pass on the GPU culls the instances and sorts the survivors by shape and LOD, so the CPU cost
+// does not grow with the belt; the draw then reads straight from those buffers.
+const int ROCK_SHAPES = 8;
+const int ROCK_LODS = 3;                // Icosphere subdivisions 2, 1 and 0
+// Projected size (radius * scale / distance) above which each LOD is used; smaller gets the last
+const float ROCK_LOD_SIZES[ROCK_LODS - 1] = { 0.03f, 0.01f };
+// Below the first size a rock is only an impostor, above the second only a mesh; in between the
+// two are dithered into each other. 0.005 is about 6 pixels of radius at 1080p.
+const float IMPOSTOR_SIZES[2] = { 0.004f, 0.006f };
+const int IMPOSTOR_GRID = 8;            // Octahedral views per side of a shape's atlas layer
+const int IMPOSTOR_CELL = 32;           // Pixels per view
+const int ROCK_BUCKETS = ROCK_LODS + 1; // What the cull sorts into: the mesh LODs, then impostors
+
+struct RockVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoords;
+};
+
+// One shape at one LOD inside the shared buffers
+struct RockMesh
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLint baseVertex;
+};
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Fills meshes[shape * ROCK_LODS + lod]. Every LOD of a shape samples the same displacement,
+// so switching between them only changes how finely the rock is tessellated.
+void generateRockMeshes(int shapeCount, float radius, unsigned seed,
+    std::vector<RockVertex>& vertices, std::vector<GLuint>& indices, std::vector<RockMesh>& meshes);
+
+class AsteroidBelt
+{
+public:
+    // surfaceTexture is the rock surface; it may still be streaming in, so the impostors are
+    // baked from it later by bakeImpostors
+    void init(const AsteroidInstance* instances, size_t count, GLuint surfaceTexture, float radius = 0.7f);
+    void init(const std::vector<AsteroidInstance>& instances, GLuint surfaceTexture, float radius = 0.7f)
+    {
+        init(instances.data(), instances.size(), surfaceTexture, radius);
+    }
+    // Starts empty, with room for slotCount chunks of up to capacity rocks each (asteroid_field.h);
+    // orbitSpeed is the fastest any of them will move, in units per sim second
+    void initStreaming(int slotCount, int capacity, float orbitSpeed, GLuint surfaceTexture, float radius = 0.7f);
+    // Replaces a slot's rocks; an empty list clears it
+    void uploadChunk(int slot, const std::vector<AsteroidInstance>& instances);
+    // Culls against the view with the orbits at time (sim seconds) and writes the visible instances
+    // of each shape and bucket to their own range of the output buffer. Leaves the cull program
+    // bound; the draws use the same time.
+    void cull(const glm::mat4& projection, const glm::mat4& view, float time);
+    // Draw what the cull kept: the rock meshes with an asteroid.vs program, the far ones with an
+    // asteroid_impostor.vs program. Each needs its program bound.
+    void draw(GLuint program);
+    void drawImpostors(GLuint program);
+    // Renders the impostors from the surface texture; call once it is resident. Until then
+    // drawImpostors draws nothing.
+    void bakeImpostors();
+    bool impostorsBaked() const { return baked; }
+    void release();
+    // Radius of a sphere around the largest rock at scale 1, for bounds on the CPU
+    float rockBoundingRadius() const { return boundingRadius; }
+
+private:
+    // Without query buffers the counts are read back on the CPU, one frame late so that never stalls
+    static const int CULL_SETS = 2;
+
+    void create(const std::vector<AsteroidInstance>& source, GLuint surfaceTexture, float radius);
+    void setInstanceUniforms(GLuint program);
+    void drawCommands(size_t first, size_t count);
+
+    GLuint vao = 0;
+    GLuint cullVao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint sourceBuffer = 0;                    // All instances, grouped by shape
+    GLuint outputBuffers[CULL_SETS] = {};       // ROCK_BUCKETS copies of the source layout
+    GLuint indirectBuffer = 0;
+    GLuint cullProgram = 0;
+    GLuint bakeProgram = 0;
+    GLuint impostorAlbedo = 0;                  // Texture arrays, one layer per shape
+    GLuint impostorNormalDepth = 0;
+    GLuint surface = 0;                         // Not owned
+    bool baked = false;
+    bool gpuCounts = false;                     // Query results go straight into the indirect buffer
+    int setCount = 1;
+    unsigned int frame = 0;
+    float rockRadius = 0.7f;
+    float boundingRadius = 0.7f;
+    float maxOrbitSpeed = 0.0f;                 // Units per sim second
+    float orbitTime = 0.0f;                     // Of the last cull
+    int slotCount = 0;                          // Streaming only
+    int slotCapacity = 0;                       // Per shape; 0 for a fixed belt
+    std::vector<RockMesh> meshes;
+    RockMesh impostorQuad;
+    std::vector<GLuint> shapeStart;             // First source instance of each shape, plus the end
+    std::vector<GLuint> queries[CULL_SETS];     // GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN per command
+    std::vector<DrawElementsIndirectCommand> commands;  // bucket * ROCK_SHAPES + shape
+    glm::vec3 lastCameraPos = glm::vec3(0.0f);
+    glm::vec3 lastForward = glm::vec3(0.0f);
+};
+
+#endif // ASTEROID_BELT_H
@@ -0,0 +1,23 @@
+#version 330 core
+// Emits only the instances asteroid_cull.vs kept, so transform feedback packs them tightly
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+in vec4 cullOrbit[];
+in vec4 cullPhase[];
+in vec4 cullRotation[];
+flat in int cullKeep[];
+
+out vec4 outOrbit;
+out vec4 outPhase;
+out vec4 outRotation;
+
+void main() {
+    if (cullKeep[0] == 0)
+        return;
+    outOrbit = cullOrbit[0];
+    outPhase = cullPhase[0];
+    outRotation = cullRotation[0];
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,53 @@
+#version 330 core
+// Asteroid culling: one point per instance, run with the rasterizer off. Instances that are
+// inside the frustum, at least a pixel or so on screen and in this pass's LOD are kept;
+// asteroid_cull.gs writes them out through transform feedback. ROCK_LODS is defined by the
+// program; pass lod == ROCK_LODS collects the impostors.
+layout(location = 0) in vec4 instanceOrbit;     // AsteroidInstance, passed through untouched
+layout(location = 1) in vec4 instancePhase;     // w uniform scale
+layout(location = 2) in vec4 instanceRotation;
+
+out vec4 cullOrbit;
+out vec4 cullPhase;
+out vec4 cullRotation;
+flat out int cullKeep;
+
+#include "asteroid_instance.glsl"
+
+uniform vec4 frustumPlanes[6];                  // World space, normals pointing inwards
+uniform vec2 cullMargin;                        // Extra radius: constant + per unit of distance
+uniform float boundingRadius;                   // Largest rock at scale 1
+uniform float pixelScale;                       // Pixels on screen per unit of radius / distance
+uniform float minPixels;
+uniform float lodSizes[ROCK_LODS - 1];
+uniform int lod;
+
+// The fade bands are widened a little so a rock the draw fades in is never missing from the
+// buckets, whichever frame they were culled in
+const float FADE_SLACK = 0.1;
+
+void main() {
+    cullOrbit = instanceOrbit;
+    cullPhase = instancePhase;
+    cullRotation = instanceRotation;
+
+    vec3 center = orbitPosition(instanceOrbit, instancePhase);
+    float dist = max(distance(center, viewPos), 0.001);
+    float radius = boundingRadius * instancePhase.w + cullMargin.x + cullMargin.y * dist;
+    bool inside = true;
+    for (int i = 0; i < 6; i++)
+        inside = inside && dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w > -radius;
+
+    float size = projectedSize(center, instancePhase.w);
+    bool wanted;
+    if (lod == ROCK_LODS)
+        wanted = size < impostorSizes.y * (1.0 + FADE_SLACK);
+    else
+    {
+        int level = 0;
+        while (level < ROCK_LODS - 1 && size < lodSizes[level])
+            level++;
+        wanted = level == lod && size >= impostorSizes.x * (1.0 - FADE_SLACK);
+    }
+    cullKeep = inside && wanted && size * pixelScale >= minPixels ? 1 : 0;
+}
@@ -0,0 +1,357 @@
+#include "asteroid_field.h"
+#include "asteroid_belt.h"
+#include "counter_rng.h"
+#include "frame_arena.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <glm/gtc/constants.hpp>
+
+// Rocks in the densest chunk; sets the grid resolution for a given count
+static const double TARGET_CHUNK_ROCKS = 2048.0;
+// Finished chunks uploaded per frame while the camera moves, so a burst never stalls a frame
+static const int UPLOADS_PER_FRAME = 32;
+// Loaded chunks stay until they are this much further than the stream radius
+static const float KEEP_FACTOR = 1.25f;
+
+bool parseAsteroidFieldArgs(int argc, char** argv, AsteroidFieldOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--asteroid-field") == 0 || strcmp(arg, "--stream-radius") == 0 || strcmp(arg, "--resident-rocks") == 0)
+        {
+            if (!hasValue)
+            {
+                std::cerr << arg << " needs a value" << std::endl;
+                return false;
+            }
+            char* end = nullptr;
+            double value = strtod(argv[++i], &end);
+            switch (*end)
+            {
+            case 'k': case 'K': value *= 1e3; break;
+            case 'm': case 'M': value *= 1e6; break;
+            case 'g': case 'G': value *= 1e9; break;
+            default: break;
+            }
+            if (value <= 0.0)
+            {
+                std::cerr << "Bad value for " << arg << ": " << argv[i] << std::endl;
+                return false;
+            }
+            if (strcmp(arg, "--asteroid-field") == 0)
+                options.count = (long long)value;
+            else if (strcmp(arg, "--stream-radius") == 0)
+                options.streamRadius = (float)value;
+            else
+                options.residentRocks = (int)std::min(value, 1e9);
+        }
+    }
+    return true;
+}
+
+// ----- Generation -----
+
+void AsteroidField::generateChunk(int chunk, std::vector<AsteroidInstance>& instances) const
+{
+    int ring = chunk / sectors, sector = chunk % sectors;
+    // Philox stream (chunk, 0): a chunk needs nothing but its own id to be rebuilt exactly
+    CounterRandom random(seed, (uint32_t)chunk, 0);
+    // Rounded up or down by chance, so the field averages out to the requested count
+    size_t count = (size_t)std::min((double)capacity, floor(ringRocks[ring] + random.next()));
+    float ringWidth = (outerRadius - innerRadius) / rings;
+    float sectorAngle = glm::two_pi<float>() / sectors;
+
+    instances.resize(count);
+    for (AsteroidInstance& instance : instances)
+    {
+        // Uniform within the chunk; the ring's count already follows the belt's radial profile
+        float radius = innerRadius + (ring + random.next()) * ringWidth;
+        float longitude = (sector + random.next()) * sectorAngle;
+        float outlierChanceY = random.next();
+        float height = asteroidHeight(outlierChanceY, random.next(), shape.outlierProbability,
+            shape.yOutlierMultiplier, shape.yInlierMultiplier);
+        float halfX = random.next() * glm::pi<float>();
+        float halfY = random.next() * glm::pi<float>();
+        float halfZ = random.next() * glm::pi<float>();
+        float scaleChance = random.next();
+        float scale = asteroidScale(scaleChance, random.next());
+        float eccentricity = random.next() * ASTEROID_MAX_ECCENTRICITY;
+        float periapsis = random.next() * glm::two_pi<float>();
+        float meanAnomaly = random.next() * glm::two_pi<float>();
+        float spin = (random.next() * 2.0f - 1.0f) * ASTEROID_MAX_SPIN;
+        instance = asteroidOrbit(radius, height, longitude, eccentricity, periapsis, meanAnomaly, ringMotion[ring],
+            scale, asteroidRotation(halfX, halfY, halfZ), spin);
+    }
+}
+
+// ----- Streaming -----
+
+AsteroidField::~AsteroidField()
+{
+    stop();
+}
+
+void AsteroidField::start(const AsteroidFieldOptions& fieldOptions, const AsteroidBeltShape& beltShape, uint32_t fieldSeed,
+    AsteroidBelt& targetBelt, GLuint surfaceTexture)
+{
+    options = fieldOptions;
+    shape = beltShape;
+    seed = fieldSeed;
+    belt = &targetBelt;
+
+    // The radial profile of asteroids(), integrated over its two draws on a fine grid
+    const int samples = 512, bins = 1024;
+    innerRadius = FLT_MAX;
+    outerRadius = 0.0f;
+    for (int i = 0; i <= samples; i++)
+    {
+        for (float offset : { 0.0f, 1.0f })
+        {
+            float radius = asteroidRadius((float)i / samples, offset, shape.beltRadius, shape.beltWidth,
+                shape.outlierProbability, shape.closerMultiplier, shape.furtherMultiplier);
+            innerRadius = std::min(innerRadius, radius);
+            outerRadius = std::max(outerRadius, radius);
+        }
+    }
+    std::vector<double> profile(bins, 0.0);
+    for (int i = 0; i < samples; i++)
+    {
+        for (int j = 0; j < samples; j++)
+        {
+            float radius = asteroidRadius((i + 0.5f) / samples, (j + 0.5f) / samples, shape.beltRadius, shape.beltWidth,
+                shape.outlierProbability, shape.closerMultiplier, shape.furtherMultiplier);
+            int bin = std::min(bins - 1, (int)((radius - innerRadius) / (outerRadius - innerRadius) * bins));
+            profile[bin] += 1.0 / ((double)samples * samples);
+        }
+    }
+
+    // Square-ish chunks, sized so the densest holds about TARGET_CHUNK_ROCKS
+    double binWidth = (outerRadius - innerRadius) / bins, peakDensity = 0.0;
+    for (int bin = 0; bin < bins; bin++)
+    {
+        double radius = innerRadius + (bin + 0.5) * binWidth;
+        peakDensity = std::max(peakDensity, options.count * profile[bin] / (binWidth * glm::two_pi<double>() * radius));
+    }
+    double side = sqrt(TARGET_CHUNK_ROCKS / std::max(peakDensity, 1e-9));
+    double middle = 0.5 * (innerRadius + outerRadius);
+    sectors = (int)glm::clamp(ceil(glm::two_pi<double>() * middle / side), 16.0, 65536.0);
+    rings = (int)glm::clamp(ceil((outerRadius - innerRadius) / side), 1.0, 4096.0);
+    ringRocks.assign(rings, 0.0);
+    for (int bin = 0; bin < bins; bin++)
+        ringRocks[std::min(rings - 1, bin * rings / bins)] += options.count * profile[bin] / sectors;
+    // A chunk holds floor(expected + u) rocks, never more than the expected count rounded up
+    double densest = *std::max_element(ringRocks.begin(), ringRocks.end());
+    capacity = std::max(ROCK_SHAPES, ((int)ceil(densest) + ROCK_SHAPES - 1) / ROCK_SHAPES * ROCK_SHAPES);
+
+    // The highest a rock can sit: the largest offset with the largest multiplier
+    maxHeight = 0.0f;
+    for (int i = 0; i <= samples; i++)
+        for (float offset : { 0.0f, 1.0f })
+            maxHeight = std::max(maxHeight, fabs(asteroidHeight((float)i / samples, offset, shape.outlierProbability,
+                shape.yOutlierMultiplier, shape.yInlierMultiplier)));
+
+    // The inner rings turn fastest, but the outer edge of a ring moves further
+    ringMotion.assign(rings, 0.0f);
+    float maxOrbitSpeed = 0.0f;
+    for (int ring = 0; ring < rings; ring++)
+    {
+        float ringOuter = innerRadius + (ring + 1) * (outerRadius - innerRadius) / rings;
+        ringMotion[ring] = asteroidMeanMotion(innerRadius + (ring + 0.5f) * (outerRadius - innerRadius) / rings, shape.beltRadius);
+        maxOrbitSpeed = std::max(maxOrbitSpeed, ringMotion[ring] * ringOuter * (1.0f + 2.0f * ASTEROID_MAX_ECCENTRICITY));
+    }
+
+    int slotCount = std::max(1, options.residentRocks / capacity);
+    belt->initStreaming(slotCount, capacity, maxOrbitSpeed, surfaceTexture);
+    freeSlots.clear();
+    for (int slot = slotCount - 1; slot >= 0; slot--)
+        freeSlots.push_back(slot);
+    resident.clear();
+    pending.clear();
+
+    stopping = false;
+    int workerCount = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&AsteroidField::workerLoop, this);
+    std::cout << "Asteroid field: " << options.count << " rocks in " << sectors << " x " << rings << " chunks of up to "
+        << capacity << ", " << slotCount << " resident within " << options.streamRadius << std::endl;
+}
+
+void AsteroidField::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        requests.clear();
+        results.clear();
+    }
+    condition.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    resident.clear();
+    pending.clear();
+    freeSlots.clear();
+}
+
+void AsteroidField::workerLoop()
+{
+    while (true)
+    {
+        int chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping)
+                return;
+            chunk = requests.front();
+            requests.pop_front();
+        }
+        Result result = { chunk, {} };
+        generateChunk(chunk, result.instances);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+        }
+        finished.notify_one();
+    }
+}
+
+// How far an eccentric, inclined orbit takes a rock of the ring from its mean place: a * e across,
+// a little over 2 * a * e along
+float AsteroidField::orbitSlack(int ring) const
+{
+    float ringOuter = innerRadius + (ring + 1) * (outerRadius - innerRadius) / rings;
+    return 2.5f * ASTEROID_MAX_ECCENTRICITY * ringOuter;
+}
+
+// From the camera, in its ring's turning frame, to the chunk's bounding cylinder
+float AsteroidField::chunkDistance(int chunk, const glm::vec3& local) const
+{
+    int ring = chunk / sectors, sector = chunk % sectors;
+    float ringWidth = (outerRadius - innerRadius) / rings;
+    float sectorAngle = glm::two_pi<float>() / sectors;
+    float radius = innerRadius + (ring + 0.5f) * ringWidth, angle = (sector + 0.5f) * sectorAngle;
+    float halfDiagonal = 0.5f * glm::length(glm::vec2(ringWidth, (radius + 0.5f * ringWidth) * sectorAngle)) + orbitSlack(ring);
+    glm::vec2 center(radius * sin(angle), radius * cos(angle));
+    float across = std::max(0.0f, glm::length(glm::vec2(local.x, local.z) - center) - halfDiagonal);
+    float above = std::max(0.0f, fabs(local.y) - maxHeight);
+    return glm::length(glm::vec2(across, above));
+}
+
+void AsteroidField::update(const glm::vec3& cameraPos, double orbitTime, bool wait)
+{
+    if (!belt || workers.empty())
+        return;
+    float keepRadius = options.streamRadius * KEEP_FACTOR;
+
+    // Every chunk that may be in range, nearest first
+    FrameVector<std::pair<float, int>> candidates;
+    float ringWidth = (outerRadius - innerRadius) / rings;
+    float sectorAngle = glm::two_pi<float>() / sectors;
+    float cameraRadius = glm::length(glm::vec2(cameraPos.x, cameraPos.z));
+    for (int ring = 0; ring < rings; ring++)
+    {
+        float ringInner = innerRadius + ring * ringWidth, slack = orbitSlack(ring);
+        if (std::max(ringInner - cameraRadius, cameraRadius - ringInner - ringWidth) > keepRadius + slack)
+            continue;
+        // Each ring turns at its own rate, so look for its chunks from the camera's place in the
+        // ring's frame; the angle is reduced in double so long runs keep their precision
+        float turn = (float)fmod(ringMotion[ring] * orbitTime, glm::two_pi<double>());
+        float cameraAngle = atan2(cameraPos.x, cameraPos.z) - turn;
+        glm::vec3 local(cameraRadius * sin(cameraAngle), cameraPos.y, cameraRadius * cos(cameraAngle));
+        // Angle either side of the camera's in which the ring comes within reach of it
+        float radius = ringInner + 0.5f * ringWidth, reach = keepRadius + ringWidth + slack;
+        float cosine = cameraRadius > 1e-3f ?
+            (radius * radius + cameraRadius * cameraRadius - reach * reach) / (2.0f * radius * cameraRadius) : -1.0f;
+        float halfAngle = acos(glm::clamp(cosine, -1.0f, 1.0f)) + sectorAngle;
+        int first = (int)floor((cameraAngle - halfAngle) / sectorAngle);
+        int count = std::min(sectors, (int)ceil(2.0f * halfAngle / sectorAngle) + 1);
+        for (int i = 0; i < count; i++)
+        {
+            int sector = ((first + i) % sectors + sectors) % sectors;
+            int chunk = ring * sectors + sector;
+            float distance = chunkDistance(chunk, local);
+            if (distance <= keepRadius)
+                candidates.push_back({ distance, chunk });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    size_t slotCount = resident.size() + pending.size() + freeSlots.size();
+    if (candidates.size() > slotCount)
+        candidates.resize(slotCount);
+    FrameSet<int> keep(candidates.size());
+    for (const auto& candidate : candidates)
+        keep.insert(candidate.second);
+
+    // Out of range: free the slot. A chunk still being generated is dropped when it arrives.
+    for (auto it = resident.begin(); it != resident.end();)
+    {
+        if (keep.count(it->first))
+        {
+            ++it;
+            continue;
+        }
+        belt->uploadChunk(it->second, {});
+        freeSlots.push_back(it->second);
+        it = resident.erase(it);
+    }
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        if (keep.count(it->first))
+        {
+            ++it;
+            continue;
+        }
+        freeSlots.push_back(it->second);
+        it = pending.erase(it);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Requeue in distance order: the queue is what no worker has picked up yet
+        FrameSet<int> queued(requests.begin(), requests.end());
+        requests.clear();
+        for (const auto& candidate : candidates)
+        {
+            int chunk = candidate.second;
+            if (queued.count(chunk) && pending.count(chunk))
+                requests.push_back(chunk);
+            else if (candidate.first <= options.streamRadius && !resident.count(chunk) && !pending.count(chunk) && !freeSlots.empty())
+            {
+                pending[chunk] = freeSlots.back();
+                freeSlots.pop_back();
+                requests.push_back(chunk);
+            }
+        }
+    }
+    condition.notify_all();
+
+    int uploads = 0;
+    while (true)
+    {
+        Result result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (wait)
+            {
+                if (pending.empty())
+                    break;
+                finished.wait(lock, [this] { return !results.empty(); });
+            }
+            else if (results.empty() || uploads >= UPLOADS_PER_FRAME)
+                break;
+            result = std::move(results.front());
+            results.pop_front();
+        }
+        auto it = pending.find(result.chunk);
+        if (it == pending.end())
+            continue;   // Left behind before it was finished
+        belt->uploadChunk(it->second, result.instances);
+        resident[result.chunk] = it->second;
+        pending.erase(it);
+        uploads++;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef ASTEROID_FIELD_H
+#define ASTEROID_FIELD_H
+
+#include "utils.h"
+#include "celestial.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+class AsteroidBelt;
+
+// A belt far larger than memory: the annulus is cut into angular sectors and radial rings, and a
+// chunk's rocks are a pure function of the seed and the chunk id. Workers generate the chunks
+// around the camera, the GL thread uploads them into the belt's slots and drops the ones left
+// behind, so only the neighbourhood is ever resident. Every rock of a ring orbits at the mean
+// motion of the ring's middle, so a chunk stays together while the rings shear past each other.
+struct AsteroidFieldOptions
+{
+    long long count = 0;            // Rocks in the whole belt; 0 keeps the fixed belt
+    float streamRadius = 8.0f;      // Chunks closer than this are loaded
+    int residentRocks = 1 << 20;    // GPU budget, in rocks
+};
+
+// Parses --asteroid-field N[k|M|G], --stream-radius R, --resident-rocks N
+// Returns false on a malformed argument
+bool parseAsteroidFieldArgs(int argc, char** argv, AsteroidFieldOptions& options);
+
+class AsteroidField
+{
+public:
+    ~AsteroidField();
+
+    // Sizes the chunk grid and the belt's slots for options.count rocks, then starts the workers
+    void start(const AsteroidFieldOptions& options, const AsteroidBeltShape& shape, uint32_t seed,
+        AsteroidBelt& belt, GLuint surfaceTexture);
+    void stop();
+
+    // Called once per frame on the GL thread, with the time the belt is drawn at: evicts chunks that
+    // fell out of range, requests the nearest missing ones and uploads what the workers finished.
+    // wait blocks until every chunk in range is resident (fixed-step runs).
+    void update(const glm::vec3& cameraPos, double orbitTime, bool wait);
+
+    // Rocks of one chunk, generated from (seed, chunk) only
+    void generateChunk(int chunk, std::vector<AsteroidInstance>& instances) const;
+
+private:
+    struct Result
+    {
+        int chunk;
+        std::vector<AsteroidInstance> instances;
+    };
+
+    void workerLoop();
+    float chunkDistance(int chunk, const glm::vec3& local) const;
+    float orbitSlack(int ring) const;
+
+    AsteroidFieldOptions options;
+    AsteroidBeltShape shape = {};
+    uint32_t seed = 0;
+    AsteroidBelt* belt = nullptr;
+
+    // Grid: chunk = ring * sectors + sector
+    int sectors = 0;
+    int rings = 0;
+    float innerRadius = 0.0f;
+    float outerRadius = 0.0f;
+    float maxHeight = 0.0f;
+    std::vector<double> ringRocks;  // Expected rocks in one chunk of each ring
+    std::vector<float> ringMotion;  // Mean motion of each ring, rad per sim second
+    int capacity = 0;               // Most rocks a chunk may hold
+
+    // GL thread only
+    std::unordered_map<int, int> resident;      // Chunk -> slot
+    std::unordered_map<int, int> pending;       // Chunk -> slot it will go into
+    std::vector<int> freeSlots;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable finished;
+    std::deque<int> requests;
+    std::deque<Result> results;
+    bool stopping = false;
+};
+
+#endif // ASTEROID_FIELD_H
@@ -0,0 +1,306 @@
+#include "asteroid_generator.h"
+#include "counter_rng.h"
+#include "job_system.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <thread>
+#include <glm/gtc/constants.hpp>
+
+// Grain of the parallel belt: below this, splitting again costs more than it spreads
+static const size_t MIN_ROCKS_PER_JOB = 16384;
+// The benchmark generates into a reused block of this many rocks per thread
+static const size_t BENCH_BLOCK_ROCKS = 65536;
+
+// ----- Generation -----
+
+// Draws of one rock, in counter order
+enum AsteroidDraw
+{
+    DRAW_CHANCE_XZ, DRAW_OFFSET_XZ, DRAW_CHANCE_Y, DRAW_OFFSET_Y,
+    DRAW_LONGITUDE, DRAW_ROT_X, DRAW_ROT_Y, DRAW_ROT_Z,
+    DRAW_SCALE_CHANCE, DRAW_SIZE, DRAW_ECCENTRICITY, DRAW_PERIAPSIS,
+    DRAW_MEAN_ANOMALY, DRAW_SPIN, DRAW_UNUSED_0, DRAW_UNUSED_1,
+    DRAW_COUNT
+};
+static_assert(DRAW_COUNT == ASTEROID_RNG_BLOCKS * 4, "Four draws per Philox block");
+
+// Everything but the starting orientation, which both paths compute before calling this
+static AsteroidInstance rockOrbit(const float* draws, size_t stride, const AsteroidBeltShape& shape, glm::vec4 rotation)
+{
+    float radius = asteroidRadius(draws[DRAW_CHANCE_XZ * stride], draws[DRAW_OFFSET_XZ * stride], shape.beltRadius,
+        shape.beltWidth, shape.outlierProbability, shape.closerMultiplier, shape.furtherMultiplier);
+    float height = asteroidHeight(draws[DRAW_CHANCE_Y * stride], draws[DRAW_OFFSET_Y * stride],
+        shape.outlierProbability, shape.yOutlierMultiplier, shape.yInlierMultiplier);
+    float scale = asteroidScale(draws[DRAW_SCALE_CHANCE * stride], draws[DRAW_SIZE * stride]);
+    return asteroidOrbit(radius, height, draws[DRAW_LONGITUDE * stride] * glm::two_pi<float>(),
+        draws[DRAW_ECCENTRICITY * stride] * ASTEROID_MAX_ECCENTRICITY, draws[DRAW_PERIAPSIS * stride] * glm::two_pi<float>(),
+        draws[DRAW_MEAN_ANOMALY * stride] * glm::two_pi<float>(), asteroidMeanMotion(radius, shape.beltRadius), scale,
+        rotation, (draws[DRAW_SPIN * stride] * 2.0f - 1.0f) * ASTEROID_MAX_SPIN);
+}
+
+#ifdef SIMD_SSE2
+void generateAsteroids(uint32_t seed, const AsteroidBeltShape& shape, uint64_t first, size_t count,
+    AsteroidInstance* out)
+{
+    // Four rocks per pass, one per lane. The counters and the trig of the orientation run in SSE
+    // registers; the outlier branches and the elements per lane on plain floats.
+    for (size_t i = 0; i < count; i += 4)
+    {
+        alignas(16) uint32_t indexLow[4], indexHigh[4];
+        for (int lane = 0; lane < 4; lane++)
+        {
+            uint64_t rock = first + i + lane;
+            indexLow[lane] = (uint32_t)rock;
+            indexHigh[lane] = (uint32_t)(rock >> 32);
+        }
+        alignas(16) float draws[DRAW_COUNT][4];
+        for (int block = 0; block < ASTEROID_RNG_BLOCKS; block++)
+        {
+            __m128i counter[4] = { _mm_load_si128((const __m128i*)indexLow), _mm_load_si128((const __m128i*)indexHigh),
+                _mm_set1_epi32(block), _mm_set1_epi32((int)ASTEROID_RNG_STREAM) };
+            philox4x32x4(counter, seed, 0);
+            for (int word = 0; word < 4; word++)
+                _mm_store_ps(draws[block * 4 + word], uniformFloat4(counter[word]));
+        }
+
+        __m128 sx, cx, sy, cy, sz, cz;
+        __m128 pi = _mm_set1_ps(glm::pi<float>());
+        sinCos4(_mm_mul_ps(_mm_load_ps(draws[DRAW_ROT_X]), pi), sx, cx);
+        sinCos4(_mm_mul_ps(_mm_load_ps(draws[DRAW_ROT_Y]), pi), sy, cy);
+        sinCos4(_mm_mul_ps(_mm_load_ps(draws[DRAW_ROT_Z]), pi), sz, cz);
+
+        // X, then Y, then Z about the local axes: qx * qy * qz, as asteroidRotation()
+        __m128 aw = _mm_mul_ps(cx, cy), ax = _mm_mul_ps(sx, cy);
+        __m128 ay = _mm_mul_ps(cx, sy), az = _mm_mul_ps(sx, sy);
+        __m128 rotation[4] = {
+            _mm_add_ps(_mm_mul_ps(ax, cz), _mm_mul_ps(ay, sz)),
+            _mm_sub_ps(_mm_mul_ps(ay, cz), _mm_mul_ps(ax, sz)),
+            _mm_add_ps(_mm_mul_ps(aw, sz), _mm_mul_ps(az, cz)),
+            _mm_sub_ps(_mm_mul_ps(aw, cz), _mm_mul_ps(az, sz)) };
+        _MM_TRANSPOSE4_PS(rotation[0], rotation[1], rotation[2], rotation[3]);
+        int lanes = (int)std::min<size_t>(4, count - i);
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            alignas(16) float quaternion[4];
+            _mm_store_ps(quaternion, rotation[lane]);
+            out[i + lane] = rockOrbit(&draws[0][lane], 4, shape,
+                glm::vec4(quaternion[0], quaternion[1], quaternion[2], quaternion[3]));
+        }
+    }
+}
+#else
+void generateAsteroids(uint32_t seed, const AsteroidBeltShape& shape, uint64_t first, size_t count,
+    AsteroidInstance* out)
+{
+    // Same operations in the same order as the SSE2 path, so both give the same bits
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t rock = first + i;
+        float draws[DRAW_COUNT];
+        for (int block = 0; block < ASTEROID_RNG_BLOCKS; block++)
+        {
+            uint32_t counter[4] = { (uint32_t)rock, (uint32_t)(rock >> 32), (uint32_t)block, ASTEROID_RNG_STREAM };
+            philox4x32(counter, seed, 0);
+            for (int word = 0; word < 4; word++)
+                draws[block * 4 + word] = uniformFloat(counter[word]);
+        }
+
+        float sx, cx, sy, cy, sz, cz;
+        sinCos(draws[DRAW_ROT_X] * glm::pi<float>(), sx, cx);
+        sinCos(draws[DRAW_ROT_Y] * glm::pi<float>(), sy, cy);
+        sinCos(draws[DRAW_ROT_Z] * glm::pi<float>(), sz, cz);
+        float aw = cx * cy, ax = sx * cy, ay = cx * sy, az = sx * sy;
+        out[i] = rockOrbit(draws, 1, shape,
+            glm::vec4(ax * cz + ay * sz, ay * cz - ax * sz, aw * sz + az * cz, aw * cz - az * sz));
+    }
+}
+#endif
+
+std::vector<AsteroidInstance> asteroids(uint32_t seed, const AsteroidBeltShape& shape)
+{
+    size_t count = NUM_ASTEROIDS;
+    std::vector<AsteroidInstance> instances(count);
+    AsteroidInstance* out = instances.data();
+    jobSystem.wait(jobSystem.parallelFor(count, MIN_ROCKS_PER_JOB, [=](size_t first, size_t rocks)
+    {
+        generateAsteroids(seed, shape, first, rocks, out + first);
+    }));
+    return instances;
+}
+
+// ----- Benchmark -----
+
+bool parseAsteroidGenBenchArgs(int argc, char** argv, AsteroidGenBenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench-asteroid-gen") != 0)
+            continue;
+        options.enabled = true;
+        // The counts are optional
+        if (i + 1 >= argc || strncmp(argv[i + 1], "--", 2) == 0)
+            continue;
+        options.counts.clear();
+        const char* list = argv[++i];
+        while (*list)
+        {
+            char* end = nullptr;
+            double value = strtod(list, &end);
+            switch (*end)
+            {
+            case 'k': case 'K': value *= 1e3; end++; break;
+            case 'm': case 'M': value *= 1e6; end++; break;
+            case 'g': case 'G': value *= 1e9; end++; break;
+            default: break;
+            }
+            if (end == list || value < 1.0 || (*end != ',' && *end != '\0'))
+            {
+                std::cerr << "Bad value for --bench-asteroid-gen: " << argv[i] << std::endl;
+                return false;
+            }
+            options.counts.push_back((long long)value);
+            list = *end == ',' ? end + 1 : end;
+        }
+    }
+    return true;
+}
+
+// Order-independent: a sum of per-rock hashes, so any split of the belt gives the same value
+static uint64_t rockChecksum(const AsteroidInstance* rocks, size_t count)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t words[sizeof(AsteroidInstance) / 4];
+        memcpy(words, &rocks[i], sizeof(words));
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (uint32_t word : words)
+            hash = (hash ^ word) * 0x100000001b3ull;
+        sum += hash;
+    }
+    return sum;
+}
+
+// The known-answer vectors published with Random123 (kat_vectors, philox4x32_10)
+struct PhiloxKnownAnswer
+{
+    uint32_t counter[4];
+    uint32_t key[2];
+    uint32_t expected[4];
+};
+
+static const PhiloxKnownAnswer PHILOX_KNOWN_ANSWERS[] = {
+    { { 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u }, { 0x00000000u, 0x00000000u },
+      { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u } },
+    { { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu }, { 0xffffffffu, 0xffffffffu },
+      { 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu } },
+    { { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u }, { 0xa4093822u, 0x299f31d0u },
+      { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u } },
+};
+
+// Runs the vectors through the scalar generator and, where built, every lane of the SSE2 one
+static bool checkPhiloxKnownAnswers()
+{
+    bool pass = true;
+    for (const PhiloxKnownAnswer& answer : PHILOX_KNOWN_ANSWERS)
+    {
+        uint32_t words[4];
+        memcpy(words, answer.counter, sizeof(words));
+        philox4x32(words, answer.key[0], answer.key[1]);
+        bool match = memcmp(words, answer.expected, sizeof(words)) == 0;
+#ifdef SIMD_SSE2
+        __m128i lanes[4];
+        for (int i = 0; i < 4; i++)
+            lanes[i] = _mm_set1_epi32((int)answer.counter[i]);
+        philox4x32x4(lanes, answer.key[0], answer.key[1]);
+        for (int i = 0; i < 4; i++)
+            match = match && _mm_movemask_epi8(_mm_cmpeq_epi32(lanes[i], _mm_set1_epi32((int)answer.expected[i]))) == 0xFFFF;
+#endif
+        if (!match)
+        {
+            std::cerr << "Philox4x32-10 known-answer mismatch for counter " << std::hex << answer.counter[0] << " "
+                << answer.counter[1] << " " << answer.counter[2] << " " << answer.counter[3] << std::dec << std::endl;
+            pass = false;
+        }
+    }
+    return pass;
+}
+
+int runAsteroidGenBenchmark(const AsteroidGenBenchOptions& options, uint32_t seed)
+{
+    // A wrong round constant or key schedule would still give a consistent checksum below
+    if (!checkPhiloxKnownAnswers())
+        return 1;
+
+    // The belt runApp uses
+    AsteroidBeltShape shape = { 38.5f, 6.5f, 0.2f, 0.9f, 1.08f, 1.1f, -1.1f };
+    int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < hardwareThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    std::cout << "Asteroid generator: Philox4x32-10, "
+#ifdef SIMD_SSE2
+        << "SSE2"
+#else
+        << "scalar"
+#endif
+        << ", seed " << seed << ", " << hardwareThreads << " hardware threads" << std::endl;
+    std::cout << std::setw(12) << "rocks" << std::setw(9) << "threads" << std::setw(11) << "ms"
+        << std::setw(12) << "Mrocks/s" << std::setw(12) << "per core" << "  checksum" << std::endl;
+
+    bool consistent = true;
+    for (long long count : options.counts)
+    {
+        uint64_t reference = 0;
+        for (size_t run = 0; run < threadCounts.size(); run++)
+        {
+            // Whole blocks per thread into a reused buffer, so 100M rocks don't need 3 GB; the time
+            // includes hashing them
+            size_t total = (size_t)count;
+            size_t blocks = (total + BENCH_BLOCK_ROCKS - 1) / BENCH_BLOCK_ROCKS;
+            int threads = (int)std::min<size_t>(threadCounts[run], blocks);
+            std::vector<uint64_t> sums(threads, 0);
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++)
+            {
+                workers.emplace_back([&, t]
+                {
+                    std::vector<AsteroidInstance> scratch(BENCH_BLOCK_ROCKS);
+                    for (size_t block = blocks * t / threads; block < blocks * (t + 1) / threads; block++)
+                    {
+                        size_t first = block * BENCH_BLOCK_ROCKS;
+                        size_t rocks = std::min(BENCH_BLOCK_ROCKS, total - first);
+                        generateAsteroids(seed, shape, first, rocks, scratch.data());
+                        sums[t] += rockChecksum(scratch.data(), rocks);
+                    }
+                });
+            }
+            for (std::thread& worker : workers)
+                worker.join();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            uint64_t checksum = 0;
+            for (uint64_t sum : sums)
+                checksum += sum;
+            if (run == 0)
+                reference = checksum;
+            double rate = count / (ms * 1e3);
+            std::cout << std::setw(12) << count << std::setw(9) << threads << std::setw(11) << std::fixed
+                << std::setprecision(1) << ms << std::setw(12) << std::setprecision(2) << rate << std::setw(12)
+                << rate / threads << "  " << std::hex << std::setw(16) << std::setfill('0') << checksum
+                << std::dec << std::setfill(' ');
+            if (checksum != reference)
+            {
+                std::cout << "  MISMATCH";
+                consistent = false;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef ASTEROID_GENERATOR_H
+#define ASTEROID_GENERATOR_H
+
+#include "celestial.h"
+#include <cstdint>
+
+// The fixed belt, drawn from Philox (counter_rng.h) instead of rand(): rock i takes blocks
+// (i, block, ASTEROID_RNG_STREAM) of the stream keyed by the seed. Every rock depends on its index
+// alone, so a seed gives the same belt on any thread count, in any order, with or without SSE2.
+const uint32_t ASTEROID_RNG_STREAM = 1;    // Counter word 3; CounterRandom streams keep it 0
+const int ASTEROID_RNG_BLOCKS = 4;         // 16 draws per rock, 14 used
+
+// Rocks first .. first + count - 1 of the belt, written to out
+void generateAsteroids(uint32_t seed, const AsteroidBeltShape& shape, uint64_t first, size_t count,
+    AsteroidInstance* out);
+
+// NUM_ASTEROIDS rocks, split over the job system's threads
+std::vector<AsteroidInstance> asteroids(uint32_t seed, const AsteroidBeltShape& shape);
+
+struct AsteroidGenBenchOptions
+{
+    bool enabled = false;
+    std::vector<long long> counts = { 1000000, 10000000, 100000000 };
+};
+
+// Parses --bench-asteroid-gen [N,N,...], counts taking k/M/G suffixes
+// Returns false on a malformed argument
+bool parseAsteroidGenBenchArgs(int argc, char** argv, AsteroidGenBenchOptions& options);
+
+// Generates every count on 1, 2, 4 ... up to all hardware threads and prints the throughput, per
+// core too, with a checksum of the rocks. Checks Philox4x32-10 against its published known-answer
+// vectors first. Returns non-zero on a mismatch there or if a thread count changed the belt.
+int runAsteroidGenBenchmark(const AsteroidGenBenchOptions& options, uint32_t seed);
+
+#endif // ASTEROID_GENERATOR_H
@@ -0,0 +1,27 @@
+#version 330 core
+in vec2 AtlasCoords;
+in vec3 FragPos;
+flat in vec3 BakeAxis;
+flat in mat3 ObjectToWorld;
+flat in float Fade;
+
+uniform sampler2DArray impostorAlbedo;        // rgb albedo, a coverage
+uniform sampler2DArray impostorNormalDepth;   // xyz object-space normal, w depth from the baked eye
+uniform float impostorLayer;                  // Rock shape
+
+// Permutations: FLASHLIGHT and BLOOM (lighting.glsl)
+#include "asteroid_lighting.glsl"
+
+void main()
+{
+    vec4 albedo = texture(impostorAlbedo, vec3(AtlasCoords, impostorLayer));
+    if (albedo.a < 0.5 || Fade > ditherThreshold())
+        discard;
+    vec4 normalDepth = texture(impostorNormalDepth, vec3(AtlasCoords, impostorLayer));
+    vec3 norm = normalize(ObjectToWorld * (normalDepth.xyz * 2.0 - 1.0));
+    // Back from the quad to the surface the baked depth saw, so the lights fall off the same way
+    vec3 surface = FragPos + BakeAxis * (1.0 - 2.0 * normalDepth.w);
+    // Edge texels were filtered against the empty background
+    vec3 result = shadeAsteroid(norm, surface, albedo.rgb / albedo.a);
+    writeLitOutput(result, 1.0, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 330 core
+// Far asteroids as camera-facing quads. Each shape was rendered from IMPOSTOR_GRID^2 directions
+// spread over an octahedron (AsteroidBelt::bakeImpostors); the quad shows the view baked closest
+// to the direction the camera sees this rock from.
+layout(location = 0) in vec3 aPos;             // Quad corner, xy in [-1, 1]
+layout(location = 3) in vec4 instanceOrbit;    // a, e, inclination, node
+layout(location = 4) in vec4 instancePhase;    // Periapsis, mean anomaly, mean motion, w uniform scale
+layout(location = 5) in vec4 instanceRotation; // Quaternion xyz at time 0, w = spin
+
+out vec2 AtlasCoords;                         // Within this shape's layer
+out vec3 FragPos;                             // On the plane through the rock's center
+flat out vec3 BakeAxis;                       // Towards the baked eye, one bounding radius long
+flat out mat3 ObjectToWorld;                  // For the baked object-space normals
+flat out float Fade;                          // Above 0 while cross-fading into the mesh
+
+#include "asteroid_instance.glsl"
+
+uniform float boundingRadius;                 // Largest rock at scale 1, the half-size of a view
+uniform int impostorGrid;                     // Views per side of the octahedral atlas
+
+// Octahedral map between unit directions and [-1, 1]^2 (impostorDirection in asteroid_belt.cpp)
+vec2 octahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 uv = n.xy;
+    if (n.z < 0.0)
+        uv = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return uv;
+}
+
+vec3 octahedralDecode(vec2 uv) {
+    vec3 n = vec3(uv, 1.0 - abs(uv.x) - abs(uv.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main() {
+    vec3 center = orbitPosition(instanceOrbit, instancePhase);
+    vec4 rotation = spinRotation(instanceRotation);
+    ObjectToWorld = mat3(rotate(rotation, vec3(1.0, 0.0, 0.0)), rotate(rotation, vec3(0.0, 1.0, 0.0)),
+        rotate(rotation, vec3(0.0, 0.0, 1.0)));
+
+    // Nearest baked view to the camera, in the rock's own space
+    vec3 eye = transpose(ObjectToWorld) * normalize(viewPos - center);
+    ivec2 cell = clamp(ivec2((octahedralEncode(eye) * 0.5 + 0.5) * float(impostorGrid)), ivec2(0), ivec2(impostorGrid - 1));
+    vec3 axis = octahedralDecode((vec2(cell) + 0.5) / float(impostorGrid) * 2.0 - 1.0);
+    // Same frame glm::lookAt built for the bake
+    vec3 right = normalize(cross(vec3(0.0, 1.0, 0.0), axis));
+    vec3 up = cross(axis, right);
+
+    float radius = boundingRadius * instancePhase.w;
+    FragPos = center + ObjectToWorld * (right * aPos.x + up * aPos.y) * radius;
+    BakeAxis = ObjectToWorld * axis * radius;
+    AtlasCoords = (vec2(cell) + aPos.xy * 0.5 + 0.5) / float(impostorGrid);
+    Fade = meshFade(projectedSize(center, instancePhase.w));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
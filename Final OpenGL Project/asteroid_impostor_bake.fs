@@ -0,0 +1,15 @@
+#version 330 core
+in vec3 Normal;
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 NormalDepth;
+
+uniform sampler2D texture1;                   // Same surface texture as asteroid.fs
+
+void main()
+{
+    Albedo = vec4(texture(texture1, TexCoords).rgb, 1.0);
+    // The projection is orthographic, so window depth is linear between the bounding sphere's ends
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, gl_FragCoord.z);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+// One octahedral view of a rock for its impostor (AsteroidBelt::bakeImpostors)
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 viewProjection;                  // Orthographic, the rock's bounding sphere fills it
+
+void main() {
+    Normal = aNormal;
+    TexCoords = aTexCoords;
+    gl_Position = viewProjection * vec4(aPos, 1.0);
+}
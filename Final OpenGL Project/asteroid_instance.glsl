@@ -0,0 +1,54 @@
+// Shared by the asteroid vertex shaders: the instance's orbit and spin at the current time, and
+// the projected size the cull, the LOD pick and the impostor cross-fade are all decided on
+// (ROCK_LOD_SIZES and IMPOSTOR_SIZES in asteroid_belt.h)
+#include "frame_uniforms.glsl"                // viewPos
+
+uniform float orbitTime;                      // Sim seconds the orbits are evaluated at
+uniform float rockRadius;                     // Radius the sizes are measured with
+uniform vec2 impostorSizes;                   // Impostor only below x, mesh only above y
+
+const float TWO_PI = 6.28318531;
+
+vec3 rotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Where the rock is at orbitTime, from the elements in AsteroidInstance (celestial.h):
+// orbit = (a, e, inclination, node), phase.xyz = (periapsis, mean anomaly at 0, mean motion)
+vec3 orbitPosition(vec4 orbit, vec4 phase) {
+    float e = orbit.y;
+    float meanAnomaly = mod(phase.y + phase.z * orbitTime, TWO_PI);
+    // Kepler's equation; e is small, so two Newton steps from M + e sin M are plenty
+    float E = meanAnomaly + e * sin(meanAnomaly);
+    for (int i = 0; i < 2; i++)
+        E -= (E - e * sin(E) - meanAnomaly) / (1.0 - e * cos(E));
+    vec2 inPlane = orbit.x * vec2(cos(E) - e, sqrt(1.0 - e * e) * sin(E));  // x towards periapsis
+
+    // Turned by the periapsis to (r cos u, r sin u), u measured from the ascending node
+    float cw = cos(phase.x), sw = sin(phase.x);
+    vec2 fromNode = vec2(inPlane.x * cw - inPlane.y * sw, inPlane.x * sw + inPlane.y * cw);
+    // The belt's longitude is atan(x, z), so the node lies along (sin, 0, cos) of it
+    float cn = cos(orbit.w), sn = sin(orbit.w), ci = cos(orbit.z), si = sin(orbit.z);
+    vec3 node = vec3(sn, 0.0, cn);
+    vec3 ahead = vec3(ci * cn, si, -ci * sn);
+    return fromNode.x * node + fromNode.y * ahead;
+}
+
+// Orientation at orbitTime: the stored one, turned about the rock's own z axis
+vec4 spinRotation(vec4 rotation) {
+    vec4 q = vec4(rotation.xyz, sqrt(max(1.0 - dot(rotation.xyz, rotation.xyz), 0.0)));
+    float halfAngle = 0.5 * mod(rotation.w * orbitTime, TWO_PI);
+    float s = sin(halfAngle), c = cos(halfAngle);
+    // q * (0, 0, s, c)
+    return vec4(q.xyz * c + vec3(q.y * s, -q.x * s, q.w * s), q.w * c - q.z * s);
+}
+
+// Radius over distance, roughly the fraction of the screen height the rock covers
+float projectedSize(vec3 center, float scale) {
+    return rockRadius * scale / max(distance(center, viewPos), 0.001);
+}
+
+// How much of the mesh shows: 1 = all mesh, 0 = all impostor
+float meshFade(float size) {
+    return clamp((size - impostorSizes.x) / (impostorSizes.y - impostorSizes.x), 0.0, 1.0);
+}
@@ -0,0 +1,57 @@
+// Shared by the asteroid mesh and impostor fragment shaders, so both light a rock the same way
+#include "lighting.glsl"
+
+uniform float ambientStrength;
+uniform float specularStrength;
+uniform float shininess;
+uniform vec3 rimColor; // Rim light color
+uniform float rimIntensity; // Rim light intensity
+
+vec3 shadeAsteroid(vec3 norm, vec3 fragPos, vec3 textureColor)
+{
+    vec3 lightDir = normalize(lightPos - fragPos);
+    vec3 viewVec = viewPos - fragPos;
+    vec3 viewDir = normalize(viewVec);
+    float normDotLight = dot(norm, lightDir);
+
+    // Calculate attenuation based on distance to the light (sun)
+    float sunAttenuation = 20.0 / sunDistance(fragPos);
+
+    // -----------------------------Diffuse Lighting----------------------------
+    float diff = max(normDotLight, 0.0);
+
+    // ----------------------------- Rim Lighting ------------------------------
+    float rimViewFactor = 1.0 - max(dot(norm, viewDir), 0.0);
+    float rimLightFactor = diff;
+    float rim = pow(rimViewFactor * rimLightFactor, 15.0); // Exponent for smoother falloff
+    vec3 rimLight = rimColor * rim * rimIntensity;
+    
+    // ----------------------------- Back Light Effect ------------------------------
+    float backViewFactor = pow(rimViewFactor, 8.0); // Smoothstep for soft transition
+    vec3 backLight = rimColor * backViewFactor *0.09 * rimIntensity; 
+
+    // -----------------------------Specular Lighting---------------------------
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    vec3 specular = vec3(1.0);
+
+    // -------------------------- Flashlight Effect ----------------------------
+    vec3 flashlightLight = flashlight(norm, viewVec, textureColor, specular, specularStrength, shininess);
+
+    // ----------------------------- Combine Results ---------------------------
+    vec3 ambient = ambientStrength * textureColor;
+    vec3 diffuse = diff * textureColor;
+    vec3 specularFinal = specular * specularStrength * spec * textureColor;
+
+    return ((rimLight + specularFinal + diffuse ) * sunAttenuation)+ ambient  + backLight + flashlightLight;
+}
+
+// Ordered 4x4 dither for the mesh/impostor cross-fade: the mesh keeps the pixels whose threshold
+// is below its fade and the impostor the rest, so together they cover every pixel exactly once
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
@@ -0,0 +1,374 @@
+#include "async_texture_loader.h"
+#include "asset_pack.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+
+typedef std::chrono::steady_clock Clock;
+
+// Bytes copied into a mapped PBO between deadline checks
+static const size_t COPY_CHUNK = 1 << 20;
+
+AsyncTextureLoader::~AsyncTextureLoader()
+{
+    stop();
+}
+
+void AsyncTextureLoader::start(int workerCount)
+{
+    if (workerCount <= 0)
+        workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    stopping = false;
+    startTime = Clock::now();
+    // Workers decide whether compiled textures need decoding on the CPU
+    queryCompressedFormatSupport();
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&AsyncTextureLoader::workerLoop, this);
+}
+
+void AsyncTextureLoader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+
+    // Anything still queued is dropped; its texture keeps the placeholder. A cubemap can have some
+    // faces decoded and others still queued, so every queued job is collected once.
+    std::vector<Job*> leftovers = uploading;
+    for (Job* job : readyQueue)
+        leftovers.push_back(job);
+    std::unordered_set<Job*> partial;
+    for (const DecodeTask& task : decodeQueue)
+        partial.insert(task.job);
+    for (Job* job : leftovers)
+        partial.erase(job);
+    leftovers.insert(leftovers.end(), partial.begin(), partial.end());
+    for (Job* job : leftovers)
+    {
+        if (job->mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        if (job->pbo)
+            glDeleteBuffers(1, &job->pbo);
+        for (Image& image : job->images)
+            stbi_image_free(image.pixels);
+        delete job;
+    }
+    uploading.clear();
+    readyQueue.clear();
+    decodeQueue.clear();
+    pending.clear();
+    outstanding = 0;
+}
+
+// Creates the texture object with its final sampling state and a 1x1 stand-in image
+static GLuint createPlaceholder(TextureKind kind)
+{
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    if (kind == TEXTURE_CUBEMAP)
+    {
+        const unsigned char black[3] = { 0, 0, 0 };
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        for (unsigned int i = 0; i < 6; i++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, black);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        return textureID;
+    }
+
+    // Grey for color maps, no specular highlight, fully transparent rings
+    unsigned char texel[4] = { 128, 128, 128, 255 };
+    if (kind == TEXTURE_SPECULAR)
+        texel[0] = texel[1] = texel[2] = 0;
+    else if (kind == TEXTURE_RING)
+        texel[3] = 0;
+
+    GLint wrap = kind == TEXTURE_RING ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, kind == TEXTURE_SPECULAR ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+GLuint AsyncTextureLoader::requestTexture(const char* path, TextureKind kind)
+{
+    Job* job = new Job();
+    job->texture = createPlaceholder(kind);
+    job->kind = kind;
+    job->images.resize(1);
+    job->images[0].path = path;
+    pending.insert(job->texture);
+    outstanding++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decodeQueue.push_back({ job, 0 });
+    }
+    condition.notify_one();
+    return job->texture;
+}
+
+GLuint AsyncTextureLoader::requestCubemap(const std::vector<std::string>& faces)
+{
+    Job* job = new Job();
+    job->texture = createPlaceholder(TEXTURE_CUBEMAP);
+    job->kind = TEXTURE_CUBEMAP;
+    job->images.resize(faces.size());
+    pending.insert(job->texture);
+    outstanding++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Faces decode in parallel but upload together so the cubemap is never incomplete
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            job->images[i].path = faces[i];
+            decodeQueue.push_back({ job, (int)i });
+        }
+    }
+    condition.notify_all();
+    return job->texture;
+}
+
+void AsyncTextureLoader::workerLoop()
+{
+    while (true)
+    {
+        DecodeTask task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !decodeQueue.empty(); });
+            if (stopping)
+                return;
+            task = decodeQueue.front();
+            decodeQueue.pop_front();
+        }
+        decode(task);
+    }
+}
+
+void AsyncTextureLoader::decode(const DecodeTask& task)
+{
+    Job* job = task.job;
+    Image& image = job->images[task.imageIndex];
+
+    if (readCompressedTexture(compressedTexturePath(image.path), image.container))
+    {
+        // Already flipped and mipmapped by the compiler; only expand it if the driver can't sample the format
+        if (!compressedFormatSupported(image.container.header.format))
+            decompressTexture(image.container);
+        image.compiled = true;
+        image.width = image.container.header.width;
+        image.height = image.container.header.height;
+        image.channels = image.container.header.channels;
+    }
+    else
+    {
+        // The flip flag is per thread, so ring textures no longer flip every texture loaded after them
+        stbi_set_flip_vertically_on_load_thread(job->kind == TEXTURE_RING);
+        int desiredChannels = job->kind == TEXTURE_SPECULAR ? 1 : 0;
+        AssetSpan file;
+        std::vector<unsigned char> storage;
+        if (loadAsset(image.path, file, storage))
+            image.pixels = stbi_load_from_memory(file.data, (int)file.size, &image.width, &image.height, &image.channels, desiredChannels);
+        if (desiredChannels)
+            image.channels = desiredChannels;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!image.pixels && !image.compiled)
+    {
+        std::cout << "Failed to load texture: " << image.path << std::endl;
+        job->failed = true;
+    }
+    if (++job->decodedCount == (int)job->images.size())
+        readyQueue.push_back(job);
+}
+
+static GLenum formatFor(int channels)
+{
+    static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    return formats[std::min(std::max(channels, 1), 4) - 1];
+}
+
+size_t AsyncTextureLoader::imageSize(const Image& image)
+{
+    return image.compiled ? image.container.payloadSize() : (size_t)image.width * image.height * image.channels;
+}
+
+const unsigned char* AsyncTextureLoader::imageData(const Image& image)
+{
+    return image.compiled ? image.container.payload() : image.pixels;
+}
+
+bool AsyncTextureLoader::copyStep(Job& job, Clock::time_point deadline)
+{
+    if (!job.pbo)
+    {
+        for (const Image& image : job.images)
+            job.totalBytes += imageSize(image);
+        glGenBuffers(1, &job.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, job.totalBytes, nullptr, GL_STREAM_DRAW);
+        job.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, job.totalBytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!job.mapped)
+        {
+            // No PBO path on this driver: upload straight from client memory
+            glDeleteBuffers(1, &job.pbo);
+            job.pbo = 0;
+            return true;
+        }
+    }
+
+    // Copy the images back to back in chunks so one huge texture can't eat the whole frame
+    do
+    {
+        size_t offset = 0;
+        for (const Image& image : job.images)
+        {
+            size_t size = imageSize(image);
+            if (job.copiedBytes < offset + size)
+            {
+                size_t start = job.copiedBytes - offset;
+                size_t count = std::min(COPY_CHUNK, size - start);
+                memcpy(job.mapped + job.copiedBytes, imageData(image) + start, count);
+                job.copiedBytes += count;
+                break;
+            }
+            offset += size;
+        }
+    } while (job.copiedBytes < job.totalBytes && Clock::now() < deadline);
+
+    return job.copiedBytes == job.totalBytes;
+}
+
+void AsyncTextureLoader::upload(Job& job)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (job.pbo)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        job.mapped = nullptr;
+    }
+
+    size_t offset = 0;
+    GLenum target = job.kind == TEXTURE_CUBEMAP ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    glBindTexture(target, job.texture);
+    bool prebuiltMips = false;
+    for (size_t i = 0; i < job.images.size(); i++)
+    {
+        const Image& image = job.images[i];
+        GLenum face = job.kind == TEXTURE_CUBEMAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i : GL_TEXTURE_2D;
+        // With a PBO bound the data pointer is an offset into it
+        const unsigned char* data = job.pbo ? (const unsigned char*)offset : imageData(image);
+        if (image.compiled)
+        {
+            const CompressedTextureHeader& header = image.container.header;
+            for (uint32_t level = 0; level < header.mipCount; level++)
+            {
+                GLsizei width = std::max(1u, header.width >> level);
+                GLsizei height = std::max(1u, header.height >> level);
+                const unsigned char* levelData = data + header.mipOffset[level];
+                if (header.format == CTEX_RGBA8)
+                    glTexImage2D(face, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, levelData);
+                else
+                    glCompressedTexImage2D(face, level, compressedGLFormat(header.format), width, height, 0, header.mipSize[level], levelData);
+            }
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, header.mipCount - 1);
+            prebuiltMips = true;
+        }
+        else
+        {
+            GLenum format = formatFor(image.channels);
+            GLenum internalFormat = job.kind == TEXTURE_CUBEMAP ? GL_RGB : format;
+            glTexImage2D(face, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, data);
+        }
+        offset += imageSize(image);
+    }
+    if (job.kind != TEXTURE_CUBEMAP)
+    {
+        // Masks come back as one or two channels; spread them so shaders can keep reading .rgb and .a
+        int channels = job.images[0].channels;
+        if (channels <= 2)
+        {
+            GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+        if (!prebuiltMips)
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    if (job.pbo)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        // The driver keeps the storage alive until the transfer is done
+        glDeleteBuffers(1, &job.pbo);
+        job.pbo = 0;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+bool AsyncTextureLoader::pump(double budgetMs)
+{
+    if (outstanding == 0)
+        return false;
+    Clock::time_point deadline = Clock::now() + std::chrono::microseconds((long long)(budgetMs * 1000.0));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!readyQueue.empty())
+        {
+            uploading.push_back(readyQueue.front());
+            readyQueue.pop_front();
+        }
+    }
+
+    size_t i = 0;
+    while (i < uploading.size())
+    {
+        Job* job = uploading[i];
+        bool done = job->failed;
+        if (!done && copyStep(*job, deadline))
+        {
+            upload(*job);
+            done = true;
+        }
+        if (done)
+        {
+            for (Image& image : job->images)
+                stbi_image_free(image.pixels);
+            pending.erase(job->texture);
+            delete job;
+            uploading.erase(uploading.begin() + i);
+            if (--outstanding == 0)
+                std::cout << "All textures resident after "
+                    << std::chrono::duration<double, std::milli>(Clock::now() - startTime).count() << " ms" << std::endl;
+        }
+        else
+            i++;
+        if (Clock::now() >= deadline)
+            break;
+    }
+    return outstanding > 0;
+}
+
+void AsyncTextureLoader::finish()
+{
+    while (pump(1000.0))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef ASYNC_TEXTURE_LOADER_H
+#define ASYNC_TEXTURE_LOADER_H
+
+#include "utils.h"
+#include "compressed_texture.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+// Matches the sampling setup of the synchronous loaders in texture_utils
+enum TextureKind
+{
+    TEXTURE_COLOR,    // loadTexture: repeat, mipmapped
+    TEXTURE_SPECULAR, // specularTextureLoad: repeat, single-channel mask
+    TEXTURE_RING,     // loadRingTexture: clamped, flipped vertically
+    TEXTURE_CUBEMAP   // loadCubemap: six faces, clamped
+};
+
+// Decodes images on a worker pool and streams them to the GPU through pixel-buffer objects.
+// Every request returns a texture name right away with a 1x1 placeholder in it; the real image
+// replaces the placeholder in the same texture object once it has been decoded and copied.
+// A compiled ".ctex" next to the source image is used instead of it, mips and all.
+class AsyncTextureLoader
+{
+public:
+    ~AsyncTextureLoader();
+
+    // workerCount = 0 uses one thread per core, minus the GL thread
+    void start(int workerCount = 0);
+    void stop();
+
+    GLuint requestTexture(const char* path, TextureKind kind);
+    GLuint requestCubemap(const std::vector<std::string>& faces);
+
+    // Called once per frame on the GL thread: copies decoded pixels into mapped PBOs and issues
+    // the uploads, stopping once budgetMs is used up. Returns true while work is outstanding.
+    bool pump(double budgetMs);
+    // Blocks until every request is uploaded (used by deterministic runs)
+    void finish();
+    // True once the texture holds its real image, or its load failed and the placeholder stays.
+    // GL thread only.
+    bool resident(GLuint texture) const { return pending.count(texture) == 0; }
+
+private:
+    struct Image
+    {
+        std::string path;
+        unsigned char* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        bool compiled = false;        // container holds the image instead of pixels
+        CompressedTexture container;
+    };
+
+    struct Job
+    {
+        GLuint texture;
+        TextureKind kind;
+        std::vector<Image> images;   // One image, or six cubemap faces
+        int decodedCount = 0;        // Guarded by mutex
+        bool failed = false;
+
+        // Upload state, only touched on the GL thread
+        GLuint pbo = 0;
+        unsigned char* mapped = nullptr;
+        size_t totalBytes = 0;
+        size_t copiedBytes = 0;
+    };
+
+    struct DecodeTask
+    {
+        Job* job;
+        int imageIndex;
+    };
+
+    static size_t imageSize(const Image& image);
+    static const unsigned char* imageData(const Image& image);
+
+    void workerLoop();
+    void decode(const DecodeTask& task);
+    bool copyStep(Job& job, std::chrono::steady_clock::time_point deadline);
+    void upload(Job& job);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<DecodeTask> decodeQueue;
+    std::deque<Job*> readyQueue;       // Fully decoded, waiting for the GL thread
+    std::vector<Job*> uploading;       // Owned by the GL thread
+    int outstanding = 0;               // Requested but not yet uploaded
+    std::unordered_set<GLuint> pending; // Their texture names, only touched on the GL thread
+    bool stopping = false;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+#endif // ASYNC_TEXTURE_LOADER_H
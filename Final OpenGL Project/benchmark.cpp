@@ -0,0 +1,292 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+unsigned int drawCallCount = 0;
+
+const std::vector<BenchmarkScene>& benchmarkScenes()
+{
+    // Body positions for reference: Earth orbits at 24, the belt at 38.5-45, Saturn at 65
+    static const std::vector<BenchmarkScene> scenes = {
+        { "overview", 20.0f, "",
+            { { 0.0f, glm::vec3(0.0f, 90.0f, 110.0f), glm::vec3(0.0f) },
+              { 10.0f, glm::vec3(110.0f, 60.0f, 0.0f), glm::vec3(0.0f) },
+              { 20.0f, glm::vec3(0.0f, 90.0f, -110.0f), glm::vec3(0.0f) } },
+            { { 0.0f, 0.25f } } },
+        { "asteroid-belt", 20.0f, "",
+            { { 0.0f, glm::vec3(41.0f, 0.5f, 0.0f), glm::vec3(41.0f, 0.0f, 12.0f) },
+              { 5.0f, glm::vec3(29.0f, -0.5f, 29.0f), glm::vec3(20.0f, 0.0f, 37.0f) },
+              { 10.0f, glm::vec3(0.0f, 1.0f, 41.0f), glm::vec3(-12.0f, 0.0f, 41.0f) },
+              { 15.0f, glm::vec3(-29.0f, 0.0f, 29.0f), glm::vec3(-37.0f, 0.0f, 20.0f) },
+              { 20.0f, glm::vec3(-41.0f, 0.5f, 0.0f), glm::vec3(-41.0f, 0.0f, -12.0f) } },
+            { { 0.0f, 0.25f } } },
+        { "earth-closeup", 15.0f, "earth",
+            { { 0.0f, glm::vec3(0.0f, 0.5f, 3.5f), glm::vec3(0.0f) },
+              { 7.5f, glm::vec3(2.5f, 1.0f, 2.0f), glm::vec3(0.0f) },
+              { 15.0f, glm::vec3(3.0f, 0.2f, -1.5f), glm::vec3(0.0f) } },
+            { { 0.0f, 0.05f } } },
+        { "saturn-rings", 15.0f, "saturn",
+            { { 0.0f, glm::vec3(7.0f, 0.4f, 0.0f), glm::vec3(0.0f) },
+              { 7.5f, glm::vec3(0.0f, 0.15f, 6.0f), glm::vec3(0.0f) },
+              { 15.0f, glm::vec3(-5.0f, 0.3f, 3.0f), glm::vec3(0.0f) } },
+            { { 0.0f, 0.05f } } },
+        { "max-warp", 20.0f, "",
+            { { 0.0f, glm::vec3(0.0f, 40.0f, 70.0f), glm::vec3(0.0f) },
+              { 20.0f, glm::vec3(-70.0f, 40.0f, 0.0f), glm::vec3(0.0f) } },
+            { { 0.0f, 0.25f }, { 5.0f, 5.0f }, { 20.0f, 40.0f } } },
+    };
+    return scenes;
+}
+
+const BenchmarkScene* findBenchmarkScene(const std::string& name)
+{
+    for (const BenchmarkScene& scene : benchmarkScenes())
+        if (scene.name == name)
+            return &scene;
+    return nullptr;
+}
+
+static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5f * ((2.0f * p1) + (-p0 + p2) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+        (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+}
+
+void sampleScene(const BenchmarkScene& scene, float t, glm::vec3 followPosition,
+    glm::vec3& position, glm::vec3& front, float& speed)
+{
+    const std::vector<CameraKey>& keys = scene.camera;
+    int last = (int)keys.size() - 1;
+    int segment = 0;
+    while (segment < last - 1 && t > keys[segment + 1].time)
+        segment++;
+
+    glm::vec3 target;
+    if (last == 0)
+    {
+        position = keys[0].position;
+        target = keys[0].target;
+    }
+    else
+    {
+        const CameraKey& k0 = keys[std::max(segment - 1, 0)];
+        const CameraKey& k1 = keys[segment];
+        const CameraKey& k2 = keys[segment + 1];
+        const CameraKey& k3 = keys[std::min(segment + 2, last)];
+        float local = glm::clamp((t - k1.time) / std::max(k2.time - k1.time, 1e-6f), 0.0f, 1.0f);
+        position = catmullRom(k0.position, k1.position, k2.position, k3.position, local);
+        target = catmullRom(k0.target, k1.target, k2.target, k3.target, local);
+    }
+    position += followPosition;
+    target += followPosition;
+    front = glm::normalize(target - position);
+
+    const std::vector<WarpKey>& warp = scene.warp;
+    speed = warp.back().speedFactor;
+    for (size_t i = 0; i + 1 < warp.size(); i++)
+    {
+        if (t < warp[i + 1].time)
+        {
+            float local = glm::clamp((t - warp[i].time) / std::max(warp[i + 1].time - warp[i].time, 1e-6f), 0.0f, 1.0f);
+            speed = glm::mix(warp[i].speedFactor, warp[i + 1].speedFactor, local);
+            break;
+        }
+    }
+}
+
+static std::vector<std::string> splitList(const char* text)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+bool parseBenchmarkArgs(int argc, char** argv, BenchmarkOptions& options)
+{
+    static const char* valueOptions[] = { "--bench", "--asteroids", "--sphere-res", "--resolution", "--warmup", "--seed", "--bench-json" };
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            for (const char* option : valueOptions)
+            {
+                if (strcmp(arg, option) == 0)
+                {
+                    std::cerr << "Missing value for " << arg << std::endl;
+                    return false;
+                }
+            }
+            break;
+        }
+        if (strcmp(arg, "--bench") == 0)
+        {
+            options.enabled = true;
+            for (const std::string& name : splitList(argv[++i]))
+            {
+                if (name == "all")
+                {
+                    for (const BenchmarkScene& scene : benchmarkScenes())
+                        options.scenes.push_back(scene.name);
+                }
+                else if (findBenchmarkScene(name))
+                    options.scenes.push_back(name);
+                else
+                {
+                    std::cerr << "Unknown benchmark scene: " << name << std::endl;
+                    return false;
+                }
+            }
+        }
+        else if (strcmp(arg, "--asteroids") == 0)
+        {
+            for (const std::string& value : splitList(argv[++i]))
+                options.asteroidCounts.push_back(std::max(1, atoi(value.c_str())));
+        }
+        else if (strcmp(arg, "--sphere-res") == 0)
+        {
+            for (const std::string& value : splitList(argv[++i]))
+                options.sphereResolutions.push_back(std::max(1, atoi(value.c_str())));
+        }
+        else if (strcmp(arg, "--resolution") == 0)
+        {
+            for (const std::string& value : splitList(argv[++i]))
+            {
+                int width = 0, height = 0;
+                if (sscanf(value.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+                {
+                    std::cerr << "Bad resolution: " << value << std::endl;
+                    return false;
+                }
+                options.resolutions.push_back(glm::ivec2(width, height));
+            }
+        }
+        else if (strcmp(arg, "--warmup") == 0)
+            options.warmupFrames = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--seed") == 0)
+            options.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(arg, "--bench-json") == 0)
+            options.jsonPath = argv[++i];
+    }
+    return true;
+}
+
+std::vector<BenchmarkConfig> expandSweep(const BenchmarkOptions& options, int defaultAsteroids, int defaultSphereRes,
+    int defaultWidth, int defaultHeight)
+{
+    std::vector<int> asteroidCounts = options.asteroidCounts;
+    std::vector<int> sphereResolutions = options.sphereResolutions;
+    std::vector<glm::ivec2> resolutions = options.resolutions;
+    if (asteroidCounts.empty()) asteroidCounts.push_back(defaultAsteroids);
+    if (sphereResolutions.empty()) sphereResolutions.push_back(defaultSphereRes);
+    if (resolutions.empty()) resolutions.push_back(glm::ivec2(defaultWidth, defaultHeight));
+
+    std::vector<BenchmarkConfig> configs;
+    for (const std::string& scene : options.scenes)
+        for (int asteroids : asteroidCounts)
+            for (int res : sphereResolutions)
+                for (const glm::ivec2& size : resolutions)
+                    configs.push_back({ scene, asteroids, res, size.x, size.y });
+    return configs;
+}
+
+static void writeStats(std::ostream& out, const char* name, const FrameStats& stats)
+{
+    out << "      \"" << name << "\": { \"p50\": " << stats.percentile(50.0) << ", \"p95\": " << stats.percentile(95.0)
+        << ", \"p99\": " << stats.percentile(99.0) << " }";
+}
+
+bool writeBenchmarkJson(const std::string& path, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    out << "{\n  \"runs\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& r = results[i];
+        unsigned int maxDraws = 0;
+        double totalDraws = 0.0;
+        for (unsigned int draws : r.drawCalls)
+        {
+            maxDraws = std::max(maxDraws, draws);
+            totalDraws += draws;
+        }
+        out << "    {\n";
+        out << "      \"scene\": \"" << r.config.scene << "\",\n";
+        out << "      \"renderer\": \"" << r.renderer << "\",\n";
+        out << "      \"asteroids\": " << r.config.asteroids << ",\n";
+        out << "      \"sphereRes\": " << r.config.sphereRes << ",\n";
+        out << "      \"width\": " << r.config.width << ",\n";
+        out << "      \"height\": " << r.config.height << ",\n";
+        out << "      \"frames\": " << r.frame.frameMs.size() << ",\n";
+        writeStats(out, "frameMs", r.frame); out << ",\n";
+        writeStats(out, "cpuMs", r.cpu); out << ",\n";
+        writeStats(out, "gpuMs", r.gpu); out << ",\n";
+        out << "      \"drawCalls\": { \"mean\": " << (r.drawCalls.empty() ? 0.0 : totalDraws / r.drawCalls.size())
+            << ", \"max\": " << maxDraws << " },\n";
+        out << "      \"workers\": [";
+        for (size_t w = 0; w < r.workers.size(); w++)
+        {
+            const WorkerStats& worker = r.workers[w];
+            out << (w ? ", " : "") << "{ \"jobs\": " << worker.jobs << ", \"steals\": " << worker.steals
+                << ", \"busy\": " << (worker.elapsedMs > 0.0 ? worker.busyMs / worker.elapsedMs : 0.0) << " }";
+        }
+        out << "]\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return (bool)out;
+}
+
+void GpuTimer::init()
+{
+    glGenQueries(QUERY_COUNT, queries);
+    readIndex = writeIndex = 0;
+}
+
+void GpuTimer::destroy()
+{
+    glDeleteQueries(QUERY_COUNT, queries);
+}
+
+void GpuTimer::begin()
+{
+    glBeginQuery(GL_TIME_ELAPSED, queries[writeIndex % QUERY_COUNT]);
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    writeIndex++;
+}
+
+bool GpuTimer::poll(double& ms, bool wait)
+{
+    if (!pending())
+        return false;
+    GLuint query = queries[readIndex % QUERY_COUNT];
+    GLint available = 0;
+    if (!wait)
+    {
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+    ms = nanoseconds / 1.0e6;
+    readIndex++;
+    return true;
+}
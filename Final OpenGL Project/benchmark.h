@@ -0,0 +1,119 @@
+#pragma once
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "utils.h"
+#include "headless.h"
+#include "job_system.h"
+
+// Incremented by every glDraw* call so runs can report submission counts
+extern unsigned int drawCallCount;
+
+struct CameraKey
+{
+    float time;
+    glm::vec3 position; // Relative to the followed body, if any
+    glm::vec3 target;   // Relative to the followed body, if any
+};
+
+struct WarpKey
+{
+    float time;
+    float speedFactor;
+};
+
+// A fixed camera spline and time-warp schedule
+struct BenchmarkScene
+{
+    std::string name;
+    float duration;
+    std::string follow; // Name of the body the camera keys are relative to ("" = world space)
+    std::vector<CameraKey> camera;
+    std::vector<WarpKey> warp;
+};
+
+const std::vector<BenchmarkScene>& benchmarkScenes();
+const BenchmarkScene* findBenchmarkScene(const std::string& name);
+
+// Samples the camera spline (Catmull-Rom) and the warp schedule (linear) at time t
+void sampleScene(const BenchmarkScene& scene, float t, glm::vec3 followPosition,
+    glm::vec3& position, glm::vec3& front, float& speed);
+
+// One point of the parameter sweep
+struct BenchmarkConfig
+{
+    std::string scene;
+    int asteroids;
+    int sphereRes;
+    int width;
+    int height;
+};
+
+struct BenchmarkOptions
+{
+    bool enabled = false;
+    std::vector<std::string> scenes;
+    std::vector<int> asteroidCounts;
+    std::vector<int> sphereResolutions;
+    std::vector<glm::ivec2> resolutions;
+    int warmupFrames = 30;
+    unsigned int seed = 1;
+    std::string jsonPath = "benchmark.json";
+};
+
+// Parses --bench a,b|all, --asteroids N,M, --sphere-res N,M, --resolution WxH,..., --warmup N, --seed N, --bench-json PATH
+// Returns false on a malformed argument or a missing value
+bool parseBenchmarkArgs(int argc, char** argv, BenchmarkOptions& options);
+
+// Cartesian product of all sweep parameters (unset ones use the current defaults)
+std::vector<BenchmarkConfig> expandSweep(const BenchmarkOptions& options, int defaultAsteroids, int defaultSphereRes,
+    int defaultWidth, int defaultHeight);
+
+struct BenchmarkResult
+{
+    BenchmarkConfig config;
+    std::string renderer;
+    FrameStats frame; // Wall time of the whole frame including the wait for the GPU
+    FrameStats cpu;   // Time spent on the CPU building and submitting the frame
+    FrameStats gpu;   // GL_TIME_ELAPSED for the frame's GL work
+    std::vector<unsigned int> drawCalls;
+    std::vector<WorkerStats> workers; // Job system threads over the measured frames
+};
+
+// State handed to the render loop for a single benchmark run
+struct BenchmarkRun
+{
+    const BenchmarkScene* scene;
+    BenchmarkConfig config;
+    int warmupFrames;
+    unsigned int seed;
+    BenchmarkResult result;
+    float endTime = -1.0f;          // Scene time of the last frame (< 0 = scene duration)
+    bool captureLastFrame = false;  // Read the final frame back into image
+    std::vector<unsigned char> image;
+};
+
+bool writeBenchmarkJson(const std::string& path, const std::vector<BenchmarkResult>& results);
+
+// Ring of GL_TIME_ELAPSED queries read back a few frames late so timing never stalls the pipeline
+class GpuTimer
+{
+public:
+    void init();
+    void destroy();
+    // Collect with poll() until full() is false before calling begin()
+    void begin();
+    void end();
+    // Returns true and the oldest finished measurement if one is available
+    bool poll(double& ms, bool wait = false);
+    bool pending() const { return readIndex != writeIndex; }
+    bool full() const { return writeIndex - readIndex == QUERY_COUNT; }
+
+private:
+    static const int QUERY_COUNT = 4;
+    GLuint queries[QUERY_COUNT] = {};
+    unsigned int readIndex = 0;
+    unsigned int writeIndex = 0;
+};
+
+#endif // BENCHMARK_H
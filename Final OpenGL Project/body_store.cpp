@@ -0,0 +1,61 @@
+#include "body_store.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+void BodyStore::reserve(size_t count)
+{
+    names.reserve(count);
+    orbits.reserve(count);
+    spins.reserve(count);
+    parents.reserve(count);
+    transforms.reserve(count);
+    materials.reserve(count);
+    renderables.reserve(count);
+}
+
+int BodyStore::add(const std::string& name, int parent)
+{
+    names.push_back(name);
+    orbits.emplace_back();
+    spins.emplace_back();
+    parents.push_back(parent);
+    transforms.emplace_back();
+    materials.emplace_back();
+    renderables.emplace_back();
+    return (int)names.size() - 1;
+}
+
+int BodyStore::find(const std::string& name) const
+{
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == name)
+            return (int)i;
+    return -1;
+}
+
+glm::dvec3 orbitMaker(double semiMajorAxis, double angle, double eccentricity, double inclination)
+{
+    double theta = glm::radians(angle);
+    double x = semiMajorAxis * (cos(theta) - eccentricity);
+    double z = semiMajorAxis * sqrt(1.0 - eccentricity * eccentricity) * sin(theta);
+
+    glm::dmat4 rotationMatrix = glm::rotate(glm::dmat4(1.0), glm::radians(inclination), glm::dvec3(1.0, 0.0, 0.0));
+    glm::dvec4 tiltedPosition = rotationMatrix * glm::dvec4(x, 0.0, z, 1.0);
+
+    return glm::dvec3(tiltedPosition);
+}
+
+void advanceBodies(std::vector<OrbitComponent>& orbits, std::vector<SpinComponent>& spins,
+    const std::vector<int>& parents, std::vector<glm::dvec3>& worldPositions, float deltaTime)
+{
+    for (OrbitComponent& orbit : orbits)
+        orbit.angle -= deltaTime * orbit.speed;
+    for (SpinComponent& spin : spins)
+        spin.angle += deltaTime * spin.speed;
+
+    for (size_t i = 0; i < orbits.size(); i++)
+    {
+        const OrbitComponent& orbit = orbits[i];
+        glm::dvec3 center = parents[i] >= 0 ? worldPositions[parents[i]] : glm::dvec3(0.0);
+        worldPositions[i] = center + orbitMaker(orbit.semiMajorAxis, orbit.angle, orbit.eccentricity, orbit.inclination);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef BODY_STORE_H
+#define BODY_STORE_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+class VirtualTexture;
+
+// The bodies as entities: a body is an index, and each component is a dense array indexed by it.
+// A loop reads only the arrays it needs, so stepping the orbits walks 24-byte OrbitComponents
+// instead of whole bodies, and the simulation side (orbits, spins, parents, world positions)
+// needs nothing from GL: this header and body_store.cpp build and run without a context.
+// Bodies are only ever added, so an index stays valid for the store's lifetime.
+
+struct OrbitComponent
+{
+    float semiMajorAxis = 0.0f;
+    float eccentricity = 0.0f;
+    float inclination = 0.0f;       // Degrees
+    float speed = 0.0f;             // Degrees per sim second
+    double angle = 0.0;             // Degrees, growing for the whole run
+};
+
+struct SpinComponent
+{
+    float speed = 0.0f;             // Degrees per sim second, negative for retrograde
+    float tilt = 0.0f;              // Degrees
+    double angle = 0.0;
+};
+
+struct TransformComponent
+{
+    // Where the simulation puts it; doubles, since real-scale distances outrun a float (real_scale.h)
+    glm::dvec3 worldPosition = glm::dvec3(0.0);
+    // worldPosition less the render origin, which stays small near the camera; set with the transforms
+    glm::vec3 position = glm::vec3(0.0f);
+    float scale = 1.0f;
+    // Orbit, tilt, spin and scale, and its normal matrix; rebuilt every frame by updateBodyTransforms
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(1.0f);
+    // Orbit and tilt alone: what the clouds and rings turn with
+    glm::mat3 tiltFrame = glm::mat3(1.0f);
+};
+
+struct MaterialComponent
+{
+    float ambientStrength = 0.0f;
+    float specularStrength = 0.0f;
+    float shininess = 0.0f;
+    glm::vec3 rimColor = glm::vec3(0.2f);
+    float rimIntensity = 0.3f;
+    glm::vec3 terminatorColor = glm::vec3(0.005f);
+    float terminatorBlendFactor = 0.7f;
+    glm::vec3 edgeColor = glm::vec3(0.0f);
+    float edgeIntensity = 0.0f;
+};
+
+// GL texture names, 0 for a map the body doesn't have
+struct RenderableComponent
+{
+    unsigned int texture = 0;
+    unsigned int specularMap = 0;
+    unsigned int nightMap = 0;
+    // Virtual texture layers that take over from texture, specularMap and nightMap when loaded;
+    // the plain map is then left at 0
+    VirtualTexture* virtualColor = nullptr;
+    VirtualTexture* virtualSpecular = nullptr;
+    VirtualTexture* virtualNight = nullptr;
+};
+
+struct BodyStore
+{
+    std::vector<std::string> names;
+    std::vector<OrbitComponent> orbits;
+    std::vector<SpinComponent> spins;
+    std::vector<int> parents;       // Index of the body it circles, always lower than its own; -1 for none
+    std::vector<TransformComponent> transforms;
+    std::vector<MaterialComponent> materials;
+    std::vector<RenderableComponent> renderables;
+
+    size_t size() const { return names.size(); }
+    void reserve(size_t count);
+    // A body with default components; returns its index
+    int add(const std::string& name, int parent = -1);
+    // Index of the body called name, or -1
+    int find(const std::string& name) const;
+};
+
+glm::dvec3 orbitMaker(double semiMajorAxis, double angle, double eccentricity = 0.0, double inclination = 0.0);
+
+// One step of deltaTime sim seconds: turns every orbit and spin, then places each body about its
+// parent's new position (parents first, as the store keeps them). The arrays are the store's, or
+// the simulation's copies of them.
+void advanceBodies(std::vector<OrbitComponent>& orbits, std::vector<SpinComponent>& spins,
+    const std::vector<int>& parents, std::vector<glm::dvec3>& worldPositions, float deltaTime);
+
+#endif // BODY_STORE_H
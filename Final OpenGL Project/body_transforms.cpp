@@ -0,0 +1,141 @@
+#include "body_transforms.h"
+#include "simd_math.h"
+#include <algorithm>
+
+static const double DEGREES_TO_RADIANS = 0.0174532925199432958;
+
+// The angles grow for the whole run; within one turn they stay where the polynomials are accurate.
+// Wrapped as doubles, so a long run's spin doesn't come out in whole-degree steps.
+static float wrappedRadians(double degrees)
+{
+    return (float)((degrees - 360.0 * floor(degrees / 360.0)) * DEGREES_TO_RADIANS);
+}
+
+// One batch, element [i][lane]; the 3x3 matrices are column-major like glm's
+struct TransformLanes
+{
+    float orbit[TRANSFORM_LANES];
+    float tilt[TRANSFORM_LANES];
+    float spin[TRANSFORM_LANES];
+    float scale[TRANSFORM_LANES];
+    float frame[9][TRANSFORM_LANES];    // Ry(orbit) * Rx(tilt)
+    float model[9][TRANSFORM_LANES];    // frame * Ry(spin) * scale
+    float normal[9][TRANSFORM_LANES];   // frame * Ry(spin) / scale, the inverse transpose of model
+};
+
+#ifdef SIMD_SSE2
+static void buildLanes(TransformLanes& lanes)
+{
+    __m128 sinOrbit, cosOrbit, sinTilt, cosTilt, sinSpin, cosSpin;
+    sinCos4(_mm_loadu_ps(lanes.orbit), sinOrbit, cosOrbit);
+    sinCos4(_mm_loadu_ps(lanes.tilt), sinTilt, cosTilt);
+    sinCos4(_mm_loadu_ps(lanes.spin), sinSpin, cosSpin);
+    __m128 scale = _mm_loadu_ps(lanes.scale);
+    __m128 inverseScale = _mm_div_ps(_mm_set1_ps(1.0f), scale);
+    __m128 zero = _mm_setzero_ps();
+
+    __m128 frame[9] = {
+        cosOrbit, zero, _mm_sub_ps(zero, sinOrbit),
+        _mm_mul_ps(sinOrbit, sinTilt), cosTilt, _mm_mul_ps(cosOrbit, sinTilt),
+        _mm_mul_ps(sinOrbit, cosTilt), _mm_sub_ps(zero, sinTilt), _mm_mul_ps(cosOrbit, cosTilt) };
+    for (int row = 0; row < 3; row++)
+    {
+        // Spinning about y mixes the first and last columns and leaves the middle one alone
+        __m128 rotation[3] = {
+            _mm_sub_ps(_mm_mul_ps(cosSpin, frame[row]), _mm_mul_ps(sinSpin, frame[6 + row])),
+            frame[3 + row],
+            _mm_add_ps(_mm_mul_ps(sinSpin, frame[row]), _mm_mul_ps(cosSpin, frame[6 + row])) };
+        for (int column = 0; column < 3; column++)
+        {
+            int i = column * 3 + row;
+            _mm_storeu_ps(lanes.frame[i], frame[i]);
+            _mm_storeu_ps(lanes.model[i], _mm_mul_ps(rotation[column], scale));
+            _mm_storeu_ps(lanes.normal[i], _mm_mul_ps(rotation[column], inverseScale));
+        }
+    }
+}
+#else
+static void buildLanes(TransformLanes& lanes)
+{
+    for (int lane = 0; lane < TRANSFORM_LANES; lane++)
+    {
+        float sinOrbit, cosOrbit, sinTilt, cosTilt, sinSpin, cosSpin;
+        sinCos(lanes.orbit[lane], sinOrbit, cosOrbit);
+        sinCos(lanes.tilt[lane], sinTilt, cosTilt);
+        sinCos(lanes.spin[lane], sinSpin, cosSpin);
+        float scale = lanes.scale[lane];
+        float inverseScale = 1.0f / scale;
+
+        float frame[9] = {
+            cosOrbit, 0.0f, 0.0f - sinOrbit,
+            sinOrbit * sinTilt, cosTilt, cosOrbit * sinTilt,
+            sinOrbit * cosTilt, 0.0f - sinTilt, cosOrbit * cosTilt };
+        for (int row = 0; row < 3; row++)
+        {
+            float rotation[3] = {
+                cosSpin * frame[row] - sinSpin * frame[6 + row],
+                frame[3 + row],
+                sinSpin * frame[row] + cosSpin * frame[6 + row] };
+            for (int column = 0; column < 3; column++)
+            {
+                int i = column * 3 + row;
+                lanes.frame[i][lane] = frame[i];
+                lanes.model[i][lane] = rotation[column] * scale;
+                lanes.normal[i][lane] = rotation[column] * inverseScale;
+            }
+        }
+    }
+}
+#endif
+
+void updateBodyTransforms(BodyStore& bodies, size_t first, size_t count, const glm::dvec3& origin)
+{
+    size_t end = first + count;
+    for (size_t batch = first; batch < end; batch += TRANSFORM_LANES)
+    {
+        int used = (int)std::min<size_t>(TRANSFORM_LANES, end - batch);
+        TransformLanes lanes;
+        for (int lane = 0; lane < TRANSFORM_LANES; lane++)
+        {
+            // Lanes past the last body repeat it and are dropped afterwards
+            size_t i = batch + std::min(lane, used - 1);
+            lanes.orbit[lane] = wrappedRadians(bodies.orbits[i].angle);
+            lanes.tilt[lane] = wrappedRadians(bodies.spins[i].tilt);
+            lanes.spin[lane] = wrappedRadians(bodies.spins[i].angle);
+            lanes.scale[lane] = bodies.transforms[i].scale;
+        }
+        buildLanes(lanes);
+        for (int lane = 0; lane < used; lane++)
+        {
+            TransformComponent& body = bodies.transforms[batch + lane];
+            for (int column = 0; column < 3; column++)
+            {
+                for (int row = 0; row < 3; row++)
+                {
+                    int i = column * 3 + row;
+                    body.tiltFrame[column][row] = lanes.frame[i][lane];
+                    body.normalMatrix[column][row] = lanes.normal[i][lane];
+                    body.model[column][row] = lanes.model[i][lane];
+                }
+                body.model[column][3] = 0.0f;
+            }
+            // Subtracted in double, so only the small offset from the camera is rounded to float
+            body.position = glm::vec3(body.worldPosition - origin);
+            body.model[3] = glm::vec4(body.position, 1.0f);
+        }
+    }
+}
+
+glm::mat3 spinFrame(const glm::mat3& frame, double spinDegrees)
+{
+    float s, c;
+    sinCos(wrappedRadians(spinDegrees), s, c);
+    return glm::mat3(c * frame[0] - s * frame[2], frame[1], s * frame[0] + c * frame[2]);
+}
+
+glm::mat4 composeModel(const glm::mat3& rotation, float scale, const glm::vec3& position)
+{
+    glm::mat4 model(rotation * scale);
+    model[3] = glm::vec4(position, 1.0f);
+    return model;
+}
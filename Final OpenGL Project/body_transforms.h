@@ -0,0 +1,24 @@
+#pragma once
+#ifndef BODY_TRANSFORMS_H
+#define BODY_TRANSFORMS_H
+
+#include "body_store.h"
+
+// The transform stage of a frame: every body's model matrix, normal matrix and tilt frame, built
+// once and shared by its planet, cloud and ring draws. Bodies go through in batches of
+// TRANSFORM_LANES gathered into structure-of-arrays lanes, so a batch takes one sinCos4 per angle
+// and one SSE2 multiply-add per matrix element. Without SSE2 the lanes run as plain loops over
+// the same polynomials.
+const int TRANSFORM_LANES = 4;
+
+// Fills position (worldPosition less origin, the render origin), model, normalMatrix and tiltFrame
+// of bodies [first, first + count) from their orbit and spin; no GL, so any thread may run it on
+// its own range
+void updateBodyTransforms(BodyStore& bodies, size_t first, size_t count, const glm::dvec3& origin = glm::dvec3(0.0));
+
+// frame turned by spinDegrees about its own y axis: a layer spinning apart from its body
+glm::mat3 spinFrame(const glm::mat3& frame, double spinDegrees);
+// rotation scaled uniformly, then moved to position
+glm::mat4 composeModel(const glm::mat3& rotation, float scale, const glm::vec3& position);
+
+#endif // BODY_TRANSFORMS_H
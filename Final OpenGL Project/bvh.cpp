@@ -0,0 +1,874 @@
+#include "bvh.h"
+#include "asteroid_generator.h"
+#include "counter_rng.h"
+#include "simd_math.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Traversal stacks are fixed arrays. Below this depth the build stops looking for SAH splits and
+// halves by count, so no path is deeper than about 80 binary levels and, three siblings waiting
+// per level, a stack of TRAVERSAL_STACK always holds the collapsed tree's.
+static const int SAH_MAX_DEPTH = 48;
+static const int TRAVERSAL_STACK = 256;
+// Opening a node against testing an item, for the SAH
+static const float TRAVERSAL_COST = 1.0f;
+static const float INTERSECT_COST = 1.0f;
+
+static float surfaceArea(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// ----- Build -----
+
+void Bvh::build(const BvhSphere* spheres, size_t count)
+{
+    nodes.clear();
+    buildNodes.clear();
+    buildItems.resize(count);
+    for (size_t i = 0; i < count; i++)
+        buildItems[i] = { spheres[i], (uint32_t)i };
+    sahCost = builtCost = 0.0f;
+    if (count == 0)
+    {
+        order.clear();
+        leafSpheres.clear();
+        return;
+    }
+
+    buildRange(0, (uint32_t)count, 0);
+    order.resize(count);
+    leafSpheres.resize(count);
+    for (size_t i = 0; i < count; i++)
+        order[i] = buildItems[i].item;
+    // Every collapsed node takes up at least one inner binary node
+    size_t innerNodes = 0;
+    for (const BuildNode& node : buildNodes)
+        innerNodes += node.left >= 0;
+    nodes.reserve(std::max<size_t>(innerNodes, 1));
+    if (buildNodes[0].left >= 0)
+    {
+        collapse(0);
+    }
+    else
+    {
+        // Too few items to split: a root with one leaf
+        nodes.emplace_back();
+        BvhNode& root = nodes[0];
+        for (int slot = 0; slot < BVH_WIDTH; slot++)
+        {
+            root.child[slot] = -1;
+            root.first[slot] = 0;
+            root.count[slot] = slot == 0 ? (uint32_t)count : 0;
+        }
+    }
+    refit(spheres);
+    builtCost = sahCost;
+}
+
+int Bvh::buildRange(uint32_t first, uint32_t count, int depth)
+{
+    BuildItem* begin = buildItems.data() + first;
+    BuildItem* end = begin + count;
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+    for (const BuildItem* item = begin; item != end; item++)
+    {
+        boundsMin = glm::min(boundsMin, item->sphere.center - item->sphere.radius);
+        boundsMax = glm::max(boundsMax, item->sphere.center + item->sphere.radius);
+        centroidMin = glm::min(centroidMin, item->sphere.center);
+        centroidMax = glm::max(centroidMax, item->sphere.center);
+    }
+    int index = (int)buildNodes.size();
+    buildNodes.push_back({ boundsMin, boundsMax, -1, -1, first, count });
+    if (count <= (uint32_t)BVH_LEAF_SIZE)
+        return index;
+
+    // Binned SAH: every bin boundary of every axis is a candidate split, costed by the surface
+    // area and item count on each side. One pass bins all three axes.
+    glm::vec3 extent = centroidMax - centroidMin;
+    glm::vec3 binScale;
+    for (int axis = 0; axis < 3; axis++)
+        binScale[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+    auto binOf = [&](const BvhSphere& sphere, int axis)
+    {
+        return std::min((int)((sphere.center[axis] - centroidMin[axis]) * binScale[axis]), BVH_BINS - 1);
+    };
+    uint32_t split = 0;
+    if (depth < SAH_MAX_DEPTH)
+    {
+        glm::vec3 binMin[3][BVH_BINS], binMax[3][BVH_BINS];
+        uint32_t binCount[3][BVH_BINS] = {};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int bin = 0; bin < BVH_BINS; bin++)
+            {
+                binMin[axis][bin] = glm::vec3(FLT_MAX);
+                binMax[axis][bin] = glm::vec3(-FLT_MAX);
+            }
+        }
+        for (const BuildItem* item = begin; item != end; item++)
+        {
+            glm::vec3 low = item->sphere.center - item->sphere.radius;
+            glm::vec3 high = item->sphere.center + item->sphere.radius;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int bin = binOf(item->sphere, axis);
+                binMin[axis][bin] = glm::min(binMin[axis][bin], low);
+                binMax[axis][bin] = glm::max(binMax[axis][bin], high);
+                binCount[axis][bin]++;
+            }
+        }
+
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (extent[axis] <= 0.0f)
+                continue;
+            // Right of each boundary, swept from the far end; then the left side on the way back
+            float rightArea[BVH_BINS];
+            uint32_t rightCount[BVH_BINS];
+            glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+            uint32_t sweepCount = 0;
+            for (int bin = BVH_BINS - 1; bin > 0; bin--)
+            {
+                sweepMin = glm::min(sweepMin, binMin[axis][bin]);
+                sweepMax = glm::max(sweepMax, binMax[axis][bin]);
+                sweepCount += binCount[axis][bin];
+                rightArea[bin] = surfaceArea(sweepMin, sweepMax);
+                rightCount[bin] = sweepCount;
+            }
+            sweepMin = glm::vec3(FLT_MAX);
+            sweepMax = glm::vec3(-FLT_MAX);
+            sweepCount = 0;
+            for (int bin = 0; bin < BVH_BINS - 1; bin++)
+            {
+                sweepMin = glm::min(sweepMin, binMin[axis][bin]);
+                sweepMax = glm::max(sweepMax, binMax[axis][bin]);
+                sweepCount += binCount[axis][bin];
+                if (sweepCount == 0 || rightCount[bin + 1] == 0)
+                    continue;
+                float cost = surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[bin + 1] * rightCount[bin + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+        if (bestAxis >= 0)
+        {
+            // binOf again, so every item lands on the side it was counted on
+            BuildItem* middle = std::partition(begin, end, [&](const BuildItem& item)
+            {
+                return binOf(item.sphere, bestAxis) <= bestBin;
+            });
+            split = (uint32_t)(middle - begin);
+        }
+    }
+    if (split == 0 || split == count)
+    {
+        // No split worth having, or too deep for one: halve by count along the longest axis
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        split = count / 2;
+        std::nth_element(begin, begin + split, end, [&](const BuildItem& a, const BuildItem& b)
+        {
+            return a.sphere.center[axis] < b.sphere.center[axis];
+        });
+    }
+    int left = buildRange(first, split, depth + 1);
+    int right = buildRange(first + split, count - split, depth + 1);
+    buildNodes[index].left = left;
+    buildNodes[index].right = right;
+    return index;
+}
+
+int Bvh::collapse(int buildNode)
+{
+    // Start from the two children and keep opening the largest inner one until four slots are used
+    int slots[BVH_WIDTH] = { buildNodes[buildNode].left, buildNodes[buildNode].right };
+    int used = 2;
+    while (used < BVH_WIDTH)
+    {
+        int widest = -1;
+        float widestArea = -1.0f;
+        for (int slot = 0; slot < used; slot++)
+        {
+            const BuildNode& candidate = buildNodes[slots[slot]];
+            float area = surfaceArea(candidate.min, candidate.max);
+            if (candidate.left >= 0 && area > widestArea)
+            {
+                widest = slot;
+                widestArea = area;
+            }
+        }
+        if (widest < 0)
+            break;
+        int opened = slots[widest];
+        slots[widest] = buildNodes[opened].left;
+        slots[used++] = buildNodes[opened].right;
+    }
+
+    int index = (int)nodes.size();
+    nodes.emplace_back();
+    for (int slot = 0; slot < BVH_WIDTH; slot++)
+    {
+        BvhNode& node = nodes[index];
+        node.child[slot] = -1;
+        node.first[slot] = slot < used ? buildNodes[slots[slot]].first : 0;
+        node.count[slot] = slot < used ? buildNodes[slots[slot]].count : 0;
+    }
+    // Pre-order, so refit can go through the nodes backwards and meet every child before its parent
+    for (int slot = 0; slot < used; slot++)
+    {
+        if (buildNodes[slots[slot]].left < 0)
+            continue;
+        int child = collapse(slots[slot]);
+        nodes[index].child[slot] = child;
+    }
+    return index;
+}
+
+void Bvh::refit(const BvhSphere* spheres)
+{
+    for (size_t i = 0; i < order.size(); i++)
+        leafSpheres[i] = spheres[order[i]];
+
+    // Empty slots get a point at FLT_MAX, which no ray reaches and no sphere query overlaps
+    float weightedArea = 0.0f;
+    for (size_t n = nodes.size(); n-- > 0;)
+    {
+        BvhNode& node = nodes[n];
+        for (int slot = 0; slot < BVH_WIDTH; slot++)
+        {
+            glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+            if (node.count[slot] == 0)
+            {
+                max = min;
+            }
+            else if (node.child[slot] < 0)
+            {
+                for (uint32_t i = node.first[slot]; i < node.first[slot] + node.count[slot]; i++)
+                {
+                    min = glm::min(min, leafSpheres[i].center - leafSpheres[i].radius);
+                    max = glm::max(max, leafSpheres[i].center + leafSpheres[i].radius);
+                }
+                weightedArea += INTERSECT_COST * node.count[slot] * surfaceArea(min, max);
+            }
+            else
+            {
+                const BvhNode& child = nodes[node.child[slot]];
+                for (int childSlot = 0; childSlot < BVH_WIDTH; childSlot++)
+                {
+                    if (child.count[childSlot] == 0)
+                        continue;
+                    min = glm::min(min, glm::vec3(child.minX[childSlot], child.minY[childSlot], child.minZ[childSlot]));
+                    max = glm::max(max, glm::vec3(child.maxX[childSlot], child.maxY[childSlot], child.maxZ[childSlot]));
+                }
+                weightedArea += TRAVERSAL_COST * surfaceArea(min, max);
+            }
+            node.minX[slot] = min.x;
+            node.minY[slot] = min.y;
+            node.minZ[slot] = min.z;
+            node.maxX[slot] = max.x;
+            node.maxY[slot] = max.y;
+            node.maxZ[slot] = max.z;
+        }
+    }
+
+    // Relative to the root's box: the chance of opening a node is its area over the root's
+    sahCost = 0.0f;
+    if (nodes.empty())
+        return;
+    glm::vec3 rootMin(FLT_MAX), rootMax(-FLT_MAX);
+    const BvhNode& root = nodes[0];
+    for (int slot = 0; slot < BVH_WIDTH; slot++)
+    {
+        if (root.count[slot] == 0)
+            continue;
+        rootMin = glm::min(rootMin, glm::vec3(root.minX[slot], root.minY[slot], root.minZ[slot]));
+        rootMax = glm::max(rootMax, glm::vec3(root.maxX[slot], root.maxY[slot], root.maxZ[slot]));
+    }
+    float rootArea = surfaceArea(rootMin, rootMax);
+    sahCost = TRAVERSAL_COST + (rootArea > 0.0f ? weightedArea / rootArea : 0.0f);
+}
+
+// ----- Node tests -----
+// Each returns a bit per slot; empty slots never set one
+
+#ifdef SIMD_SSE2
+static int occupiedSlots(const BvhNode& node)
+{
+    __m128i count = _mm_load_si128(reinterpret_cast<const __m128i*>(node.count));
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(count, _mm_setzero_si128())));
+}
+#endif
+
+// Slabs: the ray's span inside each box, kept if it starts before maxDistance
+static int rayBoxes(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance,
+    float* entry)
+{
+#ifdef SIMD_SSE2
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), _mm_set1_ps(origin.x)), _mm_set1_ps(inverse.x));
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), _mm_set1_ps(origin.x)), _mm_set1_ps(inverse.x));
+    __m128 nearest = _mm_min_ps(t0, t1);
+    __m128 farthest = _mm_max_ps(t0, t1);
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), _mm_set1_ps(origin.y)), _mm_set1_ps(inverse.y));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), _mm_set1_ps(origin.y)), _mm_set1_ps(inverse.y));
+    nearest = _mm_max_ps(nearest, _mm_min_ps(t0, t1));
+    farthest = _mm_min_ps(farthest, _mm_max_ps(t0, t1));
+    t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), _mm_set1_ps(origin.z)), _mm_set1_ps(inverse.z));
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), _mm_set1_ps(origin.z)), _mm_set1_ps(inverse.z));
+    nearest = _mm_max_ps(_mm_max_ps(nearest, _mm_min_ps(t0, t1)), _mm_setzero_ps());
+    farthest = _mm_min_ps(_mm_min_ps(farthest, _mm_max_ps(t0, t1)), _mm_set1_ps(maxDistance));
+    _mm_storeu_ps(entry, nearest);
+    return _mm_movemask_ps(_mm_cmple_ps(nearest, farthest)) & occupiedSlots(node);
+#else
+    int mask = 0;
+    for (int slot = 0; slot < BVH_WIDTH; slot++)
+    {
+        float nearest = 0.0f, farthest = maxDistance;
+        const float mins[3] = { node.minX[slot], node.minY[slot], node.minZ[slot] };
+        const float maxs[3] = { node.maxX[slot], node.maxY[slot], node.maxZ[slot] };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (mins[axis] - origin[axis]) * inverse[axis];
+            float t1 = (maxs[axis] - origin[axis]) * inverse[axis];
+            nearest = std::max(nearest, std::min(t0, t1));
+            farthest = std::min(farthest, std::max(t0, t1));
+        }
+        entry[slot] = nearest;
+        if (node.count[slot] > 0 && nearest <= farthest)
+            mask |= 1 << slot;
+    }
+    return mask;
+#endif
+}
+
+// Boxes within radius of center; inside gets the ones wholly within it
+static int sphereBoxes(const BvhNode& node, const glm::vec3& center, float radius, int& inside)
+{
+    float radius2 = radius * radius;
+#ifdef SIMD_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 nearest2 = zero, farthest2 = zero;
+    const float* mins[3] = { node.minX, node.minY, node.minZ };
+    const float* maxs[3] = { node.maxX, node.maxY, node.maxZ };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        __m128 c = _mm_set1_ps(center[axis]);
+        __m128 belowMax = _mm_sub_ps(c, _mm_load_ps(mins[axis]));     // Negative when c is below the box
+        __m128 aboveMin = _mm_sub_ps(_mm_load_ps(maxs[axis]), c);     // Negative when c is above it
+        __m128 gap = _mm_max_ps(_mm_sub_ps(zero, _mm_min_ps(belowMax, aboveMin)), zero);
+        __m128 reach = _mm_max_ps(belowMax, aboveMin);
+        nearest2 = _mm_add_ps(nearest2, _mm_mul_ps(gap, gap));
+        farthest2 = _mm_add_ps(farthest2, _mm_mul_ps(reach, reach));
+    }
+    int occupied = occupiedSlots(node);
+    inside = _mm_movemask_ps(_mm_cmple_ps(farthest2, _mm_set1_ps(radius2))) & occupied;
+    return _mm_movemask_ps(_mm_cmple_ps(nearest2, _mm_set1_ps(radius2))) & occupied;
+#else
+    int mask = 0;
+    inside = 0;
+    for (int slot = 0; slot < BVH_WIDTH; slot++)
+    {
+        if (node.count[slot] == 0)
+            continue;
+        const float mins[3] = { node.minX[slot], node.minY[slot], node.minZ[slot] };
+        const float maxs[3] = { node.maxX[slot], node.maxY[slot], node.maxZ[slot] };
+        float nearest2 = 0.0f, farthest2 = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float belowMax = center[axis] - mins[axis];
+            float aboveMin = maxs[axis] - center[axis];
+            float gap = std::max(0.0f - std::min(belowMax, aboveMin), 0.0f);
+            float reach = std::max(belowMax, aboveMin);
+            nearest2 += gap * gap;
+            farthest2 += reach * reach;
+        }
+        if (nearest2 <= radius2)
+            mask |= 1 << slot;
+        if (farthest2 <= radius2)
+            inside |= 1 << slot;
+    }
+    return mask;
+#endif
+}
+
+// Boxes not wholly outside any plane; inside gets the ones wholly inside all six
+static int frustumBoxes(const BvhNode& node, const glm::vec4 planes[6], int& inside)
+{
+#ifdef SIMD_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 outsideAny = _mm_setzero_ps();
+    __m128 insideAll = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 mins[3] = { _mm_load_ps(node.minX), _mm_load_ps(node.minY), _mm_load_ps(node.minZ) };
+    __m128 maxs[3] = { _mm_load_ps(node.maxX), _mm_load_ps(node.maxY), _mm_load_ps(node.maxZ) };
+    for (int i = 0; i < 6; i++)
+    {
+        // The corner farthest along the normal decides outside, the nearest one inside
+        __m128 farthest = _mm_set1_ps(planes[i].w), nearest = farthest;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m128 n = _mm_set1_ps(planes[i][axis]);
+            bool positive = planes[i][axis] >= 0.0f;
+            farthest = _mm_add_ps(farthest, _mm_mul_ps(n, positive ? maxs[axis] : mins[axis]));
+            nearest = _mm_add_ps(nearest, _mm_mul_ps(n, positive ? mins[axis] : maxs[axis]));
+        }
+        outsideAny = _mm_or_ps(outsideAny, _mm_cmplt_ps(farthest, zero));
+        insideAll = _mm_and_ps(insideAll, _mm_cmpge_ps(nearest, zero));
+    }
+    int occupied = occupiedSlots(node);
+    inside = _mm_movemask_ps(insideAll) & occupied;
+    return ~_mm_movemask_ps(outsideAny) & occupied;
+#else
+    int mask = 0;
+    inside = 0;
+    for (int slot = 0; slot < BVH_WIDTH; slot++)
+    {
+        if (node.count[slot] == 0)
+            continue;
+        const float mins[3] = { node.minX[slot], node.minY[slot], node.minZ[slot] };
+        const float maxs[3] = { node.maxX[slot], node.maxY[slot], node.maxZ[slot] };
+        bool outsideAny = false, insideAll = true;
+        for (int i = 0; i < 6; i++)
+        {
+            float farthest = planes[i].w, nearest = planes[i].w;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                bool positive = planes[i][axis] >= 0.0f;
+                farthest += planes[i][axis] * (positive ? maxs[axis] : mins[axis]);
+                nearest += planes[i][axis] * (positive ? mins[axis] : maxs[axis]);
+            }
+            outsideAny = outsideAny || farthest < 0.0f;
+            insideAll = insideAll && nearest >= 0.0f;
+        }
+        if (!outsideAny)
+            mask |= 1 << slot;
+        if (insideAll)
+            inside |= 1 << slot;
+    }
+    return mask;
+#endif
+}
+
+// ----- Item tests -----
+// The benchmark's linear scans use these too, so both find exactly the same items
+
+// Distance to where the ray enters the sphere, 0 from inside. The miss distance is measured off the
+// centre rather than taken from a difference of squares, which loses a planet's radius at an AU.
+static bool raySphere(const glm::vec3& origin, const glm::vec3& direction, const BvhSphere& sphere, float& distance)
+{
+    glm::vec3 toCenter = sphere.center - origin;
+    float along = glm::dot(toCenter, direction);
+    glm::vec3 miss = toCenter - along * direction;
+    float radius2 = sphere.radius * sphere.radius;
+    float miss2 = glm::dot(miss, miss);
+    if (miss2 > radius2)
+        return false;
+    float halfChord = sqrt(radius2 - miss2);
+    if (along + halfChord < 0.0f)
+        return false;
+    distance = std::max(along - halfChord, 0.0f);
+    return true;
+}
+
+static bool sphereOverlaps(const glm::vec3& center, float radius, const BvhSphere& sphere)
+{
+    glm::vec3 offset = sphere.center - center;
+    float reach = radius + sphere.radius;
+    return glm::dot(offset, offset) <= reach * reach;
+}
+
+// As asteroid_cull.vs decides it
+static bool sphereInFrustum(const glm::vec4 planes[6], const BvhSphere& sphere)
+{
+    for (int i = 0; i < 6; i++)
+        if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w <= -sphere.radius)
+            return false;
+    return true;
+}
+
+// ----- Queries -----
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhRayHit& hit) const
+{
+    if (nodes.empty())
+        return false;
+    // Kept finite, so a slab the ray runs along gives a huge span rather than 0 * inf
+    glm::vec3 inverse;
+    for (int axis = 0; axis < 3; axis++)
+        inverse[axis] = fabs(direction[axis]) > 1e-20f ? 1.0f / direction[axis] : copysign(1e20f, direction[axis]);
+
+    struct Pending
+    {
+        int node;
+        float entry;
+    };
+    Pending stack[TRAVERSAL_STACK];
+    int top = 0;
+    stack[top++] = { 0, 0.0f };
+    float best = maxDistance;
+    bool found = false;
+    while (top > 0)
+    {
+        Pending pending = stack[--top];
+        if (pending.entry > best)
+            continue;
+        const BvhNode& node = nodes[pending.node];
+        float entry[BVH_WIDTH];
+        int mask = rayBoxes(node, origin, inverse, best, entry);
+        // Leaves are tested on the spot; inner nodes go on the stack farthest first, so the
+        // nearest is opened next and shortens the ray for the rest
+        int inner[BVH_WIDTH];
+        int innerCount = 0;
+        for (int slot = 0; slot < BVH_WIDTH; slot++)
+        {
+            if (!(mask & (1 << slot)))
+                continue;
+            if (node.child[slot] >= 0)
+            {
+                int at = innerCount++;
+                while (at > 0 && entry[inner[at - 1]] < entry[slot])
+                {
+                    inner[at] = inner[at - 1];
+                    at--;
+                }
+                inner[at] = slot;
+                continue;
+            }
+            for (uint32_t i = node.first[slot]; i < node.first[slot] + node.count[slot]; i++)
+            {
+                float distance;
+                if (raySphere(origin, direction, leafSpheres[i], distance) && distance < best)
+                {
+                    best = distance;
+                    hit = { order[i], distance };
+                    found = true;
+                }
+            }
+        }
+        for (int i = 0; i < innerCount; i++)
+            stack[top++] = { node.child[inner[i]], entry[inner[i]] };
+    }
+    return found;
+}
+
+void Bvh::appendRange(uint32_t first, uint32_t count, std::vector<uint32_t>& out) const
+{
+    out.insert(out.end(), order.begin() + first, order.begin() + first + count);
+}
+
+void Bvh::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const
+{
+    if (nodes.empty())
+        return;
+    int stack[TRAVERSAL_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BvhNode& node = nodes[stack[--top]];
+        int inside;
+        int mask = sphereBoxes(node, center, radius, inside);
+        for (int slot = 0; slot < BVH_WIDTH; slot++)
+        {
+            if (!(mask & (1 << slot)))
+                continue;
+            // A box within the sphere holds only items that overlap it: take the whole run
+            if (inside & (1 << slot))
+                appendRange(node.first[slot], node.count[slot], out);
+            else if (node.child[slot] >= 0)
+                stack[top++] = node.child[slot];
+            else
+                for (uint32_t i = node.first[slot]; i < node.first[slot] + node.count[slot]; i++)
+                    if (sphereOverlaps(center, radius, leafSpheres[i]))
+                        out.push_back(order[i]);
+        }
+    }
+}
+
+void Bvh::queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& out) const
+{
+    if (nodes.empty())
+        return;
+    glm::vec4 planes[6];
+    frustumPlanes(viewProjection, planes);
+    int stack[TRAVERSAL_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BvhNode& node = nodes[stack[--top]];
+        int inside;
+        int mask = frustumBoxes(node, planes, inside);
+        for (int slot = 0; slot < BVH_WIDTH; slot++)
+        {
+            if (!(mask & (1 << slot)))
+                continue;
+            if (inside & (1 << slot))
+                appendRange(node.first[slot], node.count[slot], out);
+            else if (node.child[slot] >= 0)
+                stack[top++] = node.child[slot];
+            else
+                for (uint32_t i = node.first[slot]; i < node.first[slot] + node.count[slot]; i++)
+                    if (sphereInFrustum(planes, leafSpheres[i]))
+                        out.push_back(order[i]);
+        }
+    }
+}
+
+void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+    // Gribb/Hartmann: w plus or minus each row of the matrix
+    for (int i = 0; i < 3; i++)
+    {
+        glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[i * 2] = w + row;
+        planes[i * 2 + 1] = w - row;
+    }
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// ----- Benchmark -----
+
+bool parseBvhBenchArgs(int argc, char** argv, BvhBenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench-bvh") != 0)
+            continue;
+        options.enabled = true;
+        // The count is optional
+        if (i + 1 >= argc || strncmp(argv[i + 1], "--", 2) == 0)
+            continue;
+        char* end = nullptr;
+        double value = strtod(argv[++i], &end);
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; end++; break;
+        case 'm': case 'M': value *= 1e6; end++; break;
+        default: break;
+        }
+        if (end == argv[i] || *end != '\0' || value < 1.0 || value > 4e9)
+        {
+            std::cerr << "Bad value for --bench-bvh: " << argv[i] << std::endl;
+            return false;
+        }
+        options.count = (long long)value;
+    }
+    return true;
+}
+
+// Rocks at scale 1 are about this big; the real bound depends on the shapes asteroid_belt.cpp makes
+static const float BENCH_ROCK_RADIUS = 0.7f;
+// Sim seconds the orbits run on before the refit: most of a turn at the belt radius
+static const double BENCH_ORBIT_TIME = 60.0;
+// Queries timed through the tree, and how many of them a linear scan repeats to compare
+static const int BENCH_RAYS = 100000, BENCH_LINEAR_RAYS = 100;
+static const int BENCH_SPHERES = 100000, BENCH_LINEAR_SPHERES = 100;
+static const int BENCH_FRUSTA = 100, BENCH_LINEAR_FRUSTA = 10;
+static const float BENCH_QUERY_RADIUS = 1.5f;
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printQueryRow(const char* name, int queries, double ms, int linearQueries, double linearMs,
+    double results, bool matched)
+{
+    double perQuery = ms * 1e3 / queries;
+    double linearPerQuery = linearMs * 1e3 / linearQueries;
+    std::cout << std::setw(8) << name << std::setw(10) << queries << std::fixed << std::setprecision(2)
+        << std::setw(12) << perQuery << std::setw(14) << linearPerQuery << std::setw(10) << std::setprecision(0)
+        << linearPerQuery / perQuery << "x" << std::setw(12) << std::setprecision(1) << results
+        << (matched ? "" : "  MISMATCH") << std::endl;
+}
+
+int runBvhBenchmark(const BvhBenchOptions& options, uint32_t seed)
+{
+    // The belt sol.json describes
+    AsteroidBeltShape shape = { 38.5f, 6.5f, 0.2f, 0.9f, 1.08f, 1.1f, -1.1f };
+    size_t count = (size_t)options.count;
+    std::vector<AsteroidInstance> rocks(count);
+    generateAsteroids(seed, shape, 0, count, rocks.data());
+    std::vector<glm::vec3> positions(count);
+    std::vector<BvhSphere> spheres(count);
+    auto place = [&](double time)
+    {
+        asteroidPositions(rocks.data(), count, time, positions.data());
+        for (size_t i = 0; i < count; i++)
+            spheres[i] = { positions[i], rocks[i].phase.w * BENCH_ROCK_RADIUS };
+    };
+    place(0.0);
+
+    std::cout << "BVH: " << count << " rocks, " << BVH_WIDTH << "-wide nodes, "
+#ifdef SIMD_SSE2
+        << "SSE2"
+#else
+        << "scalar"
+#endif
+        << ", seed " << seed << std::endl;
+    Bvh bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(spheres.data(), count);
+    double buildMs = millisecondsSince(start);
+    float builtCost = bvh.cost();
+    std::cout << std::fixed << std::setprecision(1) << "build   " << std::setw(10) << buildMs << " ms, "
+        << bvh.nodeCount() << " nodes, SAH cost " << builtCost << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    place(BENCH_ORBIT_TIME);
+    double orbitMs = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    bvh.refit(spheres.data());
+    double refitMs = millisecondsSince(start);
+    std::cout << "orbits  " << std::setw(10) << orbitMs << " ms, to " << BENCH_ORBIT_TIME << " sim seconds" << std::endl;
+    std::cout << "refit   " << std::setw(10) << refitMs << " ms, SAH cost " << bvh.cost()
+        << (bvh.needsRebuild() ? ", due a rebuild" : "") << std::endl;
+    if (bvh.needsRebuild())
+    {
+        start = std::chrono::steady_clock::now();
+        bvh.build(spheres.data(), count);
+        std::cout << "rebuild " << std::setw(10) << millisecondsSince(start) << " ms, SAH cost " << bvh.cost() << std::endl;
+    }
+
+    // Rays and frusta from a ring outside the belt towards points in it; spheres around points in it.
+    // Stream 2 of the seed, apart from the belt's.
+    CounterRandom random(seed, 0, 2);
+    auto beltPoint = [&]
+    {
+        float angle = random.next() * 6.2831853f;
+        float radius = shape.beltRadius + (random.next() * 2.0f - 1.0f) * shape.beltWidth;
+        return glm::vec3(radius * sin(angle), (random.next() * 2.0f - 1.0f) * 1.5f, radius * cos(angle));
+    };
+    auto viewPoint = [&]
+    {
+        float angle = random.next() * 6.2831853f;
+        return glm::vec3(70.0f * sin(angle), (random.next() * 2.0f - 1.0f) * 20.0f, 70.0f * cos(angle));
+    };
+    std::cout << std::setw(8) << "query" << std::setw(10) << "queries" << std::setw(12) << "us each"
+        << std::setw(14) << "linear us" << std::setw(11) << "speedup" << std::setw(12) << "results" << std::endl;
+    bool consistent = true;
+
+    // Rays: the nearest hit
+    std::vector<glm::vec3> origins(BENCH_RAYS), directions(BENCH_RAYS);
+    for (int i = 0; i < BENCH_RAYS; i++)
+    {
+        origins[i] = viewPoint();
+        directions[i] = glm::normalize(beltPoint() - origins[i]);
+    }
+    std::vector<BvhRayHit> hits(BENCH_RAYS);
+    std::vector<char> found(BENCH_RAYS);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_RAYS; i++)
+        found[i] = bvh.raycast(origins[i], directions[i], FLT_MAX, hits[i]);
+    double ms = millisecondsSince(start);
+    int hitCount = 0;
+    for (char hitSomething : found)
+        hitCount += hitSomething;
+    bool matched = true;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_LINEAR_RAYS; i++)
+    {
+        BvhRayHit nearest = { 0, FLT_MAX };
+        bool any = false;
+        for (size_t item = 0; item < count; item++)
+        {
+            float distance;
+            if (raySphere(origins[i], directions[i], spheres[item], distance) && distance < nearest.distance)
+            {
+                nearest = { (uint32_t)item, distance };
+                any = true;
+            }
+        }
+        // Two rocks at the very same distance may come back either way round
+        if (any != (bool)found[i] || (any && nearest.item != hits[i].item && nearest.distance != hits[i].distance))
+            matched = false;
+    }
+    printQueryRow("ray", BENCH_RAYS, ms, BENCH_LINEAR_RAYS, millisecondsSince(start), (double)hitCount / BENCH_RAYS, matched);
+    consistent = consistent && matched;
+
+    // Spheres: every rock within reach
+    std::vector<glm::vec3> centers(BENCH_SPHERES);
+    for (glm::vec3& center : centers)
+        center = beltPoint();
+    std::vector<uint32_t> results, expected;
+    results.reserve(count);
+    expected.reserve(count);
+    size_t resultCount = 0;
+    start = std::chrono::steady_clock::now();
+    for (const glm::vec3& center : centers)
+    {
+        results.clear();
+        bvh.querySphere(center, BENCH_QUERY_RADIUS, results);
+        resultCount += results.size();
+    }
+    ms = millisecondsSince(start);
+    double linearMs = 0.0;
+    matched = true;
+    for (int i = 0; i < BENCH_LINEAR_SPHERES; i++)
+    {
+        start = std::chrono::steady_clock::now();
+        expected.clear();
+        for (size_t item = 0; item < count; item++)
+            if (sphereOverlaps(centers[i], BENCH_QUERY_RADIUS, spheres[item]))
+                expected.push_back((uint32_t)item);
+        linearMs += millisecondsSince(start);
+        results.clear();
+        bvh.querySphere(centers[i], BENCH_QUERY_RADIUS, results);
+        std::sort(results.begin(), results.end());
+        matched = matched && results == expected;
+    }
+    printQueryRow("sphere", BENCH_SPHERES, ms, BENCH_LINEAR_SPHERES, linearMs, (double)resultCount / BENCH_SPHERES, matched);
+    consistent = consistent && matched;
+
+    // Frusta: what a camera outside the belt sees of it
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::vector<glm::mat4> viewProjections(BENCH_FRUSTA);
+    for (glm::mat4& viewProjection : viewProjections)
+    {
+        glm::vec3 eye = viewPoint();
+        viewProjection = projection * glm::lookAt(eye, beltPoint(), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+    resultCount = 0;
+    start = std::chrono::steady_clock::now();
+    for (const glm::mat4& viewProjection : viewProjections)
+    {
+        results.clear();
+        bvh.queryFrustum(viewProjection, results);
+        resultCount += results.size();
+    }
+    ms = millisecondsSince(start);
+    linearMs = 0.0;
+    matched = true;
+    for (int i = 0; i < BENCH_LINEAR_FRUSTA; i++)
+    {
+        start = std::chrono::steady_clock::now();
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjections[i], planes);
+        expected.clear();
+        for (size_t item = 0; item < count; item++)
+            if (sphereInFrustum(planes, spheres[item]))
+                expected.push_back((uint32_t)item);
+        linearMs += millisecondsSince(start);
+        results.clear();
+        bvh.queryFrustum(viewProjections[i], results);
+        std::sort(results.begin(), results.end());
+        matched = matched && results == expected;
+    }
+    printQueryRow("frustum", BENCH_FRUSTA, ms, BENCH_LINEAR_FRUSTA, linearMs, (double)resultCount / BENCH_FRUSTA, matched);
+    consistent = consistent && matched;
+    return consistent ? 0 : 1;
+}
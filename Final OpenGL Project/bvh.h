@@ -0,0 +1,111 @@
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// A bounding volume hierarchy over spheres, for the questions the CPU asks of the scene: what is
+// under the cursor, what is within some distance, what a frustum holds. Built top-down with the
+// surface area heuristic over BVH_BINS bins per axis, then collapsed into nodes of BVH_WIDTH
+// children whose boxes are stored as structure-of-arrays, so one SSE2 slab test checks all four.
+// Moving items are handled by refitting the boxes bottom-up; the tree keeps its shape, and
+// needsRebuild says when the items have drifted far enough that a fresh build pays. No GL, so
+// any thread may build, refit or query it, though not while another refits.
+const int BVH_WIDTH = 4;
+const int BVH_BINS = 16;
+const int BVH_LEAF_SIZE = 4;                // Most items a leaf holds
+const float BVH_REBUILD_COST_RATIO = 1.5f;  // SAH cost over the built tree's that calls for a rebuild
+
+struct BvhSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+struct BvhRayHit
+{
+    uint32_t item;          // Index into the spheres it was built from
+    float distance;         // Along the ray to where it enters the sphere; 0 from inside
+};
+
+// Four children; a slot is a leaf (child -1) or an inner node, and either way covers items
+// [first, first + count) of the build order: everything under it, so a subtree is one run
+struct alignas(16) BvhNode
+{
+    float minX[BVH_WIDTH], minY[BVH_WIDTH], minZ[BVH_WIDTH];
+    float maxX[BVH_WIDTH], maxY[BVH_WIDTH], maxZ[BVH_WIDTH];
+    int32_t child[BVH_WIDTH];
+    uint32_t first[BVH_WIDTH];
+    uint32_t count[BVH_WIDTH];      // 0 for an empty slot
+};
+
+class Bvh
+{
+public:
+    // Over spheres[0, count); the item ids the queries return are indices into it. Reuses the
+    // buffers of the last build, so rebuilding the same number of items allocates nothing.
+    void build(const BvhSphere* spheres, size_t count);
+    // The same items in their new places: the boxes are refit, the tree is not rebuilt
+    void refit(const BvhSphere* spheres);
+    bool needsRebuild() const { return sahCost > BVH_REBUILD_COST_RATIO * builtCost; }
+    // Expected nodes opened and spheres tested by a query, as of the last build or refit
+    float cost() const { return sahCost; }
+    size_t size() const { return leafSpheres.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+
+    // Nearest sphere the ray enters within maxDistance; direction must be unit length
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhRayHit& hit) const;
+    // Appends every item overlapping the sphere
+    void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+    // Appends every item at least partly inside the frustum of viewProjection
+    void queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& out) const;
+
+private:
+    // The binary tree the SAH build makes, before collapsing
+    struct BuildNode
+    {
+        glm::vec3 min, max;
+        int left, right;            // -1 for a leaf
+        uint32_t first, count;
+    };
+    // The build partitions these in place, so each level reads its range in order
+    struct BuildItem
+    {
+        BvhSphere sphere;
+        uint32_t item;
+    };
+
+    int buildRange(uint32_t first, uint32_t count, int depth);
+    int collapse(int buildNode);
+    void appendRange(uint32_t first, uint32_t count, std::vector<uint32_t>& out) const;
+
+    std::vector<BvhNode> nodes;                 // Root first; children always after their parent
+    std::vector<uint32_t> order;                // Item ids in leaf order
+    std::vector<BvhSphere> leafSpheres;         // spheres[order[i]], so leaves read memory in order
+    std::vector<BuildNode> buildNodes;
+    std::vector<BuildItem> buildItems;
+    float sahCost = 0.0f;
+    float builtCost = 0.0f;
+};
+
+// Planes of the frustum of viewProjection, xyz pointing inwards, normalized so w is a distance
+void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+struct BvhBenchOptions
+{
+    bool enabled = false;
+    long long count = 1000000;
+};
+
+// Parses --bench-bvh [N], N taking a k/M suffix
+// Returns false on a malformed argument
+bool parseBvhBenchArgs(int argc, char** argv, BvhBenchOptions& options);
+
+// Builds the index over N rocks of the belt and prints the build, orbit and refit times, then ray,
+// sphere and frustum queries against a linear scan of the same spheres. Returns non-zero if the
+// two ever disagree.
+int runBvhBenchmark(const BvhBenchOptions& options, uint32_t seed);
+
+#endif // BVH_H
@@ -1,97 +1,81 @@
 #include "utils.h"
 #include "celestial.h"
+#include "benchmark.h"
+#include "virtual_texture.h"
+#include "asteroid_belt.h"
+#include "body_transforms.h"
+#include "geometry.h"
+#include "simd_math.h"
 #include <random>
 #include <ctime>
 
 extern glm::vec3 cameraPos;
-extern int sphereRes;
 int ringRes = 6;
 int ringSegments = 20;
 
 
-void updateCelestialPosition(PlanetParams& satellite, float deltaTime, glm::vec3 mainPosition)
-{
-    satellite.orbitAngle -= deltaTime * satellite.orbitalSpeed;
-    satellite.spinAngle += deltaTime * satellite.spinSpeed;
-
-    glm::vec3 satelliteOffset = orbitMaker(satellite.semiMajorAxis, satellite.orbitAngle, satellite.eccentricity, satellite.inclination);
-    satellite.position = mainPosition + satelliteOffset; // Position relative
-}
-
-glm::vec3 orbitMaker(float semiMajorAxis, float angle, float eccentricity, float inclination)
-{
-    float theta = glm::radians(angle);
-    float x = semiMajorAxis * (cos(theta) - eccentricity);
-    float z = semiMajorAxis * sqrt(1.0f - eccentricity * eccentricity) * sin(theta);
-
-    glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(inclination), glm::vec3(1.0f, 0.0f, 0.0f));
-    glm::vec4 tiltedPosition = rotationMatrix * glm::vec4(x, 0.0f, z, 1.0f);
-
-    return glm::vec3(tiltedPosition);
-}
-
-// Function to generate orbit path for the Moon relative to Earth
-std::vector<glm::vec3> computeMoonOrbitPath(glm::vec3 center, float semiMajorAxis, float eccentricity, float inclination, int segments)
+std::vector<glm::vec3> generateOrbitPath(float semiMajorAxis, float eccentricity, float inclination, int segments)
 {
-    std::vector<glm::vec3> orbitPoints;
+    std::vector<glm::vec3> orbitVertices;
     for (int i = 0; i < segments; ++i)
     {
         float angle = i * (360.0f / segments);
-        glm::vec3 point = center + orbitMaker(semiMajorAxis, angle, eccentricity, inclination);
-        orbitPoints.push_back(point);
+        orbitVertices.push_back(glm::vec3(orbitMaker(semiMajorAxis, angle, eccentricity, inclination)));
     }
-    return orbitPoints;
+    return orbitVertices;
 }
 
-std::vector<glm::vec3> generateOrbitPath(float semiMajorAxis, float eccentricity, float inclination, int segments)
+void uploadOrbitPath(Orbit& orbit)
 {
-    std::vector<glm::vec3> orbitVertices;
-    for (int i = 0; i < segments; ++i)
+    GLsizeiptr size = orbit.points.size() * sizeof(glm::vec3);
+    if (!orbit.VAO)
     {
-        float angle = i * (360.0f / segments);
-        orbitVertices.push_back(orbitMaker(semiMajorAxis, angle, eccentricity, inclination));
+        glGenVertexArrays(1, &orbit.VAO);
+        glGenBuffers(1, &orbit.VBO);
+        glBindVertexArray(orbit.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, orbit.VBO);
+        glBufferData(GL_ARRAY_BUFFER, size, orbit.points.data(), GL_DYNAMIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
     }
-    return orbitVertices;
+    else
+    {
+        // The point count never changes, so the storage is reused
+        glBindBuffer(GL_ARRAY_BUFFER, orbit.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, orbit.points.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void renderOrbitPath(GLuint shaderProgram, const std::vector<glm::vec3>& orbitPoints)
+void renderOrbitPath(GLuint shaderProgram, const Orbit& orbit, glm::vec3 offset)
 {
-    GLuint orbitVAO, orbitVBO;
-
-    // Create and bind the VAO and VBO for each orbit
-    glGenVertexArrays(1, &orbitVAO);
-    glGenBuffers(1, &orbitVBO);
-
-    glBindVertexArray(orbitVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, orbitVBO);
-    glBufferData(GL_ARRAY_BUFFER, orbitPoints.size() * sizeof(glm::vec3), orbitPoints.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // Use the shader program
     glUseProgram(shaderProgram);
     glUniform3fv(glGetUniformLocation(shaderProgram, "cameraPos"), 1, glm::value_ptr(cameraPos));
+    glUniform3fv(glGetUniformLocation(shaderProgram, "offset"), 1, glm::value_ptr(offset));
     // Render the orbit
-    glBindVertexArray(orbitVAO);
-    glDrawArrays(GL_LINE_LOOP, 0, orbitPoints.size());
+    glBindVertexArray(orbit.VAO);
+    glDrawArrays(GL_LINE_LOOP, 0, (GLsizei)orbit.points.size());
+    drawCallCount++;
     glBindVertexArray(0);
+}
 
-    // Cleanup VAO and VBO
-    glDeleteBuffers(1, &orbitVBO);
-    glDeleteVertexArrays(1, &orbitVAO);
+void deleteOrbitPath(Orbit& orbit)
+{
+    glDeleteBuffers(1, &orbit.VBO);
+    glDeleteVertexArrays(1, &orbit.VAO);
+    orbit.VAO = orbit.VBO = 0;
 }
 
-void renderCloudLayer(GLuint shaderProgram, GLuint VAO, const PlanetParams& planet, GLuint cloudTexture,
+void renderCloudLayer(GLuint shaderProgram, const SphereModel& sphere, const BodyStore& bodies, int body, GLuint cloudTexture,
     glm::vec3 cloudColor, float scale, float time, float alphaFactor,
-    glm::vec3 rimColor, float rimIntensity, glm::vec3 terminatorColor, float terminatorBlendFactor) {
-    // Model transformation matrix
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, planet.position);
-    model = glm::rotate(model, glm::radians(planet.orbitAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Orbit rotation
-    model = glm::rotate(model, glm::radians(planet.tilt), glm::vec3(1.0f, 0.0f, 0.0f));       // Tilt rotation
-    model = glm::rotate(model, glm::radians(planet.spinAngle - time), glm::vec3(0.0f, 1.0f, 0.0f));  // Add spinning animation
-    model = glm::scale(model, glm::vec3(planet.scale * scale)); // Scale for clouds
+    glm::vec3 rimColor, float rimIntensity, glm::vec3 terminatorColor, float terminatorBlendFactor,
+    const VirtualTexture* virtualClouds) {
+    const TransformComponent& planet = bodies.transforms[body];
+    // The planet's frame, spinning at its own pace and a little above the surface
+    glm::mat3 rotation = spinFrame(planet.tiltFrame, bodies.spins[body].angle - time);
+    glm::mat4 model = composeModel(rotation, planet.scale * scale, planet.position);
+    glm::mat3 normalMatrix = rotation * (1.0f / (planet.scale * scale));
 
     // Use the shader program
     glUseProgram(shaderProgram);
@@ -99,6 +83,7 @@ void renderCloudLayer(GLuint shaderProgram, GLuint VAO, const PlanetParams& plan
     // Pass uniform values to the shader
 
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
     glUniform1f(glGetUniformLocation(shaderProgram, "transparency"), alphaFactor);
     glUniform3f(glGetUniformLocation(shaderProgram, "cloudBaseColor"), cloudColor.r, cloudColor.g, cloudColor.b);
     glUniform1f(glGetUniformLocation(shaderProgram, "rimIntensity"), rimIntensity);
@@ -111,27 +96,30 @@ void renderCloudLayer(GLuint shaderProgram, GLuint VAO, const PlanetParams& plan
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, cloudTexture);
     glUniform1i(glGetUniformLocation(shaderProgram, "cloudTexture"), 0);
+    bindVirtualTexture(shaderProgram, "vtClouds", virtualClouds, 3);
 
     // Draw the cloud layer using the VAO
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36 * sphereRes * 18 * sphereRes * 6 * sphereRes, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(sphere.VAO);
+    glDrawElements(GL_TRIANGLES, sphere.indexCount, GL_UNSIGNED_INT, 0);
+    drawCallCount++;
     glBindVertexArray(0);
 }
 
-void renderRing(GLuint shaderProgram, GLuint ringVAO, const PlanetParams& planet, GLuint  ringTexture, bool flipped) {
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, planet.position);
-    model = glm::rotate(model, glm::radians(planet.orbitAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Orbit rotation
-    model = glm::rotate(model, glm::radians(planet.tilt), glm::vec3(1.0f, 0.0f, 0.0f));       // Tilt rotation
-    model = glm::scale(model, glm::vec3(planet.scale)); // Adjust scale
+void renderRing(GLuint shaderProgram, GLuint ringVAO, const BodyStore& bodies, int body, GLuint  ringTexture, bool flipped) {
+    const TransformComponent& planet = bodies.transforms[body];
+    const MaterialComponent& material = bodies.materials[body];
+    // In the planet's tilted frame, without its spin
+    glm::mat4 model = composeModel(planet.tiltFrame, planet.scale, planet.position);
+    glm::mat3 normalMatrix = planet.tiltFrame * (1.0f / planet.scale);
 
     glUseProgram(shaderProgram);
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniform1f(glGetUniformLocation(shaderProgram, "ambientStrength"), planet.ambientStrength + 0.02);
-    glUniform3f(glGetUniformLocation(shaderProgram, "rimColor"), planet.rimColor.r, planet.rimColor.g, planet.rimColor.b);
-    glUniform1f(glGetUniformLocation(shaderProgram, "rimIntensity"), planet.rimIntensity);
-    glUniform1f(glGetUniformLocation(shaderProgram, "specularStrength"), planet.specularStrength);
-    glUniform1f(glGetUniformLocation(shaderProgram, "shininess"), planet.shininess);
+    glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    glUniform1f(glGetUniformLocation(shaderProgram, "ambientStrength"), material.ambientStrength + 0.02);
+    glUniform3f(glGetUniformLocation(shaderProgram, "rimColor"), material.rimColor.r, material.rimColor.g, material.rimColor.b);
+    glUniform1f(glGetUniformLocation(shaderProgram, "rimIntensity"), material.rimIntensity);
+    glUniform1f(glGetUniformLocation(shaderProgram, "specularStrength"), material.specularStrength);
+    glUniform1f(glGetUniformLocation(shaderProgram, "shininess"), material.shininess);
     glUniform1i(glGetUniformLocation(shaderProgram, "flipped"), flipped);
     // Bind textures
     glActiveTexture(GL_TEXTURE0);
@@ -141,19 +129,36 @@ void renderRing(GLuint shaderProgram, GLuint ringVAO, const PlanetParams& planet
     // Render ring
     glBindVertexArray(ringVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, (ringSegments + 1) * 2 * ringRes);
+    drawCallCount++;
     glBindVertexArray(0);
 }
 
-void renderPlanet(GLuint shaderProgram, GLuint VAO, const PlanetParams& planet)
+unsigned planetShaderFeatures(const RenderableComponent& planet)
 {
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, planet.position);
-    model = glm::rotate(model, glm::radians(planet.orbitAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Orbit rotation
-    model = glm::rotate(model, glm::radians(planet.tilt), glm::vec3(1.0f, 0.0f, 0.0f));       // Tilt rotation
-    model = glm::rotate(model, glm::radians(planet.spinAngle), glm::vec3(0.0f, 1.0f, 0.0f));  // Self rotation
-    model = glm::scale(model, glm::vec3(planet.scale));
+    unsigned features = 0;
+    if (planet.virtualColor)
+        features |= PLANET_VT_COLOR;
+    // A virtual specular layer replaces the plain map, so only one of them is sampled
+    if (planet.virtualSpecular)
+        features |= PLANET_VT_SPECULAR;
+    else if (planet.specularMap)
+        features |= PLANET_SPECULAR_MAP;
+    if (planet.nightMap || planet.virtualNight)
+    {
+        features |= PLANET_NIGHT_MAP;
+        if (planet.virtualNight)
+            features |= PLANET_VT_NIGHT;
+    }
+    return features;
+}
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+void renderPlanet(GLuint shaderProgram, const SphereModel& sphere, const BodyStore& bodies, int body)
+{
+    const TransformComponent& transform = bodies.transforms[body];
+    const MaterialComponent& planet = bodies.materials[body];
+    const RenderableComponent& maps = bodies.renderables[body];
+    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(transform.model));
+    glUniformMatrix3fv(glGetUniformLocation(shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(transform.normalMatrix));
     glUniform1f(glGetUniformLocation(shaderProgram, "ambientStrength"), planet.ambientStrength);
     glUniform1f(glGetUniformLocation(shaderProgram, "specularStrength"), planet.specularStrength);
     glUniform1f(glGetUniformLocation(shaderProgram, "shininess"), planet.shininess);
@@ -164,120 +169,214 @@ void renderPlanet(GLuint shaderProgram, GLuint VAO, const PlanetParams& planet)
     glUniform3f(glGetUniformLocation(shaderProgram, "terminatorColor"), planet.terminatorColor.r, planet.terminatorColor.g, planet.terminatorColor.b);
     glUniform1f(glGetUniformLocation(shaderProgram, "terminatorBlendFactor"), planet.terminatorBlendFactor);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, planet.texture);
+    glBindTexture(GL_TEXTURE_2D, maps.texture);
     glUniform1i(glGetUniformLocation(shaderProgram, "texture1"), 0);
 
-    if (planet.useSpecularMap)
+    // Which of these the shader reads is decided by its variant (planetShaderFeatures)
+    if (maps.specularMap)
     {
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, planet.specularMap);
+        glBindTexture(GL_TEXTURE_2D, maps.specularMap);
         glUniform1i(glGetUniformLocation(shaderProgram, "specularMap"), 1);
     }
-    glUniform1i(glGetUniformLocation(shaderProgram, "useSpecularMap"), planet.useSpecularMap);
 
-    if (planet.useNightMap)
+    if (maps.nightMap)
     {
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, planet.nightMap);
+        glBindTexture(GL_TEXTURE_2D, maps.nightMap);
         glUniform1i(glGetUniformLocation(shaderProgram, "nightMap"), 2);
     }
-    glUniform1i(glGetUniformLocation(shaderProgram, "useNightMap"), planet.useNightMap);
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36 * sphereRes * 18 * sphereRes * 6 * sphereRes, GL_UNSIGNED_INT, 0);
+    bindVirtualTexture(shaderProgram, "vtColor", maps.virtualColor, 3);
+    bindVirtualTexture(shaderProgram, "vtSpecular", maps.virtualSpecular, 5);
+    bindVirtualTexture(shaderProgram, "vtNight", maps.virtualNight, 7);
+
+    glBindVertexArray(sphere.VAO);
+    glDrawElements(GL_TRIANGLES, sphere.indexCount, GL_UNSIGNED_INT, 0);
+    drawCallCount++;
     glBindVertexArray(0);
 }
 
-std::vector<glm::mat4> asteroids(float beltRadius, float beltWidth, float outlierProbability,
-    float closerMultiplier, float furtherMultiplier,
+float asteroidRadius(float outlierChanceXZ, float offset, float beltRadius, float beltWidth, float outlierProbability,
+    float closerMultiplier, float furtherMultiplier) {
+    float radius = beltRadius + offset * beltWidth; // Normal belt radius
+
+    if (outlierChanceXZ < outlierProbability / 2.0f) {
+        // Spawn closer in
+        radius *= closerMultiplier;
+        radius -= outlierChanceXZ; // Shrink radius
+    }
+    else if (outlierChanceXZ < outlierProbability) {
+        // Spawn further out
+        radius *= furtherMultiplier; // Increase radius
+        radius += outlierChanceXZ;
+    }
+    return radius;
+}
+
+float asteroidHeight(float outlierChanceY, float offset, float outlierProbability,
     float yOutlierMultiplier, float yInlierMultiplier) {
-    std::vector<glm::mat4> asteroidTransforms(NUM_ASTEROIDS);
+    float yOffset = offset * 1.1f - 1.2f; // Normal thickness range
 
-    for (unsigned int i = 0; i < NUM_ASTEROIDS; i++) {
-        glm::mat4 transform = glm::mat4(1.0f);
+    if (outlierChanceY < outlierProbability) {
+        // Y-axis outliers
+        yOffset *= yOutlierMultiplier + outlierChanceY; // Amplify the Y-offset
+    }
+    else if (outlierChanceY > outlierProbability) {
+        // Spawn closer in Y
+        yOffset *= yInlierMultiplier - outlierChanceY; // Reduce Y offset
+    }
+    return yOffset;
+}
 
-        // Determine outlier type: closer, further, or normal in XZ plane
-        float outlierChanceXZ = static_cast<float>(rand()) / RAND_MAX;
-        float radius = beltRadius + static_cast<float>(rand()) / RAND_MAX * beltWidth; // Normal belt radius
+float asteroidScale(float scaleChance, float size) {
+    // Random scale with a chance for a size outlier
+    if (scaleChance < 0.01f) { // 1% chance for a larger asteroid
+        return 0.3f + size * 0.8f; // Large scale between 0.3 and 1.1
+    }
+    else if (scaleChance < 0.017f) { // 1.7% chance for a large asteroid
+        return 0.2f + size * 0.7f; // Large scale between 0.2 and 0.9
+    }
+    return 0.1f + size * 0.3f; // Normal scale between 0.1 and 0.4
+}
 
-        if (outlierChanceXZ < outlierProbability / 2.0f) {
-            // Spawn closer in
-            radius *= closerMultiplier;
-            radius -= outlierChanceXZ; // Shrink radius
-        }
-        else if (outlierChanceXZ < outlierProbability) {
-            // Spawn further out
-            radius *= furtherMultiplier; // Increase radius
-            radius += outlierChanceXZ;
-        }
+glm::vec4 asteroidRotation(float halfX, float halfY, float halfZ) {
+    float sx = sin(halfX), cx = cos(halfX);
+    float sy = sin(halfY), cy = cos(halfY);
+    float sz = sin(halfZ), cz = cos(halfZ);
+    float aw = cx * cy, ax = sx * cy, ay = cx * sy, az = sx * sy;
+    return glm::vec4(ax * cz + ay * sz, ay * cz - ax * sz, aw * sz + az * cz, aw * cz - az * sz);
+}
 
-        // Random Y offset with outliers
-        float outlierChanceY = static_cast<float>(rand()) / RAND_MAX;
-        float yOffset = static_cast<float>(rand()) / RAND_MAX * 1.1f - 1.2f; // Normal thickness range
+float asteroidMeanMotion(float semiMajorAxis, float beltRadius) {
+    // Kepler's third law; sqrt rather than pow so every platform gets the same bits
+    float ratio = beltRadius / semiMajorAxis;
+    return BELT_MEAN_MOTION * ratio * sqrt(ratio);
+}
 
-        if (outlierChanceY < outlierProbability) {
-            // Y-axis outliers
-            yOffset *= yOutlierMultiplier + outlierChanceY; // Amplify the Y-offset
-        }
-        else if (outlierChanceY > outlierProbability) {
-            // Spawn closer in Y
-            yOffset *= yInlierMultiplier - outlierChanceY; // Reduce Y offset
-        }
+AsteroidInstance asteroidOrbit(float radius, float height, float longitude, float eccentricity, float periapsis,
+    float meanAnomaly, float meanMotion, float scale, glm::vec4 rotation, float spin) {
+    // The slope stands in for the angle; it is a few degrees at most
+    float inclination = height / radius;
+    // q and -q are the same turn, so w can be left out and rebuilt as the positive root
+    if (rotation.w < 0.0f)
+        rotation = -rotation;
+    AsteroidInstance instance;
+    instance.orbit = glm::vec4(radius, eccentricity, inclination, longitude - periapsis - meanAnomaly);
+    instance.phase = glm::vec4(periapsis, meanAnomaly, meanMotion, scale);
+    instance.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, spin);
+    return instance;
+}
 
-        // Random position in a toroidal region
-        float angle = static_cast<float>(rand()) / RAND_MAX * 360.0f; // Random angle in degrees
-
-        transform = glm::translate(transform, glm::vec3(
-            radius * sin(glm::radians(angle)), // X position
-            yOffset,                           // Y position
-            radius * cos(glm::radians(angle))  // Z position
-        ));
-
-        // Random rotation around all three axes
-        float rotX = static_cast<float>(rand()) / RAND_MAX * 360.0f; // Random rotation around X-axis
-        float rotY = static_cast<float>(rand()) / RAND_MAX * 360.0f; // Random rotation around Y-axis
-        float rotZ = static_cast<float>(rand()) / RAND_MAX * 360.0f; // Random rotation around Z-axis
-
-        transform = glm::rotate(transform, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around X-axis
-        transform = glm::rotate(transform, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around Y-axis
-        transform = glm::rotate(transform, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f)); // Rotate around Z-axis
-
-        // Random scale with a chance for a size outlier
-        float scaleChance = static_cast<float>(rand()) / RAND_MAX;
-        float scale;
-        if (scaleChance < 0.01f) { // 1% chance for a larger asteroid
-            scale = 0.3f + static_cast<float>(rand()) / RAND_MAX * 0.8f; // Large scale between 0.3 and 1.1
-        }
-        else if (scaleChance < 0.017f) { // 1.7% chance for a large asteroid
-            scale = 0.2f + static_cast<float>(rand()) / RAND_MAX * 0.7f; // Large scale between 0.2 and 0.9
-        }
-        else {
-            scale = 0.1f + static_cast<float>(rand()) / RAND_MAX * 0.3f; // Normal scale between 0.1 and 0.4
-        }
-        transform = glm::scale(transform, glm::vec3(scale));
+// Mean anomaly at time, wrapped in doubles: a float time times the mean motion loses the phase
+// within a few thousand sim seconds
+static float asteroidMeanAnomaly(const AsteroidInstance& rock, double time)
+{
+    const double twoPi = 6.283185307179586;
+    double meanAnomaly = fmod((double)rock.phase.y + (double)rock.phase.z * time, twoPi);
+    return (float)(meanAnomaly < 0.0 ? meanAnomaly + twoPi : meanAnomaly);
+}
 
-        asteroidTransforms[i] = transform;
+// orbitPosition of asteroid_instance.glsl for one rock; the SSE2 path below does four the same way
+static glm::vec3 asteroidPosition(const AsteroidInstance& rock, float meanAnomaly)
+{
+    float e = rock.orbit.y;
+    float s, c;
+    sinCos(meanAnomaly, s, c);
+    float E = meanAnomaly + e * s;
+    for (int i = 0; i < 2; i++)
+    {
+        sinCos(E, s, c);
+        E -= (E - e * s - meanAnomaly) / (1.0f - e * c);
     }
+    sinCos(E, s, c);
+    float x = rock.orbit.x * (c - e);
+    float y = rock.orbit.x * (std::sqrt(1.0f - e * e) * s);
+
+    float sw, cw, sn, cn, si, ci;
+    sinCos(rock.phase.x, sw, cw);
+    sinCos(rock.orbit.w, sn, cn);
+    sinCos(rock.orbit.z, si, ci);
+    float u = x * cw - y * sw;
+    float v = x * sw + y * cw;
+    return glm::vec3(u * sn + v * (ci * cn), v * si, u * cn - v * (ci * sn));
+}
 
-    return asteroidTransforms;
+void asteroidPositions(const AsteroidInstance* instances, size_t count, double time, glm::vec3* out)
+{
+    size_t i = 0;
+#ifdef SIMD_SSE2
+    // Four rocks a pass, one per lane
+    for (; i + 4 <= count; i += 4)
+    {
+        alignas(16) float lanes[6][4];   // a, e, inclination, node, periapsis, mean anomaly
+        for (int lane = 0; lane < 4; lane++)
+        {
+            const AsteroidInstance& rock = instances[i + lane];
+            lanes[0][lane] = rock.orbit.x;
+            lanes[1][lane] = rock.orbit.y;
+            lanes[2][lane] = rock.orbit.z;
+            lanes[3][lane] = rock.orbit.w;
+            lanes[4][lane] = rock.phase.x;
+            lanes[5][lane] = asteroidMeanAnomaly(rock, time);
+        }
+        __m128 a = _mm_load_ps(lanes[0]);
+        __m128 e = _mm_load_ps(lanes[1]);
+        __m128 meanAnomaly = _mm_load_ps(lanes[5]);
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 s, c;
+        sinCos4(meanAnomaly, s, c);
+        __m128 E = _mm_add_ps(meanAnomaly, _mm_mul_ps(e, s));
+        for (int step = 0; step < 2; step++)
+        {
+            sinCos4(E, s, c);
+            __m128 residual = _mm_sub_ps(_mm_sub_ps(E, _mm_mul_ps(e, s)), meanAnomaly);
+            E = _mm_sub_ps(E, _mm_div_ps(residual, _mm_sub_ps(one, _mm_mul_ps(e, c))));
+        }
+        sinCos4(E, s, c);
+        __m128 x = _mm_mul_ps(a, _mm_sub_ps(c, e));
+        __m128 y = _mm_mul_ps(a, _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(one, _mm_mul_ps(e, e))), s));
+
+        __m128 sw, cw, sn, cn, si, ci;
+        sinCos4(_mm_load_ps(lanes[4]), sw, cw);
+        sinCos4(_mm_load_ps(lanes[3]), sn, cn);
+        sinCos4(_mm_load_ps(lanes[2]), si, ci);
+        __m128 u = _mm_sub_ps(_mm_mul_ps(x, cw), _mm_mul_ps(y, sw));
+        __m128 v = _mm_add_ps(_mm_mul_ps(x, sw), _mm_mul_ps(y, cw));
+        alignas(16) float position[3][4];
+        _mm_store_ps(position[0], _mm_add_ps(_mm_mul_ps(u, sn), _mm_mul_ps(v, _mm_mul_ps(ci, cn))));
+        _mm_store_ps(position[1], _mm_mul_ps(v, si));
+        _mm_store_ps(position[2], _mm_sub_ps(_mm_mul_ps(u, cn), _mm_mul_ps(v, _mm_mul_ps(ci, sn))));
+        for (int lane = 0; lane < 4; lane++)
+            out[i + lane] = glm::vec3(position[0][lane], position[1][lane], position[2][lane]);
+    }
+#endif
+    for (; i < count; i++)
+        out[i] = asteroidPosition(instances[i], asteroidMeanAnomaly(instances[i], time));
 }
 
-void renderAsteroidBelt(GLuint shaderProgram, GLuint VAO, int vertexCount,
+void renderAsteroidBelt(GLuint shaderProgram, GLuint impostorProgram, AsteroidBelt& belt,
+    const glm::mat4& projection, const glm::mat4& view,
     float ambientStrength, float specularStrength,
     glm::vec3 rimColor, float rimIntensity,
-    float asteroidRotationAngle)
+    float orbitTime)
 {
-    // Set the asteroid rotation angle
-    glUniform1f(glGetUniformLocation(shaderProgram, "asteroidRotationAngle"), asteroidRotationAngle);
+    // Cull and sort by rock shape and LOD on the GPU first; that pass binds its own program
+    belt.cull(projection, view, orbitTime);
 
-    // Set lighting and material properties
-    glUniform1f(glGetUniformLocation(shaderProgram, "ambientStrength"), ambientStrength);
-    glUniform1f(glGetUniformLocation(shaderProgram, "specularStrength"), specularStrength);
-    glUniform3f(glGetUniformLocation(shaderProgram, "rimColor"), rimColor.r, rimColor.g, rimColor.b);
-    glUniform1f(glGetUniformLocation(shaderProgram, "rimIntensity"), rimIntensity);
-
-    // Bind and render
-    glBindVertexArray(VAO);
-    glDrawElementsInstanced(GL_TRIANGLES, vertexCount, GL_UNSIGNED_INT, 0, NUM_ASTEROIDS);
-    glBindVertexArray(0);
+    // Meshes up close, impostors further out, lit the same way
+    for (GLuint program : { shaderProgram, impostorProgram })
+    {
+        glUseProgram(program);
+        // Set lighting and material properties
+        glUniform1f(glGetUniformLocation(program, "ambientStrength"), ambientStrength);
+        glUniform1f(glGetUniformLocation(program, "specularStrength"), specularStrength);
+        glUniform3f(glGetUniformLocation(program, "rimColor"), rimColor.r, rimColor.g, rimColor.b);
+        glUniform1f(glGetUniformLocation(program, "rimIntensity"), rimIntensity);
+
+        if (program == shaderProgram)
+            belt.draw(program);
+        else
+            belt.drawImpostors(program);
+    }
 }
@@ -2,79 +2,113 @@
 #ifndef CELESTIAL_H
 #define CELESTIAL_H
 #include "texture_utils.h"
+#include "shader_variants.h"
 #include "utils.h"
+#include "body_store.h"
+#include "geometry.h"
 
 extern int NUM_ASTEROIDS;
+class VirtualTexture;
 
-struct PlanetParams
+// Permutation bits of celestial.fs, after the shared ShaderFeature bits
+enum PlanetShaderFeature
 {
-    float semiMajorAxis;
-    float orbitalSpeed;
-    float spinSpeed;
-    float tilt;
-    float eccentricity;
-    float inclination;
-    float scale;
-    GLuint texture;
-    float ambientStrength;
-    float specularStrength;
-    float shininess;
-    GLuint specularMap;
-    bool useSpecularMap;
-    glm::vec3 position;
-    float orbitAngle;
-    float spinAngle;
-    glm::vec3 rimColor;
-    float rimIntensity;
-    glm::vec3 terminatorColor;
-    float terminatorBlendFactor;
-    glm::vec3 edgeColor;
-    float edgeIntensity;
-    GLuint nightMap;
-    bool useNightMap;
-
-    PlanetParams(float semiMajorAxis, float orbitalSpeed, float spinSpeed, float tilt, float eccentricity, float inclination, float scale,
-        GLuint texture, float ambientStrength, float specularStrength, float shininess = false
-        , glm::vec3 rimColor = glm::vec3(0.2f), float rimIntensity = 0.3f, glm::vec3 terminatorColor = glm::vec3(0.005f), 
-        float terminatorBlendFactor = 0.7f, glm::vec3 edgeColor = glm::vec3(0.0f),
-        float edgeIntensity = 0.0f, GLuint specularMap = 0, bool useSpecularMap = false, GLuint nightMap = 0, bool useNightMap = false)
-        : semiMajorAxis(semiMajorAxis), orbitalSpeed(orbitalSpeed), spinSpeed(spinSpeed), tilt(tilt), eccentricity(eccentricity),
-        inclination(inclination), scale(scale), texture(texture), ambientStrength(ambientStrength),
-        specularStrength(specularStrength), shininess(shininess), rimColor(rimColor), rimIntensity(rimIntensity),
-        terminatorColor(terminatorColor), terminatorBlendFactor(terminatorBlendFactor), 
-        edgeColor(edgeColor), edgeIntensity(edgeIntensity),
-        specularMap(specularMap),useSpecularMap(useSpecularMap), nightMap(nightMap), useNightMap(useNightMap),
-        position(glm::vec3(0.0f)), orbitAngle(0.0f), spinAngle(0.0f) {}
+    PLANET_SPECULAR_MAP = SHADER_FIRST_CUSTOM,
+    PLANET_NIGHT_MAP = SHADER_FIRST_CUSTOM << 1,
+    PLANET_VT_COLOR = SHADER_FIRST_CUSTOM << 2,
+    PLANET_VT_SPECULAR = SHADER_FIRST_CUSTOM << 3,
+    PLANET_VT_NIGHT = SHADER_FIRST_CUSTOM << 4
 };
+const std::vector<std::string> PLANET_SHADER_FEATURES = { "SPECULAR_MAP", "NIGHT_MAP", "VT_COLOR", "VT_SPECULAR", "VT_NIGHT" };
+
+// Permutation bit of cloud.fs
+const unsigned CLOUD_VIRTUAL = SHADER_FIRST_CUSTOM;
+const std::vector<std::string> CLOUD_SHADER_FEATURES = { "VIRTUAL" };
+
+// The cheapest celestial.fs variant that still draws everything this planet has
+unsigned planetShaderFeatures(const RenderableComponent& planet);
+
 struct Orbit
 {
     std::vector<glm::vec3> points;
+    GLuint VAO = 0;     // Made by uploadOrbitPath, kept until deleteOrbitPath
+    GLuint VBO = 0;
     Orbit(std::vector<glm::vec3> points)
         : points(points) {}
 };
 
-glm::vec3 orbitMaker(float semiMajorAxis, float angle, float eccentricity = 0.0f, float inclination = 0.0f);
-
-std::vector<glm::vec3> computeMoonOrbitPath(glm::vec3 center, float semiMajorAxis, float eccentricity, float inclination, int segments = 360);
-
 std::vector<glm::vec3> generateOrbitPath(float semiMajorAxis, float eccentricity, float inclination, int segments = 360);
 
-void updateCelestialPosition(PlanetParams& satellite, float deltaTime, glm::vec3 mainPosition = glm::vec3(0.0f));
-
-void renderOrbitPath(GLuint shaderProgram, const std::vector<glm::vec3>& orbitPoints);
+// Copies orbit.points to its buffer, making the buffer the first time; call again when they move
+void uploadOrbitPath(Orbit& orbit);
+// offset moves the world-space points to where the world is drawn: minus the render origin
+void renderOrbitPath(GLuint shaderProgram, const Orbit& orbit, glm::vec3 offset = glm::vec3(0.0f));
+void deleteOrbitPath(Orbit& orbit);
 
-void renderCloudLayer(GLuint shaderProgram, GLuint VAO, const PlanetParams& planet, GLuint cloudTexture,
+// Clouds and rings turn with planet.tiltFrame, so they too need this frame's transforms
+void renderCloudLayer(GLuint shaderProgram, const SphereModel& sphere, const BodyStore& bodies, int body, GLuint cloudTexture,
     glm::vec3 cloudColor, float scale, float time = 0.0f, float alphaFactor = 1.0f,
     glm::vec3 rimColor = glm::vec3(0.85, 0.86, 0.99), float rimIntensity = 1.2f,
-    glm::vec3 terminatorColor = glm::vec3(0.0010, 0.0072, 0.016), float terminatorBlendFactor = 5.0f);
-void renderRing(GLuint shaderProgram, GLuint ringVAO, const PlanetParams& planet, GLuint  ringTexture, bool flipped = false);
+    glm::vec3 terminatorColor = glm::vec3(0.0010, 0.0072, 0.016), float terminatorBlendFactor = 5.0f,
+    const VirtualTexture* virtualClouds = nullptr);
+void renderRing(GLuint shaderProgram, GLuint ringVAO, const BodyStore& bodies, int body, GLuint  ringTexture, bool flipped = false);
 
-void renderPlanet(GLuint shaderProgram, GLuint VAO, const PlanetParams& planet);
-std::vector<glm::mat4> asteroids(float beltRadius, float beltWidth, float outlierProbability = 0.1f, float closerMultiplier = 1.5f , float furtherMultiplier = 1.5f, float yOutlierMultiplier=1.5f, float yInlierMultiplier = 1.5f);
+// Draws with planet.model and normalMatrix as they were last built (body_transforms.h)
+void renderPlanet(GLuint shaderProgram, const SphereModel& sphere, const BodyStore& bodies, int body);
+// Per-instance data of the asteroid belt: Keplerian elements instead of a position, so every
+// rock follows its own orbit at its own speed. asteroid_instance.glsl evaluates them at the
+// current sim time, so nothing is updated on the CPU per frame.
+struct AsteroidInstance
+{
+    glm::vec4 orbit;        // Semi-major axis, eccentricity, inclination, longitude of the ascending node
+    glm::vec4 phase;        // Argument of periapsis, mean anomaly at time 0, mean motion (rad per sim second), scale
+    glm::vec4 rotation;     // xyz of the unit quaternion at time 0 (w >= 0 is implied), w = spin about its z axis (rad/s)
+};
+static_assert(sizeof(AsteroidInstance) == 48, "AsteroidInstance is uploaded as three vec4 attributes");
+const int ASTEROID_INSTANCE_VEC4S = 3;
+
+// Mean motion at the belt radius; the old rigid belt turned this fast. Closer rocks go faster:
+// n = n0 * (beltRadius / a)^1.5.
+const float BELT_MEAN_MOTION = 0.1f;
+const float ASTEROID_MAX_ECCENTRICITY = 0.02f;  // Keeps a rock within ~2e * a of its mean place
+const float ASTEROID_MAX_SPIN = 0.5f;           // Rad per sim second, either way
 
+// One rock of the belt from uniform draws in [0, 1]: radius, height, rotation, scale, then the
+// orbit through them. Shared by asteroids() and the streamed field (asteroid_field.h).
+float asteroidRadius(float outlierChanceXZ, float offset, float beltRadius, float beltWidth, float outlierProbability,
+    float closerMultiplier, float furtherMultiplier);
+float asteroidHeight(float outlierChanceY, float offset, float outlierProbability,
+    float yOutlierMultiplier, float yInlierMultiplier);
+float asteroidScale(float scaleChance, float size);
+// X, then Y, then Z about the local axes, from half angles
+glm::vec4 asteroidRotation(float halfX, float halfY, float halfZ);
+float asteroidMeanMotion(float semiMajorAxis, float beltRadius);
+// Orbit through (radius, height, longitude) at time 0 on average: the height becomes the amplitude
+// of the inclined orbit, the longitude the mean longitude. rotation is a unit quaternion.
+AsteroidInstance asteroidOrbit(float radius, float height, float longitude, float eccentricity, float periapsis,
+    float meanAnomaly, float meanMotion, float scale, glm::vec4 rotation, float spin);
+// Centres of the rocks at time (sim seconds), as orbitPosition in asteroid_instance.glsl finds them.
+// For what the CPU has to ask of the belt (bvh.h); the draws still evaluate the orbits on the GPU.
+void asteroidPositions(const AsteroidInstance* instances, size_t count, double time, glm::vec3* out);
+
+// The parameters of those draws, as runApp sets them; asteroids() lives in asteroid_generator.h
+struct AsteroidBeltShape
+{
+    float beltRadius;
+    float beltWidth;
+    float outlierProbability;
+    float closerMultiplier;
+    float furtherMultiplier;
+    float yOutlierMultiplier;
+    float yInlierMultiplier;
+};
 
-void renderAsteroidBelt(GLuint shaderProgram, GLuint VAO, int vertexCount,
+class AsteroidBelt;
+// Culls the belt for this view with the orbits at orbitTime (sim seconds), then draws the near
+// rocks with shaderProgram and the far ones with impostorProgram
+void renderAsteroidBelt(GLuint shaderProgram, GLuint impostorProgram, AsteroidBelt& belt,
+    const glm::mat4& projection, const glm::mat4& view,
     float ambientStrength, float specularStrength,
     glm::vec3 rimColor, float rimIntensity,
-    float asteroidRotationAngle);
+    float orbitTime);
 #endif 
\ No newline at end of file
@@ -7,13 +7,14 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+#include "frame_uniforms.glsl"
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;  // Built on the CPU with the model matrix
 
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords; // Pass texture coordinates to fragment shader
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
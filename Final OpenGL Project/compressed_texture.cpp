@@ -0,0 +1,252 @@
+#include "compressed_texture.h"
+#include "asset_pack.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+// Not part of the GL 3.3 core headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+static std::atomic<bool> s3tcSupported(false);
+static std::atomic<bool> bptcSupported(false);
+
+std::string compressedTexturePath(const std::string& sourcePath)
+{
+    return sourcePath + ".ctex";
+}
+
+static bool validCompressedTexture(const std::string& path, const CompressedTexture& texture)
+{
+    const CompressedTextureHeader& header = texture.header;
+    if (memcmp(header.magic, "CTEX", 4) != 0 || header.version != CTEX_VERSION ||
+        header.mipCount == 0 || header.mipCount > CTEX_MAX_MIPS)
+    {
+        std::cerr << "Not a compiled texture: " << path << std::endl;
+        return false;
+    }
+    for (uint32_t level = 0; level < header.mipCount; level++)
+    {
+        if ((size_t)header.mipOffset[level] + header.mipSize[level] > texture.payloadSize())
+        {
+            std::cerr << "Truncated compiled texture: " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readCompressedTexture(const std::string& path, CompressedTexture& texture)
+{
+    AssetSpan span;
+    if (assetPack.find(path, span))
+    {
+        if (span.size < sizeof(CompressedTextureHeader))
+            return false;
+        // The pack keeps payloads 16-byte aligned, so the mip levels are uploaded straight from the mapping
+        memcpy(&texture.header, span.data, sizeof(texture.header));
+        texture.data.clear();
+        texture.packed = span.data + sizeof(texture.header);
+        texture.packedSize = span.size - sizeof(texture.header);
+        return validCompressedTexture(path, texture);
+    }
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    std::streamoff size = file.tellg();
+    if (size < (std::streamoff)sizeof(CompressedTextureHeader))
+        return false;
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(&texture.header), sizeof(texture.header));
+    texture.packed = nullptr;
+    texture.data.resize((size_t)size - sizeof(texture.header));
+    file.read(reinterpret_cast<char*>(texture.data.data()), texture.data.size());
+    return file && validCompressedTexture(path, texture);
+}
+
+bool writeCompressedTexture(const std::string& path, const CompressedTexture& texture)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&texture.header), sizeof(texture.header));
+    file.write(reinterpret_cast<const char*>(texture.data.data()), texture.data.size());
+    return (bool)file;
+}
+
+unsigned int blockBytes(uint32_t format)
+{
+    switch (format)
+    {
+    case CTEX_BC1:
+    case CTEX_BC4:
+        return 8;
+    case CTEX_BC5:
+    case CTEX_BC7:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+GLenum compressedGLFormat(uint32_t format)
+{
+    switch (format)
+    {
+    case CTEX_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case CTEX_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case CTEX_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case CTEX_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+    }
+}
+
+void queryCompressedFormatSupport()
+{
+    s3tcSupported = glfwExtensionSupported("GL_EXT_texture_compression_s3tc") == GLFW_TRUE;
+    bptcSupported = glfwExtensionSupported("GL_ARB_texture_compression_bptc") == GLFW_TRUE;
+}
+
+bool compressedFormatSupported(uint32_t format)
+{
+    switch (format)
+    {
+    case CTEX_BC1: return s3tcSupported;
+    case CTEX_BC7: return bptcSupported;
+    default: return true;   // RGTC and plain RGBA are core
+    }
+}
+
+// ----- Block decoders for the fallback path -----
+
+static void unpack565(uint16_t c, int rgb[3])
+{
+    rgb[0] = ((c >> 11) & 31) * 255 / 31;
+    rgb[1] = ((c >> 5) & 63) * 255 / 63;
+    rgb[2] = (c & 31) * 255 / 31;
+}
+
+static void decodeBC1Block(const unsigned char* block, unsigned char out[16][4])
+{
+    uint16_t c0 = (uint16_t)(block[0] | block[1] << 8);
+    uint16_t c1 = (uint16_t)(block[2] | block[3] << 8);
+    int palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    for (int c = 0; c < 3; c++)
+    {
+        if (c0 > c1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+    for (int i = 0; i < 16; i++)
+    {
+        const int* color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 4; c++)
+            out[i][c] = (unsigned char)color[c];
+    }
+}
+
+// The compiler only writes BC7 mode 6 (one subset, 7.7.7.7 endpoints with p-bits, 4-bit indices)
+static void decodeBC7Block(const unsigned char* block, unsigned char out[16][4])
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    int bit = 0;
+    auto read = [&](int count) {
+        int value = 0;
+        for (int i = 0; i < count; i++, bit++)
+            value |= ((block[bit >> 3] >> (bit & 7)) & 1) << i;
+        return value;
+    };
+
+    if (read(7) != 0x40)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            out[i][0] = out[i][2] = out[i][3] = 255;   // Unsupported mode shows up magenta
+            out[i][1] = 0;
+        }
+        return;
+    }
+    int endpoints[2][4];
+    for (int c = 0; c < 4; c++)
+    {
+        endpoints[0][c] = read(7) << 1;
+        endpoints[1][c] = read(7) << 1;
+    }
+    int p0 = read(1), p1 = read(1);
+    for (int c = 0; c < 4; c++)
+    {
+        endpoints[0][c] |= p0;
+        endpoints[1][c] |= p1;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        int w = weights[read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+            out[i][c] = (unsigned char)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+    }
+}
+
+void decompressTexture(CompressedTexture& texture)
+{
+    CompressedTextureHeader& header = texture.header;
+    if (header.format != CTEX_BC1 && header.format != CTEX_BC7)
+        return;
+
+    std::vector<unsigned char> decoded;
+    unsigned int stride = blockBytes(header.format);
+    for (uint32_t level = 0; level < header.mipCount; level++)
+    {
+        int width = std::max(1u, header.width >> level);
+        int height = std::max(1u, header.height >> level);
+        const unsigned char* blocks = texture.payload() + header.mipOffset[level];
+        size_t offset = decoded.size();
+        decoded.resize(offset + (size_t)width * height * 4);
+        unsigned char* pixels = decoded.data() + offset;
+
+        int blocksWide = (width + 3) / 4;
+        int blocksHigh = (height + 3) / 4;
+        for (int by = 0; by < blocksHigh; by++)
+        {
+            for (int bx = 0; bx < blocksWide; bx++, blocks += stride)
+            {
+                unsigned char texels[16][4];
+                if (header.format == CTEX_BC1)
+                    decodeBC1Block(blocks, texels);
+                else
+                    decodeBC7Block(blocks, texels);
+                // Edge blocks hang over the image; drop the padding
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                    if (x < width && y < height)
+                        memcpy(pixels + ((size_t)y * width + x) * 4, texels[i], 4);
+                }
+            }
+        }
+        header.mipOffset[level] = (uint32_t)offset;
+        header.mipSize[level] = (uint32_t)(decoded.size() - offset);
+    }
+    header.format = CTEX_RGBA8;
+    texture.data.swap(decoded);
+    texture.packed = nullptr;
+}
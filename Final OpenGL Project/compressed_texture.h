@@ -0,0 +1,67 @@
+#pragma once
+#ifndef COMPRESSED_TEXTURE_H
+#define COMPRESSED_TEXTURE_H
+
+#include "utils.h"
+#include <cstdint>
+
+// Block-compressed texture container written by the texture compiler (".ctex" next to the source image).
+// The payload is every mip level back to back, so loading is a single read and the upload a memcpy.
+enum CompressedFormat : uint32_t
+{
+    CTEX_RGBA8 = 0, // Uncompressed; only produced in memory by the decode fallback
+    CTEX_BC1 = 1,   // RGB, 4 bits per texel (S3TC)
+    CTEX_BC4 = 4,   // One channel, 4 bits per texel (RGTC, core since GL 3.0)
+    CTEX_BC5 = 5,   // Two channels, 8 bits per texel (RGTC)
+    CTEX_BC7 = 7    // RGBA, 8 bits per texel (BPTC)
+};
+
+const uint32_t CTEX_MAX_MIPS = 16;
+const uint32_t CTEX_VERSION = 1;
+
+struct CompressedTextureHeader
+{
+    char magic[4];                       // "CTEX"
+    uint32_t version;
+    uint32_t format;                     // CompressedFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;                   // Channels the sampler should see: 1 and 2 are swizzled to grey
+    uint32_t mipCount;
+    uint32_t flags;                      // Unused, zero
+    uint32_t mipOffset[CTEX_MAX_MIPS];   // Relative to the start of the payload
+    uint32_t mipSize[CTEX_MAX_MIPS];
+};
+
+struct CompressedTexture
+{
+    CompressedTextureHeader header;
+    std::vector<unsigned char> data;          // Payload read from a loose file, compiled or decompressed
+    const unsigned char* packed = nullptr;    // Payload inside the mounted asset pack, used instead of data
+    size_t packedSize = 0;
+
+    const unsigned char* payload() const { return packed ? packed : data.data(); }
+    size_t payloadSize() const { return packed ? packedSize : data.size(); }
+};
+
+// Path of the compiled container for a source image
+std::string compressedTexturePath(const std::string& sourcePath);
+
+// Points into the asset pack when it holds the file, otherwise reads the loose file
+bool readCompressedTexture(const std::string& path, CompressedTexture& texture);
+bool writeCompressedTexture(const std::string& path, const CompressedTexture& texture);
+
+// Bytes per 4x4 block, 0 for CTEX_RGBA8
+unsigned int blockBytes(uint32_t format);
+// Internal format for glCompressedTexImage2D
+GLenum compressedGLFormat(uint32_t format);
+
+// Records which of the optional formats the context can sample. Call on the GL thread before
+// compressedFormatSupported is used from any other thread.
+void queryCompressedFormatSupport();
+bool compressedFormatSupported(uint32_t format);
+
+// Fallback for drivers without S3TC/BPTC: expands every mip level to CTEX_RGBA8 in place
+void decompressTexture(CompressedTexture& texture);
+
+#endif // COMPRESSED_TEXTURE_H
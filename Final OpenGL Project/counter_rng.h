@@ -0,0 +1,106 @@
+#pragma once
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include "simd_math.h"
+#include <cstdint>
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"). A counter-based
+// generator: the output is a pure function of (counter, key), so the n-th value of a stream can be
+// computed directly, on any thread, in any order, and is the same on every platform.
+
+const uint32_t PHILOX_M0 = 0xD2511F53u;
+const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+const uint32_t PHILOX_W0 = 0x9E3779B9u;
+const uint32_t PHILOX_W1 = 0xBB67AE85u;
+
+// Encrypts counter in place with the key (seed, stream)
+inline void philox4x32(uint32_t counter[4], uint32_t key0, uint32_t key1)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t product0 = (uint64_t)PHILOX_M0 * counter[0];
+        uint64_t product1 = (uint64_t)PHILOX_M1 * counter[2];
+        uint32_t next[4] = {
+            (uint32_t)(product1 >> 32) ^ counter[1] ^ key0, (uint32_t)product1,
+            (uint32_t)(product0 >> 32) ^ counter[3] ^ key1, (uint32_t)product0 };
+        for (int i = 0; i < 4; i++)
+            counter[i] = next[i];
+        key0 += PHILOX_W0;
+        key1 += PHILOX_W1;
+    }
+}
+
+// Top 24 bits as a float in [0, 1); exact, so it doesn't depend on the compiler's rounding
+inline float uniformFloat(uint32_t bits)
+{
+    return (float)(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Successive uniforms of one stream: counter = (id, stream, block, 0), four values per block
+class CounterRandom
+{
+public:
+    CounterRandom(uint32_t seed, uint32_t id, uint32_t stream) : seed(seed), id(id), stream(stream) {}
+
+    float next()
+    {
+        if (used == 4)
+        {
+            words[0] = id;
+            words[1] = stream;
+            words[2] = block++;
+            words[3] = 0;
+            philox4x32(words, seed, 0);
+            used = 0;
+        }
+        return uniformFloat(words[used++]);
+    }
+
+private:
+    uint32_t seed;
+    uint32_t id;
+    uint32_t stream;
+    uint32_t block = 0;
+    uint32_t words[4] = {};
+    int used = 4;
+};
+
+#ifdef SIMD_SSE2
+// High and low halves of m * a for four lanes; SSE2 only multiplies the even ones, so the odd
+// lanes are shifted down for a second multiply and the halves interleaved back
+inline void mulHiLo4(__m128i a, uint32_t m, __m128i& hi, __m128i& lo)
+{
+    __m128i factor = _mm_set1_epi32((int)m);
+    __m128i even = _mm_mul_epu32(a, factor);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), factor);
+    __m128i evenLanes = _mm_set_epi32(0, -1, 0, -1);
+    lo = _mm_or_si128(_mm_and_si128(even, evenLanes), _mm_slli_epi64(odd, 32));
+    hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(evenLanes, odd));
+}
+
+// philox4x32 on four counters at once, one per lane: counter[i] holds word i of each
+inline void philox4x32x4(__m128i counter[4], uint32_t key0, uint32_t key1)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        __m128i hi0, lo0, hi1, lo1;
+        mulHiLo4(counter[0], PHILOX_M0, hi0, lo0);
+        mulHiLo4(counter[2], PHILOX_M1, hi1, lo1);
+        counter[0] = _mm_xor_si128(_mm_xor_si128(hi1, counter[1]), _mm_set1_epi32((int)key0));
+        counter[1] = lo1;
+        counter[2] = _mm_xor_si128(_mm_xor_si128(hi0, counter[3]), _mm_set1_epi32((int)key1));
+        counter[3] = lo0;
+        key0 += PHILOX_W0;
+        key1 += PHILOX_W1;
+    }
+}
+
+// uniformFloat on four lanes
+inline __m128 uniformFloat4(__m128i bits)
+{
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(bits, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+#endif
+
+#endif // COUNTER_RNG_H
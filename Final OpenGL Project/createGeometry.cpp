@@ -1,11 +1,12 @@
 #include "utils.h"
 #include "geometry.h"
-// Sphere vertices and rendering setup
-GLuint createSphereVAO(float radius, int sectorCount, int stackCount) {
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<float> normals;
-    std::vector<float> texCoords;
+// Sphere vertices, no GL
+SphereMesh buildSphereMesh(float radius, int sectorCount, int stackCount) {
+    SphereMesh mesh;
+    std::vector<float>& vertices = mesh.vertices;
+    std::vector<unsigned int>& indices = mesh.indices;
+    std::vector<float>& normals = mesh.normals;
+    std::vector<float>& texCoords = mesh.texCoords;
 
     for (int i = 0; i <= stackCount; ++i) {
         float stackAngle = M_PI / 2 - i * M_PI / stackCount;
@@ -45,37 +46,107 @@ GLuint createSphereVAO(float radius, int sectorCount, int stackCount) {
         }
     }
 
-    GLuint VAO, VBO, EBO, normalVBO, texVBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    glGenBuffers(1, &normalVBO);
-    glGenBuffers(1, &texVBO);
+    return mesh;
+}
 
+// Vertex array for a mesh with its buffers already filled
+static GLuint sphereVertexArray(GLuint VBO, GLuint normalVBO, GLuint texVBO, GLuint EBO) {
+    GLuint VAO;
+    glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), normals.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
 
     glBindBuffer(GL_ARRAY_BUFFER, texVBO);
-    glBufferData(GL_ARRAY_BUFFER, texCoords.size() * sizeof(float), texCoords.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(2);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
     glBindVertexArray(0);
     return VAO;
 }
 
+// Sphere rendering setup
+SphereModel createSphereVAO(float radius, int sectorCount, int stackCount) {
+    SphereMesh mesh = buildSphereMesh(radius, sectorCount, stackCount);
+    GLuint VBO, EBO, normalVBO, texVBO;
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &normalVBO);
+    glGenBuffers(1, &texVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(float), mesh.vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(float), mesh.normals.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, texVBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh.texCoords.size() * sizeof(float), mesh.texCoords.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+    SphereModel sphere;
+    sphere.VAO = sphereVertexArray(VBO, normalVBO, texVBO, EBO);
+    sphere.indexCount = (GLsizei)mesh.indices.size();
+    return sphere;
+}
+
+void deleteSphereVAO(GLuint VAO) {
+    // The buffers are only known to the vertex array itself
+    GLint buffers[4] = {};
+    glBindVertexArray(VAO);
+    for (int i = 0; i < 3; i++)
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffers[i]);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffers[3]);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &VAO);
+    for (GLint buffer : buffers)
+    {
+        GLuint name = (GLuint)buffer;
+        glDeleteBuffers(1, &name);
+    }
+}
+
+AsyncTask rebuildSphere(int resolution, SphereModel& sphere, bool& busy) {
+    busy = true;
+    co_await taskScheduler.onWorker();
+    SphereMesh mesh = buildSphereMesh(1.0f, 36 * resolution, 18 * resolution);
+
+    // Uploaded through the copy target, which no vertex array or draw depends on, a slice at a
+    // time, handing the frame back whenever its budget runs out
+    co_await taskScheduler.onGlThread();
+    const size_t SLICE_BYTES = 1 << 20;
+    GLuint buffers[4];
+    glGenBuffers(4, buffers);
+    const void* data[4] = { mesh.vertices.data(), mesh.normals.data(), mesh.texCoords.data(), mesh.indices.data() };
+    size_t bytes[4] = { mesh.vertices.size() * sizeof(float), mesh.normals.size() * sizeof(float),
+        mesh.texCoords.size() * sizeof(float), mesh.indices.size() * sizeof(unsigned int) };
+    for (int i = 0; i < 4; i++)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[i]);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes[i], nullptr, GL_STATIC_DRAW);
+        for (size_t offset = 0; offset < bytes[i]; offset += SLICE_BYTES)
+        {
+            co_await taskScheduler.yieldIfOverBudget();
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[i]);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, std::min(SLICE_BYTES, bytes[i] - offset), (const char*)data[i] + offset);
+        }
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // Swapped in whole before any draw of the frame, so no frame mixes resolutions
+    deleteSphereVAO(sphere.VAO);
+    sphere.VAO = sphereVertexArray(buffers[0], buffers[1], buffers[2], buffers[3]);
+    sphere.indexCount = (GLsizei)mesh.indices.size();
+    sphereRes = resolution;
+    busy = false;
+}
+
 GLuint createRingVAO(float innerRadius, float outerRadius, int segments) {
     std::vector<float> ringVertices;
 
@@ -0,0 +1,62 @@
+#include "frame_arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+FrameArena frameArena;
+
+FrameArena::~FrameArena()
+{
+    release();
+}
+
+void FrameArena::init(size_t bytes)
+{
+    release();
+    memory = static_cast<unsigned char*>(::operator new(bytes));
+    size = bytes;
+    offset = 0;
+    peak = 0;
+    warned = false;
+}
+
+void FrameArena::release()
+{
+    ::operator delete(memory);
+    memory = nullptr;
+    size = 0;
+    offset = 0;
+}
+
+void FrameArena::reset()
+{
+    peak = std::max(peak, used());
+    offset.store(0, std::memory_order_relaxed);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    if (!memory)
+        return ::operator new(bytes);   // Not set up yet: loading code shares these containers
+    size_t current = offset.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // Aligned on the address rather than the offset, so alignments past the block's own work too
+        uintptr_t base = reinterpret_cast<uintptr_t>(memory);
+        size_t start = (size_t)(((base + current + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+        if (start + bytes > size)
+            break;
+        if (offset.compare_exchange_weak(current, start + bytes, std::memory_order_relaxed))
+            return memory + start;
+    }
+    if (!warned.exchange(true))
+        std::cout << "Frame arena: out of its " << (size >> 10) << " KB, the rest of the frame uses the heap" << std::endl;
+    // Frame containers hold nothing over-aligned, so the heap's default alignment is enough
+    return ::operator new(bytes);
+}
+
+void FrameArena::deallocate(void* pointer)
+{
+    if (pointer && !owns(pointer))
+        ::operator delete(pointer);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <unordered_set>
+#include <vector>
+
+// Scratch memory for data that only lives for one frame. Allocating is a bump of an offset, freeing
+// does nothing, and the whole block is handed out again once the next frame starts. Any thread may
+// allocate, so jobs of the frame can use it too; nothing allocated here may outlive the frame.
+//
+//     FrameVector<int> visible;   // Grows in the arena, never touches the heap once it is sized
+//
+// When a frame needs more than the block holds the rest comes from the heap, with a warning the
+// first time, so the arena only has to be sized for the usual frame.
+const size_t FRAME_ARENA_BYTES = 4 << 20;
+
+class FrameArena
+{
+public:
+    ~FrameArena();
+
+    void init(size_t bytes = FRAME_ARENA_BYTES);
+    void release();
+    // Start of a frame, once nothing allocated in the last one is in use any more
+    void reset();
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    // Only frees what the heap handed out after the arena ran out
+    void deallocate(void* pointer);
+    bool owns(const void* pointer) const { return pointer >= memory && pointer < memory + size; }
+
+    size_t used() const { return offset.load(std::memory_order_relaxed); }
+    size_t capacity() const { return size; }
+    // Most any frame has used since init
+    size_t highWater() const { return peak > used() ? peak : used(); }
+
+private:
+    unsigned char* memory = nullptr;
+    size_t size = 0;
+    std::atomic<size_t> offset{ 0 };
+    size_t peak = 0;                    // Updated by reset()
+    std::atomic<bool> warned{ false };
+};
+
+// Initialised in runApp and reset at the top of every frame
+extern FrameArena frameArena;
+
+// Standard allocator over frameArena, for containers that live inside a frame
+template <typename T>
+struct FrameAllocator
+{
+    typedef T value_type;
+
+    FrameAllocator() = default;
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>&) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(frameArena.allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T* pointer, size_t) { frameArena.deallocate(pointer); }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+template <typename T>
+using FrameSet = std::unordered_set<T, std::hash<T>, std::equal_to<T>, FrameAllocator<T>>;
+
+#endif // FRAME_ARENA_H
@@ -0,0 +1,13 @@
+// Per-frame values shared by the lit programs, uploaded once a frame (FrameUniforms in shader_variants.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightPos;
+    float gamma;
+    vec4 lightColor;
+    vec3 viewPos;           // Also where the flashlight sits
+    float exposure;
+    vec3 flashlightDir;
+    float distanceScale;    // Compressed units per world unit: 1, or per km in real scale
+};
@@ -3,11 +3,32 @@
 #define GEOMETRY_H
 
 #include "utils.h"
+#include "task_scheduler.h"
 extern int sphereRes;
 extern int ringRes;
 extern int ringSegments;
-// Declare the function
-GLuint createSphereVAO(float radius = 1.0f, int sectorCount = 36 * sphereRes, int stackCount = 18 * sphereRes);
+struct SphereMesh
+{
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texCoords;
+    std::vector<unsigned int> indices;
+};
+
+// The uploaded sphere: its vertex array and how many indices its element buffer holds
+struct SphereModel
+{
+    GLuint VAO = 0;
+    GLsizei indexCount = 0;
+};
+
+SphereMesh buildSphereMesh(float radius, int sectorCount, int stackCount);
+SphereModel createSphereVAO(float radius = 1.0f, int sectorCount = 36 * sphereRes, int stackCount = 18 * sphereRes);
+// Deletes the vertex array and the buffers it points at
+void deleteSphereVAO(GLuint VAO);
+// Tessellates a unit sphere at resolution on a worker and uploads it over as many frames as the
+// budget needs, then replaces sphere and sphereRes; busy is true until then
+AsyncTask rebuildSphere(int resolution, SphereModel& sphere, bool& busy);
 
 GLuint createRingVAO(float innerRadius = 5.0, float outerRadius = 6.0f, int segments = ringSegments * ringRes);
 #endif // SPHERE_H
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "golden.h"
+#include "headless.h"
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+const std::vector<GoldenCase>& goldenCases()
+{
+    static const std::vector<GoldenCase> cases = {
+        { "overview_start", "overview", 0.0f },
+        { "overview_late", "overview", 12.0f },
+        { "asteroid_belt", "asteroid-belt", 8.0f },
+        { "earth_clouds", "earth-closeup", 4.0f },
+        { "saturn_rings", "saturn-rings", 6.0f },
+        { "max_warp", "max-warp", 15.0f },
+    };
+    return cases;
+}
+
+bool parseGoldenArgs(int argc, char** argv, GoldenOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--golden") == 0)
+        {
+            options.enabled = true;
+            if (hasValue && strncmp(argv[i + 1], "--", 2) != 0)
+                options.dir = argv[++i];
+        }
+        else if (strcmp(arg, "--update-golden") == 0)
+            options.enabled = options.update = true;
+        else if (strcmp(arg, "--psnr-min") == 0 && hasValue)
+            options.minPsnr = atof(argv[++i]);
+        else if (strcmp(arg, "--ssim-min") == 0 && hasValue)
+            options.minSsim = atof(argv[++i]);
+        else if (strcmp(arg, "--perf-tolerance") == 0 && hasValue)
+            options.perfTolerance = atof(argv[++i]);
+        else if (strcmp(arg, "--golden-report") == 0 && hasValue)
+            options.reportPath = argv[++i];
+    }
+    return true;
+}
+
+static double luma(const unsigned char* p)
+{
+    return 0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2];
+}
+
+ImageComparison compareImages(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, int width, int height)
+{
+    ImageComparison result;
+
+    double squaredError = 0.0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        double d = (double)a[i] - (double)b[i];
+        squaredError += d * d;
+    }
+    double mse = squaredError / a.size();
+    result.psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+
+    // SSIM over non-overlapping 8x8 luma windows
+    const int window = 8;
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    double ssimSum = 0.0;
+    int windows = 0;
+    for (int wy = 0; wy + window <= height; wy += window)
+    {
+        for (int wx = 0; wx + window <= width; wx += window)
+        {
+            double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+            for (int y = wy; y < wy + window; y++)
+            {
+                for (int x = wx; x < wx + window; x++)
+                {
+                    size_t offset = (size_t)(y * width + x) * 3;
+                    double la = luma(&a[offset]);
+                    double lb = luma(&b[offset]);
+                    sumA += la;
+                    sumB += lb;
+                    sumAA += la * la;
+                    sumBB += lb * lb;
+                    sumAB += la * lb;
+                }
+            }
+            const double n = window * window;
+            double meanA = sumA / n, meanB = sumB / n;
+            double varA = sumAA / n - meanA * meanA;
+            double varB = sumBB / n - meanB * meanB;
+            double covariance = sumAB / n - meanA * meanB;
+            ssimSum += ((2.0 * meanA * meanB + c1) * (2.0 * covariance + c2)) /
+                ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+            windows++;
+        }
+    }
+    result.ssim = windows > 0 ? ssimSum / windows : 1.0;
+    return result;
+}
+
+// Render times of the golden images, one "name milliseconds" pair per line
+static std::map<std::string, double> readManifest(const std::string& path)
+{
+    std::map<std::string, double> times;
+    std::ifstream file(path);
+    std::string name;
+    double ms;
+    while (file >> name >> ms)
+        times[name] = ms;
+    return times;
+}
+
+static bool writeManifest(const std::string& path, const std::map<std::string, double>& times)
+{
+    std::ofstream file(path);
+    for (const auto& entry : times)
+        file << entry.first << " " << entry.second << "\n";
+    return (bool)file;
+}
+
+int runGoldenSuite(const GoldenOptions& options, const std::function<bool(const GoldenCase&, GoldenCapture&)>& render)
+{
+    std::string manifestPath = options.dir + "/manifest.txt";
+    std::error_code error;
+    if (options.update)
+    {
+        std::filesystem::create_directories(options.dir, error);
+        if (error)
+        {
+            std::cerr << "Failed to create " << options.dir << ": " << error.message() << std::endl;
+            return -1;
+        }
+    }
+    else if (!std::filesystem::is_directory(options.dir, error))
+    {
+        // Nothing to compare against yet; the baselines are recorded on the reference machine
+        std::cerr << "No golden images in " << options.dir << "; record them with --update-golden first" << std::endl;
+        return -1;
+    }
+    std::map<std::string, double> goldenTimes = readManifest(manifestPath);
+    std::ofstream report(options.reportPath);
+    report << "{\n  \"cases\": [\n";
+
+    int failures = 0;
+    const std::vector<GoldenCase>& cases = goldenCases();
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        const GoldenCase& golden = cases[i];
+        std::string imagePath = options.dir + "/" + golden.name + ".ppm";
+        GoldenCapture capture;
+        if (!render(golden, capture))
+        {
+            std::cerr << "Golden " << golden.name << ": render failed" << std::endl;
+            return -1;
+        }
+
+        std::string status = "pass";
+        ImageComparison comparison = { INFINITY, 1.0 };
+        double baselineMs = goldenTimes.count(golden.name) ? goldenTimes[golden.name] : 0.0;
+        if (options.update)
+        {
+            if (!writeImage(imagePath, capture.pixels, options.width, options.height))
+            {
+                std::cerr << "Failed to write " << imagePath << std::endl;
+                return -1;
+            }
+            goldenTimes[golden.name] = capture.renderMs;
+            status = "updated";
+        }
+        else
+        {
+            std::vector<unsigned char> expected;
+            int width = 0, height = 0;
+            if (!readImage(imagePath, expected, width, height))
+                status = "missing";
+            else if (width != options.width || height != options.height)
+                status = "size-mismatch";
+            else
+            {
+                comparison = compareImages(capture.pixels, expected, width, height);
+                if (comparison.psnr < options.minPsnr || comparison.ssim < options.minSsim)
+                    status = "image-regression";
+                else if (options.perfTolerance > 0.0 && baselineMs > 0.0 && capture.renderMs > baselineMs * options.perfTolerance)
+                    status = "perf-regression";
+            }
+            if (status != "pass")
+            {
+                failures++;
+                // Keep the failing render next to the report for inspection
+                std::string actualPath = options.dir + "/" + golden.name + ".actual.ppm";
+                if (!writeImage(actualPath, capture.pixels, options.width, options.height))
+                    std::cerr << "Failed to write " << actualPath << std::endl;
+            }
+        }
+
+        std::cout << "Golden " << golden.name << ": " << status << " (PSNR " << comparison.psnr << " dB, SSIM "
+            << comparison.ssim << ", " << capture.renderMs << " ms)" << std::endl;
+        report << "    { \"name\": \"" << golden.name << "\", \"status\": \"" << status << "\", \"psnr\": "
+            << (std::isinf(comparison.psnr) ? 999.0 : comparison.psnr) << ", \"ssim\": " << comparison.ssim
+            << ", \"renderMs\": " << capture.renderMs << ", \"baselineMs\": " << baselineMs << " }"
+            << (i + 1 < cases.size() ? "," : "") << "\n";
+    }
+    report << "  ]\n}\n";
+
+    if (options.update && !writeManifest(manifestPath, goldenTimes))
+    {
+        std::cerr << "Failed to write " << manifestPath << std::endl;
+        return -1;
+    }
+    std::cout << (cases.size() - failures) << "/" << cases.size() << " golden cases passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
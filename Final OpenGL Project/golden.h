@@ -0,0 +1,54 @@
+#pragma once
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include "utils.h"
+#include <functional>
+
+// A benchmark scene frozen at a fixed simulation time
+struct GoldenCase
+{
+    const char* name;
+    const char* scene;
+    float simTime;
+};
+
+const std::vector<GoldenCase>& goldenCases();
+
+struct GoldenOptions
+{
+    bool enabled = false;
+    bool update = false;                          // Write new golden images instead of comparing
+    std::string dir = "../golden";
+    std::string reportPath = "golden_report.json";
+    double minPsnr = 35.0;                        // dB over RGB
+    double minSsim = 0.97;                        // Mean SSIM over luma
+    double perfTolerance = 0.0;                   // Fail if render time grows by more than this factor (0 = report only)
+    int width = 640;
+    int height = 360;
+};
+
+// Parses --golden [DIR], --update-golden, --psnr-min X, --ssim-min X, --perf-tolerance X, --golden-report PATH
+bool parseGoldenArgs(int argc, char** argv, GoldenOptions& options);
+
+struct ImageComparison
+{
+    double psnr;
+    double ssim;
+};
+
+// Images are tightly packed top-down RGB of the same size
+ImageComparison compareImages(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, int width, int height);
+
+// What the renderer hands back for one case
+struct GoldenCapture
+{
+    std::vector<unsigned char> pixels;
+    double renderMs; // Sum of frame times to reach the case's sim time
+};
+
+// Renders every case through render(), then compares against (or replaces) the stored images.
+// Returns the process exit code: 0 when every case passed.
+int runGoldenSuite(const GoldenOptions& options, const std::function<bool(const GoldenCase&, GoldenCapture&)>& render);
+
+#endif // GOLDEN_H
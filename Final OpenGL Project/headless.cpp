@@ -0,0 +1,145 @@
+#include "headless.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+bool parseHeadlessArgs(int argc, char** argv, HeadlessOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--headless") == 0)
+            options.enabled = true;
+        else if (strcmp(arg, "--egl") == 0)
+            options.useEGL = true;
+        else if (strcmp(arg, "--raw") == 0)
+            options.rawOutput = true;
+        else if (strcmp(arg, "--frames") == 0 && hasValue)
+            options.frames = std::max(1, atoi(argv[++i]));
+        else if (strcmp(arg, "--step") == 0 && hasValue)
+            options.fixedStep = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--out") == 0 && hasValue)
+            options.outputDir = argv[++i];
+        else if (strcmp(arg, "--capture-every") == 0 && hasValue)
+            options.captureEvery = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--frames") == 0 || strcmp(arg, "--step") == 0 || strcmp(arg, "--out") == 0 ||
+                 strcmp(arg, "--capture-every") == 0)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void applyHeadlessInitHints(const HeadlessOptions& options)
+{
+    if (!options.enabled)
+        return;
+    // The null platform needs no display server; the context comes from OSMesa or EGL
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+}
+
+void applyHeadlessWindowHints(const HeadlessOptions& options)
+{
+    if (!options.enabled)
+        return;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, options.useEGL ? GLFW_EGL_CONTEXT_API : GLFW_OSMESA_CONTEXT_API);
+    // Software rasterizers get very slow with multisampling and the post-processing FBO is single sampled anyway
+    glfwWindowHint(GLFW_SAMPLES, 0);
+}
+
+void scriptedCamera(int frame, int totalFrames, glm::vec3& position, glm::vec3& front)
+{
+    float t = totalFrames > 1 ? (float)frame / (float)(totalFrames - 1) : 0.0f;
+    float angle = glm::radians(90.0f + 120.0f * t);   // A third of a lap over the run
+    float radius = 35.0f + 20.0f * t;                 // Pull back to see the asteroid belt
+    float height = 4.0f + 10.0f * sin(t * (float)M_PI);
+
+    position = glm::vec3(radius * cos(angle), height, radius * sin(angle));
+    front = glm::normalize(-position);                // Always look at the sun
+}
+
+std::vector<unsigned char> readFramebuffer(int width, int height)
+{
+    std::vector<unsigned char> pixels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    // OpenGL rows start at the bottom, image files at the top
+    int rowSize = width * 3;
+    std::vector<unsigned char> row(rowSize);
+    for (int y = 0; y < height / 2; y++)
+    {
+        unsigned char* top = &pixels[y * rowSize];
+        unsigned char* bottom = &pixels[(height - 1 - y) * rowSize];
+        std::copy(top, top + rowSize, row.begin());
+        std::copy(bottom, bottom + rowSize, top);
+        std::copy(row.begin(), row.end(), bottom);
+    }
+    return pixels;
+}
+
+bool writeImage(const std::string& path, const std::vector<unsigned char>& pixels, int width, int height, bool raw)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    if (!raw)
+        file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()), width * height * 3);
+    return (bool)file;
+}
+
+bool readImage(const std::string& path, std::vector<unsigned char>& pixels, int& width, int& height)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    int maxValue = 0;
+    if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255 || width <= 0 || height <= 0)
+        return false;
+    file.get(); // Single whitespace before the pixel data
+    pixels.resize(width * height * 3);
+    file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+    return (bool)file;
+}
+
+bool saveFramebuffer(const std::string& path, int width, int height, bool raw)
+{
+    return writeImage(path, readFramebuffer(width, height), width, height, raw);
+}
+
+double FrameStats::percentile(double p) const
+{
+    if (frameMs.empty())
+        return 0.0;
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    size_t index = (size_t)std::min<double>(sorted.size() - 1, p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void FrameStats::printSummary(std::ostream& out) const
+{
+    if (frameMs.empty())
+    {
+        out << "No frames rendered" << std::endl;
+        return;
+    }
+    double total = 0.0;
+    for (double ms : frameMs)
+        total += ms;
+    double average = total / frameMs.size();
+
+    out << "Frames:      " << frameMs.size() << "\n";
+    out << "Total:       " << total << " ms\n";
+    out << "Average:     " << average << " ms (" << 1000.0 / average << " fps)\n";
+    out << "Min / Max:   " << *std::min_element(frameMs.begin(), frameMs.end()) << " / "
+        << *std::max_element(frameMs.begin(), frameMs.end()) << " ms\n";
+    out << "p50 / p95:   " << percentile(50.0) << " / " << percentile(95.0) << " ms" << std::endl;
+}
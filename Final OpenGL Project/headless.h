@@ -0,0 +1,52 @@
+#pragma once
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "utils.h"
+
+// Options for running without a display (CI, servers without a GPU)
+struct HeadlessOptions
+{
+    bool enabled = false;
+    bool useEGL = false;            // EGL surfaceless context instead of OSMesa
+    int frames = 300;               // Number of frames to render before exiting
+    float fixedStep = 1.0f / 60.0f; // Simulation step per frame, independent of wall clock
+    std::string outputDir;          // Where captured frames go (empty = no capture)
+    int captureEvery = 0;           // Capture every Nth frame (0 = last frame only)
+    bool rawOutput = false;         // Write .raw RGB dumps instead of .ppm images
+};
+
+// Parses --headless, --egl, --frames N, --step S, --out DIR, --capture-every N, --raw
+// Returns false on a malformed argument
+bool parseHeadlessArgs(int argc, char** argv, HeadlessOptions& options);
+
+// Must be called before glfwInit()
+void applyHeadlessInitHints(const HeadlessOptions& options);
+// Must be called after the regular window hints, before glfwCreateWindow()
+void applyHeadlessWindowHints(const HeadlessOptions& options);
+
+// Camera path used instead of keyboard/mouse input: a slow inclined circle around the sun
+void scriptedCamera(int frame, int totalFrames, glm::vec3& position, glm::vec3& front);
+
+// Reads the current read framebuffer as tightly packed RGB rows, top row first
+std::vector<unsigned char> readFramebuffer(int width, int height);
+// Writes top-down RGB pixels as a binary PPM (or raw RGB if raw = true)
+bool writeImage(const std::string& path, const std::vector<unsigned char>& pixels, int width, int height, bool raw = false);
+// Reads a binary PPM written by writeImage
+bool readImage(const std::string& path, std::vector<unsigned char>& pixels, int& width, int& height);
+// Reads the current read framebuffer and writes it as a binary PPM (or raw RGB if raw = true)
+bool saveFramebuffer(const std::string& path, int width, int height, bool raw = false);
+
+// Collects per-frame render times and prints a summary at the end of a run
+struct FrameStats
+{
+    std::vector<double> frameMs;
+
+    void add(double ms) { frameMs.push_back(ms); }
+    // Room for a whole run up front, so adding never allocates mid-run
+    void reserve(int frames) { frameMs.reserve(frames); }
+    double percentile(double p) const;
+    void printSummary(std::ostream& out) const;
+};
+
+#endif // HEADLESS_H
@@ -1,6 +1,7 @@
 #include "input_utils.h"
 #include "utils.h"
 #include "camera.h"
+#include "real_scale.h"
 
 // External variables
 
@@ -16,12 +17,17 @@ float yaw = -90.0f;
 float pitch = 0.0f;
 float fov = 45.0f;
 float cameraSpeed = 0.1f* deltaTime;
+float cameraSpeedScale = 1.0f;
+glm::vec3 orbitCenter = glm::vec3(0.0f);
+bool pickRequested = false;
 float tempSpeedFactor = speedFactor;
 extern bool flashlightOn;
 extern bool OrbitOn;
 extern bool bloom;
 extern bool skyBoxOn;
 extern float exposureVal;
+extern int sphereRes;
+int requestedSphereRes = 0;
 // Utility function to compile shaders
 GLuint compileShader(GLenum type, const char* source) {
     GLuint shader = glCreateShader(type);
@@ -51,28 +57,30 @@ void printControls() {
     cout << "[P] Pause.\n";
     cout << "[F] Flashlight.\n";
     cout << "[Left Click] Orbital Movement.\n";
+    cout << "[Right Click] Orbit What Is at the Screen Centre.\n";
     cout << "[T] Toggle Path.\n";
     cout << "[B] Toggle Skybox.\n";
     cout << "[Scroll] Zoom.\n";
     cout << "[X] Bloom\n";
     cout << "[UP] [DOWN] Exposure.\n"; 
+    cout << "[[] []] Sphere Detail.\n";
 }
 
 void processInput(GLFWwindow* window) {
     static bool pKeyPressed = false; // To prevent multiple triggers while key is held
     static bool paused = false;     // This will track whether the simulation is paused
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cameraPos += cameraSpeed * cameraFront;
+        cameraPos += cameraSpeed * cameraSpeedScale * cameraFront;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cameraPos -= cameraSpeed * cameraFront;
+        cameraPos -= cameraSpeed * cameraSpeedScale * cameraFront;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+        cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed * cameraSpeedScale;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+        cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed * cameraSpeedScale;
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-        cameraPos += cameraSpeed * cameraUp; // Move up
+        cameraPos += cameraSpeed * cameraSpeedScale * cameraUp; // Move up
     if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-        cameraPos -= cameraSpeed * cameraUp; // Move down
+        cameraPos -= cameraSpeed * cameraSpeedScale * cameraUp; // Move down
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);}
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
@@ -144,10 +152,39 @@ void processInput(GLFWwindow* window) {
         tKeyPressed = false;
     }
 
+    // Sphere detail; the mesh is rebuilt in the background and swapped in when ready
+    static bool bracketPressed = false;
+    bool lower = glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+    bool higher = glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+    if (lower || higher) {
+        if (!bracketPressed) {
+            int current = requestedSphereRes ? requestedSphereRes : sphereRes;
+            requestedSphereRes = std::max(1, std::min(16, current + (higher ? 1 : -1)));
+            bracketPressed = true;
+        }
+    }
+    else {
+        bracketPressed = false;
+    }
+
+    // Picks along the view direction, since the cursor is captured
+    static bool rightClickPressed = false;
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
+        if (!rightClickPressed) {
+            pickRequested = true;
+            rightClickPressed = true;
+        }
+    }
+    else {
+        rightClickPressed = false;
+    }
+
     static bool xKeyPressed = false;
     if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) {
         if (!xKeyPressed) {
-            bloom = !bloom; 
+            // Reversed depth needs the float depth buffer of the bloom target; the window's is 24-bit
+            if (!reversedDepth)
+                bloom = !bloom;
             xKeyPressed = true;
         }
     }
@@ -159,7 +196,7 @@ void processInput(GLFWwindow* window) {
 bool firstMouse = true;
 float sensitivity = 0.2f;
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
-    static float distanceFromCenter;  // Distance from the origin
+    static float distanceFromCenter;  // Distance from the orbit center
     static bool leftClickHeld = false; // Track whether the left mouse button is held
 
     if (firstMouse) {
@@ -189,8 +226,8 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
         leftClickHeld = true;
 
-        // Calculate distance from the origin (for spherical movement)
-        distanceFromCenter = glm::length(cameraPos);
+        // Calculate distance from the orbit center (for spherical movement)
+        distanceFromCenter = glm::length(cameraPos - orbitCenter);
 
         // Update camera position in spherical coordinates
         glm::vec3 position;
@@ -198,10 +235,10 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
         position.y = distanceFromCenter * sin(glm::radians(pitch));
         position.z = distanceFromCenter * cos(glm::radians(pitch)) * sin(glm::radians(yaw));
 
-        cameraPos = position;
+        cameraPos = orbitCenter + position;
 
-        // Set cameraFront to point toward the origin
-        cameraFront = glm::normalize(-cameraPos); // Point toward the origin
+        // Set cameraFront to point toward the orbit center
+        cameraFront = glm::normalize(orbitCenter - cameraPos);
         camera.ProcessMouseMovement(xoffset, yoffset, leftClickHeld);
     }
     else if (leftClickHeld && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE) {
@@ -14,6 +14,10 @@ extern float lastX;
 extern float lastY;
 extern bool firstMouse;
 extern float fov;
+extern int requestedSphereRes; // Set by [ and ]; 0 once the rebuild has been started
+extern float cameraSpeedScale;  // Movement per step is cameraSpeed times this; real scale ties it to altitude
+extern glm::vec3 orbitCenter;   // What left-drag orbits: the sun, or in real scale the body followed
+extern bool pickRequested;      // Set by right click; cleared once the frame has picked
 
 // Function prototypes for input processing
 void processInput(GLFWwindow* window);
@@ -0,0 +1,297 @@
+#include "job_system.h"
+#include "alloc_trace.h"
+#include <algorithm>
+#include <iomanip>
+
+JobSystem jobSystem;
+
+// Jobs added to the pool at a time
+static const int JOB_BLOCK_SIZE = 64;
+
+// Which deque the current thread owns, and the job it is running
+static thread_local const JobSystem* threadSystem = nullptr;
+static thread_local int threadSlot = -1;
+static thread_local Job* currentJob = nullptr;
+
+JobSystem::~JobSystem()
+{
+    stop();
+}
+
+void JobSystem::start(int workerCount)
+{
+    if (workerCount <= 0)
+        workerCount = std::max(1, (int)std::thread::hardware_concurrency());
+    stopping = false;
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(new Worker());
+    threadSystem = this;
+    threadSlot = 0;
+    statsStart = std::chrono::steady_clock::now();
+    for (int i = 1; i < workerCount; i++)
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+    threads.clear();
+    // Whatever is submitted from now on runs inside wait()
+    workers.clear();
+}
+
+int JobSystem::slotOf() const
+{
+    return threadSystem == this && threadSlot < (int)workers.size() ? threadSlot : -1;
+}
+
+JobHandle::JobHandle(Job* job) : job(job)
+{
+    if (job)
+        job->references++;
+}
+
+JobHandle::~JobHandle()
+{
+    if (job)
+        JobSystem::release(job);
+}
+
+Job* JobSystem::allocate()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (freeJobs.empty())
+    {
+        blocks.emplace_back(new Job[JOB_BLOCK_SIZE]);
+        for (int i = JOB_BLOCK_SIZE - 1; i >= 0; i--)
+            freeJobs.push_back(&blocks.back()[i]);
+    }
+    Job* job = freeJobs.back();
+    freeJobs.pop_back();
+    return job;
+}
+
+void JobSystem::release(Job* job)
+{
+    if (--job->references > 0)
+        return;
+    JobSystem& system = *job->system;
+    std::lock_guard<std::mutex> lock(system.poolMutex);
+    system.freeJobs.push_back(job);
+}
+
+JobHandle JobSystem::launch(Job* job, std::initializer_list<JobHandle> after)
+{
+    job->system = this;
+    job->references = 1;    // Queued, then running; the handle below adds its own
+    job->unfinished = 1;
+    job->blockers = 1;
+    job->finished = false;
+    job->done = false;
+    job->parent = currentJob;
+    if (currentJob)
+    {
+        currentJob->unfinished++;
+        currentJob->references++;
+    }
+    JobHandle handle(job);
+    for (const JobHandle& dependency : after)
+    {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->finished)
+        {
+            dependency->continuations.push_back(job);
+            job->blockers++;
+        }
+    }
+    if (--job->blockers == 0)
+        schedule(job);
+    return handle;
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+    int slot = slotOf();
+    while (!job->done)
+    {
+        bool stolen;
+        if (Job* next = findJob(slot, stolen))
+        {
+            execute(next, slot, stolen);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers++;
+        condition.wait(lock, [&] { return queued > 0 || job->done; });
+        sleepers--;
+    }
+}
+
+void JobSystem::workerLoop(int index)
+{
+    threadSystem = this;
+    threadSlot = index;
+    markFrameThread(); // What jobs allocate belongs to the frame that ran them
+    while (true)
+    {
+        bool stolen;
+        if (Job* job = findJob(index, stolen))
+        {
+            execute(job, index, stolen);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers++;
+        condition.wait(lock, [this] { return queued > 0 || stopping; });
+        sleepers--;
+        if (stopping)
+            return;
+    }
+}
+
+void JobSystem::schedule(Job* job)
+{
+    queued++;
+    int slot = slotOf();
+    if (slot < 0 || !workers[slot]->deque.push(job))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        injected.push_back(job);
+        injectedCount++;
+    }
+    wake();
+}
+
+void JobSystem::wake()
+{
+    if (sleepers > 0)
+    {
+        // Taking the lock orders this after a sleeper's last look at queued
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_one();
+    }
+}
+
+Job* JobSystem::findJob(int index, bool& stolen)
+{
+    stolen = false;
+    if (queued == 0)
+        return nullptr;
+    Job* job = nullptr;
+    if (index >= 0)
+        job = workers[index]->deque.pop();
+    if (!job && injectedCount > 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!injected.empty())
+        {
+            job = injected.front();
+            injected.pop_front();
+            injectedCount--;
+        }
+    }
+    int count = (int)workers.size();
+    for (int i = 1; !job && i <= count; i++)
+    {
+        int victim = (std::max(index, 0) + i) % count;
+        if (victim != index && (job = workers[victim]->deque.steal()) != nullptr)
+            stolen = true;
+    }
+    if (job)
+        queued--;
+    return job;
+}
+
+void JobSystem::execute(Job* job, int index, bool stolen)
+{
+    Job* outer = currentJob;
+    currentJob = job;
+    auto start = std::chrono::steady_clock::now();
+    job->run(*job);
+    auto end = std::chrono::steady_clock::now();
+    currentJob = outer;
+    if (index >= 0)
+    {
+        Worker& worker = *workers[index];
+        worker.jobs++;
+        if (stolen)
+            worker.steals++;
+        worker.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+    finishOne(job);
+}
+
+void JobSystem::finishOne(Job* job)
+{
+    if (--job->unfinished > 0)
+        return;
+    // Only now: spawned jobs may still have been using what the work holds (parallelFor's body)
+    job->destroy(*job);
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        for (Job* next : job->continuations)
+            if (--next->blockers == 0)
+                schedule(next);
+        job->continuations.clear();
+    }
+    Job* parent = job->parent;
+    job->parent = nullptr;
+    job->done = true;
+    if (sleepers > 0)
+    {
+        // Someone may be waiting on exactly this job
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+    }
+    release(job);   // The reference it held while queued and running
+    if (parent)
+    {
+        finishOne(parent);
+        release(parent);
+    }
+}
+
+std::vector<WorkerStats> JobSystem::stats() const
+{
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - statsStart).count();
+    std::vector<WorkerStats> result(workers.size());
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        result[i].jobs = workers[i]->jobs;
+        result[i].steals = workers[i]->steals;
+        result[i].busyMs = workers[i]->busyNs * 1e-6;
+        result[i].elapsedMs = elapsedMs;
+    }
+    return result;
+}
+
+void JobSystem::resetStats()
+{
+    for (const std::unique_ptr<Worker>& worker : workers)
+    {
+        worker->jobs = 0;
+        worker->steals = 0;
+        worker->busyNs = 0;
+    }
+    statsStart = std::chrono::steady_clock::now();
+}
+
+void JobSystem::printUtilization(std::ostream& out) const
+{
+    std::vector<WorkerStats> threadStats = stats();
+    out << "Job system: " << threadStats.size() << " threads" << std::endl;
+    for (size_t i = 0; i < threadStats.size(); i++)
+    {
+        const WorkerStats& s = threadStats[i];
+        out << "  " << (i == 0 ? "main    " : "worker " + std::to_string(i)) << std::setw(9) << s.jobs << " jobs"
+            << std::setw(8) << s.steals << " stolen" << std::setw(8) << std::fixed << std::setprecision(1)
+            << (s.elapsedMs > 0.0 ? 100.0 * s.busyMs / s.elapsedMs : 0.0) << "% busy" << std::endl;
+    }
+}
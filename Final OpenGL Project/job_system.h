@@ -0,0 +1,222 @@
+#pragma once
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include "lock_free.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Work-stealing scheduler for the CPU side of a frame. Every worker, and the thread that started
+// the system, owns a deque: jobs it spawns go to the bottom of its own, and an idle thread steals
+// from the top of someone else's. A job may wait on others, and only counts as finished once the
+// jobs it spawned have too, which is what parallelFor builds on.
+//
+// Jobs come from a pool and keep their work in place, so once the pool has grown to what a frame
+// needs, submitting allocates nothing.
+class JobSystem;
+
+// Holds jobs the owning thread spawned; more than this and they go through the shared queue
+const size_t JOB_DEQUE_CAPACITY = 4096;
+// Most a job's work (a lambda and its captures) may take; it always lives inside the job, so a
+// bigger capture is a compile error rather than a hidden allocation. Capture by reference, or
+// point at a struct, to stay under it.
+const size_t JOB_INLINE_BYTES = 96;
+
+struct Job
+{
+    // The work, type-erased in place: run calls it, destroy ends its lifetime
+    alignas(std::max_align_t) unsigned char storage[JOB_INLINE_BYTES];
+    void (*run)(Job& job) = nullptr;
+    void (*destroy)(Job& job) = nullptr;
+
+    JobSystem* system = nullptr;
+    Job* parent = nullptr;              // The job that spawned this one, held open until it finishes
+    std::atomic<int> references{ 0 };   // Handles, plus one while queued or running, plus children
+    std::atomic<int> unfinished{ 0 };   // The work itself plus spawned jobs still running
+    std::atomic<int> blockers{ 0 };     // Dependencies still running, plus one until submit is done
+    std::mutex mutex;
+    std::vector<Job*> continuations;    // Jobs waiting on this one; guarded by mutex, keeps its capacity
+    bool finished = false;              // Guarded by mutex
+    std::atomic<bool> done{ false };
+
+    template <typename F>
+    void setWork(F&& work);
+};
+
+// Shared reference to a job; the job goes back to the pool when the last one is gone
+class JobHandle
+{
+public:
+    JobHandle() = default;
+    explicit JobHandle(Job* job);
+    JobHandle(const JobHandle& other) : JobHandle(other.job) {}
+    JobHandle(JobHandle&& other) noexcept : job(other.job) { other.job = nullptr; }
+    JobHandle& operator=(JobHandle other) { std::swap(job, other.job); return *this; }
+    ~JobHandle();
+
+    Job* get() const { return job; }
+    Job* operator->() const { return job; }
+    explicit operator bool() const { return job != nullptr; }
+
+private:
+    Job* job = nullptr;
+};
+
+struct WorkerStats
+{
+    uint64_t jobs = 0;          // Jobs run on this thread
+    uint64_t steals = 0;        // ... of which it took from another thread's deque
+    double busyMs = 0.0;        // Time spent inside them
+    double elapsedMs = 0.0;     // Since start() or resetStats()
+};
+
+class JobSystem
+{
+public:
+    ~JobSystem();
+
+    // workerCount = 0 uses one thread per core, the calling thread counting as one of them
+    void start(int workerCount = 0);
+    void stop();
+    // Workers plus the thread that called start()
+    int threadCount() const { return (int)workers.size(); }
+
+    // Runs work() once every job in after has finished; a job spawned from inside another one also
+    // holds that one open until it finishes
+    template <typename F>
+    JobHandle submit(F&& work, std::initializer_list<JobHandle> after = {});
+    // Calls body(first, count) on ranges of [0, count) no smaller than grain / 2, splitting in
+    // halves so thieves take the biggest pieces left
+    template <typename Body>
+    JobHandle parallelFor(size_t count, size_t grain, Body&& body, std::initializer_list<JobHandle> after = {});
+    // Runs other jobs until this one has finished
+    void wait(const JobHandle& job);
+
+    std::vector<WorkerStats> stats() const;
+    void resetStats();
+    // One line per thread: jobs, steals and the share of the time it was busy
+    void printUtilization(std::ostream& out) const;
+
+private:
+    friend class JobHandle;
+
+    struct Worker
+    {
+        WorkStealingDeque<Job, JOB_DEQUE_CAPACITY> deque;
+        std::atomic<uint64_t> jobs{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<uint64_t> busyNs{ 0 };
+    };
+
+    // The body of a parallelFor, kept in the first job; the pieces point back at it
+    template <typename Body>
+    struct Range
+    {
+        JobSystem* system;
+        Body body;
+        size_t count;
+        size_t grain;
+
+        void operator()() { system->split(*this, 0, count); }
+    };
+
+    template <typename Body>
+    struct Piece
+    {
+        Range<Body>* range;
+        size_t first;
+        size_t count;
+
+        void operator()() { range->system->split(*range, first, count); }
+    };
+
+    template <typename Body>
+    void split(Range<Body>& range, size_t first, size_t count);
+
+    Job* allocate();
+    // Drops one reference; the last one puts the job back in the pool
+    static void release(Job* job);
+    JobHandle launch(Job* job, std::initializer_list<JobHandle> after);
+
+    int slotOf() const;
+    void workerLoop(int index);
+    void schedule(Job* job);
+    // Own deque first, then the shared queue, then the others' deques
+    Job* findJob(int index, bool& stolen);
+    void execute(Job* job, int index, bool stolen);
+    void finishOne(Job* job);
+    void wake();
+
+    std::vector<std::unique_ptr<Worker>> workers;   // Slot 0 is the thread that called start()
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Job*> injected;                      // From threads without a deque, or full ones
+    std::atomic<int> injectedCount{ 0 };
+    std::atomic<int> queued{ 0 };                   // Jobs waiting in any deque or injected
+    std::atomic<int> sleepers{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::chrono::steady_clock::time_point statsStart;
+
+    // Pool: jobs are made in blocks and never freed before the system is
+    std::mutex poolMutex;
+    std::vector<std::unique_ptr<Job[]>> blocks;
+    std::vector<Job*> freeJobs;
+};
+
+// Started in main, shared by everything that splits work across cores
+extern JobSystem jobSystem;
+
+template <typename F>
+void Job::setWork(F&& work)
+{
+    typedef typename std::decay<F>::type Work;
+    static_assert(sizeof(Work) <= JOB_INLINE_BYTES, "Job work is bigger than JOB_INLINE_BYTES; capture less");
+    static_assert(alignof(Work) <= alignof(std::max_align_t), "Job work is over-aligned");
+    new (storage) Work(std::forward<F>(work));
+    run = [](Job& job) { (*std::launder(reinterpret_cast<Work*>(job.storage)))(); };
+    destroy = [](Job& job) { std::launder(reinterpret_cast<Work*>(job.storage))->~Work(); };
+}
+
+template <typename F>
+JobHandle JobSystem::submit(F&& work, std::initializer_list<JobHandle> after)
+{
+    Job* job = allocate();
+    job->setWork(std::forward<F>(work));
+    return launch(job, after);
+}
+
+template <typename Body>
+JobHandle JobSystem::parallelFor(size_t count, size_t grain, Body&& body, std::initializer_list<JobHandle> after)
+{
+    typedef typename std::decay<Body>::type Work;
+    return submit(Range<Work>{ this, std::forward<Body>(body), count, grain ? grain : 1 }, after);
+}
+
+template <typename Body>
+void JobSystem::split(Range<Body>& range, size_t first, size_t count)
+{
+    // The back half goes on this thread's deque until the front is small enough; thieves take from
+    // the other end, so they get the biggest halves and split those in turn. The pieces hold the
+    // first job open, which keeps range alive until they are done.
+    while (count > range.grain)
+    {
+        size_t half = count / 2;
+        submit(Piece<Body>{ &range, first + half, count - half });
+        count = half;
+    }
+    if (count)
+        range.body(first, count);
+}
+
+#endif // JOB_SYSTEM_H
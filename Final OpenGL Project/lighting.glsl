@@ -0,0 +1,70 @@
+// Shared by the lit surface shaders. Permutation defines (see ShaderVariants):
+//   FLASHLIGHT  the flashlight is on; without it flashlight() folds to zero
+//   BLOOM       rendering into the bloom targets, where the final pass does the gamma correction
+#include "frame_uniforms.glsl"
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BloomColor;
+
+const float FLASHLIGHT_CUTOFF = 0.95;           // Narrower cone angle for smaller radius
+const float FLASHLIGHT_OUTER_CUTOFF = 0.97;     // Slightly larger for smoother transition
+const float FLASHLIGHT_A = 0.02;                // Refined decay factors for more realistic falloff
+const float FLASHLIGHT_B = 0.6;
+const float SUN_RADIUS = 8.0;                   // Compressed units
+
+// Distance to the sun in the compressed units the lighting was tuned in. Never less than the compressed
+// sun's radius: the real sun is a hundredth of an AU across and its own surface would burn white.
+float sunDistance(vec3 position)
+{
+    return max(length(lightPos - position) * distanceScale, SUN_RADIUS * 0.99);
+}
+
+// Diffuse and specular light from the flashlight cone; surfaceColor tints the diffuse part
+vec3 flashlight(vec3 norm, vec3 viewVec, vec3 surfaceColor, vec3 specular, float specularStrength, float shininess)
+{
+#ifdef FLASHLIGHT
+    vec3 viewDir = normalize(viewVec);
+    float theta = dot(viewDir, -normalize(flashlightDir));
+    if (theta <= FLASHLIGHT_CUTOFF)
+        return vec3(0.0);
+
+    float epsilon = FLASHLIGHT_OUTER_CUTOFF - FLASHLIGHT_CUTOFF;
+    float intensity = clamp((theta - FLASHLIGHT_CUTOFF) / epsilon, 0.0, 1.0);
+    // green ring blending region
+    float ringEpsilon1 = epsilon - 0.18;
+    float ringIntensity1 = clamp((theta - FLASHLIGHT_CUTOFF - 0.18) / ringEpsilon1, 0.0, 1.0);
+    // red ring blending region
+    float ringEpsilon2 = epsilon - 0.08;
+    float ringIntensity2 = clamp((theta - FLASHLIGHT_CUTOFF - 0.08) / ringEpsilon2, 0.0, 1.0);
+
+    // Distance-based attenuation
+    float dist = length(viewVec) * distanceScale;
+    float attenuation = 1.5 / (FLASHLIGHT_A * dist * dist + FLASHLIGHT_B * dist + 1.0);
+
+    // Spotlight diffuse component
+    vec3 coreColor = vec3(0.0, 0.0, 0.82) * intensity;          // blue core
+    vec3 ringColor1 = vec3(0.0, 0.81, 0.0) * ringIntensity1;    // Fading green ring
+    vec3 ringColor2 = vec3(0.8, 0.0, 0.0) * ringIntensity2;     // Fading red ring
+    vec3 spotlight = attenuation * surfaceColor * (coreColor + ringColor1 + ringColor2) * intensity;
+
+    // Spotlight specular component
+    vec3 flashlightColor = vec3(0.8, 0.81, 0.82);
+    vec3 spotlightReflectDir = reflect(-viewDir, norm);
+    float spotlightSpec = pow(max(dot(viewDir, spotlightReflectDir), 0.0), shininess / attenuation);
+    return spotlight + attenuation * intensity * specular * specularStrength * spotlightSpec * flashlightColor * spotlightSpec;
+#else
+    return vec3(0.0);
+#endif
+}
+
+// Tone maps the colour and writes both targets; only bright fragments feed the bloom
+void writeLitOutput(vec3 color, float alpha, float bloomAlpha)
+{
+#ifndef BLOOM
+    color = pow(color, vec3(1.0 / gamma));
+#endif
+    vec3 result = vec3(1.0) - exp(-color * exposure);
+    FragColor = vec4(result, alpha);
+    float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
+    BloomColor = brightness > 0.15 ? vec4(result, bloomAlpha) : vec4(0.0, 0.0, 0.0, bloomAlpha);
+}
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef LOCK_FREE_H
+#define LOCK_FREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Latest-value handoff between one writer and one reader thread. The writer fills back() and
+// publishes it; the reader swaps in whatever was published last and keeps it until it asks again.
+// Neither side ever waits for the other, and values the reader never picked up are overwritten.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer: the slot to fill, still holding whatever was written there three publishes ago
+    T& back() { return slots[backIndex]; }
+
+    void publish()
+    {
+        backIndex = state.exchange((uint8_t)(backIndex | FRESH), std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader: swaps in the newest published value; false if nothing new was published since
+    bool update()
+    {
+        if (!(state.load(std::memory_order_acquire) & FRESH))
+            return false;
+        frontIndex = state.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static const uint8_t INDEX = 3;
+    static const uint8_t FRESH = 4;     // The middle slot holds a value the reader hasn't taken
+
+    T slots[3];
+    uint8_t backIndex = 0;                      // Writer only
+    alignas(64) std::atomic<uint8_t> state{ 1 };// Middle slot, plus FRESH
+    alignas(64) uint8_t frontIndex = 2;         // Reader only
+};
+
+// Bounded single-producer, single-consumer FIFO; Capacity must be a power of two
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    // Producer: false when full
+    bool push(const T& value)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[tail & (Capacity - 1)] = value;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false when empty
+    bool pop(T& value)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire))
+            return false;
+        value = items[head & (Capacity - 1)];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Capacity];
+    alignas(64) std::atomic<size_t> headIndex{ 0 };
+    alignas(64) std::atomic<size_t> tailIndex{ 0 };
+};
+
+// Chase-Lev work-stealing deque of pointers (Le et al., "Correct and efficient work-stealing for
+// weak memory models"), fixed size. The owner pushes and pops at the bottom, last in first out;
+// any other thread steals from the top, so thieves take the oldest, usually the biggest, work.
+template <typename T, size_t Capacity>
+class WorkStealingDeque
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "WorkStealingDeque capacity must be a power of two");
+
+public:
+    // Owner: false when full
+    bool push(T* item)
+    {
+        int64_t bottom = bottomIndex.load(std::memory_order_relaxed);
+        int64_t top = topIndex.load(std::memory_order_acquire);
+        if (bottom - top >= (int64_t)Capacity)
+            return false;
+        items[bottom & (Capacity - 1)].store(item, std::memory_order_relaxed);
+        bottomIndex.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner: the newest item, nullptr when empty
+    T* pop()
+    {
+        int64_t bottom = bottomIndex.load(std::memory_order_relaxed) - 1;
+        bottomIndex.store(bottom, std::memory_order_seq_cst);
+        int64_t top = topIndex.load(std::memory_order_seq_cst);
+        if (top > bottom)
+        {
+            bottomIndex.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* item = items[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // The last one: race the thieves for it
+            if (!topIndex.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            bottomIndex.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread: the oldest item, nullptr when empty or another thread got there first
+    T* steal()
+    {
+        int64_t top = topIndex.load(std::memory_order_seq_cst);
+        int64_t bottom = bottomIndex.load(std::memory_order_seq_cst);
+        if (top >= bottom)
+            return nullptr;
+        T* item = items[top & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (!topIndex.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    bool empty() const
+    {
+        return topIndex.load(std::memory_order_acquire) >= bottomIndex.load(std::memory_order_acquire);
+    }
+
+private:
+    // Padded apart rather than aligned, so deques can live on the heap without over-aligned new
+    std::atomic<T*> items[Capacity] = {};
+    std::atomic<int64_t> topIndex{ 0 };
+    char topPadding[64];
+    std::atomic<int64_t> bottomIndex{ 0 };
+    char bottomPadding[64];
+};
+
+#endif // LOCK_FREE_H
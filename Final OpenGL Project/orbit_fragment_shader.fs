@@ -5,8 +5,9 @@ uniform vec3 cameraPos; // Camera position in world space
 in vec3 FragPos;        // Orbit point in world space
 uniform float gamma;    // Gamma correction parameter
 uniform bool haveBloom; 
+uniform float distanceScale;    // To the compressed units the fade was tuned in
 void main() {
-    float distance = length(cameraPos - FragPos);
+    float distance = length(cameraPos - FragPos) * distanceScale;
     float alpha = clamp(1.0 / (distance * distance * 0.005), 0.1, 2.2);
     float darkness = clamp(1.0 / (0.005 * distance), 0.0, 2.2);
 
@@ -3,10 +3,11 @@ layout(location = 0) in vec3 aPos;
 
 uniform mat4 projection;
 uniform mat4 view;
+uniform vec3 offset;    // Minus the render origin
 
 out vec3 FragPos; // Pass the world space position to the fragment shader
 
 void main() {
-    FragPos = aPos; // Directly pass vertex position 
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    FragPos = aPos + offset; // Relative to the render origin, like cameraPos
+    gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "real_scale.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+bool reversedDepth = false;
+
+// Not in the GL 3.3 headers
+static const GLenum CLIP_ZERO_TO_ONE = 0x935F;
+typedef void (APIENTRYP ClipControlProc)(GLenum origin, GLenum depth);
+
+static const double MIN_ALTITUDE_KM = 0.01;
+
+bool parseRealScaleArgs(int argc, char** argv, RealScaleOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--real-scale") != 0)
+            continue;
+        options.enabled = true;
+        // The value is optional
+        if (i + 1 >= argc || strncmp(argv[i + 1], "--", 2) == 0)
+            continue;
+        char* end = nullptr;
+        double value = strtod(argv[i + 1], &end);
+        if (end == argv[i + 1] || *end != '\0' || value <= 0.0)
+        {
+            std::cerr << "Bad value for --real-scale: " << argv[i + 1] << std::endl;
+            return false;
+        }
+        options.nearPlane = (float)value;
+        i++;
+    }
+    return true;
+}
+
+struct RealBody
+{
+    const char* name;
+    double radius;          // km
+    double semiMajorAxis;   // km, about the sun or, for the moon, the earth
+    double yearDays;        // 0 = doesn't orbit
+    double dayHours;        // Sidereal
+};
+
+static const RealBody REAL_BODIES[] = {
+    { "sun",     695700.0, 0.0,          0.0,     609.12 },
+    { "mercury", 2439.7,   57909050.0,   87.969,  1407.6 },
+    { "venus",   6051.8,   108208000.0,  224.701, 5832.5 },
+    { "earth",   6371.0,   149598023.0,  365.256, 23.9345 },
+    { "moon",    1737.4,   384399.0,     27.3217, 655.72 },
+    { "mars",    3389.5,   227939200.0,  686.980, 24.6229 },
+    { "jupiter", 69911.0,  778570000.0,  4332.59, 9.925 },
+    { "saturn",  58232.0,  1433530000.0, 10759.22, 10.656 },
+    { "uranus",  25362.0,  2870972000.0, 30688.5, 17.24 },
+    { "neptune", 24622.0,  4500000000.0, 60195.0, 16.11 },
+    { "pluto",   1188.3,   5906440628.0, 90560.0, 153.29 },
+};
+
+bool applyRealScale(BodyStore& bodies, int body)
+{
+    const std::string& name = bodies.names[body];
+    for (const RealBody& real : REAL_BODIES)
+    {
+        if (name != real.name)
+            continue;
+        OrbitComponent& orbit = bodies.orbits[body];
+        SpinComponent& spin = bodies.spins[body];
+        bodies.transforms[body].scale = (float)real.radius;
+        orbit.semiMajorAxis = (float)real.semiMajorAxis;
+        // Degrees per sim second, with a sim second a day; the compressed spin keeps its direction
+        orbit.speed = real.yearDays > 0.0 ? (float)(360.0 / real.yearDays) : 0.0f;
+        spin.speed = std::copysign((float)(360.0 * 24.0 / real.dayHours), spin.speed);
+        return true;
+    }
+    std::cerr << "No real-scale data for " << name << std::endl;
+    return false;
+}
+
+bool enableReversedDepth()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    ClipControlProc clipControl = nullptr;
+    if (major > 4 || (major == 4 && minor >= 5) || glfwExtensionSupported("GL_ARB_clip_control"))
+        clipControl = (ClipControlProc)glfwGetProcAddress("glClipControl");
+    if (!clipControl)
+    {
+        std::cerr << "Reversed depth needs glClipControl (OpenGL 4.5 or ARB_clip_control), which "
+            << glGetString(GL_RENDERER) << " doesn't have" << std::endl;
+        return false;
+    }
+    clipControl(GL_LOWER_LEFT, CLIP_ZERO_TO_ONE);
+    glClearDepth(0.0);
+    glDepthFunc(GL_GREATER);
+    reversedDepth = true;
+    return true;
+}
+
+float farDepth()
+{
+    return reversedDepth ? 0.0f : 1.0f;
+}
+
+GLenum nearerDepthFunc()
+{
+    return reversedDepth ? GL_GREATER : GL_LESS;
+}
+
+GLenum nearerOrEqualDepthFunc()
+{
+    return reversedDepth ? GL_GEQUAL : GL_LEQUAL;
+}
+
+glm::mat4 infiniteReversedPerspective(float fovy, float aspect, float zNear)
+{
+    // z_clip = zNear and w_clip = -z_eye, so depth is zNear / distance: 1 at the near plane, 0 at infinity
+    float f = 1.0f / tanf(fovy * 0.5f);
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / aspect;
+    projection[1][1] = f;
+    projection[2][3] = -1.0f;
+    projection[3][2] = zNear;
+    return projection;
+}
+
+void updateRealScaleView(RealScaleView& view, const BodyStore& bodies)
+{
+    const std::vector<TransformComponent>& transforms = bodies.transforms;
+    glm::dvec3 camera = view.offset;
+    if (view.anchor >= 0)
+        camera += transforms[view.anchor].worldPosition;
+
+    // Nearest surface rather than nearest centre: next to the moon, the moon is followed, not the earth
+    int nearest = -1;
+    double altitude = 0.0;
+    for (size_t i = 0; i < transforms.size(); i++)
+    {
+        const TransformComponent& body = transforms[i];
+        double above = glm::length(camera - body.worldPosition) - body.scale;
+        if (nearest < 0 || above < altitude)
+        {
+            nearest = (int)i;
+            altitude = above;
+        }
+    }
+    if (nearest >= 0)
+    {
+        view.anchor = nearest;
+        view.offset = camera - transforms[nearest].worldPosition;
+    }
+    view.origin = camera;
+    // Still a step to take when the camera has gone into a surface
+    view.altitude = std::max(altitude, MIN_ALTITUDE_KM);
+}
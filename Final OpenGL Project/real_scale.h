@@ -0,0 +1,70 @@
+#pragma once
+#ifndef REAL_SCALE_H
+#define REAL_SCALE_H
+
+#include "celestial.h"
+
+// --real-scale: the bodies at their real sizes and distances, in kilometres, with one sim second
+// a day. A float a few AU out is only good to tens of kilometres, so world positions are doubles
+// (TransformComponent::worldPosition) and the floating origin follows the camera: what goes to the GPU
+// is an offset from the camera, small wherever precision shows. Depth is reversed with an
+// infinite far plane, so one float depth buffer holds a metre at the surface and Pluto's orbit.
+struct RealScaleOptions
+{
+    bool enabled = false;
+    float nearPlane = 0.001f;   // km: a metre, close enough to stand on a surface
+};
+
+// Parses --real-scale [NEAR_KM]
+// Returns false on a malformed argument
+bool parseRealScaleArgs(int argc, char** argv, RealScaleOptions& options);
+
+const double KM_PER_AU = 149597870.7;
+// Where the compressed scene puts the earth, and what its lighting and orbit lines were tuned on
+const double COMPRESSED_UNITS_PER_AU = 24.0;
+// Compressed units per kilometre, for everything that fades with distance
+const float REAL_SCALE_DISTANCE_SCALE = (float)(COMPRESSED_UNITS_PER_AU / KM_PER_AU);
+// Segments of a real-scale orbit line: at 360, Pluto's would miss Pluto by 200,000 km
+const int REAL_SCALE_ORBIT_SEGMENTS = 4096;
+
+// Real radius, semi-major axis, year and day for the body, found by its name; tilt, eccentricity
+// and inclination are real already. False when the name is unknown.
+bool applyRealScale(BodyStore& bodies, int body);
+
+// ----- Depth -----
+
+// Near is 1 and infinitely far is 0, with clip depth in [0, 1] so the float's exponent goes where
+// perspective squeezes depth. Needs glClipControl (GL 4.5 or ARB_clip_control).
+extern bool reversedDepth;
+
+// GL thread, after glad is loaded and before any depth buffer is made; false if unsupported
+bool enableReversedDepth();
+// Depth of the far plane: what depth is cleared to and where the skybox goes
+float farDepth();
+// What GL_LESS and GL_LEQUAL become
+GLenum nearerDepthFunc();
+GLenum nearerOrEqualDepthFunc();
+// Reversed-depth perspective without a far plane
+glm::mat4 infiniteReversedPerspective(float fovy, float aspect, float zNear);
+
+// ----- Camera -----
+
+// The camera rides along with the body whose surface is nearest, or it would be left behind at
+// orbital speeds. The camera is always at the render origin, so cameraPos is only this frame's
+// movement, folded into offset before the origin is moved.
+struct RealScaleView
+{
+    int anchor = -1;                        // Index into the bodies; -1 and offset is in the world
+    glm::dvec3 offset = glm::dvec3(0.0);    // Camera from the anchor, km
+    glm::dvec3 origin = glm::dvec3(0.0);    // Camera in the world: the render origin
+    double altitude = 0.0;                  // Above the anchor's surface, never under ten metres
+};
+
+// Fraction of the altitude one step of cameraSpeed 1 covers, so a few seconds of flying take the
+// camera from a surface out past Pluto
+const float REAL_SCALE_CAMERA_SPEED = 0.2f;
+
+// Once the frame's world positions are in: re-anchors to the nearest surface and moves the origin
+void updateRealScaleView(RealScaleView& view, const BodyStore& bodies);
+
+#endif // REAL_SCALE_H
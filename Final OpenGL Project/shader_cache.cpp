@@ -0,0 +1,303 @@
+#include "shader_cache.h"
+#include "asset_pack.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+
+// Not part of the GL 3.3 core headers
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRY* GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRY* ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRY* ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t SHADER_CACHE_VERSION = 1;
+
+struct ShaderCacheHeader
+{
+    char magic[4];          // "SBIN"
+    uint32_t version;
+    uint64_t driver;        // Hash of the vendor, renderer and version strings
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+// Followed by size bytes of binary
+struct ShaderCacheEntry
+{
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+};
+
+struct CachedProgram
+{
+    GLenum format;
+    std::vector<unsigned char> binary;
+};
+
+struct PendingProgram
+{
+    GLuint program;
+    GLuint vertex;
+    GLuint second;          // Fragment or geometry shader
+    uint64_t key;
+    std::string name;
+};
+
+static GetProgramBinaryProc getProgramBinary = nullptr;
+static ProgramBinaryProc programBinary = nullptr;
+static ProgramParameteriProc programParameteri = nullptr;
+static bool parallelCompile = false;
+
+static std::string cacheFile;
+static uint64_t driverHash = 0;
+static std::unordered_map<uint64_t, CachedProgram> cache;
+static bool cacheDirty = false;
+
+static std::vector<PendingProgram> pending;
+static bool timing = false;
+static Clock::time_point buildStart;
+static int builtCount = 0;
+static int cachedCount = 0;
+
+static void startTiming()
+{
+    if (timing)
+        return;
+    timing = true;
+    buildStart = Clock::now();
+    builtCount = cachedCount = 0;
+}
+
+static void readCache()
+{
+    cache.clear();
+    std::ifstream file(cacheFile, std::ios::binary);
+    ShaderCacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return;
+    // A different driver can't load these binaries; they are rebuilt and the file replaced
+    if (memcmp(header.magic, "SBIN", 4) != 0 || header.version != SHADER_CACHE_VERSION || header.driver != driverHash)
+        return;
+    for (uint32_t i = 0; i < header.entryCount; i++)
+    {
+        ShaderCacheEntry entry;
+        if (!file.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+            break;
+        CachedProgram& program = cache[entry.key];
+        program.format = entry.format;
+        program.binary.resize(entry.size);
+        if (!file.read(reinterpret_cast<char*>(program.binary.data()), entry.size))
+        {
+            cache.erase(entry.key);
+            break;
+        }
+    }
+}
+
+static void writeCache()
+{
+    std::ofstream file(cacheFile, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << cacheFile << " for writing" << std::endl;
+        return;
+    }
+    ShaderCacheHeader header = { { 'S', 'B', 'I', 'N' }, SHADER_CACHE_VERSION, driverHash, (uint32_t)cache.size(), 0 };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& item : cache)
+    {
+        ShaderCacheEntry entry = { item.first, item.second.format, (uint32_t)item.second.binary.size() };
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        file.write(reinterpret_cast<const char*>(item.second.binary.data()), item.second.binary.size());
+    }
+    cacheDirty = false;
+}
+
+void initShaderCache(const std::string& cachePath)
+{
+    cacheFile = cachePath;
+    pending.clear();
+    timing = false;
+
+    getProgramBinary = nullptr;
+    programBinary = nullptr;
+    programParameteri = nullptr;
+    GLint formatCount = 0;
+    if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1) ||
+        glfwExtensionSupported("GL_ARB_get_program_binary"))
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    // Some drivers expose the entry points but no formats to save in
+    if (formatCount > 0)
+    {
+        getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+        programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+        programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+        if (!getProgramBinary || !programBinary || !programParameteri)
+            getProgramBinary = nullptr;
+    }
+
+    MaxShaderCompilerThreadsProc maxThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    parallelCompile = maxThreads != nullptr;
+    if (maxThreads)
+        maxThreads(0xFFFFFFFF); // As many as the driver likes
+
+    driverHash = 0;
+    cache.clear();
+    if (getProgramBinary)
+    {
+        const char* strings[] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER),
+            (const char*)glGetString(GL_VERSION) };
+        driverHash = hashBytes(nullptr, 0);
+        for (const char* text : strings)
+            if (text)
+                driverHash = hashBytes(text, strlen(text) + 1, driverHash);
+        readCache();
+    }
+}
+
+uint64_t shaderSourceKey(const char* vertexSource, GLint vertexLength, const char* fragmentSource, GLint fragmentLength)
+{
+    startTiming();
+    const char separator = 0;
+    uint64_t hash = hashBytes(vertexSource, vertexLength);
+    hash = hashBytes(&separator, 1, hash);
+    return hashBytes(fragmentSource, fragmentLength, hash);
+}
+
+bool loadCachedProgram(GLuint program, uint64_t key)
+{
+    if (!programBinary)
+        return false;
+    auto found = cache.find(key);
+    if (found == cache.end())
+        return false;
+    programBinary(program, found->second.format, found->second.binary.data(), (GLsizei)found->second.binary.size());
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // Rejected after a driver update with the same strings; build from source and replace it
+        cache.erase(found);
+        cacheDirty = true;
+        return false;
+    }
+    cachedCount++;
+    return true;
+}
+
+void prepareProgramLink(GLuint program)
+{
+    if (programParameteri && getProgramBinary)
+        programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void queueProgramLink(GLuint program, GLuint vertex, GLuint second, uint64_t key, const std::string& name)
+{
+    pending.push_back({ program, vertex, second, key, name });
+}
+
+static void checkCompileErrors(GLuint shader, const char* type, const std::string& name)
+{
+    GLint success;
+    GLchar infoLog[1024];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+        std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << " (" << name << ")\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+    }
+}
+
+// Called once the link is known to be finished, so none of these queries block
+static void completeProgram(const PendingProgram& pendingProgram)
+{
+    GLuint program = pendingProgram.program;
+    checkCompileErrors(pendingProgram.vertex, "VERTEX", pendingProgram.name);
+    GLint secondType = GL_FRAGMENT_SHADER;
+    glGetShaderiv(pendingProgram.second, GL_SHADER_TYPE, &secondType);
+    checkCompileErrors(pendingProgram.second, secondType == GL_GEOMETRY_SHADER ? "GEOMETRY" : "FRAGMENT", pendingProgram.name);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        GLchar infoLog[1024];
+        glGetProgramInfoLog(program, 1024, NULL, infoLog);
+        std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM (" << pendingProgram.name << ")\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+    }
+    // The shader objects are no longer needed once linked
+    glDetachShader(program, pendingProgram.vertex);
+    glDetachShader(program, pendingProgram.second);
+    glDeleteShader(pendingProgram.vertex);
+    glDeleteShader(pendingProgram.second);
+    builtCount++;
+
+    if (!success || !getProgramBinary)
+        return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    CachedProgram& cached = cache[pendingProgram.key];
+    cached.binary.resize(length);
+    GLenum format = 0;
+    getProgramBinary(program, length, &length, &format, cached.binary.data());
+    cached.binary.resize(length);
+    cached.format = format;
+    cacheDirty = true;
+}
+
+bool pollShaders()
+{
+    size_t i = 0;
+    while (i < pending.size())
+    {
+        GLint done = GL_TRUE;
+        if (parallelCompile)
+            glGetProgramiv(pending[i].program, GL_COMPLETION_STATUS_KHR, &done);
+        if (done)
+        {
+            completeProgram(pending[i]);
+            pending.erase(pending.begin() + i);
+        }
+        else
+            i++;
+    }
+    return !pending.empty();
+}
+
+void finishShaders()
+{
+    while (pollShaders())
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    if (cacheDirty)
+        writeCache();
+    if (timing)
+    {
+        std::cout << "Shaders ready in " << std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count()
+            << " ms: " << builtCount << " compiled" << (parallelCompile ? " in parallel" : "") << ", "
+            << cachedCount << " from the binary cache" << std::endl;
+        timing = false;
+    }
+}
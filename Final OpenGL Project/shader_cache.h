@@ -0,0 +1,33 @@
+#pragma once
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include "utils.h"
+#include <cstdint>
+
+// Program binaries kept between runs (GL 4.1 / ARB_get_program_binary) and background compilation
+// (KHR/ARB_parallel_shader_compile). Both are optional; without them programs build as they always did.
+// Shader constructors only issue the compile and link, finishShaders collects the results.
+
+// Call once per context, after GLAD is loaded
+void initShaderCache(const std::string& cachePath = "../shader_cache.bin");
+
+// Identifies a program by its sources; the driver is checked when the cache file is read
+uint64_t shaderSourceKey(const char* vertexSource, GLint vertexLength, const char* fragmentSource, GLint fragmentLength);
+
+// Fills program from a cached binary; false when there is none or the driver rejects it
+bool loadCachedProgram(GLuint program, uint64_t key);
+
+// Sets the hints a program needs before glLinkProgram so its binary can be cached
+void prepareProgramLink(GLuint program);
+
+// Takes over a program whose link was issued but not checked: finishShaders reports its errors,
+// deletes the shader objects and stores the binary. second is the fragment or geometry shader.
+void queueProgramLink(GLuint program, GLuint vertex, GLuint second, uint64_t key, const std::string& name);
+
+// Collects the programs the driver has finished without blocking; true while any are still building
+bool pollShaders();
+// Waits for every queued program, writes new binaries to the cache and prints the build time
+void finishShaders();
+
+#endif // SHADER_CACHE_H
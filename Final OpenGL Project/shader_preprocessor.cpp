@@ -0,0 +1,81 @@
+#include "shader_preprocessor.h"
+#include "asset_pack.h"
+#include <sstream>
+
+static std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// The quoted name of an `#include "name"` line, or false for any other line
+static bool includeTarget(const std::string& line, std::string& name)
+{
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+        return false;
+    size_t open = line.find('"', start + 8);
+    size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+    if (close == std::string::npos)
+        return false;
+    name = line.substr(open + 1, close - open - 1);
+    return true;
+}
+
+static bool appendFile(const std::string& path, const std::vector<std::string>& defines,
+    std::vector<std::string>& included, std::string& source)
+{
+    AssetSpan span;
+    std::vector<unsigned char> storage;
+    if (!loadAsset(path, span, storage))
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    int fileIndex = (int)included.size();
+    included.push_back(normalizeAssetPath(path));
+
+    std::istringstream lines(std::string(reinterpret_cast<const char*>(span.data), span.size));
+    std::string line, name;
+    int lineNumber = 0;
+    bool succeeded = true;
+    while (std::getline(lines, line))
+    {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (includeTarget(line, name))
+        {
+            std::string target = directoryOf(path) + name;
+            bool seen = false;
+            for (const std::string& file : included)
+                seen = seen || file == normalizeAssetPath(target);
+            if (!seen)
+            {
+                source += "#line 1 " + std::to_string(included.size()) + "\n";
+                succeeded = appendFile(target, defines, included, source) && succeeded;
+                source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+            else
+                source += "\n";
+            continue;
+        }
+        source += line;
+        source += '\n';
+        // Defines have to follow #version, which must come first
+        if (fileIndex == 0 && line.compare(0, 8, "#version") == 0 && !defines.empty())
+        {
+            for (const std::string& define : defines)
+                source += "#define " + define + "\n";
+            source += "#line " + std::to_string(lineNumber + 1) + " 0\n";
+        }
+    }
+    return succeeded;
+}
+
+bool loadShaderSource(const std::string& path, const std::vector<std::string>& defines, std::string& source)
+{
+    source.clear();
+    std::vector<std::string> included;
+    return appendFile(path, defines, included, source);
+}
@@ -0,0 +1,14 @@
+#pragma once
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include "utils.h"
+
+// GLSL 3.30 has no #include, so sources are stitched together here before they reach the driver.
+// `#include "file"` is resolved relative to the including file and each file is pasted once;
+// `#line` markers keep compiler errors pointing at the original lines, with the string number
+// being the file's index in the order it was first included (0 is the top-level shader).
+// Each define is inserted as "#define NAME" right after #version.
+bool loadShaderSource(const std::string& path, const std::vector<std::string>& defines, std::string& source);
+
+#endif // SHADER_PREPROCESSOR_H
@@ -0,0 +1,89 @@
+#include "shader_variants.h"
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& customFeatures)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+    featureNames = { "FLASHLIGHT", "BLOOM" };
+    featureNames.insert(featureNames.end(), customFeatures.begin(), customFeatures.end());
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    release();
+}
+
+ShaderVariants::Variant& ShaderVariants::variant(unsigned features)
+{
+    // Bits this shader doesn't know about would only duplicate an existing variant
+    features &= (1u << featureNames.size()) - 1;
+    Variant& entry = variants[features];
+    if (!entry.shader)
+    {
+        std::vector<std::string> defines;
+        for (size_t bit = 0; bit < featureNames.size(); bit++)
+            if (features & (1u << bit))
+                defines.push_back(featureNames[bit]);
+        entry.shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+    }
+    return entry;
+}
+
+const Shader& ShaderVariants::use(unsigned features)
+{
+    Variant& entry = variant(features);
+    if (!entry.ready)
+    {
+        // A variant first needed mid-frame stalls here once; prepare() avoids that for the usual ones
+        finishShaders();
+        bindFrameUniforms(entry.shader->ID);
+        entry.ready = true;
+    }
+    entry.shader->use();
+    return *entry.shader;
+}
+
+void ShaderVariants::prepare(unsigned features)
+{
+    variant(features);
+}
+
+void ShaderVariants::release()
+{
+    for (auto& item : variants)
+        glDeleteProgram(item.second.shader->ID);
+    variants.clear();
+}
+
+// ----- Frame uniforms -----
+
+void FrameUniformBuffer::init()
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, buffer);
+}
+
+void FrameUniformBuffer::update(const FrameUniforms& values)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    // Orphan last frame's copy so the upload never waits for draws still reading it
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &values);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniformBuffer::release()
+{
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void bindFrameUniforms(GLuint program)
+{
+    GLuint block = glGetUniformBlockIndex(program, "FrameData");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, FRAME_UNIFORM_BINDING);
+}
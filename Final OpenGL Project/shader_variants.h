@@ -0,0 +1,84 @@
+#pragma once
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "utils.h"
+#include "shader_m.h"
+#include <memory>
+#include <unordered_map>
+
+// Feature bits of a permutation. Each set bit becomes a #define, so a draw only pays for the
+// branches and samplers it uses; the first two are shared by every lit shader (lighting.glsl).
+enum ShaderFeature
+{
+    SHADER_FLASHLIGHT = 1 << 0,
+    SHADER_BLOOM = 1 << 1,
+    SHADER_FIRST_CUSTOM = 1 << 2    // Bits after this are named per shader
+};
+
+// Compiled permutations of one vertex/fragment pair, built the first time they are asked for.
+// They go through the same program binary cache as every other shader, so a variant is only
+// compiled from source once per driver.
+class ShaderVariants
+{
+public:
+    // customFeatures names the bits from SHADER_FIRST_CUSTOM upwards, in order
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& customFeatures = {});
+    ~ShaderVariants();
+
+    // Binds the variant for these features, building it first if this is the first use
+    const Shader& use(unsigned features);
+    // Issues the compile without waiting, so startup variants build together with everything else
+    void prepare(unsigned features);
+    void release();
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<Shader> shader;
+        bool ready = false;     // Linked and bound to the frame uniforms
+    };
+
+    Variant& variant(unsigned features);
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> featureNames;  // Index = bit
+    std::unordered_map<unsigned, Variant> variants;
+};
+
+// ----- Frame uniforms -----
+
+// Values every lit program reads, uploaded once a frame instead of once per program.
+// Matches the std140 layout of FrameData in frame_uniforms.glsl.
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 lightPos;
+    float gamma;
+    glm::vec4 lightColor;
+    glm::vec3 viewPos;
+    float exposure;
+    glm::vec3 flashlightDir;
+    float distanceScale;    // What distances are multiplied by before anything fades with them
+};
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms must match the std140 FrameData block");
+
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+class FrameUniformBuffer
+{
+public:
+    void init();
+    void update(const FrameUniforms& values);
+    void release();
+
+private:
+    GLuint buffer = 0;
+};
+
+// Points a program's FrameData block at FRAME_UNIFORM_BINDING; programs without it are left alone
+void bindFrameUniforms(GLuint program);
+
+#endif // SHADER_VARIANTS_H
@@ -0,0 +1,115 @@
+#include "simulation.h"
+#include <algorithm>
+
+// Ticks the thread may fall behind by (a debugger break, a hitch) before it stops catching up
+static const int MAX_LAG_TICKS = 4;
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::init(const BodyStore& bodies, float initialSpeed)
+{
+    orbits = bodies.orbits;
+    spins = bodies.spins;
+    parents = bodies.parents;
+    worldPositions.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++)
+        worldPositions[i] = bodies.transforms[i].worldPosition;
+    speedFactor = initialSpeed;
+    simTime = 0.0;
+    tick = 0;
+}
+
+void Simulation::start()
+{
+    stopping = false;
+    thread = std::thread(&Simulation::threadLoop, this);
+}
+
+void Simulation::stop()
+{
+    stopping = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+double Simulation::clock() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Simulation::threadLoop()
+{
+    const std::chrono::duration<double> period(1.0 / SIM_TICK_HZ);
+    auto next = std::chrono::steady_clock::now();
+    while (!stopping)
+    {
+        step(period.count());
+        next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+        auto now = std::chrono::steady_clock::now();
+        if (now - next > MAX_LAG_TICKS * period)
+            next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void Simulation::step(double dt)
+{
+    SimCommand command;
+    while (commands.pop(command))
+    {
+        switch (command.type)
+        {
+        case SIM_SET_SPEED: speedFactor = command.value; break;
+        }
+    }
+
+    float warped = (float)dt * speedFactor;
+    simTime += warped;
+    advanceBodies(orbits, spins, parents, worldPositions, warped);
+
+    SimSnapshot& snapshot = snapshots.back();
+    snapshot.tick = ++tick;
+    snapshot.wallTime = clock();
+    snapshot.simTime = simTime;
+    snapshot.bodies.resize(orbits.size());
+    for (size_t i = 0; i < orbits.size(); i++)
+        snapshot.bodies[i] = { worldPositions[i], orbits[i].angle, spins[i].angle };
+    snapshots.publish();
+}
+
+bool Simulation::send(const SimCommand& command)
+{
+    return commands.push(command);
+}
+
+void Simulation::apply(BodyStore& targets, double& renderSimTime)
+{
+    if (snapshots.update())
+    {
+        previous = current;
+        current = snapshots.front();
+    }
+    if (current.tick == 0)
+        return;     // Nothing published yet
+
+    // Drawn a tick behind the clock so there is nearly always a snapshot on either side
+    float alpha = 1.0f;
+    if (thread.joinable() && previous.tick != 0 && current.wallTime > previous.wallTime)
+    {
+        double drawTime = clock() - 1.0 / SIM_TICK_HZ;
+        alpha = (float)glm::clamp((drawTime - previous.wallTime) / (current.wallTime - previous.wallTime), 0.0, 1.0);
+    }
+    const SimSnapshot& from = alpha < 1.0f ? previous : current;
+    for (size_t i = 0; i < targets.size() && i < current.bodies.size(); i++)
+    {
+        const BodyState& a = from.bodies[i];
+        const BodyState& b = current.bodies[i];
+        targets.transforms[i].worldPosition = glm::mix(a.worldPosition, b.worldPosition, (double)alpha);
+        targets.orbits[i].angle = glm::mix(a.orbitAngle, b.orbitAngle, (double)alpha);
+        targets.spins[i].angle = glm::mix(a.spinAngle, b.spinAngle, (double)alpha);
+    }
+    renderSimTime = from.simTime + (current.simTime - from.simTime) * alpha;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "body_store.h"
+#include "lock_free.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// The orbits run on their own thread at a fixed rate, apart from input and GL submission. Each
+// tick publishes an immutable snapshot through a triple buffer; the render thread draws between
+// the last two it received. Input goes the other way through an SPSC queue, so a slow frame and
+// a slow tick never hold each other up. Fixed-step runs skip the thread and step once a frame,
+// so they render exactly what they always did. It keeps copies of the bodies' orbit, spin and
+// parent components only, and builds and runs without GL.
+const int SIM_TICK_HZ = 240;
+
+struct BodyState
+{
+    glm::dvec3 worldPosition;
+    double orbitAngle;
+    double spinAngle;
+};
+
+struct SimSnapshot
+{
+    uint64_t tick = 0;
+    double wallTime = 0.0;              // When the tick ran, on Simulation::clock()
+    double simTime = 0.0;               // Warped seconds, what the asteroid orbits are evaluated at
+    std::vector<BodyState> bodies;      // Same order as the bodies given to init
+};
+
+enum SimCommandType
+{
+    SIM_SET_SPEED                       // value: the new speedFactor
+};
+
+struct SimCommand
+{
+    SimCommandType type;
+    float value;
+};
+
+class Simulation
+{
+public:
+    ~Simulation();
+
+    // Copies the bodies' orbit, spin and parent components
+    void init(const BodyStore& bodies, float speedFactor);
+    // Ticks on a thread of its own until stop()
+    void start();
+    void stop();
+    // One tick of dt seconds: applies the queued commands, moves the bodies and publishes
+    void step(double dt);
+
+    // ----- Render thread -----
+    // Queues a command for the next tick; false if the queue is full
+    bool send(const SimCommand& command);
+    // Takes the newest snapshot, then writes the state to draw now into the bodies' worldPosition
+    // and angles: one tick behind the clock, between the last two snapshots, when threaded; the
+    // newest as is otherwise
+    void apply(BodyStore& bodies, double& simTime);
+
+    double clock() const;
+
+private:
+    void threadLoop();
+
+    // Simulation side
+    std::vector<OrbitComponent> orbits;
+    std::vector<SpinComponent> spins;
+    std::vector<int> parents;
+    std::vector<glm::dvec3> worldPositions;
+    float speedFactor = 1.0f;
+    double simTime = 0.0;
+    uint64_t tick = 0;
+
+    TripleBuffer<SimSnapshot> snapshots;
+    SpscQueue<SimCommand, 64> commands;
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    // Render side
+    SimSnapshot previous;
+    SimSnapshot current;
+};
+
+#endif // SIMULATION_H
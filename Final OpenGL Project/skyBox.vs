@@ -5,10 +5,11 @@ out vec3 TexCoords;
 
 uniform mat4 projection;
 uniform mat4 view;
+uniform float farDepth; // 1, or 0 with reversed depth
 
 void main()
 {
     TexCoords = aPos;
     vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
+    gl_Position = vec4(pos.xy, pos.w * farDepth, pos.w);
 }  
\ No newline at end of file
@@ -0,0 +1,857 @@
+#include "system_description.h"
+#include "asset_pack.h"
+#include "counter_rng.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/constants.hpp>
+
+// Catalog rows have no orientation; it is drawn from the row's index under this key
+static const uint32_t MINOR_PLANET_SEED = 0x6D706C74u;
+static const int MINOR_PLANET_COLUMNS = 7;
+
+int SystemDescription::find(const std::string& name) const
+{
+    for (size_t i = 0; i < bodies.size(); i++)
+        if (bodies[i].name == name)
+            return (int)i;
+    return -1;
+}
+
+void SystemDescription::clear()
+{
+    bodies.clear();
+    hasBelt = false;
+    belt = {};
+    beltTexture.clear();
+    minorPlanets = nullptr;
+    minorPlanetCount = 0;
+    minorPlanetStorage.clear();
+    file.close();
+}
+
+std::string compiledSystemPath(const std::string& jsonPath)
+{
+    return jsonPath + ".sysb";
+}
+
+int addBody(BodyStore& bodies, const BodyDescription& body, const RenderableComponent& maps)
+{
+    const BodyElements& e = body.elements;
+    int index = bodies.add(body.name, body.parent);
+    OrbitComponent& orbit = bodies.orbits[index];
+    orbit.semiMajorAxis = e.semiMajorAxis;
+    orbit.eccentricity = e.eccentricity;
+    orbit.inclination = e.inclination;
+    orbit.speed = e.orbitalSpeed;
+    SpinComponent& spin = bodies.spins[index];
+    spin.speed = e.spinSpeed;
+    spin.tilt = e.tilt;
+    bodies.transforms[index].scale = e.scale;
+    MaterialComponent& material = bodies.materials[index];
+    material.ambientStrength = e.ambientStrength;
+    material.specularStrength = e.specularStrength;
+    material.shininess = e.shininess;
+    material.rimColor = e.rimColor;
+    material.rimIntensity = e.rimIntensity;
+    material.terminatorColor = e.terminatorColor;
+    material.terminatorBlendFactor = e.terminatorBlendFactor;
+    material.edgeColor = e.edgeColor;
+    material.edgeIntensity = e.edgeIntensity;
+    bodies.renderables[index] = maps;
+    return index;
+}
+
+// ----- JSON -----
+
+// Reads the description straight off the text, without building a tree, so a catalog row costs
+// no more than its numbers. Lists are walked with nextMember and nextItem:
+//
+//     bool first = true;
+//     while (json.nextMember(first, key)) { ... read or skip the value ... }
+class JsonReader
+{
+public:
+    JsonReader(const char* text, size_t size) : p(text), end(text + size) {}
+
+    bool failed() const { return !error.empty(); }
+    const std::string& what() const { return error; }
+    int errorLine() const { return failLine; }
+
+    bool fail(const std::string& message)
+    {
+        if (error.empty())
+        {
+            error = message;
+            failLine = line;
+        }
+        return false;
+    }
+
+    // Whitespace skipped; 0 at the end
+    char peek()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        {
+            if (*p == '\n')
+                line++;
+            p++;
+        }
+        return p < end ? *p : 0;
+    }
+
+    bool expect(char c)
+    {
+        if (failed())
+            return false;
+        if (peek() != c)
+            return fail(std::string("expected '") + c + "'");
+        p++;
+        return true;
+    }
+
+    bool atEnd() { return peek() == 0; }
+
+    // False after the closing '}' (or on an error); key is the next member's otherwise
+    bool nextMember(bool& first, std::string& key)
+    {
+        if (failed())
+            return false;
+        if (peek() == '}')
+        {
+            p++;
+            return false;
+        }
+        if (!first && !expect(','))
+            return false;
+        first = false;
+        return readString(key) && expect(':');
+    }
+
+    // False after the closing ']' (or on an error)
+    bool nextItem(bool& first)
+    {
+        if (failed())
+            return false;
+        if (peek() == ']')
+        {
+            p++;
+            return false;
+        }
+        if (!first && !expect(','))
+            return false;
+        first = false;
+        return true;
+    }
+
+    bool readString(std::string& out)
+    {
+        if (!expect('"'))
+            return false;
+        out.clear();
+        while (p < end && *p != '"')
+        {
+            char c = *p++;
+            if (c == '\n')
+                return fail("newline in a string");
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (p >= end)
+                break;
+            c = *p++;
+            switch (c)
+            {
+            case '"': case '\\': case '/': out += c; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                if (end - p < 4)
+                    return fail("short \\u escape");
+                unsigned code = (unsigned)strtoul(std::string(p, 4).c_str(), nullptr, 16);
+                p += 4;
+                // Paths and names: the basic plane is plenty
+                if (code < 0x80)
+                    out += (char)code;
+                else if (code < 0x800)
+                {
+                    out += (char)(0xC0 | (code >> 6));
+                    out += (char)(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    out += (char)(0xE0 | (code >> 12));
+                    out += (char)(0x80 | ((code >> 6) & 0x3F));
+                    out += (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return fail(std::string("bad escape \\") + c);
+            }
+        }
+        if (p >= end)
+            return fail("unterminated string");
+        p++;
+        return true;
+    }
+
+    bool readNumber(double& out)
+    {
+        if (failed())
+            return false;
+        peek();
+        // strtod wants a terminator the text may not have past its last number
+        char digits[64];
+        size_t length = 0;
+        while (p + length < end && length < sizeof(digits) - 1 && strchr("+-0123456789.eE", p[length]) && p[length])
+        {
+            digits[length] = p[length];
+            length++;
+        }
+        digits[length] = '\0';
+        char* stop = nullptr;
+        out = strtod(digits, &stop);
+        if (length == 0 || stop != digits + length)
+            return fail("expected a number");
+        p += length;
+        return true;
+    }
+
+    bool readFloat(float& out)
+    {
+        double value;
+        if (!readNumber(value))
+            return false;
+        out = (float)value;
+        return true;
+    }
+
+    bool readBool(bool& out)
+    {
+        if (failed())
+            return false;
+        peek();
+        if (end - p >= 4 && memcmp(p, "true", 4) == 0)
+        {
+            out = true;
+            p += 4;
+            return true;
+        }
+        if (end - p >= 5 && memcmp(p, "false", 5) == 0)
+        {
+            out = false;
+            p += 5;
+            return true;
+        }
+        return fail("expected true or false");
+    }
+
+    bool readVec3(glm::vec3& out)
+    {
+        return expect('[') && readFloat(out.x) && expect(',') && readFloat(out.y) && expect(',') &&
+            readFloat(out.z) && expect(']');
+    }
+
+    // Any value, for keys this version doesn't know
+    bool skipValue()
+    {
+        char c = peek();
+        std::string key;
+        bool first = true;
+        if (c == '{')
+        {
+            p++;
+            while (nextMember(first, key))
+                skipValue();
+        }
+        else if (c == '[')
+        {
+            p++;
+            while (nextItem(first))
+                skipValue();
+        }
+        else if (c == '"')
+            readString(key);
+        else if (c == 't' || c == 'f')
+        {
+            bool value;
+            readBool(value);
+        }
+        else if (c == 'n' && end - p >= 4 && memcmp(p, "null", 4) == 0)
+            p += 4;
+        else
+        {
+            double value;
+            readNumber(value);
+        }
+        return !failed();
+    }
+
+private:
+    const char* p;
+    const char* end;
+    int line = 1;
+    int failLine = 0;
+    std::string error;
+};
+
+static void unknownKey(const std::string& where, const std::string& key)
+{
+    std::cerr << "Ignoring unknown key \"" << key << "\" in " << where << std::endl;
+}
+
+static bool readRing(JsonReader& json, BodyDescription& body)
+{
+    std::string key;
+    bool first = true;
+    if (!json.expect('{'))
+        return false;
+    while (json.nextMember(first, key))
+    {
+        if (key == "texture")
+            json.readString(body.ringTexture);
+        else if (key == "innerRadius")
+            json.readFloat(body.ring.innerRadius);
+        else if (key == "outerRadius")
+            json.readFloat(body.ring.outerRadius);
+        else if (key == "flipped")
+        {
+            bool flipped = false;
+            json.readBool(flipped);
+            body.ring.flipped = flipped;
+        }
+        else
+        {
+            unknownKey(body.name + "'s ring", key);
+            json.skipValue();
+        }
+    }
+    if (!json.failed() && body.ringTexture.empty())
+        return json.fail(body.name + "'s ring has no texture");
+    return !json.failed();
+}
+
+static bool readCloudLayer(JsonReader& json, const std::string& bodyName, CloudLayerDescription& layer)
+{
+    std::string key;
+    bool first = true;
+    CloudElements& e = layer.elements;
+    if (!json.expect('{'))
+        return false;
+    while (json.nextMember(first, key))
+    {
+        if (key == "texture")
+            json.readString(layer.texture);
+        else if (key == "color")
+            json.readVec3(e.color);
+        else if (key == "scale")
+            json.readFloat(e.scale);
+        else if (key == "alpha")
+            json.readFloat(e.alpha);
+        else if (key == "rimColor")
+            json.readVec3(e.rimColor);
+        else if (key == "rimIntensity")
+            json.readFloat(e.rimIntensity);
+        else if (key == "terminatorColor")
+            json.readVec3(e.terminatorColor);
+        else if (key == "terminatorBlendFactor")
+            json.readFloat(e.terminatorBlendFactor);
+        else if (key == "ambientStrength")
+            json.readFloat(e.ambientStrength);
+        else if (key == "timeOffset")
+            json.readNumber(e.timeOffset);
+        else
+        {
+            unknownKey(bodyName + "'s clouds", key);
+            json.skipValue();
+        }
+    }
+    if (!json.failed() && layer.texture.empty())
+        return json.fail(bodyName + " has a cloud layer without a texture");
+    return !json.failed();
+}
+
+static bool readBody(JsonReader& json, SystemDescription& system, BodyDescription& body)
+{
+    std::string key, parent;
+    bool first = true;
+    bool hasSpinPeriod = false;
+    float spinPeriod = 0.0f;
+    BodyElements& e = body.elements;
+    if (!json.expect('{'))
+        return false;
+    while (json.nextMember(first, key))
+    {
+        if (key == "name")
+            json.readString(body.name);
+        else if (key == "parent")
+            json.readString(parent);
+        else if (key == "semiMajorAxis")
+            json.readFloat(e.semiMajorAxis);
+        else if (key == "orbitalSpeed")
+            json.readFloat(e.orbitalSpeed);
+        else if (key == "spinSpeed")
+            json.readFloat(e.spinSpeed);
+        else if (key == "spinPeriod")
+            hasSpinPeriod = json.readFloat(spinPeriod);
+        else if (key == "tilt")
+            json.readFloat(e.tilt);
+        else if (key == "eccentricity")
+            json.readFloat(e.eccentricity);
+        else if (key == "inclination")
+            json.readFloat(e.inclination);
+        else if (key == "scale")
+            json.readFloat(e.scale);
+        else if (key == "ambientStrength")
+            json.readFloat(e.ambientStrength);
+        else if (key == "specularStrength")
+            json.readFloat(e.specularStrength);
+        else if (key == "shininess")
+            json.readFloat(e.shininess);
+        else if (key == "rimColor")
+            json.readVec3(e.rimColor);
+        else if (key == "rimIntensity")
+            json.readFloat(e.rimIntensity);
+        else if (key == "terminatorColor")
+            json.readVec3(e.terminatorColor);
+        else if (key == "terminatorBlendFactor")
+            json.readFloat(e.terminatorBlendFactor);
+        else if (key == "edgeColor")
+            json.readVec3(e.edgeColor);
+        else if (key == "edgeIntensity")
+            json.readFloat(e.edgeIntensity);
+        else if (key == "texture")
+            json.readString(body.texture);
+        else if (key == "specularMap")
+            json.readString(body.specularMap);
+        else if (key == "nightMap")
+            json.readString(body.nightMap);
+        else if (key == "showOrbit")
+            json.readBool(body.showOrbit);
+        else if (key == "ring")
+            readRing(json, body);
+        else if (key == "clouds")
+        {
+            bool firstLayer = true;
+            json.expect('[');
+            while (json.nextItem(firstLayer))
+            {
+                body.clouds.emplace_back();
+                readCloudLayer(json, body.name, body.clouds.back());
+            }
+        }
+        else
+        {
+            unknownKey(body.name.empty() ? "a body" : body.name, key);
+            json.skipValue();
+        }
+    }
+    if (json.failed())
+        return false;
+
+    if (body.name.empty())
+        return json.fail("a body has no name");
+    if (system.find(body.name) >= 0)
+        return json.fail("two bodies are called " + body.name);
+    if (body.texture.empty())
+        return json.fail(body.name + " has no texture");
+    if (hasSpinPeriod)
+    {
+        if (spinPeriod == 0.0f)
+            return json.fail(body.name + " has a spinPeriod of 0");
+        e.spinSpeed = 360.0f / spinPeriod;
+    }
+    if (!parent.empty())
+    {
+        // Parents first, so one pass in list order moves every body after what it circles
+        body.parent = system.find(parent);
+        if (body.parent < 0)
+            return json.fail(body.name + "'s parent " + parent + " must come before it");
+    }
+    return true;
+}
+
+static bool readBelt(JsonReader& json, SystemDescription& system)
+{
+    std::string key;
+    bool first = true;
+    AsteroidBeltShape& belt = system.belt;
+    if (!json.expect('{'))
+        return false;
+    system.hasBelt = true;
+    while (json.nextMember(first, key))
+    {
+        if (key == "radius")
+            json.readFloat(belt.beltRadius);
+        else if (key == "width")
+            json.readFloat(belt.beltWidth);
+        else if (key == "outlierProbability")
+            json.readFloat(belt.outlierProbability);
+        else if (key == "closerMultiplier")
+            json.readFloat(belt.closerMultiplier);
+        else if (key == "furtherMultiplier")
+            json.readFloat(belt.furtherMultiplier);
+        else if (key == "yOutlierMultiplier")
+            json.readFloat(belt.yOutlierMultiplier);
+        else if (key == "yInlierMultiplier")
+            json.readFloat(belt.yInlierMultiplier);
+        else if (key == "texture")
+            json.readString(system.beltTexture);
+        else
+        {
+            unknownKey("the belt", key);
+            json.skipValue();
+        }
+    }
+    if (!json.failed() && (belt.beltRadius <= 0.0f || system.beltTexture.empty()))
+        return json.fail("the belt needs a radius and a texture");
+    return !json.failed();
+}
+
+// One catalog row as a belt instance; the mean motion is filled in once the belt is known
+static AsteroidInstance minorPlanet(const double row[MINOR_PLANET_COLUMNS], size_t index)
+{
+    CounterRandom random(MINOR_PLANET_SEED, (uint32_t)index, 0);
+    float halfX = random.next() * glm::pi<float>();
+    float halfY = random.next() * glm::pi<float>();
+    float halfZ = random.next() * glm::pi<float>();
+    float spin = (random.next() * 2.0f - 1.0f) * ASTEROID_MAX_SPIN;
+    glm::vec4 rotation = asteroidRotation(halfX, halfY, halfZ);
+    if (rotation.w < 0.0f)
+        rotation = -rotation;
+
+    AsteroidInstance instance;
+    instance.orbit = glm::vec4((float)row[0], (float)row[1], glm::radians((float)row[2]), glm::radians((float)row[3]));
+    instance.phase = glm::vec4(glm::radians((float)row[4]), glm::radians((float)row[5]), 0.0f, (float)row[6]);
+    instance.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, spin);
+    return instance;
+}
+
+static bool readMinorPlanets(JsonReader& json, SystemDescription& system)
+{
+    bool first = true;
+    if (!json.expect('['))
+        return false;
+    while (json.nextItem(first))
+    {
+        double row[MINOR_PLANET_COLUMNS];
+        bool firstColumn = true;
+        int columns = 0;
+        json.expect('[');
+        while (json.nextItem(firstColumn))
+        {
+            if (columns == MINOR_PLANET_COLUMNS)
+                return json.fail("a minor planet row has more than 7 columns");
+            json.readNumber(row[columns++]);
+        }
+        if (json.failed())
+            return false;
+        if (columns != MINOR_PLANET_COLUMNS || row[0] <= 0.0)
+            return json.fail("a minor planet row needs [a > 0, e, i, node, periapsis, meanAnomaly, size]");
+        system.minorPlanetStorage.push_back(minorPlanet(row, system.minorPlanetStorage.size()));
+    }
+    return !json.failed();
+}
+
+bool loadSystemJson(const std::string& path, SystemDescription& system)
+{
+    AssetSpan span;
+    std::vector<unsigned char> storage;
+    if (!loadAsset(path, span, storage))
+    {
+        std::cerr << "Failed to open system description: " << path << std::endl;
+        return false;
+    }
+
+    system.clear();
+    JsonReader json(reinterpret_cast<const char*>(span.data), span.size);
+    std::string key;
+    bool first = true;
+    json.expect('{');
+    while (json.nextMember(first, key))
+    {
+        if (key == "bodies")
+        {
+            bool firstBody = true;
+            json.expect('[');
+            while (json.nextItem(firstBody))
+            {
+                BodyDescription body;
+                if (readBody(json, system, body))
+                    system.bodies.push_back(std::move(body));
+            }
+        }
+        else if (key == "belt")
+            readBelt(json, system);
+        else if (key == "minorPlanets")
+            readMinorPlanets(json, system);
+        else
+        {
+            unknownKey(path, key);
+            json.skipValue();
+        }
+    }
+    if (!json.failed() && !json.atEnd())
+        json.fail("text after the description");
+    if (!json.failed() && system.bodies.empty())
+        json.fail("no bodies");
+    if (!json.failed() && !system.minorPlanetStorage.empty() && !system.hasBelt)
+        json.fail("minor planets take their mean motion from the belt, and there is no belt");
+    if (json.failed())
+    {
+        std::cerr << path << ":" << json.errorLine() << ": " << json.what() << std::endl;
+        return false;
+    }
+
+    for (AsteroidInstance& instance : system.minorPlanetStorage)
+        instance.phase.z = asteroidMeanMotion(instance.orbit.x, system.belt.beltRadius);
+    system.minorPlanets = system.minorPlanetStorage.data();
+    system.minorPlanetCount = system.minorPlanetStorage.size();
+    return true;
+}
+
+// ----- Compiled form -----
+
+static SystemString addString(std::string& blob, const std::string& value)
+{
+    SystemString ref = { (uint32_t)blob.size(), (uint32_t)value.size() };
+    blob += value;
+    return ref;
+}
+
+static uint64_t alignUp(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+bool writeSystemBinary(const SystemDescription& system, const std::string& path)
+{
+    std::string strings;
+    std::vector<SystemBodyRecord> bodies(system.bodies.size());
+    std::vector<SystemCloudRecord> clouds;
+    for (size_t i = 0; i < system.bodies.size(); i++)
+    {
+        const BodyDescription& body = system.bodies[i];
+        SystemBodyRecord& record = bodies[i];
+        record.elements = body.elements;
+        record.parent = body.parent;
+        record.showOrbit = body.showOrbit;
+        record.name = addString(strings, body.name);
+        record.texture = addString(strings, body.texture);
+        record.specularMap = addString(strings, body.specularMap);
+        record.nightMap = addString(strings, body.nightMap);
+        record.ringTexture = addString(strings, body.ringTexture);
+        record.ring = body.ring;
+        record.firstCloud = (uint32_t)clouds.size();
+        record.cloudCount = (uint32_t)body.clouds.size();
+        for (const CloudLayerDescription& layer : body.clouds)
+        {
+            SystemCloudRecord cloud = {};
+            cloud.elements = layer.elements;
+            cloud.texture = addString(strings, layer.texture);
+            clouds.push_back(cloud);
+        }
+    }
+
+    SystemFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "SYSB", 4);
+    header.version = SYSB_VERSION;
+    header.bodyCount = (uint32_t)bodies.size();
+    header.cloudCount = (uint32_t)clouds.size();
+    header.minorPlanetCount = system.minorPlanetCount;
+    header.belt = system.belt;
+    header.hasBelt = system.hasBelt;
+    header.beltTexture = addString(strings, system.beltTexture);
+    header.bodiesOffset = alignUp(sizeof(header), 16);
+    header.cloudsOffset = alignUp(header.bodiesOffset + bodies.size() * sizeof(SystemBodyRecord), 16);
+    header.minorPlanetsOffset = alignUp(header.cloudsOffset + clouds.size() * sizeof(SystemCloudRecord), 16);
+    header.stringsOffset = header.minorPlanetsOffset + system.minorPlanetCount * sizeof(AsteroidInstance);
+    header.stringsSize = strings.size();
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    auto writeAt = [&](uint64_t offset, const void* data, size_t size)
+    {
+        uint64_t at = (uint64_t)out.tellp();
+        out.write(std::string((size_t)(offset - at), '\0').data(), offset - at);
+        out.write(static_cast<const char*>(data), size);
+    };
+    writeAt(0, &header, sizeof(header));
+    writeAt(header.bodiesOffset, bodies.data(), bodies.size() * sizeof(SystemBodyRecord));
+    writeAt(header.cloudsOffset, clouds.data(), clouds.size() * sizeof(SystemCloudRecord));
+    writeAt(header.minorPlanetsOffset, system.minorPlanets, system.minorPlanetCount * sizeof(AsteroidInstance));
+    writeAt(header.stringsOffset, strings.data(), strings.size());
+    if (!out)
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool validString(const SystemFileHeader& header, SystemString ref)
+{
+    return (uint64_t)ref.offset + ref.length <= header.stringsSize;
+}
+
+// Checks everything the rest relies on once, then copies out the bodies and points at the catalog
+static bool decodeSystem(const unsigned char* data, size_t size, SystemDescription& system)
+{
+    if (size < sizeof(SystemFileHeader))
+        return false;
+    const SystemFileHeader& header = *reinterpret_cast<const SystemFileHeader*>(data);
+    bool valid = memcmp(header.magic, "SYSB", 4) == 0 && header.version == SYSB_VERSION &&
+        header.bodiesOffset % alignof(SystemBodyRecord) == 0 &&
+        header.bodiesOffset + (uint64_t)header.bodyCount * sizeof(SystemBodyRecord) <= size &&
+        header.cloudsOffset % alignof(SystemCloudRecord) == 0 &&
+        header.cloudsOffset + (uint64_t)header.cloudCount * sizeof(SystemCloudRecord) <= size &&
+        header.minorPlanetsOffset % 16 == 0 &&
+        header.minorPlanetCount <= (size - header.minorPlanetsOffset) / sizeof(AsteroidInstance) &&
+        header.minorPlanetsOffset <= size &&
+        header.stringsOffset + header.stringsSize <= size &&
+        header.bodyCount > 0 && validString(header, header.beltTexture);
+    if (!valid)
+        return false;
+
+    const SystemBodyRecord* bodies = reinterpret_cast<const SystemBodyRecord*>(data + header.bodiesOffset);
+    const SystemCloudRecord* clouds = reinterpret_cast<const SystemCloudRecord*>(data + header.cloudsOffset);
+    const char* strings = reinterpret_cast<const char*>(data + header.stringsOffset);
+    auto text = [&](SystemString ref) { return std::string(strings + ref.offset, ref.length); };
+
+    system.bodies.resize(header.bodyCount);
+    for (uint32_t i = 0; i < header.bodyCount; i++)
+    {
+        const SystemBodyRecord& record = bodies[i];
+        if (record.parent >= (int32_t)i || record.parent < -1 ||
+            (uint64_t)record.firstCloud + record.cloudCount > header.cloudCount ||
+            !validString(header, record.name) || !validString(header, record.texture) ||
+            !validString(header, record.specularMap) || !validString(header, record.nightMap) ||
+            !validString(header, record.ringTexture))
+            return false;
+        BodyDescription& body = system.bodies[i];
+        body.name = text(record.name);
+        body.parent = record.parent;
+        body.showOrbit = record.showOrbit != 0;
+        body.elements = record.elements;
+        body.texture = text(record.texture);
+        body.specularMap = text(record.specularMap);
+        body.nightMap = text(record.nightMap);
+        body.ringTexture = text(record.ringTexture);
+        body.ring = record.ring;
+        body.clouds.resize(record.cloudCount);
+        for (uint32_t layer = 0; layer < record.cloudCount; layer++)
+        {
+            const SystemCloudRecord& cloud = clouds[record.firstCloud + layer];
+            if (!validString(header, cloud.texture))
+                return false;
+            body.clouds[layer].texture = text(cloud.texture);
+            body.clouds[layer].elements = cloud.elements;
+        }
+    }
+    system.hasBelt = header.hasBelt != 0;
+    system.belt = header.belt;
+    system.beltTexture = text(header.beltTexture);
+    system.minorPlanets = reinterpret_cast<const AsteroidInstance*>(data + header.minorPlanetsOffset);
+    system.minorPlanetCount = (size_t)header.minorPlanetCount;
+    return true;
+}
+
+bool loadSystemBinary(const std::string& path, SystemDescription& system)
+{
+    system.clear();
+    // In place from the pack's mapping, or from a mapping of its own
+    AssetSpan span;
+    if (!assetPack.find(path, span))
+    {
+        if (!system.file.open(path, true))
+        {
+            std::cerr << "Failed to open compiled system: " << path << std::endl;
+            return false;
+        }
+        span.data = system.file.data();
+        span.size = system.file.size();
+    }
+    if (!decodeSystem(span.data, span.size, system))
+    {
+        std::cerr << "Not a valid compiled system: " << path << std::endl;
+        system.clear();
+        return false;
+    }
+    return true;
+}
+
+bool loadSystem(const std::string& jsonPath, SystemDescription& system)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string compiled = compiledSystemPath(jsonPath);
+    AssetSpan span;
+    bool useCompiled = assetPack.find(compiled, span);
+    if (!useCompiled)
+    {
+        // A loose compiled file only while it is up to date with the JSON it came from
+        std::error_code jsonMissing, compiledMissing;
+        auto jsonTime = std::filesystem::last_write_time(jsonPath, jsonMissing);
+        auto compiledTime = std::filesystem::last_write_time(compiled, compiledMissing);
+        useCompiled = !compiledMissing && (jsonMissing || compiledTime >= jsonTime);
+        if (!compiledMissing && !useCompiled)
+            std::cout << compiled << " is older than " << jsonPath << "; reading the JSON" << std::endl;
+    }
+    bool loaded = useCompiled ? loadSystemBinary(compiled, system) : loadSystemJson(jsonPath, system);
+    if (!loaded)
+        return false;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Loaded " << (useCompiled ? compiled : jsonPath) << ": " << system.bodies.size() << " bodies, "
+        << system.minorPlanetCount << " minor planets in " << ms << " ms" << std::endl;
+    return true;
+}
+
+// ----- Options -----
+
+bool parseSystemArgs(int argc, char** argv, SystemOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--system") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "--system needs a file name" << std::endl;
+                return false;
+            }
+            options.path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--compile-system") == 0)
+        {
+            options.compile = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+                options.path = argv[++i];
+        }
+    }
+    return true;
+}
+
+int compileSystem(const SystemOptions& options)
+{
+    SystemDescription system;
+    if (!loadSystemJson(options.path, system))
+        return -1;
+    std::string output = compiledSystemPath(options.path);
+    if (!writeSystemBinary(system, output))
+        return -1;
+    std::cout << "Compiled " << options.path << ": " << system.bodies.size() << " bodies, " << system.minorPlanetCount
+        << " minor planets into " << output << std::endl;
+    return 0;
+}
@@ -0,0 +1,180 @@
+#pragma once
+#ifndef SYSTEM_DESCRIPTION_H
+#define SYSTEM_DESCRIPTION_H
+
+#include "celestial.h"
+#include "mapped_file.h"
+#include <cstdint>
+
+// A planetary system as data: bodies with their hierarchy, orbital elements, materials, maps, rings
+// and cloud layers, the asteroid belt, and a catalog of minor planets. Authored as JSON
+// (../systems/sol.json is the default scene); --compile-system turns that into a ".sysb" next to it,
+// which the loader maps and reads in place. The minor planets are stored there as the belt's
+// instances, ready to upload, so a catalog of any size loads in the time it takes to map the file.
+//
+//     { "bodies": [ { "name": "earth", "parent": "sun", "semiMajorAxis": 24, ... }, ... ],
+//       "belt": { "radius": 38.5, ... },
+//       "minorPlanets": [ [a, e, i, node, periapsis, meanAnomaly, size], ... ] }
+//
+// Angles in the file are degrees, speeds degrees per sim second; "spinPeriod" (sim seconds per
+// turn, negative for retrograde) may stand in for "spinSpeed". Minor planet rows are in scene units
+// and take the belt's mean motion for their semi-major axis.
+const uint32_t SYSB_VERSION = 1;
+
+// A body's numbers, as the compiled file stores them; addBody splits them into components
+struct BodyElements
+{
+    float semiMajorAxis = 0.0f;
+    float orbitalSpeed = 0.0f;
+    float spinSpeed = 0.0f;
+    float tilt = 0.0f;
+    float eccentricity = 0.0f;
+    float inclination = 0.0f;
+    float scale = 1.0f;
+    float ambientStrength = 0.0f;
+    float specularStrength = 0.0f;
+    float shininess = 0.0f;
+    glm::vec3 rimColor = glm::vec3(0.2f);
+    float rimIntensity = 0.3f;
+    glm::vec3 terminatorColor = glm::vec3(0.005f);
+    float terminatorBlendFactor = 0.7f;
+    glm::vec3 edgeColor = glm::vec3(0.0f);
+    float edgeIntensity = 0.0f;
+};
+
+// Radii in units of the body's scale, like createRingVAO takes them
+struct RingElements
+{
+    float innerRadius = 0.0f;
+    float outerRadius = 0.0f;
+    uint32_t flipped = 0;
+};
+
+// What renderCloudLayer takes besides the body
+struct CloudElements
+{
+    glm::vec3 color = glm::vec3(1.0f);
+    float scale = 1.01f;                // Of the body's radius
+    float alpha = 1.0f;
+    glm::vec3 rimColor = glm::vec3(0.85f, 0.86f, 0.99f);
+    float rimIntensity = 1.2f;
+    glm::vec3 terminatorColor = glm::vec3(0.0010f, 0.0072f, 0.016f);
+    float terminatorBlendFactor = 5.0f;
+    float ambientStrength = 0.001f;
+    double timeOffset = 0.0;            // Added to the frame's time, so layers drift apart
+};
+
+struct CloudLayerDescription
+{
+    std::string texture;
+    CloudElements elements;
+};
+
+struct BodyDescription
+{
+    std::string name;
+    int parent = -1;                    // Index into bodies, always before this one; -1 for a root
+    bool showOrbit = true;
+    BodyElements elements;
+    std::string texture;
+    std::string specularMap;            // Empty when the body has none
+    std::string nightMap;
+    std::string ringTexture;            // Empty when it has no ring
+    RingElements ring;
+    std::vector<CloudLayerDescription> clouds;
+};
+
+struct SystemDescription
+{
+    std::vector<BodyDescription> bodies;
+    bool hasBelt = false;
+    AsteroidBeltShape belt = {};
+    std::string beltTexture;
+    // Inside the mapped file when it was compiled, in minorPlanetStorage when it was parsed
+    const AsteroidInstance* minorPlanets = nullptr;
+    size_t minorPlanetCount = 0;
+    std::vector<AsteroidInstance> minorPlanetStorage;
+    MappedFile file;
+
+    // Index of the body called name, or -1
+    int find(const std::string& name) const;
+    // Back to empty, unmapping the file
+    void clear();
+};
+
+// ----- Compiled form -----
+
+// Everything is little-endian and laid out as in memory; strings are runs of one blob, without
+// terminators
+struct SystemString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SystemFileHeader
+{
+    char magic[4];                  // "SYSB"
+    uint32_t version;
+    uint32_t bodyCount;
+    uint32_t cloudCount;
+    uint64_t minorPlanetCount;
+    uint64_t bodiesOffset;          // SystemBodyRecord[bodyCount]
+    uint64_t cloudsOffset;          // SystemCloudRecord[cloudCount], each body's layers in one run
+    uint64_t minorPlanetsOffset;    // AsteroidInstance[minorPlanetCount], 16-byte aligned
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    AsteroidBeltShape belt;
+    uint32_t hasBelt;
+    SystemString beltTexture;
+};
+
+struct SystemBodyRecord
+{
+    BodyElements elements;
+    int32_t parent;
+    uint32_t showOrbit;
+    SystemString name;
+    SystemString texture;
+    SystemString specularMap;
+    SystemString nightMap;
+    SystemString ringTexture;
+    RingElements ring;
+    uint32_t firstCloud;
+    uint32_t cloudCount;
+};
+
+struct SystemCloudRecord
+{
+    CloudElements elements;
+    SystemString texture;
+};
+
+// The compiled form of a JSON description: path + ".sysb"
+std::string compiledSystemPath(const std::string& jsonPath);
+
+// The compiled form when there is one (in the asset pack, or a loose file no older than the JSON),
+// the JSON otherwise. Reports what is wrong and returns false when neither loads.
+bool loadSystem(const std::string& jsonPath, SystemDescription& system);
+bool loadSystemJson(const std::string& path, SystemDescription& system);
+bool loadSystemBinary(const std::string& path, SystemDescription& system);
+bool writeSystemBinary(const SystemDescription& system, const std::string& path);
+
+// Adds the body to the store with the maps to draw it with. Bodies are added in the description's
+// order, so its parent indices are the store's too.
+int addBody(BodyStore& bodies, const BodyDescription& body, const RenderableComponent& maps);
+
+struct SystemOptions
+{
+    std::string path = "../systems/sol.json";
+    bool compile = false;
+};
+
+// Parses --system FILE and --compile-system [FILE]
+// Returns false on a malformed argument
+bool parseSystemArgs(int argc, char** argv, SystemOptions& options);
+
+// Build step: writes the compiled form next to the JSON. Returns the process exit code.
+int compileSystem(const SystemOptions& options);
+
+#endif // SYSTEM_DESCRIPTION_H
@@ -0,0 +1,66 @@
+#include "task_scheduler.h"
+#include "job_system.h"
+
+TaskScheduler taskScheduler;
+
+AsyncTask::promise_type::promise_type()
+{
+    taskScheduler.tasks++;
+}
+
+AsyncTask::promise_type::~promise_type()
+{
+    taskScheduler.tasks--;
+}
+
+bool TaskScheduler::WorkerAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    // Nobody else would ever pick the job up
+    if (jobSystem.threadCount() <= 1)
+        return false;
+    jobSystem.submit([handle] { handle.resume(); });
+    return true;
+}
+
+TaskScheduler::GlThreadAwaiter TaskScheduler::yieldIfOverBudget()
+{
+    return { *this, onGl() && pumping && std::chrono::steady_clock::now() < deadline };
+}
+
+void TaskScheduler::park(std::coroutine_handle<> handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    parked.push_back(handle);
+}
+
+void TaskScheduler::pump(double budgetMs)
+{
+    deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+    // Only what was parked before this frame; whatever parks while it runs waits for the next one
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(parked);
+    }
+    pumping = true;
+    size_t resumed = 0;
+    while (resumed < batch.size() && (resumed == 0 || std::chrono::steady_clock::now() < deadline))
+        batch[resumed++].resume();
+    pumping = false;
+    {
+        // Ahead of anything parked meanwhile, so the order they came in is kept
+        std::lock_guard<std::mutex> lock(mutex);
+        parked.insert(parked.begin(), batch.begin() + resumed, batch.end());
+    }
+    batch.clear();
+}
+
+void TaskScheduler::finish()
+{
+    while (tasks > 0)
+    {
+        pump(1e9);
+        if (tasks > 0)
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work that spans frames, written as straight-line code: a coroutine hops between the job system
+// and the GL thread with co_await, and checks the frame budget between slices of GL work. The GL
+// thread resumes what is parked on it in pump(), once a frame, until the budget is spent.
+//
+//     AsyncTask rebuild()
+//     {
+//         co_await taskScheduler.onWorker();      // CPU work off the GL thread
+//         ...
+//         co_await taskScheduler.onGlThread();    // back for the uploads
+//         for (each slice)
+//         {
+//             ...
+//             co_await taskScheduler.yieldIfOverBudget();
+//         }
+//     }
+
+// A coroutine started right away and left to run on its own; its frame is freed when it returns
+struct AsyncTask
+{
+    struct promise_type
+    {
+        promise_type();
+        ~promise_type();
+        AsyncTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+class TaskScheduler
+{
+public:
+    struct WorkerAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+
+    struct GlThreadAwaiter
+    {
+        TaskScheduler& scheduler;
+        bool ready;
+        bool await_ready() const noexcept { return ready; }
+        void await_suspend(std::coroutine_handle<> handle) { scheduler.park(handle); }
+        void await_resume() const noexcept {}
+    };
+
+    // Continues on a job system thread, or right here when there are no worker threads
+    WorkerAwaiter onWorker() { return {}; }
+    // Continues on the GL thread: straight away if already on it, otherwise in the next pump()
+    GlThreadAwaiter onGlThread() { return { *this, onGl() }; }
+    // Continues in the next frame's pump()
+    GlThreadAwaiter nextFrame() { return { *this, false }; }
+    // Inside pump() with budget left: carries on; otherwise waits for the next pump()
+    GlThreadAwaiter yieldIfOverBudget();
+
+    // GL thread, once a frame: resumes parked coroutines until budgetMs is used up, at least one
+    void pump(double budgetMs);
+    // GL thread: pumps without a budget until every task has returned (shutdown)
+    void finish();
+    // Tasks started and not yet returned
+    int running() const { return tasks; }
+
+private:
+    friend struct AsyncTask::promise_type;
+
+    bool onGl() const { return std::this_thread::get_id() == glThread; }
+    void park(std::coroutine_handle<> handle);
+
+    // The scheduler is a global built before main, on the thread that makes the GL context
+    std::thread::id glThread = std::this_thread::get_id();
+    std::mutex mutex;
+    std::vector<std::coroutine_handle<>> parked;   // Guarded by mutex
+    std::vector<std::coroutine_handle<>> batch;    // GL thread only; both keep their capacity
+    std::atomic<int> tasks{ 0 };
+    bool pumping = false;                           // GL thread only
+    std::chrono::steady_clock::time_point deadline; // GL thread only
+};
+
+extern TaskScheduler taskScheduler;
+
+#endif // TASK_SCHEDULER_H
@@ -0,0 +1,770 @@
+#include "texture_compiler.h"
+#include "compressed_texture.h"
+#include "virtual_texture.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+bool parseTextureCompilerArgs(int argc, char** argv, TextureCompilerOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--compile-textures") == 0)
+        {
+            options.enabled = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+                options.manifest = argv[++i];
+        }
+    }
+    return true;
+}
+
+// ----- Mip chain -----
+
+// Four floats per texel; colour in linear light unless the texture is a data mask
+struct FloatImage
+{
+    int width;
+    int height;
+    std::vector<float> texels;
+};
+
+// Same exponent the post-processing pass uses
+static const float TEXTURE_GAMMA = 2.2f;
+
+static FloatImage toFloatImage(const unsigned char* pixels, int width, int height, bool linearize)
+{
+    float table[256];
+    for (int i = 0; i < 256; i++)
+        table[i] = linearize ? powf(i / 255.0f, TEXTURE_GAMMA) : i / 255.0f;
+
+    FloatImage image = { width, height, std::vector<float>((size_t)width * height * 4) };
+    for (size_t i = 0; i < image.texels.size(); i++)
+        image.texels[i] = (i & 3) == 3 ? pixels[i] / 255.0f : table[pixels[i]];
+    return image;
+}
+
+static std::vector<unsigned char> toBytes(const FloatImage& image, bool linearized)
+{
+    std::vector<unsigned char> pixels(image.texels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        float value = std::min(1.0f, std::max(0.0f, image.texels[i]));
+        if (linearized && (i & 3) != 3)
+            value = powf(value, 1.0f / TEXTURE_GAMMA);
+        pixels[i] = (unsigned char)(value * 255.0f + 0.5f);
+    }
+    return pixels;
+}
+
+// 2x2 box filter. Colour is weighted by alpha so transparent texels don't bleed into ring edges.
+static FloatImage downsample(const FloatImage& source)
+{
+    FloatImage result = { std::max(1, source.width / 2), std::max(1, source.height / 2), {} };
+    result.texels.resize((size_t)result.width * result.height * 4);
+    for (int y = 0; y < result.height; y++)
+    {
+        for (int x = 0; x < result.width; x++)
+        {
+            int xs[2] = { std::min(2 * x, source.width - 1), std::min(2 * x + 1, source.width - 1) };
+            int ys[2] = { std::min(2 * y, source.height - 1), std::min(2 * y + 1, source.height - 1) };
+            float color[3] = { 0.0f, 0.0f, 0.0f };
+            float alpha = 0.0f;
+            for (int j = 0; j < 2; j++)
+            {
+                for (int i = 0; i < 2; i++)
+                {
+                    const float* texel = &source.texels[((size_t)ys[j] * source.width + xs[i]) * 4];
+                    float weight = texel[3] + 1e-4f;
+                    for (int c = 0; c < 3; c++)
+                        color[c] += texel[c] * weight;
+                    alpha += weight;
+                }
+            }
+            float* out = &result.texels[((size_t)y * result.width + x) * 4];
+            for (int c = 0; c < 3; c++)
+                out[c] = color[c] / alpha;
+            out[3] = std::max(0.0f, alpha * 0.25f - 1e-4f);
+        }
+    }
+    return result;
+}
+
+// ----- Block encoders -----
+
+// Dominant direction of the block's texels through power iteration on their covariance
+static void principalAxis(const float points[16][4], int dims, float mean[4], float axis[4])
+{
+    for (int c = 0; c < dims; c++)
+    {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; i++)
+            mean[c] += points[i][c];
+        mean[c] /= 16.0f;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < dims; a++)
+            for (int b = 0; b < dims; b++)
+                covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+
+    for (int c = 0; c < dims; c++)
+        axis[c] = 1.0f;
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < dims; a++)
+        {
+            for (int b = 0; b < dims; b++)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f)
+            break;   // Flat block: any axis will do
+        length = sqrtf(length);
+        for (int c = 0; c < dims; c++)
+            axis[c] = next[c] / length;
+    }
+}
+
+// Extremes of the block along its principal axis, pulled in slightly to reduce endpoint error
+static void fitEndpoints(const float points[16][4], int dims, float low[4], float high[4])
+{
+    float mean[4], axis[4];
+    principalAxis(points, dims, mean, axis);
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < dims; c++)
+            t += (points[i][c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float inset = (maxT - minT) / 16.0f;
+    minT += inset;
+    maxT -= inset;
+    for (int c = 0; c < dims; c++)
+    {
+        low[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minT));
+        high[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxT));
+    }
+}
+
+static uint16_t pack565(const float color[3])
+{
+    int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void unpack565(uint16_t c, float color[3])
+{
+    color[0] = ((c >> 11) & 31) * 255.0f / 31.0f;
+    color[1] = ((c >> 5) & 63) * 255.0f / 63.0f;
+    color[2] = (c & 31) * 255.0f / 31.0f;
+}
+
+// Picks the nearest palette entry per texel for endpoints c0 > c1 (four-colour mode)
+static float bc1Indices(const float points[16][4], uint16_t c0, uint16_t c1, int indices[16])
+{
+    float palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    float error = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float best = 1e30f;
+        for (int p = 0; p < 4; p++)
+        {
+            float d = 0.0f;
+            for (int c = 0; c < 3; c++)
+                d += (points[i][c] - palette[p][c]) * (points[i][c] - palette[p][c]);
+            if (d < best)
+            {
+                best = d;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+static float encodeBC1Endpoints(const float points[16][4], uint16_t& c0, uint16_t& c1, int indices[16])
+{
+    if (c0 < c1)
+        std::swap(c0, c1);
+    if (c0 == c1)
+    {
+        // Three-colour mode, but index 0 is still the endpoint itself
+        float error = bc1Indices(points, c0, c1, indices);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 0;
+        return error;
+    }
+    return bc1Indices(points, c0, c1, indices);
+}
+
+static void encodeBC1Block(const unsigned char texels[16][4], unsigned char* out)
+{
+    float points[16][4];
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            points[i][c] = texels[i][c];
+
+    float low[4], high[4];
+    fitEndpoints(points, 3, low, high);
+    uint16_t c0 = pack565(high), c1 = pack565(low);
+    int indices[16];
+    float error = encodeBC1Endpoints(points, c0, c1, indices);
+
+    // One least-squares pass: re-solve both endpoints for the chosen indices
+    static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ap[3] = {}, bp[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float a = weight0[indices[i]], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++)
+        {
+            ap[c] += a * points[i][c];
+            bp[c] += b * points[i][c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) > 1e-6f)
+    {
+        float refined0[3], refined1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            refined0[c] = (bb * ap[c] - ab * bp[c]) / determinant;
+            refined1[c] = (aa * bp[c] - ab * ap[c]) / determinant;
+        }
+        uint16_t r0 = pack565(refined0), r1 = pack565(refined1);
+        int refinedIndices[16];
+        if (encodeBC1Endpoints(points, r0, r1, refinedIndices) < error)
+        {
+            c0 = r0;
+            c1 = r1;
+            memcpy(indices, refinedIndices, sizeof(refinedIndices));
+        }
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (uint32_t)indices[i] << (2 * i);
+    out[0] = (unsigned char)(c0 & 0xFF);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// Eight-value mode (a0 > a1) with the block's minimum and maximum as endpoints
+static void encodeBC4Block(const unsigned char values[16], unsigned char* out)
+{
+    int high = *std::max_element(values, values + 16);
+    int low = *std::min_element(values, values + 16);
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+
+    int palette[8] = { high, low };
+    for (int k = 2; k < 8; k++)
+        palette[k] = ((8 - k) * high + (k - 1) * low) / 7;
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        for (int k = 1; k < 8 && high != low; k++)
+            if (abs(values[i] - palette[k]) < abs(values[i] - palette[best]))
+                best = k;
+        bits |= (uint64_t)best << (3 * i);
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// BC7 mode 6 only: one subset, RGBA endpoints at 7 bits plus a p-bit each, 4-bit indices.
+// It handles smooth alpha gradients well, which is all the ring textures have.
+static void encodeBC7Block(const unsigned char texels[16][4], unsigned char* out)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    float points[16][4];
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            points[i][c] = texels[i][c];
+
+    float fitted[2][4];
+    fitEndpoints(points, 4, fitted[0], fitted[1]);
+
+    // Quantize each endpoint with whichever p-bit lands closer
+    int quantized[2][4], pbit[2];
+    int endpoints[2][4];
+    for (int e = 0; e < 2; e++)
+    {
+        float bestError = 1e30f;
+        for (int p = 0; p < 2; p++)
+        {
+            int q[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                q[c] = std::min(127, std::max(0, (int)((fitted[e][c] - p) / 2.0f + 0.5f)));
+                float d = fitted[e][c] - (q[c] * 2 + p);
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbit[e] = p;
+                memcpy(quantized[e], q, sizeof(q));
+            }
+        }
+        for (int c = 0; c < 4; c++)
+            endpoints[e][c] = quantized[e][c] << 1 | pbit[e];
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        float best = 1e30f;
+        for (int w = 0; w < 16; w++)
+        {
+            float d = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                float value = (float)(((64 - weights[w]) * endpoints[0][c] + weights[w] * endpoints[1][c] + 32) >> 6);
+                d += (points[i][c] - value) * (points[i][c] - value);
+            }
+            if (d < best)
+            {
+                best = d;
+                indices[i] = w;
+            }
+        }
+    }
+
+    // The first texel's index is stored without its top bit, so it must be below 8
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(quantized[0][c], quantized[1][c]);
+        std::swap(pbit[0], pbit[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    int bit = 0;
+    auto write = [&](int value, int count) {
+        for (int i = 0; i < count; i++, bit++)
+            out[bit >> 3] |= (unsigned char)(((value >> i) & 1) << (bit & 7));
+    };
+    write(0x40, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        write(quantized[0][c], 7);
+        write(quantized[1][c], 7);
+    }
+    write(pbit[0], 1);
+    write(pbit[1], 1);
+    for (int i = 0; i < 16; i++)
+        write(indices[i], i == 0 ? 3 : 4);
+}
+
+// Encodes one RGBA8 level, clamping edge blocks onto the last row and column
+static void encodeLevel(const std::vector<unsigned char>& pixels, int width, int height, uint32_t format,
+                        std::vector<unsigned char>& data)
+{
+    unsigned int stride = blockBytes(format);
+    for (int by = 0; by < height; by += 4)
+    {
+        for (int bx = 0; bx < width; bx += 4)
+        {
+            unsigned char texels[16][4];
+            for (int i = 0; i < 16; i++)
+            {
+                int x = std::min(bx + (i & 3), width - 1);
+                int y = std::min(by + (i >> 2), height - 1);
+                memcpy(texels[i], &pixels[((size_t)y * width + x) * 4], 4);
+            }
+
+            size_t offset = data.size();
+            data.resize(offset + stride);
+            unsigned char* block = &data[offset];
+            if (format == CTEX_BC1)
+                encodeBC1Block(texels, block);
+            else if (format == CTEX_BC7)
+                encodeBC7Block(texels, block);
+            else
+            {
+                // Grey lives in red and alpha moves to green for BC5
+                unsigned char red[16], green[16];
+                for (int i = 0; i < 16; i++)
+                {
+                    red[i] = texels[i][0];
+                    green[i] = texels[i][3];
+                }
+                encodeBC4Block(red, block);
+                if (format == CTEX_BC5)
+                    encodeBC4Block(green, block + 8);
+            }
+        }
+    }
+}
+
+// Lets the content pick the channel count: many JPEGs are grey saved as RGB.
+// Grey images are collapsed to luminance in place.
+static void chooseFormat(unsigned char* pixels, size_t texelCount, TextureKind kind, uint32_t& format, uint32_t& channels)
+{
+    bool grey = true, alpha = false;
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        const unsigned char* p = pixels + i * 4;
+        if (abs(p[0] - p[1]) > 2 || abs(p[1] - p[2]) > 2)
+            grey = false;
+        if (p[3] < 255)
+            alpha = true;
+    }
+    if (kind == TEXTURE_SPECULAR)
+    {
+        grey = true;   // A mask: only the luminance matters
+        alpha = false;
+    }
+    if (grey)
+    {
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            unsigned char* p = pixels + i * 4;
+            p[0] = p[1] = p[2] = (unsigned char)((299 * p[0] + 587 * p[1] + 114 * p[2] + 500) / 1000);
+        }
+    }
+    channels = grey ? (alpha ? 2 : 1) : (alpha ? 4 : 3);
+    format = grey ? (alpha ? CTEX_BC5 : CTEX_BC4) : (alpha ? CTEX_BC7 : CTEX_BC1);
+}
+
+bool compileTexture(const std::string& sourcePath, TextureKind kind, const std::string& outputPath)
+{
+    // Rings are stored flipped, the same way loadRingTexture reads them
+    stbi_set_flip_vertically_on_load_thread(kind == TEXTURE_RING);
+    int width, height, fileChannels;
+    unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &fileChannels, 4);
+    if (!pixels)
+    {
+        std::cerr << "Failed to load texture: " << sourcePath << std::endl;
+        return false;
+    }
+
+    uint32_t format, channels;
+    size_t texelCount = (size_t)width * height;
+    chooseFormat(pixels, texelCount, kind, format, channels);
+
+    CompressedTexture texture;
+    CompressedTextureHeader& header = texture.header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "CTEX", 4);
+    header.version = CTEX_VERSION;
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.format = format;
+    if (kind != TEXTURE_CUBEMAP)
+    {
+        // The cubemap samples without mips
+        while (header.mipCount < CTEX_MAX_MIPS && (std::max(width, height) >> header.mipCount) > 0)
+            header.mipCount++;
+    }
+    header.mipCount = std::max(1u, header.mipCount);
+
+    bool linearize = kind != TEXTURE_SPECULAR;
+    FloatImage level = toFloatImage(pixels, width, height, linearize);
+    stbi_image_free(pixels);
+    for (uint32_t i = 0; i < header.mipCount; i++)
+    {
+        if (i > 0)
+            level = downsample(level);
+        header.mipOffset[i] = (uint32_t)texture.data.size();
+        encodeLevel(toBytes(level, linearize), level.width, level.height, header.format, texture.data);
+        header.mipSize[i] = (uint32_t)texture.data.size() - header.mipOffset[i];
+    }
+
+    if (!writeCompressedTexture(outputPath, texture))
+        return false;
+    // What the runtime path used to upload: the file's channels plus a third for generated mips
+    size_t uncompressedBytes = texelCount * (kind == TEXTURE_SPECULAR ? 4 : fileChannels);
+    if (header.mipCount > 1)
+        uncompressedBytes = uncompressedBytes * 4 / 3;
+    std::cout << "Compiled " << sourcePath << ": " << width << "x" << height << " BC" << header.format << ", "
+        << header.mipCount << " mips, " << texture.data.size() / 1024 << " KB (was " << uncompressedBytes / 1024 << " KB)" << std::endl;
+    return true;
+}
+
+// ----- Virtual texture pyramids -----
+
+// Source maps for virtual textures can be 32k wide, so these work on bytes instead of FloatImage
+
+struct GammaTables
+{
+    float toLinear[256];
+    unsigned char fromLinear[4096];
+
+    explicit GammaTables(bool linearize)
+    {
+        for (int i = 0; i < 256; i++)
+            toLinear[i] = linearize ? powf(i / 255.0f, TEXTURE_GAMMA) : i / 255.0f;
+        for (int i = 0; i < 4096; i++)
+        {
+            float value = i / 4095.0f;
+            fromLinear[i] = (unsigned char)((linearize ? powf(value, 1.0f / TEXTURE_GAMMA) : value) * 255.0f + 0.5f);
+        }
+    }
+
+    unsigned char encode(float value, bool isAlpha) const
+    {
+        value = std::min(1.0f, std::max(0.0f, value));
+        return isAlpha ? (unsigned char)(value * 255.0f + 0.5f) : fromLinear[(int)(value * 4095.0f + 0.5f)];
+    }
+};
+
+static int nearestPowerOfTwo(int value)
+{
+    int power = 1;
+    while (power * 2 <= value)
+        power *= 2;
+    return value - power > power * 2 - value ? power * 2 : power;
+}
+
+// Bilinear resample to the power-of-two size the tile grid needs
+static std::vector<unsigned char> resampleBytes(const unsigned char* pixels, int width, int height,
+                                                int newWidth, int newHeight, const GammaTables& gamma)
+{
+    std::vector<unsigned char> result((size_t)newWidth * newHeight * 4);
+    for (int y = 0; y < newHeight; y++)
+    {
+        float sy = std::max(0.0f, (y + 0.5f) * height / newHeight - 0.5f);
+        int y0 = std::min((int)sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+        float fy = sy - y0;
+        for (int x = 0; x < newWidth; x++)
+        {
+            float sx = (x + 0.5f) * width / newWidth - 0.5f;
+            int x0 = (int)floorf(sx);
+            float fx = sx - x0;
+            // Longitude wraps
+            int x1 = (x0 + 1) % width;
+            x0 = (x0 + width) % width;
+            const unsigned char* p00 = pixels + ((size_t)y0 * width + x0) * 4;
+            const unsigned char* p10 = pixels + ((size_t)y0 * width + x1) * 4;
+            const unsigned char* p01 = pixels + ((size_t)y1 * width + x0) * 4;
+            const unsigned char* p11 = pixels + ((size_t)y1 * width + x1) * 4;
+            unsigned char* out = &result[((size_t)y * newWidth + x) * 4];
+            for (int c = 0; c < 4; c++)
+            {
+                const float* table = gamma.toLinear;
+                float top = c == 3 ? p00[c] + (p10[c] - p00[c]) * fx : table[p00[c]] + (table[p10[c]] - table[p00[c]]) * fx;
+                float bottom = c == 3 ? p01[c] + (p11[c] - p01[c]) * fx : table[p01[c]] + (table[p11[c]] - table[p01[c]]) * fx;
+                float value = top + (bottom - top) * fy;
+                out[c] = c == 3 ? (unsigned char)(value + 0.5f) : gamma.encode(value, false);
+            }
+        }
+    }
+    return result;
+}
+
+// 2x2 box filter in linear light, the byte counterpart of downsample()
+static std::vector<unsigned char> halveBytes(const std::vector<unsigned char>& pixels, int width, int height,
+                                             const GammaTables& gamma)
+{
+    int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+    std::vector<unsigned char> result((size_t)newWidth * newHeight * 4);
+    for (int y = 0; y < newHeight; y++)
+    {
+        int ys[2] = { std::min(2 * y, height - 1), std::min(2 * y + 1, height - 1) };
+        for (int x = 0; x < newWidth; x++)
+        {
+            int xs[2] = { std::min(2 * x, width - 1), std::min(2 * x + 1, width - 1) };
+            float sum[4] = {};
+            for (int j = 0; j < 2; j++)
+            {
+                for (int i = 0; i < 2; i++)
+                {
+                    const unsigned char* p = &pixels[((size_t)ys[j] * width + xs[i]) * 4];
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += gamma.toLinear[p[c]];
+                    sum[3] += p[3] / 255.0f;
+                }
+            }
+            unsigned char* out = &result[((size_t)y * newWidth + x) * 4];
+            for (int c = 0; c < 4; c++)
+                out[c] = gamma.encode(sum[c] * 0.25f, c == 3);
+        }
+    }
+    return result;
+}
+
+bool compileVirtualTexture(const std::string& sourcePath, TextureKind kind, const std::string& outputPath)
+{
+    stbi_set_flip_vertically_on_load_thread(false);
+    int sourceWidth, sourceHeight, fileChannels;
+    unsigned char* source = stbi_load(sourcePath.c_str(), &sourceWidth, &sourceHeight, &fileChannels, 4);
+    if (!source)
+    {
+        std::cerr << "Failed to load texture: " << sourcePath << std::endl;
+        return false;
+    }
+
+    VirtualTextureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "VTEX", 4);
+    header.version = VT_VERSION;
+    chooseFormat(source, (size_t)sourceWidth * sourceHeight, kind, header.format, header.channels);
+    header.width = nearestPowerOfTwo(sourceWidth);
+    header.height = nearestPowerOfTwo(sourceHeight);
+    header.levelCount = 1;
+    while (header.levelCount < VT_MAX_LEVELS &&
+           (virtualTilesWide(header.width, header.levelCount - 1) > 1 || virtualTilesHigh(header.height, header.levelCount - 1) > 1))
+        header.levelCount++;
+
+    GammaTables gamma(kind != TEXTURE_SPECULAR);
+    std::vector<unsigned char> level;
+    if ((int)header.width == sourceWidth && (int)header.height == sourceHeight)
+        level.assign(source, source + (size_t)sourceWidth * sourceHeight * 4);
+    else
+        level = resampleBytes(source, sourceWidth, sourceHeight, header.width, header.height, gamma);
+    stbi_image_free(source);
+
+    std::ofstream file(outputPath, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << outputPath << " for writing" << std::endl;
+        return false;
+    }
+
+    // Tiles stream straight to disk; the table is written last, once every offset is known
+    std::vector<VirtualTileEntry> table;
+    for (uint32_t l = 0; l < header.levelCount; l++)
+        table.resize(table.size() + virtualTilesWide(header.width, l) * virtualTilesHigh(header.height, l));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(VirtualTileEntry));
+    uint64_t offset = sizeof(header) + table.size() * sizeof(VirtualTileEntry);
+
+    size_t entry = 0;
+    int width = header.width, height = header.height;
+    std::vector<unsigned char> tilePixels((size_t)VT_PADDED_TILE * VT_PADDED_TILE * 4);
+    std::vector<unsigned char> blocks;
+    for (uint32_t l = 0; l < header.levelCount; l++)
+    {
+        if (l > 0)
+        {
+            level = halveBytes(level, width, height, gamma);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        uint32_t wide = virtualTilesWide(header.width, l);
+        uint32_t high = virtualTilesHigh(header.height, l);
+        for (uint32_t ty = 0; ty < high; ty++)
+        {
+            for (uint32_t tx = 0; tx < wide; tx++, entry++)
+            {
+                for (int y = 0; y < (int)VT_PADDED_TILE; y++)
+                {
+                    int sy = std::min(std::max((int)(ty * VT_TILE_SIZE) + y - (int)VT_TILE_BORDER, 0), height - 1);
+                    for (int x = 0; x < (int)VT_PADDED_TILE; x++)
+                    {
+                        int sx = (((int)(tx * VT_TILE_SIZE) + x - (int)VT_TILE_BORDER) % width + width) % width;
+                        memcpy(&tilePixels[((size_t)y * VT_PADDED_TILE + x) * 4], &level[((size_t)sy * width + sx) * 4], 4);
+                    }
+                }
+                blocks.clear();
+                encodeLevel(tilePixels, VT_PADDED_TILE, VT_PADDED_TILE, header.format, blocks);
+                file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+                table[entry].offset = offset;
+                table[entry].size = (uint32_t)blocks.size();
+                offset += blocks.size();
+            }
+        }
+    }
+    file.seekp(sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(VirtualTileEntry));
+    if (!file)
+    {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return false;
+    }
+
+    std::cout << "Compiled " << sourcePath << ": " << header.width << "x" << header.height << " virtual BC" << header.format
+        << ", " << header.levelCount << " levels, " << table.size() << " tiles, " << offset / (1024 * 1024) << " MB" << std::endl;
+    return true;
+}
+
+int compileTextureManifest(const TextureCompilerOptions& options)
+{
+    std::ifstream file(options.manifest);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << options.manifest << std::endl;
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int compiled = 0, failures = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string kindName, path;
+        if (!(fields >> kindName >> path))
+            continue;
+
+        // "virtual" and "virtual-<kind>" build a tile pyramid instead of a single container
+        bool isVirtual = kindName.compare(0, 7, "virtual") == 0;
+        if (isVirtual)
+            kindName = kindName.size() > 8 ? kindName.substr(8) : "color";
+
+        TextureKind kind;
+        if (kindName == "color")
+            kind = TEXTURE_COLOR;
+        else if (kindName == "specular")
+            kind = TEXTURE_SPECULAR;
+        else if (kindName == "ring")
+            kind = TEXTURE_RING;
+        else if (kindName == "cubemap")
+            kind = TEXTURE_CUBEMAP;
+        else
+        {
+            std::cerr << "Unknown texture kind '" << kindName << "' for " << path << std::endl;
+            failures++;
+            continue;
+        }
+
+        bool succeeded = isVirtual ? compileVirtualTexture(path, kind, path + ".vtex")
+                                   : compileTexture(path, kind, compressedTexturePath(path));
+        if (succeeded)
+            compiled++;
+        else
+            failures++;
+    }
+
+    std::cout << "Compiled " << compiled << " textures in "
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s";
+    if (failures)
+        std::cout << ", " << failures << " failed";
+    std::cout << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#ifndef TEXTURE_COMPILER_H
+#define TEXTURE_COMPILER_H
+
+#include "utils.h"
+#include "async_texture_loader.h"
+
+// Offline build step: turns the source images listed in a manifest into ".ctex" containers with
+// block-compressed mip chains, which the texture loaders pick up in place of the originals.
+struct TextureCompilerOptions
+{
+    bool enabled = false;
+    std::string manifest = "../textures/manifest.txt";
+};
+
+// Parses --compile-textures [MANIFEST]
+bool parseTextureCompilerArgs(int argc, char** argv, TextureCompilerOptions& options);
+
+// Picks the format from the image content: grey -> BC4, grey + alpha -> BC5, RGB -> BC1, RGBA -> BC7.
+// Mips are filtered in linear light (alpha and specular masks linearly); cubemap faces get no mips.
+bool compileTexture(const std::string& sourcePath, TextureKind kind, const std::string& outputPath);
+
+// Writes a ".vtex" tile pyramid for the virtual texture system. The image is resampled to the nearest
+// power-of-two size and cut into bordered tiles in the same formats compileTexture picks.
+bool compileVirtualTexture(const std::string& sourcePath, TextureKind kind, const std::string& outputPath);
+
+// Manifest lines are "<color|specular|ring|cubemap|virtual|virtual-specular> <path>"; '#' starts a comment.
+// Returns the process exit code.
+int compileTextureManifest(const TextureCompilerOptions& options);
+
+#endif // TEXTURE_COMPILER_H
@@ -3,13 +3,24 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "utils.h"
+#include "asset_pack.h"
+
+// Decodes from the asset pack when it is mounted, otherwise from the loose file
+static unsigned char* loadImage(const char* path, int* width, int* height, int* channels, int desiredChannels)
+{
+    AssetSpan file;
+    std::vector<unsigned char> storage;
+    if (!loadAsset(path, file, storage))
+        return nullptr;
+    return stbi_load_from_memory(file.data, (int)file.size, width, height, channels, desiredChannels);
+}
 
 GLuint loadTexture(const char* path) {
     GLuint textureID;
     glGenTextures(1, &textureID);
 
     int width, height, nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
+    unsigned char* data = loadImage(path, &width, &height, &nrChannels, 0);
     if (data) {
         GLenum format = (nrChannels == 3) ? GL_RGB : GL_RGBA;
         glBindTexture(GL_TEXTURE_2D, textureID);
@@ -41,10 +52,14 @@ GLuint specularTextureLoad(const char* filePath) {
 
     // Load image using stb_image library
     int width, height, nrChannels;
-    unsigned char* data = stbi_load(filePath, &width, &height, &nrChannels, 4); // Force RGBA loading
+    unsigned char* data = loadImage(filePath, &width, &height, &nrChannels, 1); // The map is a grey mask
     if (data) {
-        // Upload the texture data as RGBA, but use the alpha channel in the shader
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        // Store one channel and let the sampler repeat it, so the shader still reads .rgb
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
     else {
@@ -64,7 +79,7 @@ GLuint loadCubemap(std::vector<std::string> faces) {
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++) {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+        unsigned char* data = loadImage(faces[i].c_str(), &width, &height, &nrChannels, 0);
         if (data) {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
             stbi_image_free(data);
@@ -88,7 +103,7 @@ unsigned int loadRingTexture(const char* path) {
 
     int width, height, nrChannels;
     stbi_set_flip_vertically_on_load(true); // Flip the texture vertically
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
+    unsigned char* data = loadImage(path, &width, &height, &nrChannels, 0);
     if (data) {
         GLenum format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
 
@@ -0,0 +1,596 @@
+#include "virtual_texture.h"
+#include "real_scale.h"
+#include "frame_arena.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Level 0 of the reference space the feedback shader measures texel density in.
+// Each texture converts it to its own size, so layers of different resolutions share one pass.
+static const float FEEDBACK_REFERENCE_SIZE = 32768.0f;
+
+static uint64_t tileKey(int textureId, int tile)
+{
+    return (uint64_t)textureId << 32 | (uint32_t)tile;
+}
+
+// ----- VirtualTexture -----
+
+int VirtualTexture::tileIndex(uint32_t level, uint32_t x, uint32_t y) const
+{
+    return levelStart[level] + (int)(y * virtualTilesWide(header.width, level) + x);
+}
+
+bool VirtualTexture::open(const std::string& filePath, int cacheTilesPerSide)
+{
+    path = filePath;
+    // Tiles come straight out of the mapping when the pack has the file
+    packed = AssetSpan();
+    if (assetPack.find(path, packed))
+    {
+        if (packed.size >= sizeof(header))
+            memcpy(&header, packed.data, sizeof(header));
+        else
+            memset(&header, 0, sizeof(header));
+    }
+    else
+    {
+        file.open(path, std::ios::binary);
+        if (!file)
+            return false;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file)
+            memset(&header, 0, sizeof(header));
+    }
+    if (memcmp(header.magic, "VTEX", 4) != 0 || header.version != VT_VERSION ||
+        header.levelCount == 0 || header.levelCount > VT_MAX_LEVELS || blockBytes(header.format) == 0)
+    {
+        std::cerr << "Not a virtual texture: " << path << std::endl;
+        file.close();
+        return false;
+    }
+
+    int tileCount = 0;
+    for (uint32_t level = 0; level < header.levelCount; level++)
+    {
+        levelStart.push_back(tileCount);
+        tileCount += (int)(virtualTilesWide(header.width, level) * virtualTilesHigh(header.height, level));
+    }
+    tiles.resize(tileCount);
+    size_t tableBytes = tiles.size() * sizeof(VirtualTileEntry);
+    bool complete;
+    if (packed.data)
+    {
+        complete = sizeof(header) + tableBytes <= packed.size;
+        if (complete)
+            memcpy(tiles.data(), packed.data + sizeof(header), tableBytes);
+        for (size_t i = 0; complete && i < tiles.size(); i++)
+            complete = tiles[i].offset + tiles[i].size <= packed.size;
+    }
+    else
+    {
+        file.read(reinterpret_cast<char*>(tiles.data()), tableBytes);
+        complete = (bool)file;
+    }
+    if (!complete)
+    {
+        std::cerr << "Truncated virtual texture: " << path << std::endl;
+        file.close();
+        return false;
+    }
+
+    // Physical cache: a grid of padded tiles in the stored format (or RGBA8 when it can't be sampled)
+    slotsPerSide = std::min(cacheTilesPerSide, 255);
+    slots.assign(slotsPerSide * slotsPerSide, Slot());
+    tileSlot.assign(tileCount, -1);
+    uploadFormat = compressedFormatSupported(header.format) ? header.format : CTEX_RGBA8;
+    GLsizei atlasSize = slotsPerSide * VT_PADDED_TILE;
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    if (uploadFormat == CTEX_RGBA8)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, compressedGLFormat(uploadFormat), atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    if (header.channels <= 2)
+    {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, header.channels == 2 ? GL_GREEN : GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // Indirection: one texel per tile with a real mip chain, so the shader can texelFetch any level
+    glGenTextures(1, &indirection);
+    glBindTexture(GL_TEXTURE_2D, indirection);
+    for (uint32_t level = 0; level < header.levelCount; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, virtualTilesWide(header.width, level),
+            virtualTilesHigh(header.height, level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levelCount - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+bool VirtualTexture::readTile(int tile, std::vector<unsigned char>& data)
+{
+    const VirtualTileEntry& entry = tiles[tile];
+    data.resize(entry.size);
+    if (packed.data)
+        memcpy(data.data(), packed.data + entry.offset, entry.size);
+    else if (!file.seekg(entry.offset) || !file.read(reinterpret_cast<char*>(data.data()), entry.size))
+    {
+        file.clear();
+        data.clear();
+        return false;
+    }
+    if (uploadFormat != header.format)
+    {
+        CompressedTexture block;
+        memset(&block.header, 0, sizeof(block.header));
+        block.header.format = header.format;
+        block.header.width = block.header.height = VT_PADDED_TILE;
+        block.header.mipCount = 1;
+        block.header.mipSize[0] = entry.size;
+        block.data.swap(data);
+        decompressTexture(block);
+        data.swap(block.data);
+    }
+    return true;
+}
+
+void VirtualTexture::release()
+{
+    if (atlas)
+        glDeleteTextures(1, &atlas);
+    if (indirection)
+        glDeleteTextures(1, &indirection);
+    atlas = indirection = 0;
+    file.close();
+}
+
+// Every tile points at itself when resident, otherwise at whatever its parent points at
+void VirtualTexture::rebuildIndirection()
+{
+    // Sized for the finest level, so neither grows past the first one filled
+    FrameVector<unsigned char> coarser, current;
+    coarser.reserve((size_t)virtualTilesWide(header.width, 0) * virtualTilesHigh(header.height, 0) * 4);
+    current.reserve(coarser.capacity());
+    glBindTexture(GL_TEXTURE_2D, indirection);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = (int)header.levelCount - 1; level >= 0; level--)
+    {
+        uint32_t wide = virtualTilesWide(header.width, level);
+        uint32_t high = virtualTilesHigh(header.height, level);
+        uint32_t parentWide = virtualTilesWide(header.width, level + 1);
+        current.assign((size_t)wide * high * 4, 0);
+        for (uint32_t y = 0; y < high; y++)
+        {
+            for (uint32_t x = 0; x < wide; x++)
+            {
+                unsigned char* entry = &current[((size_t)y * wide + x) * 4];
+                int slot = tileSlot[tileIndex(level, x, y)];
+                if (slot >= 0)
+                {
+                    entry[0] = (unsigned char)(slot % slotsPerSide);
+                    entry[1] = (unsigned char)(slot / slotsPerSide);
+                    entry[2] = (unsigned char)level;
+                    entry[3] = 255;
+                }
+                else if (!coarser.empty())
+                    memcpy(entry, &coarser[((size_t)(y / 2) * parentWide + x / 2) * 4], 4);
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, wide, high, GL_RGBA, GL_UNSIGNED_BYTE, current.data());
+        coarser.swap(current);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    indirectionDirty = false;
+}
+
+// ----- VirtualTextureSystem -----
+
+VirtualTextureSystem::~VirtualTextureSystem()
+{
+    shutdown();
+}
+
+bool VirtualTextureSystem::init(int width, int height, int feedbackDivisor)
+{
+    divisor = std::max(1, feedbackDivisor);
+    feedbackWidth = std::max(1, width / divisor);
+    feedbackHeight = std::max(1, height / divisor);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenTextures(2, targets);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, targets[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, feedbackWidth, feedbackHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, targets[i], 0);
+    }
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, reversedDepth ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24,
+        feedbackWidth, feedbackHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (!complete)
+    {
+        std::cout << "Virtual texture feedback framebuffer error" << std::endl;
+        return false;
+    }
+
+    // Both targets read back into one buffer; three in flight hide the transfer latency
+    GLsizeiptr readbackSize = (GLsizeiptr)feedbackWidth * feedbackHeight * 4 * 2;
+    for (Readback& readback : readbacks)
+    {
+        glGenBuffers(1, &readback.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    stopping = false;
+    streamer = std::thread(&VirtualTextureSystem::streamLoop, this);
+    return true;
+}
+
+void VirtualTextureSystem::shutdown()
+{
+    if (streamer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        streamer.join();
+    }
+    loadQueue.clear();
+    loadedQueue.clear();
+    pending.clear();
+
+    for (VirtualTexture* texture : textures)
+    {
+        texture->release();
+        delete texture;
+    }
+    textures.clear();
+    feedbackLayers.clear();
+    for (Readback& readback : readbacks)
+    {
+        if (readback.fence)
+            glDeleteSync(readback.fence);
+        if (readback.pbo)
+            glDeleteBuffers(1, &readback.pbo);
+        readback = Readback();
+    }
+    if (fbo)
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(2, targets);
+        glDeleteRenderbuffers(1, &depthBuffer);
+        fbo = depthBuffer = targets[0] = targets[1] = 0;
+    }
+}
+
+VirtualTexture* VirtualTextureSystem::load(const std::string& sourcePath, int cacheTilesPerSide)
+{
+    if (!fbo)
+        return nullptr;
+    VirtualTexture* texture = new VirtualTexture();
+    if (!texture->open(sourcePath + ".vtex", cacheTilesPerSide))
+    {
+        delete texture;
+        return nullptr;
+    }
+
+    // The single tile of the coarsest level stays resident so every lookup finds something
+    uint32_t top = texture->header.levelCount - 1;
+    int topTile = texture->tileIndex(top, 0, 0);
+    LoadedTile tile = { texture, topTile, {} };
+    if (!texture->readTile(topTile, tile.data))
+    {
+        std::cerr << "Failed to read " << texture->path << std::endl;
+        texture->release();
+        delete texture;
+        return nullptr;
+    }
+    texture->id = (int)textures.size();
+    textures.push_back(texture);
+    uploadTile(tile);
+    texture->slots[texture->tileSlot[topTile]].pinned = true;
+    texture->rebuildIndirection();
+
+    std::cout << "Virtual texture " << sourcePath << ": " << texture->header.width << "x" << texture->header.height
+        << ", " << texture->header.levelCount << " levels, " << texture->slots.size() << " cache tiles" << std::endl;
+    return texture;
+}
+
+int VirtualTextureSystem::feedbackId(const std::vector<VirtualTexture*>& layers)
+{
+    std::vector<VirtualTexture*> present;
+    for (VirtualTexture* layer : layers)
+        if (layer)
+            present.push_back(layer);
+    if (present.empty() || feedbackLayers.size() >= 255)
+        return 0;
+    feedbackLayers.push_back(present);
+    return (int)feedbackLayers.size();
+}
+
+float VirtualTextureSystem::lodBias() const
+{
+    // Derivatives in the small feedback buffer are divisor times larger than on screen
+    return -log2f((float)divisor);
+}
+
+void VirtualTextureSystem::beginFeedback()
+{
+    static const GLenum both[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    static const GLenum opaque[2] = { GL_COLOR_ATTACHMENT0, GL_NONE };
+    const GLfloat none[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const GLfloat clearDepth = farDepth();
+
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    glDrawBuffers(2, both);
+    glClearBufferfv(GL_COLOR, 0, none);
+    glClearBufferfv(GL_COLOR, 1, none);
+    glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+    glDrawBuffers(2, opaque);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
+
+void VirtualTextureSystem::beginTranslucentFeedback()
+{
+    static const GLenum translucent[2] = { GL_NONE, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, translucent);
+    glDepthMask(GL_FALSE);
+}
+
+void VirtualTextureSystem::endFeedback(GLuint restoreFramebuffer)
+{
+    glDepthMask(GL_TRUE);
+
+    // A buffer whose fence never got processed is simply overwritten
+    Readback& readback = readbacks[readbackIndex];
+    if (readback.fence)
+        glDeleteSync(readback.fence);
+    size_t targetBytes = (size_t)feedbackWidth * feedbackHeight * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int i = 0; i < 2; i++)
+    {
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)(i * targetBytes));
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readbackIndex = (readbackIndex + 1) % 3;
+
+    static const GLenum first[1] = { GL_COLOR_ATTACHMENT0 };
+    glDrawBuffers(1, first);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_FRAMEBUFFER, restoreFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void VirtualTextureSystem::requestTile(VirtualTexture* texture, uint32_t level, uint32_t x, uint32_t y)
+{
+    int tile = texture->tileIndex(level, x, y);
+    int slot = texture->tileSlot[tile];
+    if (slot >= 0)
+    {
+        texture->slots[slot].lastUsed = frame;
+        return;
+    }
+    if (pending.insert(tileKey(texture->id, tile)).second)
+        loadQueue.push_back({ texture, tile, level });
+}
+
+void VirtualTextureSystem::processFeedback(const unsigned char* pixels, size_t pixelCount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Requests nobody has started on are stale now; this feedback replaces them
+    for (const TileRequest& request : loadQueue)
+        pending.erase(tileKey(request.texture->id, request.tile));
+    loadQueue.clear();
+
+    FrameSet<uint32_t> seen;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        const unsigned char* p = pixels + i * 4;
+        if (p[3] == 0 || p[3] > feedbackLayers.size())
+            continue;
+        // Many pixels land on the same tile; skip exact repeats cheaply
+        uint32_t packed = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        if (!seen.insert(packed).second)
+            continue;
+
+        float u = (p[0] + 0.5f) / 256.0f;
+        float v = (p[1] + 0.5f) / 256.0f;
+        float referenceLod = p[2] / 16.0f;
+        for (VirtualTexture* texture : feedbackLayers[p[3] - 1])
+        {
+            const VirtualTextureHeader& header = texture->header;
+            float lod = referenceLod - log2f(FEEDBACK_REFERENCE_SIZE / header.width);
+            uint32_t level = (uint32_t)std::min<float>((float)header.levelCount - 1, std::max(0.0f, floorf(lod)));
+            // Also keep the parent resident so zooming out never drops straight to the coarsest level
+            for (uint32_t l = level; l < std::min(level + 2, header.levelCount); l++)
+            {
+                uint32_t wide = virtualTilesWide(header.width, l);
+                uint32_t high = virtualTilesHigh(header.height, l);
+                requestTile(texture, l, std::min(wide - 1, (uint32_t)(u * wide)), std::min(high - 1, (uint32_t)(v * high)));
+            }
+        }
+    }
+
+    // Coarse tiles first: they cover the most screen and unblock the finer ones visually
+    std::stable_sort(loadQueue.begin(), loadQueue.end(),
+        [](const TileRequest& a, const TileRequest& b) { return a.level > b.level; });
+    if (!loadQueue.empty())
+        condition.notify_one();
+}
+
+void VirtualTextureSystem::streamLoop()
+{
+    while (true)
+    {
+        TileRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !loadQueue.empty(); });
+            if (stopping)
+                return;
+            request = loadQueue.front();
+            loadQueue.pop_front();
+        }
+
+        // A failed read leaves the data empty; it is dropped on upload and the coarser tile stays in use
+        LoadedTile tile = { request.texture, request.tile, {} };
+        request.texture->readTile(request.tile, tile.data);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        loadedQueue.push_back(std::move(tile));
+    }
+}
+
+bool VirtualTextureSystem::uploadTile(LoadedTile& tile)
+{
+    VirtualTexture* texture = tile.texture;
+    if (tile.data.empty() || texture->tileSlot[tile.tile] >= 0)
+        return false;
+
+    // A free slot, otherwise the least recently used one that this frame doesn't need
+    int victim = -1;
+    for (size_t i = 0; i < texture->slots.size(); i++)
+    {
+        const VirtualTexture::Slot& slot = texture->slots[i];
+        if (slot.tile < 0)
+        {
+            victim = (int)i;
+            break;
+        }
+        if (!slot.pinned && slot.lastUsed < frame &&
+            (victim < 0 || slot.lastUsed < texture->slots[victim].lastUsed))
+            victim = (int)i;
+    }
+    if (victim < 0)
+        return false;   // Cache full of visible tiles: the coarser fallback has to do
+
+    VirtualTexture::Slot& slot = texture->slots[victim];
+    if (slot.tile >= 0)
+        texture->tileSlot[slot.tile] = -1;
+    slot.tile = tile.tile;
+    slot.lastUsed = frame;
+    texture->tileSlot[tile.tile] = victim;
+    texture->indirectionDirty = true;
+
+    GLint x = (victim % texture->slotsPerSide) * VT_PADDED_TILE;
+    GLint y = (victim / texture->slotsPerSide) * VT_PADDED_TILE;
+    glBindTexture(GL_TEXTURE_2D, texture->atlas);
+    if (texture->uploadFormat == CTEX_RGBA8)
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VT_PADDED_TILE, VT_PADDED_TILE, GL_RGBA, GL_UNSIGNED_BYTE, tile.data.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    else
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VT_PADDED_TILE, VT_PADDED_TILE,
+            compressedGLFormat(texture->uploadFormat), (GLsizei)tile.data.size(), tile.data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void VirtualTextureSystem::update(double budgetMs)
+{
+    if (textures.empty())
+        return;
+    frame++;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(budgetMs * 1000.0));
+
+    // Newest finished readback wins; older ones only describe frames that are already gone
+    for (int i = 1; i <= 3; i++)
+    {
+        Readback& readback = readbacks[(readbackIndex + 3 - i) % 3];
+        if (!readback.fence)
+            continue;
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        size_t pixelCount = (size_t)feedbackWidth * feedbackHeight * 2;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixelCount * 4, GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            processFeedback(pixels, pixelCount);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        for (Readback& older : readbacks)
+        {
+            if (older.fence)
+            {
+                glDeleteSync(older.fence);
+                older.fence = 0;
+            }
+        }
+        break;
+    }
+
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        LoadedTile tile;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (loadedQueue.empty())
+                break;
+            tile = std::move(loadedQueue.front());
+            loadedQueue.pop_front();
+            pending.erase(tileKey(tile.texture->id, tile.tile));
+        }
+        uploadTile(tile);
+    }
+
+    for (VirtualTexture* texture : textures)
+        if (texture->indirectionDirty)
+            texture->rebuildIndirection();
+}
+
+void bindVirtualTexture(GLuint shaderProgram, const char* name, const VirtualTexture* texture, int firstUnit)
+{
+    if (!texture)
+        return;
+    // Built on the stack: this runs for every virtual layer of every draw
+    char uniform[128];
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_2D, texture->indirectionTexture());
+    snprintf(uniform, sizeof(uniform), "%s.indirection", name);
+    glUniform1i(glGetUniformLocation(shaderProgram, uniform), firstUnit);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, texture->atlasTexture());
+    snprintf(uniform, sizeof(uniform), "%s.atlas", name);
+    glUniform1i(glGetUniformLocation(shaderProgram, uniform), firstUnit + 1);
+    snprintf(uniform, sizeof(uniform), "%s.maxLevel", name);
+    glUniform1f(glGetUniformLocation(shaderProgram, uniform), (float)texture->levelCount() - 1.0f);
+    glActiveTexture(GL_TEXTURE0);
+}
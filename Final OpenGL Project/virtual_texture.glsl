@@ -0,0 +1,25 @@
+// Virtual texture layer: see virtual_texture.h
+struct VirtualLayer
+{
+    sampler2D indirection;  // One texel per tile and level: cache slot xy, resident level
+    sampler2D atlas;        // Physical tile cache
+    float maxLevel;
+};
+const float VT_TILE_SIZE = 128.0;
+const float VT_TILE_BORDER = 4.0;
+
+vec4 sampleVirtual(sampler2D indirection, sampler2D atlas, float maxLevel, vec2 uv)
+{
+    vec2 size = vec2(textureSize(indirection, 0)) * VT_TILE_SIZE;
+    vec2 texel = uv * size;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float level = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy)))), 0.0, maxLevel);
+    vec2 coord = clamp(uv, 0.0, 0.99999);
+    ivec2 tiles = textureSize(indirection, int(level));
+    vec3 entry = floor(texelFetch(indirection, ivec2(coord * vec2(tiles)), int(level)).xyz * 255.0 + 0.5);
+    // The resident tile can be coarser than the requested level
+    vec2 levelSize = max(size / exp2(entry.z), vec2(1.0));
+    vec2 inTile = fract(coord * levelSize / VT_TILE_SIZE);
+    vec2 atlasTexel = entry.xy * (VT_TILE_SIZE + 2.0 * VT_TILE_BORDER) + VT_TILE_BORDER + inTile * VT_TILE_SIZE;
+    return textureLod(atlas, atlasTexel / vec2(textureSize(atlas, 0)), 0.0);
+}
@@ -0,0 +1,178 @@
+#pragma once
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include "utils.h"
+#include "compressed_texture.h"
+#include "asset_pack.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+// Tiled mip pyramid written by the texture compiler (".vtex" next to the source image).
+// Sizes are powers of two; every level is cut into tiles of VT_TILE_SIZE texels plus a
+// VT_TILE_BORDER texel apron on each side, so bilinear filtering never reads a neighbour slot.
+// The apron wraps horizontally (planet maps wrap in longitude) and clamps vertically.
+const uint32_t VT_VERSION = 1;
+const uint32_t VT_TILE_SIZE = 128;
+const uint32_t VT_TILE_BORDER = 4;
+const uint32_t VT_PADDED_TILE = VT_TILE_SIZE + 2 * VT_TILE_BORDER;
+const uint32_t VT_MAX_LEVELS = 16;
+
+struct VirtualTextureHeader
+{
+    char magic[4];          // "VTEX"
+    uint32_t version;
+    uint32_t format;        // CompressedFormat of every tile
+    uint32_t channels;
+    uint32_t width;         // Level 0 size in texels
+    uint32_t height;
+    uint32_t levelCount;    // The last level fits in a single tile
+    uint32_t flags;         // Unused, zero
+};
+
+// Follows the header: one entry per tile, level 0 first, rows top to bottom
+struct VirtualTileEntry
+{
+    uint64_t offset;        // From the start of the file
+    uint32_t size;
+    uint32_t reserved;
+};
+
+inline uint32_t virtualTilesWide(uint32_t width, uint32_t level)
+{
+    return std::max(1u, (width >> level) / VT_TILE_SIZE);
+}
+
+inline uint32_t virtualTilesHigh(uint32_t height, uint32_t level)
+{
+    return std::max(1u, (height >> level) / VT_TILE_SIZE);
+}
+
+// One virtual texture: its tile table on disk, a fixed-size physical tile cache and the
+// indirection texture that maps every tile of every level to the best resident tile.
+class VirtualTexture
+{
+public:
+    bool open(const std::string& path, int cacheTilesPerSide);
+    void release();
+
+    uint32_t width() const { return header.width; }
+    uint32_t levelCount() const { return header.levelCount; }
+    GLuint atlasTexture() const { return atlas; }
+    GLuint indirectionTexture() const { return indirection; }
+
+private:
+    friend class VirtualTextureSystem;
+
+    struct Slot
+    {
+        int tile = -1;          // Tile index held by this slot
+        unsigned int lastUsed = 0;
+        bool pinned = false;    // The coarsest level is never evicted
+    };
+
+    int tileIndex(uint32_t level, uint32_t x, uint32_t y) const;
+    // Reads one tile from disk, expanded to RGBA8 if the atlas can't hold the stored format
+    bool readTile(int tile, std::vector<unsigned char>& data);
+    void rebuildIndirection();
+
+    int id = 0;                           // Index in VirtualTextureSystem, part of tile keys
+    std::string path;
+    VirtualTextureHeader header;
+    std::vector<VirtualTileEntry> tiles;
+    std::vector<int> levelStart;          // First tile index of each level
+    std::vector<int> tileSlot;            // -1 when not resident
+    std::vector<Slot> slots;
+    int slotsPerSide = 0;
+    uint32_t uploadFormat = CTEX_RGBA8;   // Tile format after the CPU fallback, if any
+    GLuint atlas = 0;
+    GLuint indirection = 0;
+    bool indirectionDirty = true;
+    AssetSpan packed;                     // The whole file when it is in the asset pack
+    std::ifstream file;                   // Otherwise; only read by the streaming thread
+};
+
+// Owns the virtual textures, the feedback pass that finds out which tiles are visible and
+// the thread that streams tiles from disk. All methods run on the GL thread.
+class VirtualTextureSystem
+{
+public:
+    ~VirtualTextureSystem();
+
+    // The feedback buffer is rendered at 1/feedbackDivisor of the screen size
+    bool init(int screenWidth, int screenHeight, int feedbackDivisor = 8);
+    void shutdown();
+
+    // Opens sourcePath's ".vtex" if one was compiled; returns null to fall back to the plain texture
+    VirtualTexture* load(const std::string& sourcePath, int cacheTilesPerSide = 16);
+    bool active() const { return !textures.empty(); }
+
+    // Groups the virtual textures that share a surface's UVs. The id goes to the feedback shader.
+    int feedbackId(const std::vector<VirtualTexture*>& layers);
+    float lodBias() const;
+
+    // Opaque surfaces first, then translucent layers (depth-tested against the opaque ones)
+    void beginFeedback();
+    void beginTranslucentFeedback();
+    void endFeedback(GLuint restoreFramebuffer);
+
+    // Reads back old feedback, queues missing tiles and uploads the ones that arrived
+    void update(double budgetMs);
+
+private:
+    struct TileRequest
+    {
+        VirtualTexture* texture;
+        int tile;
+        uint32_t level;
+    };
+
+    struct LoadedTile
+    {
+        VirtualTexture* texture;
+        int tile;
+        std::vector<unsigned char> data;
+    };
+
+    struct Readback
+    {
+        GLuint pbo = 0;
+        GLsync fence = 0;
+    };
+
+    void streamLoop();
+    void processFeedback(const unsigned char* pixels, size_t pixelCount);
+    void requestTile(VirtualTexture* texture, uint32_t level, uint32_t x, uint32_t y);
+    bool uploadTile(LoadedTile& tile);
+
+    std::vector<VirtualTexture*> textures;
+    std::vector<std::vector<VirtualTexture*>> feedbackLayers;   // Index is feedback id - 1
+    unsigned int frame = 0;
+
+    // Feedback targets: attachment 0 for opaque surfaces, 1 for translucent layers
+    GLuint fbo = 0, depthBuffer = 0;
+    GLuint targets[2] = { 0, 0 };
+    int feedbackWidth = 0, feedbackHeight = 0, divisor = 8;
+    GLint savedViewport[4] = { 0, 0, 0, 0 };
+    Readback readbacks[3];
+    int readbackIndex = 0;
+
+    std::unordered_set<uint64_t> pending;                   // Queued or loading, GL thread only
+    std::thread streamer;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<TileRequest> loadQueue;
+    std::deque<LoadedTile> loadedQueue;
+    bool stopping = false;
+};
+
+// Sets the "<name>.*" uniforms used by sampleVirtual in the shaders; null binds nothing, the
+// shader variant decides whether the layer is sampled at all
+void bindVirtualTexture(GLuint shaderProgram, const char* name, const VirtualTexture* texture, int firstUnit);
+
+#endif // VIRTUAL_TEXTURE_H
@@ -0,0 +1,21 @@
+#version 330 core
+// Virtual texture feedback: records which part of which surface is visible at what texel density.
+// Drawn with celestial.vs into a small buffer that the CPU reads back a few frames later.
+layout (location = 0) out vec4 Feedback;
+
+in vec2 TexCoords;
+
+uniform int feedbackId;     // Set of virtual textures sharing these UVs, 0 = none
+uniform float lodBias;      // Compensates for the feedback buffer being smaller than the screen
+
+// Density is measured against a 32k texture; each virtual texture offsets it by its own size
+const float REFERENCE_SIZE = 32768.0;
+
+void main() {
+    vec2 uv = clamp(TexCoords, 0.0, 0.99999);
+    vec2 texel = uv * REFERENCE_SIZE;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + lodBias, 0.0, 15.0);
+    // 8-bit UV cells are as fine as the level-0 tile grid of a 32k texture; lod in 1/16 steps
+    Feedback = vec4(floor(uv * 256.0) / 255.0, floor(lod * 16.0) / 255.0, float(feedbackId) / 255.0);
+}